@@ -10,7 +10,8 @@ int main(int argc, char** argv) {
 
     char* file_path = argv[1];
     debug_print(YELLOW, "Loading model from %s...\n", file_path);
-    decode_gltf(file_path);
-    
+    Scene scene = decode_gltf(file_path);
+    deallocate_scene(&scene);
+
     return 0;
 }
\ No newline at end of file
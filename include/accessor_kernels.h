@@ -0,0 +1,154 @@
+#ifndef _ACCESSOR_KERNELS_H_
+#define _ACCESSOR_KERNELS_H_
+
+#include <float.h>
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+
+// Every kernel below is generated for one component type, normalization or topology, so that their loops carry
+// no per-component branch. Accessors pick theirs once through the get_*_kernel tables.
+typedef void (*ComponentsKernel)(const unsigned char* data, unsigned int count, void* components);
+typedef void (*FloatsKernel)(const unsigned char* data, unsigned int first, unsigned int stride, unsigned int count, float* values);
+typedef void (*IndicesKernel)(const unsigned char* data, unsigned int count, unsigned int* indices);
+typedef void (*FacesKernel)(const unsigned int* indices, unsigned int indices_count, Face* faces, unsigned int faces_count, unsigned int* faces_indices);
+
+/* -------------------------------------------------------------------------- */
+
+ComponentsKernel get_components_kernel(ComponentType component_type);
+FloatsKernel get_floats_kernel(ComponentType component_type, bool normalized);
+IndicesKernel get_indices_kernel(ComponentType component_type);
+FacesKernel get_faces_kernel(Topology topology);
+
+/* -------------------------------------------------------------------------- */
+
+static inline signed char load_i8(const unsigned char* data, unsigned int offset) {
+    return (signed char) data[offset];
+}
+
+static inline unsigned char load_u8(const unsigned char* data, unsigned int offset) {
+    return data[offset];
+}
+
+static inline unsigned short int load_le16(const unsigned char* data, unsigned int offset) {
+    return (unsigned short int) (data[offset] | ((unsigned int) data[offset + 1] << 8));
+}
+
+static inline short int load_le16_signed(const unsigned char* data, unsigned int offset) {
+    return (short int) load_le16(data, offset);
+}
+
+static inline unsigned int load_le32(const unsigned char* data, unsigned int offset) {
+    return (unsigned int) data[offset] | ((unsigned int) data[offset + 1] << 8) | ((unsigned int) data[offset + 2] << 16) | ((unsigned int) data[offset + 3] << 24);
+}
+
+static inline float load_le_float(const unsigned char* data, unsigned int offset) {
+    unsigned int bits = load_le32(data, offset);
+    float value = 0.0f;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+// Copies the components keeping their type, only moving them to the host byte order
+#define DEFINE_COMPONENTS_KERNEL(name, type, load)                                          \
+    static void name(const unsigned char* data, unsigned int count, void* components) {     \
+        type* output = (type*) components;                                                   \
+        for (unsigned int i = 0; i < count; ++i) output[i] = (type) load(data, i * sizeof(type)); \
+        return;                                                                              \
+    }
+
+DEFINE_COMPONENTS_KERNEL(copy_i8_components, signed char, load_i8)
+DEFINE_COMPONENTS_KERNEL(copy_u8_components, unsigned char, load_u8)
+DEFINE_COMPONENTS_KERNEL(copy_i16_components, short int, load_le16_signed)
+DEFINE_COMPONENTS_KERNEL(copy_u16_components, unsigned short int, load_le16)
+DEFINE_COMPONENTS_KERNEL(copy_u32_components, unsigned int, load_le32)
+DEFINE_COMPONENTS_KERNEL(copy_float_components, float, load_le_float)
+
+// Reads count components, stride apart from the component first, as floats. Normalized integers are divided by
+// their largest value, signed ones clamped to -1, as the glTF specification asks.
+#define DEFINE_FLOATS_KERNEL(name, type, load, divisor, min_value)                                                        \
+    static void name(const unsigned char* data, unsigned int first, unsigned int stride, unsigned int count, float* values) { \
+        for (unsigned int i = 0; i < count; ++i) {                                                                         \
+            float value = (float) load(data, (first + i * stride) * sizeof(type)) / (divisor);                             \
+            values[i] = (value < (min_value)) ? (min_value) : value;                                                       \
+        }                                                                                                                  \
+        return;                                                                                                            \
+    }
+
+DEFINE_FLOATS_KERNEL(read_i8_floats, signed char, load_i8, 1.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_u8_floats, unsigned char, load_u8, 1.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_i16_floats, short int, load_le16_signed, 1.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_u16_floats, unsigned short int, load_le16, 1.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_u32_floats, unsigned int, load_le32, 1.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_float_floats, float, load_le_float, 1.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_normalized_i8_floats, signed char, load_i8, 127.0f, -1.0f)
+DEFINE_FLOATS_KERNEL(read_normalized_u8_floats, unsigned char, load_u8, 255.0f, -FLT_MAX)
+DEFINE_FLOATS_KERNEL(read_normalized_i16_floats, short int, load_le16_signed, 32767.0f, -1.0f)
+DEFINE_FLOATS_KERNEL(read_normalized_u16_floats, unsigned short int, load_le16, 65535.0f, -FLT_MAX)
+
+#define DEFINE_INDICES_KERNEL(name, type, load)                                                 \
+    static void name(const unsigned char* data, unsigned int count, unsigned int* indices) {    \
+        for (unsigned int i = 0; i < count; ++i) indices[i] = load(data, i * sizeof(type));     \
+        return;                                                                                 \
+    }
+
+DEFINE_INDICES_KERNEL(read_u8_indices, unsigned char, load_u8)
+DEFINE_INDICES_KERNEL(read_u16_indices, unsigned short int, load_le16)
+DEFINE_INDICES_KERNEL(read_u32_indices, unsigned int, load_le32)
+
+// Assembles the faces of a topology from the flat indices, first, second and third are the positions of the
+// corners of the face i, the ones past the topology size are not stored. The corners go into faces_indices,
+// which holds faces_count times the topology size.
+#define DEFINE_FACES_KERNEL(name, face_topology, first, second, third)                                           \
+    static void name(const unsigned int* indices, unsigned int indices_count, Face* faces, unsigned int faces_count, unsigned int* faces_indices) { \
+        for (unsigned int i = 0; i < faces_count; ++i) {                                                             \
+            unsigned int corners[3] = { indices[first], indices[second], indices[third] };                          \
+            faces[i].topology = (face_topology);                                                                     \
+            faces[i].indices = faces_indices + i * topology_size[face_topology];                                     \
+            memcpy(faces[i].indices, corners, sizeof(unsigned int) * topology_size[face_topology]);                 \
+        }                                                                                                            \
+        (void) indices_count;                                                                                        \
+        return;                                                                                                      \
+    }
+
+DEFINE_FACES_KERNEL(create_points, POINTS, i, i, i)
+DEFINE_FACES_KERNEL(create_lines, LINES, 2 * i, 2 * i + 1, 2 * i)
+DEFINE_FACES_KERNEL(create_line_loop, LINE_LOOP, i, (i + 1) % indices_count, i)
+DEFINE_FACES_KERNEL(create_line_strip, LINE_STRIP, i, i + 1, i)
+DEFINE_FACES_KERNEL(create_triangles, TRIANGLES, 3 * i, 3 * i + 1, 3 * i + 2)
+DEFINE_FACES_KERNEL(create_triangle_strip, TRIANGLE_STRIP, i, i + 1 + i % 2, i + 2 - i % 2)
+DEFINE_FACES_KERNEL(create_triangle_fan, TRIANGLE_FAN, i + 1, i + 2, 0)
+
+// Indexed by ComponentType, the unused slot 4 and HALF_FLOAT have no accessor kernel
+static const ComponentsKernel components_kernels[] = { copy_i8_components, copy_u8_components, copy_i16_components, copy_u16_components, NULL, copy_u32_components, copy_float_components, NULL };
+static const FloatsKernel floats_kernels[][2] = {
+    { read_i8_floats, read_normalized_i8_floats },
+    { read_u8_floats, read_normalized_u8_floats },
+    { read_i16_floats, read_normalized_i16_floats },
+    { read_u16_floats, read_normalized_u16_floats },
+    { NULL, NULL },
+    { read_u32_floats, read_u32_floats },
+    { read_float_floats, read_float_floats },
+    { NULL, NULL }
+};
+static const IndicesKernel indices_kernels[] = { NULL, read_u8_indices, NULL, read_u16_indices, NULL, read_u32_indices, NULL, NULL };
+static const FacesKernel faces_kernels[] = { create_points, create_lines, create_line_loop, create_line_strip, create_triangles, create_triangle_strip, create_triangle_fan };
+
+// The getters return NULL for the types glTF doesn't allow there
+ComponentsKernel get_components_kernel(ComponentType component_type) {
+    return ((unsigned int) component_type < sizeof(components_kernels) / sizeof(components_kernels[0])) ? components_kernels[component_type] : NULL;
+}
+
+FloatsKernel get_floats_kernel(ComponentType component_type, bool normalized) {
+    return ((unsigned int) component_type < sizeof(floats_kernels) / sizeof(floats_kernels[0])) ? floats_kernels[component_type][normalized != FALSE] : NULL;
+}
+
+IndicesKernel get_indices_kernel(ComponentType component_type) {
+    return ((unsigned int) component_type < sizeof(indices_kernels) / sizeof(indices_kernels[0])) ? indices_kernels[component_type] : NULL;
+}
+
+FacesKernel get_faces_kernel(Topology topology) {
+    return ((unsigned int) topology < sizeof(faces_kernels) / sizeof(faces_kernels[0])) ? faces_kernels[topology] : NULL;
+}
+
+#endif //_ACCESSOR_KERNELS_H_
@@ -0,0 +1,117 @@
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./debug_print.h"
+#include "./types.h"
+
+/* -------------------------------------------------------------------------- */
+
+GltfAllocator get_default_allocator();
+GltfAllocator get_allocator();
+void set_allocator(GltfAllocator* allocator);
+void* gltf_calloc(size_t count, size_t size);
+void* gltf_realloc(void* ptr, size_t size);
+void gltf_free(void* ptr);
+char* gltf_strdup(const char* str);
+bool has_allocation_failed();
+void set_allocation_failed(bool failed);
+
+/* -------------------------------------------------------------------------- */
+
+static void* default_alloc(size_t size, void* user_data) {
+    NOT_USED(user_data);
+    return malloc(size);
+}
+
+static void* default_realloc(void* ptr, size_t size, void* user_data) {
+    NOT_USED(user_data);
+    return realloc(ptr, size);
+}
+
+static void default_free(void* ptr, void* user_data) {
+    NOT_USED(user_data);
+    free(ptr);
+    return;
+}
+
+// The allocator is per thread, so that concurrent loads can be routed into different pools
+static _Thread_local GltfAllocator current_allocator = { .alloc = default_alloc, .realloc = default_realloc, .free = default_free, .user_data = NULL };
+
+// Set by any failed allocation of the thread, so that the loader can stop and release what it built
+static _Thread_local bool allocation_failed = FALSE;
+
+GltfAllocator get_default_allocator() {
+    return (GltfAllocator) { .alloc = default_alloc, .realloc = default_realloc, .free = default_free, .user_data = NULL };
+}
+
+GltfAllocator get_allocator() {
+    return current_allocator;
+}
+
+void set_allocator(GltfAllocator* allocator) {
+    if (allocator == NULL) current_allocator = get_default_allocator();
+    else current_allocator = *allocator;
+    return;
+}
+
+void* gltf_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        error_print("allocation of %lu elements of %lu bytes overflows\n", (unsigned long) count, (unsigned long) size);
+        allocation_failed = TRUE;
+        return NULL;
+    }
+
+    size_t total_size = count * size;
+    if (total_size == 0) total_size = 1;
+
+    void* ptr = current_allocator.alloc(total_size, current_allocator.user_data);
+    if (ptr == NULL) {
+        error_print("failed to allocate %lu bytes\n", (unsigned long) total_size);
+        allocation_failed = TRUE;
+        return NULL;
+    }
+
+    memset(ptr, 0, total_size);
+
+    return ptr;
+}
+
+// On failure NULL is returned and ptr is left allocated, so callers must not overwrite their only pointer to it
+void* gltf_realloc(void* ptr, size_t size) {
+    if (size == 0) size = 1;
+    void* new_ptr = current_allocator.realloc(ptr, size, current_allocator.user_data);
+    if (new_ptr == NULL) {
+        error_print("failed to reallocate %lu bytes\n", (unsigned long) size);
+        allocation_failed = TRUE;
+    }
+    return new_ptr;
+}
+
+void gltf_free(void* ptr) {
+    if (ptr == NULL) return;
+    current_allocator.free(ptr, current_allocator.user_data);
+    return;
+}
+
+char* gltf_strdup(const char* str) {
+    if (str == NULL) return NULL;
+    size_t len = strlen(str);
+    char* new_str = (char*) gltf_calloc(len + 1, sizeof(char));
+    if (new_str == NULL) return NULL;
+    memcpy(new_str, str, len);
+    return new_str;
+}
+
+bool has_allocation_failed() {
+    return allocation_failed;
+}
+
+void set_allocation_failed(bool failed) {
+    allocation_failed = failed;
+    return;
+}
+
+#endif //_ALLOCATOR_H_
@@ -0,0 +1,238 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#include <math.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./simd.h"
+#include "./scene.h"
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int* allocate_animation_cursors(Animation* animation);
+void reset_animation_cursors(Animation* animation, unsigned int* cursors);
+void sample_animation(Scene* scene, Animation* animation, float time, unsigned int* cursors, bool nlerp_rotations);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct KeyframeSpan {
+    const float* value_0;
+    const float* value_1;
+    const float* out_tangent_0;
+    const float* in_tangent_1;
+    float t;
+    float delta_time;
+} KeyframeSpan;
+
+unsigned int* allocate_animation_cursors(Animation* animation) {
+    return (unsigned int*) gltf_calloc(animation -> channels_count, sizeof(unsigned int));
+}
+
+void reset_animation_cursors(Animation* animation, unsigned int* cursors) {
+    for (unsigned int i = 0; i < animation -> channels_count; ++i) cursors[i] = 0;
+    return;
+}
+
+// Moves the cursor forward from the last sampled keyframe, playback usually advances by a
+// keyframe at most per call so this replaces the binary search. Rewinding restarts from the first keyframe.
+static unsigned int advance_cursor(AnimationSampler* sampler, float time, unsigned int cursor) {
+    const float* inputs = sampler -> inputs;
+    unsigned int keyframes_count = sampler -> keyframes_count;
+    if (keyframes_count < 2) return 0;
+    if (cursor > keyframes_count - 2 || time < inputs[cursor]) cursor = 0;
+    while (cursor < keyframes_count - 2 && time >= inputs[cursor + 1]) cursor++;
+    return cursor;
+}
+
+static KeyframeSpan get_keyframe_span(AnimationSampler* sampler, unsigned int cursor, float time) {
+    KeyframeSpan span = {0};
+    unsigned int stride = sampler -> values_stride;
+    bool cubic = (sampler -> interpolation == INTERPOLATION_CUBICSPLINE);
+    unsigned int keys_per_frame = cubic ? 3 : 1;
+    unsigned int value_offset = cubic ? 1 : 0;
+
+    unsigned int next = (sampler -> keyframes_count > 1) ? cursor + 1 : cursor;
+    span.value_0 = sampler -> outputs + (cursor * keys_per_frame + value_offset) * stride;
+    span.value_1 = sampler -> outputs + (next * keys_per_frame + value_offset) * stride;
+    if (cubic) {
+        span.out_tangent_0 = span.value_0 + stride;
+        span.in_tangent_1 = span.value_1 - stride;
+    }
+
+    span.delta_time = (sampler -> inputs)[next] - (sampler -> inputs)[cursor];
+    span.t = (span.delta_time > 0.0f) ? (time - (sampler -> inputs)[cursor]) / span.delta_time : 0.0f;
+    span.t = CLAMP(span.t, 0.0f, 1.0f);
+
+    return span;
+}
+
+static void write_channel_value(Node* node, AnimationPath path, const float* value) {
+    if (path == TRANSLATION_PATH) {
+        for (unsigned char i = 0; i < 3; ++i) node -> translation_vec[i] = value[i];
+    } else if (path == SCALE_PATH) {
+        for (unsigned char i = 0; i < 3; ++i) node -> scale_vec[i] = value[i];
+    } else if (path == ROTATION_PATH) {
+        for (unsigned char i = 0; i < 4; ++i) node -> rotation_quat[i] = value[i];
+    }
+    return;
+}
+
+// Morph weights have one value per target, so they are interpolated in groups of four with a scalar tail
+static void sample_weights(Node* node, AnimationSampler* sampler, KeyframeSpan* span) {
+    unsigned int count = (sampler -> values_stride < node -> weights_count) ? sampler -> values_stride : node -> weights_count;
+    float* weights = node -> weights;
+    unsigned int i = 0;
+
+    if (sampler -> interpolation == INTERPOLATION_STEP) {
+        const float* value = (span -> t >= 1.0f) ? span -> value_1 : span -> value_0;
+        for (; i < count; ++i) weights[i] = value[i];
+        return;
+    } else if (sampler -> interpolation == INTERPOLATION_CUBICSPLINE) {
+        float t = span -> t;
+        float t2 = t * t;
+        float t3 = t2 * t;
+        float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+        float h10 = (t3 - 2.0f * t2 + t) * span -> delta_time;
+        float h01 = -2.0f * t3 + 3.0f * t2;
+        float h11 = (t3 - t2) * span -> delta_time;
+        for (; i < count; ++i) {
+            weights[i] = (span -> value_0)[i] * h00 + (span -> out_tangent_0)[i] * h10 + (span -> value_1)[i] * h01 + (span -> in_tangent_1)[i] * h11;
+        }
+        return;
+    }
+
+    Vec4 t = vec4_set1(span -> t);
+    for (; i + 4 <= count; i += 4) vec4_store(weights + i, vec4_lerp(vec4_load(span -> value_0 + i), vec4_load(span -> value_1 + i), t));
+    for (; i < count; ++i) weights[i] = (span -> value_0)[i] + ((span -> value_1)[i] - (span -> value_0)[i]) * span -> t;
+
+    return;
+}
+
+static Vec4 normalize_quaternion(Vec4 quat) {
+    float q[4];
+    vec4_store(q, quat);
+    float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    if (length <= 0.0f) return vec4_set(0.0f, 0.0f, 0.0f, 1.0f);
+    return vec4_mul(quat, vec4_set1(1.0f / length));
+}
+
+static Vec4 sample_cubic_spline(KeyframeSpan* span) {
+    float t = span -> t;
+    float t2 = t * t;
+    float t3 = t2 * t;
+    Vec4 h00 = vec4_set1(2.0f * t3 - 3.0f * t2 + 1.0f);
+    Vec4 h10 = vec4_set1((t3 - 2.0f * t2 + t) * span -> delta_time);
+    Vec4 h01 = vec4_set1(-2.0f * t3 + 3.0f * t2);
+    Vec4 h11 = vec4_set1((t3 - t2) * span -> delta_time);
+
+    Vec4 result = vec4_mul(vec4_load(span -> value_0), h00);
+    result = vec4_madd(vec4_load(span -> out_tangent_0), h10, result);
+    result = vec4_madd(vec4_load(span -> value_1), h01, result);
+    result = vec4_madd(vec4_load(span -> in_tangent_1), h11, result);
+
+    return result;
+}
+
+// Interpolates up to four LINEAR rotation channels at once: the quaternions are transposed
+// into structure-of-arrays form so that the dot products and the normalization run on whole registers.
+static void blend_rotations(KeyframeSpan* spans, Node** targets, unsigned char count, bool nlerp_rotations) {
+    const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    Vec4 a[4];
+    Vec4 b[4];
+    for (unsigned char i = 0; i < 4; ++i) {
+        a[i] = vec4_load((i < count) ? spans[i].value_0 : identity);
+        b[i] = vec4_load((i < count) ? spans[i].value_1 : identity);
+    }
+    vec4_transpose(a, a + 1, a + 2, a + 3);
+    vec4_transpose(b, b + 1, b + 2, b + 3);
+
+    float dots[4];
+    Vec4 dot = vec4_mul(a[0], b[0]);
+    for (unsigned char i = 1; i < 4; ++i) dot = vec4_madd(a[i], b[i], dot);
+    vec4_store(dots, dot);
+
+    // The blend weights are the only per-lane scalar work, taking the shortest arc
+    float weights_0[4];
+    float weights_1[4];
+    for (unsigned char i = 0; i < 4; ++i) {
+        float t = (i < count) ? spans[i].t : 0.0f;
+        float sign = (dots[i] < 0.0f) ? -1.0f : 1.0f;
+        float cos_theta = dots[i] * sign;
+        if (nlerp_rotations || cos_theta > 0.9995f) {
+            weights_0[i] = 1.0f - t;
+            weights_1[i] = t * sign;
+        } else {
+            float theta = acosf(cos_theta);
+            float inv_sin_theta = 1.0f / sinf(theta);
+            weights_0[i] = sinf((1.0f - t) * theta) * inv_sin_theta;
+            weights_1[i] = sinf(t * theta) * inv_sin_theta * sign;
+        }
+    }
+
+    Vec4 weight_0 = vec4_load(weights_0);
+    Vec4 weight_1 = vec4_load(weights_1);
+    Vec4 result[4];
+    Vec4 length_squared = vec4_set1(0.0f);
+    for (unsigned char i = 0; i < 4; ++i) {
+        result[i] = vec4_madd(b[i], weight_1, vec4_mul(a[i], weight_0));
+        length_squared = vec4_madd(result[i], result[i], length_squared);
+    }
+
+    Vec4 inv_length = vec4_div(vec4_set1(1.0f), vec4_sqrt(length_squared));
+    for (unsigned char i = 0; i < 4; ++i) result[i] = vec4_mul(result[i], inv_length);
+    vec4_transpose(result, result + 1, result + 2, result + 3);
+
+    for (unsigned char i = 0; i < count; ++i) {
+        float quat[4];
+        vec4_store(quat, result[i]);
+        write_channel_value(targets[i], ROTATION_PATH, quat);
+    }
+
+    return;
+}
+
+void sample_animation(Scene* scene, Animation* animation, float time, unsigned int* cursors, bool nlerp_rotations) {
+    KeyframeSpan rotation_spans[4];
+    Node* rotation_targets[4];
+    unsigned char rotations_count = 0;
+
+    for (unsigned int i = 0; i < animation -> channels_count; ++i) {
+        AnimationChannel* channel = animation -> channels + i;
+        Node* node = get_scene_node(scene, channel -> target_node);
+        if (node == NULL) continue;
+
+        AnimationSampler* sampler = animation -> samplers + channel -> sampler_index;
+        if (sampler -> keyframes_count == 0) continue;
+
+        cursors[i] = advance_cursor(sampler, time, cursors[i]);
+        KeyframeSpan span = get_keyframe_span(sampler, cursors[i], time);
+
+        float value[4];
+        if (channel -> path == WEIGHTS_PATH) {
+            sample_weights(node, sampler, &span);
+        } else if (sampler -> interpolation == INTERPOLATION_STEP) {
+            write_channel_value(node, channel -> path, (span.t >= 1.0f) ? span.value_1 : span.value_0);
+        } else if (sampler -> interpolation == INTERPOLATION_CUBICSPLINE) {
+            Vec4 result = sample_cubic_spline(&span);
+            if (channel -> path == ROTATION_PATH) result = normalize_quaternion(result);
+            vec4_store(value, result);
+            write_channel_value(node, channel -> path, value);
+        } else if (channel -> path == ROTATION_PATH) {
+            rotation_spans[rotations_count] = span;
+            rotation_targets[rotations_count] = node;
+            if (++rotations_count == 4) {
+                blend_rotations(rotation_spans, rotation_targets, rotations_count, nlerp_rotations);
+                rotations_count = 0;
+            }
+        } else {
+            vec4_store(value, vec4_lerp(vec4_load(span.value_0), vec4_load(span.value_1), vec4_set1(span.t)));
+            write_channel_value(node, channel -> path, value);
+        }
+    }
+
+    if (rotations_count > 0) blend_rotations(rotation_spans, rotation_targets, rotations_count, nlerp_rotations);
+
+    return;
+}
+
+#endif //_ANIMATION_H_
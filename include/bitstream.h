@@ -6,14 +6,18 @@
 #include <string.h>
 #include "./debug_print.h"
 #include "./types.h"
+#include "./allocator.h"
 
 BitStream* allocate_bit_stream(unsigned char* data_stream, unsigned int size, bool copy_flag) {
-    BitStream* bit_stream = (BitStream*) calloc(1, sizeof(BitStream));
+    BitStream* bit_stream = (BitStream*) gltf_calloc(1, sizeof(BitStream));
+    if (bit_stream == NULL) return NULL;
     if (copy_flag) {
-        unsigned char* new_data_stream = (unsigned char*) calloc(size, sizeof(unsigned char));
-        for (unsigned int i = 0; i < size; ++i) {
-            new_data_stream[i] = data_stream[i];
+        unsigned char* new_data_stream = (unsigned char*) gltf_calloc(size, sizeof(unsigned char));
+        if (new_data_stream == NULL) {
+            gltf_free(bit_stream);
+            return NULL;
         }
+        memcpy(new_data_stream, data_stream, size);
         bit_stream -> stream = new_data_stream;
     } else bit_stream -> stream = data_stream;
     bit_stream -> bit = 0;
@@ -27,8 +31,8 @@ BitStream* allocate_bit_stream(unsigned char* data_stream, unsigned int size, bo
 
 void deallocate_bit_stream(BitStream* bit_stream) {
     debug_print(BLUE, "deallocating bitstream...\n");
-    free(bit_stream -> stream);
-    free(bit_stream);
+    gltf_free(bit_stream -> stream);
+    gltf_free(bit_stream);
     return;
 }
 
@@ -52,15 +56,39 @@ unsigned char get_next_byte_uc(BitStream* bit_stream) {
     return bit_stream -> current_byte;
 }
 
+// Overflow-safe check of [offset, offset + length) against the stream, flags the stream on failure
+static bool is_range_valid(BitStream* bit_stream, unsigned long long int offset, unsigned long long int length) {
+    if (length <= bit_stream -> size && offset <= bit_stream -> size - length) return TRUE;
+    error_print("range [%llu, %llu) exceeds the bitstream length: %u\n", offset, offset + length, bit_stream -> size);
+    bit_stream -> error = EXCEEDED_LENGTH;
+    return FALSE;
+}
+
+// Returns a pointer inside the stream, valid as long as the stream, or NULL if the range is out of bounds.
+// The read position is left untouched.
+const unsigned char* get_bytes_range(BitStream* bit_stream, unsigned int offset, unsigned long long int length) {
+    if (!is_range_valid(bit_stream, offset, length)) return NULL;
+    return bit_stream -> stream + offset;
+}
+
+// Copies the range into destination, returns TRUE if it is out of bounds and nothing was copied
+bool read_bytes_range(BitStream* bit_stream, unsigned int offset, unsigned long long int length, void* destination) {
+    const unsigned char* source = get_bytes_range(bit_stream, offset, length);
+    if (source == NULL) return TRUE;
+    memcpy(destination, source, length);
+    return FALSE;
+}
+
+// The whole range is validated once and copied in one go, on failure the data is left zeroed
 void* get_next_n_byte(BitStream* bit_stream, unsigned int n, unsigned char size) {
-    void* data = calloc(n, size);
-    unsigned char* data_ptr = (unsigned char*) data;
-    
-    for (unsigned int i = 0; i < (n * size); ++i) {
-        get_next_byte(bit_stream);
-        data_ptr[i] = bit_stream -> current_byte;
-        if (bit_stream -> error) return data;
-    }
+    void* data = gltf_calloc(n, size);
+    unsigned long long int length = (unsigned long long int) n * size;
+    if (length == 0 || !is_range_valid(bit_stream, bit_stream -> byte, length)) return data;
+
+    memcpy(data, bit_stream -> stream + bit_stream -> byte, length);
+    bit_stream -> byte += (unsigned int) length;
+    bit_stream -> current_byte = (bit_stream -> stream)[bit_stream -> byte - 1];
+    bit_stream -> bit = 0;
 
     return data;
 }
@@ -96,15 +124,18 @@ void skip_n_bits(BitStream* bit_stream, unsigned int bits) {
     return;
 }
 
-void set_byte(BitStream* bit_stream, unsigned int byte) {
-    if (byte >= bit_stream -> size) {
+// Seeking to the end is allowed, any further read will fail. Returns TRUE if the position is out of bounds.
+bool set_byte(BitStream* bit_stream, unsigned int byte) {
+    if (byte > bit_stream -> size) {
         error_print("Set byte to %u while the length of the BitStream is %u\n", byte, bit_stream -> size);
-        return;
+        bit_stream -> error = EXCEEDED_LENGTH;
+        return TRUE;
     }
 
     bit_stream -> byte = byte;
+    bit_stream -> bit = 0;
 
-    return;
+    return FALSE;
 }
 
 unsigned int get_next_bytes_ui(BitStream* bit_stream) {
@@ -160,12 +191,18 @@ unsigned int get_symbol_pos(char* str, unsigned char symbol, unsigned int pos) {
 }
 
 char* get_str(BitStream* bit_stream, unsigned char* str_terminators, unsigned int terminators_num) {
-    char* str = (char*) calloc(1, sizeof(char));
+    char* str = (char*) gltf_calloc(1, sizeof(char));
     unsigned int index = 0;
     char str_data = get_next_byte_uc(bit_stream);
 
-    while (!is_contained(str_data, str_terminators, terminators_num)) {
-        str = (char*) realloc(str, (index + 1) * sizeof(char));
+    while (str != NULL && !is_contained(str_data, str_terminators, terminators_num)) {
+        char* new_str = (char*) gltf_realloc(str, (index + 1) * sizeof(char));
+        if (new_str == NULL) {
+            gltf_free(str);
+            bit_stream -> error = OUT_OF_MEMORY;
+            return NULL;
+        }
+        str = new_str;
         str[index] = str_data;
         index++;
         str_data = get_next_byte_uc(bit_stream); 
@@ -176,14 +213,20 @@ char* get_str(BitStream* bit_stream, unsigned char* str_terminators, unsigned in
 
 void append_n_bytes(BitStream* bit_stream, unsigned char* data, unsigned int length) {
     unsigned int old_size = bit_stream -> size;
+    unsigned char* stream = (unsigned char*) gltf_realloc(bit_stream -> stream, sizeof(unsigned char) * (old_size + length));
+    if (stream == NULL) {
+        bit_stream -> error = OUT_OF_MEMORY;
+        gltf_free(data);
+        return;
+    }
+    bit_stream -> stream = stream;
     (bit_stream -> size) += length;
-    bit_stream -> stream = (unsigned char*) realloc(bit_stream -> stream, sizeof(unsigned char) * (bit_stream -> size));
     
     for (unsigned int i = 0; i < length; ++i) {
         (bit_stream -> stream)[old_size + i] = data[i];
     }
 
-    free(data);
+    gltf_free(data);
 
     debug_print(WHITE, "successfully appended %u bytes, new size: %u\n", length, bit_stream -> size);
     return;
@@ -192,6 +235,12 @@ void append_n_bytes(BitStream* bit_stream, unsigned char* data, unsigned int len
 void read_until(BitStream* bit_stream, char* symbols, char** data) {
     unsigned int size = 0;
     get_next_byte(bit_stream); // Start the reading
+
+    // A buffer that could not be allocated is only skipped, the caller stops on the error
+    if (data != NULL && *data == NULL) {
+        bit_stream -> error = OUT_OF_MEMORY;
+        data = NULL;
+    }
     
     while (!is_contained(bit_stream -> current_byte, (unsigned char*) symbols, strlen(symbols)) && (bit_stream -> byte < bit_stream -> size)) {
         if (data != NULL) {
@@ -205,15 +254,96 @@ void read_until(BitStream* bit_stream, char* symbols, char** data) {
     if (data != NULL) {
         (*data)[size] = '\0';
         size++;
-        (*data) = (char*) realloc(*data, size * sizeof(char));
+        // Shrinking only fails with allocators that always move, the larger buffer is kept then
+        char* shrunk_data = (char*) gltf_realloc(*data, size * sizeof(char));
+        if (shrunk_data != NULL) (*data) = shrunk_data;
     }
 
     return;
 }
 
-void skip_back(BitStream* bit_stream, unsigned int n) {
+bool skip_back(BitStream* bit_stream, unsigned int n) {
+    if (n > bit_stream -> byte || bit_stream -> byte - n >= bit_stream -> size) {
+        error_print("skip back of %u bytes from %u out of the bitstream\n", n, bit_stream -> byte);
+        bit_stream -> error = EXCEEDED_LENGTH;
+        return TRUE;
+    }
+
     bit_stream -> byte -= n;
     bit_stream -> current_byte = (bit_stream -> stream)[bit_stream -> byte];
+
+    return FALSE;
+}
+
+void init_bit_reader(BitReader* reader, const unsigned char* data, size_t size) {
+    *reader = (BitReader) { .data = data, .size = size };
+    return;
+}
+
+// Tops the buffer up to at least 56 bits. Away from the end a single unaligned load is shifted in and
+// the position advances by the whole bytes that fit, without branching on the bits count.
+static inline void refill_bits(BitReader* reader) {
+    if (reader -> position + 8 <= reader -> size) {
+        unsigned long long int word = 0;
+        memcpy(&word, reader -> data + reader -> position, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        reader -> bits |= word << reader -> bits_count;
+        reader -> position += (63 - reader -> bits_count) >> 3;
+        reader -> bits_count |= 56;
+        return;
+    }
+
+    while (reader -> bits_count <= 56) {
+        unsigned long long int byte = (reader -> position < reader -> size) ? (reader -> data)[reader -> position] : 0;
+        reader -> bits |= byte << reader -> bits_count;
+        reader -> position++;
+        reader -> bits_count += 8;
+    }
+
+    return;
+}
+
+// n must not exceed the buffered bits, up to 56 after a refill
+static inline unsigned int peek_bits(BitReader* reader, unsigned char n) {
+    return (unsigned int) (reader -> bits & ((1ULL << n) - 1));
+}
+
+static inline void consume_bits(BitReader* reader, unsigned char n) {
+    reader -> bits >>= n;
+    reader -> bits_count -= n;
+    return;
+}
+
+static inline unsigned int read_bits(BitReader* reader, unsigned char n) {
+    if (reader -> bits_count < n) refill_bits(reader);
+    unsigned int value = peek_bits(reader, n);
+    consume_bits(reader, n);
+    return value;
+}
+
+// The zero padding past the end is never an error by itself, only consuming it is
+static inline bool is_bit_reader_overrun(BitReader* reader) {
+    return reader -> position * 8 - reader -> bits_count > reader -> size * 8;
+}
+
+// Drops the bits up to the next byte boundary, then copies length bytes: first the whole bytes left in the
+// buffer, then straight from the data. Returns TRUE if the data ends first.
+bool read_aligned_bytes(BitReader* reader, unsigned char* destination, size_t length) {
+    consume_bits(reader, reader -> bits_count & 7);
+    for (; length > 0 && reader -> bits_count > 0; --length) {
+        *destination++ = (unsigned char) peek_bits(reader, 8);
+        consume_bits(reader, 8);
+    }
+    if (length == 0) return FALSE;
+
+    if (reader -> position > reader -> size || length > reader -> size - reader -> position) return TRUE;
+    memcpy(destination, reader -> data + reader -> position, length);
+    reader -> position += length;
+    reader -> bits = 0;
+
+    return FALSE;
 }
 
 #endif //_BIT_STREAM_H_
\ No newline at end of file
@@ -0,0 +1,126 @@
+#ifndef _BOUNDS_H_
+#define _BOUNDS_H_
+
+#include <float.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./simd.h"
+#include "./scene.h"
+
+/* -------------------------------------------------------------------------- */
+
+void compute_positions_bounds(const float* positions, unsigned int vertices_count, float* bounds_min, float* bounds_max);
+void transform_bounds(const float* matrix, const float* bounds_min, const float* bounds_max, float* transformed_min, float* transformed_max);
+void update_world_bounds(Scene* scene, const float* world_matrices);
+
+/* -------------------------------------------------------------------------- */
+
+static void reset_bounds(float* bounds_min, float* bounds_max) {
+    for (unsigned char i = 0; i < 3; ++i) {
+        bounds_min[i] = FLT_MAX;
+        bounds_max[i] = -FLT_MAX;
+    }
+    return;
+}
+
+static bool is_bounds_empty(const float* bounds_min, const float* bounds_max) {
+    return bounds_min[0] > bounds_max[0] || bounds_min[1] > bounds_max[1] || bounds_min[2] > bounds_max[2];
+}
+
+static void merge_bounds(float* bounds_min, float* bounds_max, const float* other_min, const float* other_max) {
+    for (unsigned char i = 0; i < 3; ++i) {
+        if (other_min[i] < bounds_min[i]) bounds_min[i] = other_min[i];
+        if (other_max[i] > bounds_max[i]) bounds_max[i] = other_max[i];
+    }
+    return;
+}
+
+// Fallback for POSITION accessors without min/max, each vertex is loaded as a whole register so
+// the last one, that would read past the end of the array, is handled separately
+void compute_positions_bounds(const float* positions, unsigned int vertices_count, float* bounds_min, float* bounds_max) {
+    reset_bounds(bounds_min, bounds_max);
+    if (vertices_count == 0) return;
+
+    Vec4 min_vec = vec4_set1(FLT_MAX);
+    Vec4 max_vec = vec4_set1(-FLT_MAX);
+    for (unsigned int i = 0; i < vertices_count - 1; ++i) {
+        Vec4 position = vec4_load(positions + i * 3);
+        min_vec = vec4_min(min_vec, position);
+        max_vec = vec4_max(max_vec, position);
+    }
+
+    const float* last = positions + (vertices_count - 1) * 3;
+    Vec4 position = vec4_set(last[0], last[1], last[2], 0.0f);
+    float result[4];
+    vec4_store(result, vec4_min(min_vec, position));
+    for (unsigned char i = 0; i < 3; ++i) bounds_min[i] = result[i];
+    vec4_store(result, vec4_max(max_vec, position));
+    for (unsigned char i = 0; i < 3; ++i) bounds_max[i] = result[i];
+
+    return;
+}
+
+// Transforms the box by center and half extents (Arvo), the extents go through the absolute value of the
+// upper 3x3 so the result stays tight without transforming the eight corners
+void transform_bounds(const float* matrix, const float* bounds_min, const float* bounds_max, float* transformed_min, float* transformed_max) {
+    if (is_bounds_empty(bounds_min, bounds_max)) {
+        reset_bounds(transformed_min, transformed_max);
+        return;
+    }
+
+    Vec4 half = vec4_set1(0.5f);
+    Vec4 min_vec = vec4_set(bounds_min[0], bounds_min[1], bounds_min[2], 0.0f);
+    Vec4 max_vec = vec4_set(bounds_max[0], bounds_max[1], bounds_max[2], 0.0f);
+    float center[4];
+    float extent[4];
+    vec4_store(center, vec4_mul(vec4_add(min_vec, max_vec), half));
+    vec4_store(extent, vec4_mul(vec4_sub(max_vec, min_vec), half));
+
+    Vec4 new_center = vec4_load(matrix + 12);
+    Vec4 new_extent = vec4_set1(0.0f);
+    for (unsigned char i = 0; i < 3; ++i) {
+        Vec4 column = vec4_load(matrix + i * 4);
+        new_center = vec4_madd(column, vec4_set1(center[i]), new_center);
+        new_extent = vec4_madd(vec4_abs(column), vec4_set1(extent[i]), new_extent);
+    }
+
+    float result[4];
+    vec4_store(result, vec4_sub(new_center, new_extent));
+    for (unsigned char i = 0; i < 3; ++i) transformed_min[i] = result[i];
+    vec4_store(result, vec4_add(new_center, new_extent));
+    for (unsigned char i = 0; i < 3; ++i) transformed_max[i] = result[i];
+
+    return;
+}
+
+static void update_node_world_bounds(Scene* scene, Node* node, const float* world_matrices) {
+    reset_bounds(node -> bounds_min, node -> bounds_max);
+
+    if (node -> index < scene -> nodes_count) {
+        for (unsigned int i = 0; i < node -> meshes_indices.count; ++i) {
+            unsigned int mesh_index = *GET_ELEMENT(unsigned int*, node -> meshes_indices, i);
+            if (mesh_index >= scene -> meshes_count) continue;
+            Mesh* mesh = scene -> meshes + mesh_index;
+            float mesh_min[3];
+            float mesh_max[3];
+            transform_bounds(world_matrices + node -> index * 16, mesh -> bounds_min, mesh -> bounds_max, mesh_min, mesh_max);
+            merge_bounds(node -> bounds_min, node -> bounds_max, mesh_min, mesh_max);
+        }
+    }
+
+    for (unsigned int i = 0; i < node -> children_count; ++i) {
+        update_node_world_bounds(scene, node -> childrens + i, world_matrices);
+        merge_bounds(node -> bounds_min, node -> bounds_max, node -> childrens[i].bounds_min, node -> childrens[i].bounds_max);
+    }
+
+    return;
+}
+
+// Recomputes the world space bounds of every node, enclosing its meshes and its whole subtree.
+// world_matrices comes from compute_world_matrices, call again after animating the nodes.
+void update_world_bounds(Scene* scene, const float* world_matrices) {
+    update_node_world_bounds(scene, &(scene -> root_node), world_matrices);
+    return;
+}
+
+#endif //_BOUNDS_H_
@@ -0,0 +1,258 @@
+#ifndef _BUFFER_CACHE_H_
+#define _BUFFER_CACHE_H_
+
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./file_io.h"
+#include "./utils.h"
+
+#define BUFFER_CACHE_DEFAULT_CAPACITY (256ULL * 1024 * 1024)
+
+// Nanoseconds of the modification time, glibc only names them st_mtim when POSIX 2008 is requested
+#if defined(__APPLE__)
+#define STAT_MODIFICATION_NANOSECONDS(file_stat) ((file_stat).st_mtimespec.tv_nsec)
+#elif defined(__GLIBC__) && !defined(__USE_XOPEN2K8)
+#define STAT_MODIFICATION_NANOSECONDS(file_stat) ((file_stat).st_mtimensec)
+#else
+#define STAT_MODIFICATION_NANOSECONDS(file_stat) ((file_stat).st_mtim.tv_nsec)
+#endif
+
+/* -------------------------------------------------------------------------- */
+
+bool set_buffer_cache_allocator(GltfAllocator* allocator);
+void set_buffer_cache_capacity(unsigned long long int capacity);
+const unsigned char* acquire_cached_file(const char* file_path, bool check_content, unsigned int* size);
+void release_cached_file(const unsigned char* data);
+void clear_buffer_cache(void);
+BufferCacheStatistics get_buffer_cache_statistics(void);
+
+/* -------------------------------------------------------------------------- */
+
+// Process-wide state, guarded by cache_mutex. The entries are few (one per distinct buffer), so they are
+// searched linearly. Every allocation goes through cache_allocator rather than the one of the load, as the
+// cache outlives the loads.
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static GltfAllocator cache_allocator = { .alloc = default_alloc, .realloc = default_realloc, .free = default_free, .user_data = NULL };
+static CachedBuffer* cached_buffers = NULL;
+static unsigned int cached_buffers_count = 0;
+static unsigned long long int cache_capacity = BUFFER_CACHE_DEFAULT_CAPACITY;
+static unsigned long long int cache_clock = 0;
+static BufferCacheStatistics cache_statistics = {0};
+
+static bool get_file_identity(const char* file_path, FileIdentity* identity) {
+    struct stat file_stat;
+    if (stat(file_path, &file_stat) != 0) return TRUE;
+    *identity = (FileIdentity) { .device = file_stat.st_dev, .inode = file_stat.st_ino, .size = file_stat.st_size, .modification_time = file_stat.st_mtime, .modification_nanoseconds = STAT_MODIFICATION_NANOSECONDS(file_stat) };
+    return FALSE;
+}
+
+static bool is_same_identity(const FileIdentity* a, const FileIdentity* b) {
+    return a -> device == b -> device && a -> inode == b -> inode && a -> size == b -> size && a -> modification_time == b -> modification_time && a -> modification_nanoseconds == b -> modification_nanoseconds;
+}
+
+// A file rewritten within the modification time granularity keeps its identity, so a content check drops it
+static void forget_file_identity(const FileIdentity* identity) {
+    for (unsigned int i = 0; i < cached_buffers_count; ++i) {
+        CachedBuffer* buffer = cached_buffers + i;
+        for (unsigned int j = 0; j < buffer -> identities_count; ++j) {
+            if (!is_same_identity(buffer -> identities + j, identity)) continue;
+            (buffer -> identities)[j--] = (buffer -> identities)[--(buffer -> identities_count)];
+        }
+    }
+    return;
+}
+
+// Returns TRUE when out of memory, the buffer keeps its previous identities
+static bool add_file_identity(CachedBuffer* buffer, const FileIdentity* identity) {
+    forget_file_identity(identity);
+    FileIdentity* identities = (FileIdentity*) gltf_realloc(buffer -> identities, sizeof(FileIdentity) * (buffer -> identities_count + 1));
+    if (identities == NULL) return TRUE;
+    buffer -> identities = identities;
+    (buffer -> identities)[(buffer -> identities_count)++] = *identity;
+    return FALSE;
+}
+
+// Drops the least recently used unreferenced buffers until the cached bytes fit the capacity
+static void evict_cached_buffers(void) {
+    while (cache_statistics.cached_bytes > cache_capacity) {
+        int victim = -1;
+        for (unsigned int i = 0; i < cached_buffers_count; ++i) {
+            if (cached_buffers[i].references == 0 && (victim < 0 || cached_buffers[i].last_use < cached_buffers[victim].last_use)) victim = (int) i;
+        }
+        if (victim < 0) return;
+
+        debug_print(BLUE, "evicting a cached buffer of %u bytes\n", cached_buffers[victim].size);
+        cache_statistics.cached_bytes -= cached_buffers[victim].size;
+        cache_statistics.evictions++;
+        gltf_free(cached_buffers[victim].data);
+        gltf_free(cached_buffers[victim].identities);
+        cached_buffers[victim] = cached_buffers[--cached_buffers_count];
+    }
+    return;
+}
+
+// Allocator of every cached buffer, NULL restores the default one. It can only change while the cache holds
+// no buffers, so it must be set before the first load using the cache. Returns TRUE when it could not be set.
+bool set_buffer_cache_allocator(GltfAllocator* allocator) {
+    pthread_mutex_lock(&cache_mutex);
+    if (cached_buffers_count > 0) {
+        pthread_mutex_unlock(&cache_mutex);
+        error_print("the buffer cache allocator can't change while %u buffers are cached\n", cached_buffers_count);
+        return TRUE;
+    }
+
+    // The empty entries table was allocated by the previous allocator
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&cache_allocator);
+    gltf_free(cached_buffers);
+    cached_buffers = NULL;
+    cache_allocator = (allocator != NULL) ? *allocator : get_default_allocator();
+    set_allocator(&previous_allocator);
+    pthread_mutex_unlock(&cache_mutex);
+
+    return FALSE;
+}
+
+// Bytes kept by the cache once no load references them, 0 frees every buffer as soon as it is released
+void set_buffer_cache_capacity(unsigned long long int capacity) {
+    pthread_mutex_lock(&cache_mutex);
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&cache_allocator);
+    cache_capacity = capacity;
+    evict_cached_buffers();
+    set_allocator(&previous_allocator);
+    pthread_mutex_unlock(&cache_mutex);
+    return;
+}
+
+// Returns the bytes of the file, shared and read-only until release_cached_file, or NULL on error. A file
+// whose identity is known is not read again, unless check_content asks to compare its bytes: files read
+// anyway share the buffer of any other file holding the same bytes.
+const unsigned char* acquire_cached_file(const char* file_path, bool check_content, unsigned int* size) {
+    FileIdentity identity = {0};
+    if (get_file_identity(file_path, &identity)) {
+        error_print("unable to open the file: %s, cause: %s\n", file_path, strerror(errno));
+        return NULL;
+    }
+
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&cache_allocator);
+
+    pthread_mutex_lock(&cache_mutex);
+    for (unsigned int i = 0; i < cached_buffers_count && !check_content; ++i) {
+        CachedBuffer* buffer = cached_buffers + i;
+        for (unsigned int j = 0; j < buffer -> identities_count; ++j) {
+            if (!is_same_identity(buffer -> identities + j, &identity)) continue;
+            buffer -> references++;
+            buffer -> last_use = ++cache_clock;
+            cache_statistics.identity_hits++;
+            *size = buffer -> size;
+            pthread_mutex_unlock(&cache_mutex);
+            set_allocator(&previous_allocator);
+            return buffer -> data;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    // Read outside of the lock, so that the other loads are not held by the disk
+    File file = { .file_path = (char*) file_path };
+    if (read_model_file(&file)) {
+        gltf_free(file.data);
+        set_allocator(&previous_allocator);
+        return NULL;
+    }
+    unsigned long long int hash = hash_data(file.data, file.size, HASH_SEED);
+
+    pthread_mutex_lock(&cache_mutex);
+    CachedBuffer* buffer = NULL;
+    for (unsigned int i = 0; i < cached_buffers_count && buffer == NULL; ++i) {
+        if (cached_buffers[i].hash == hash && cached_buffers[i].size == file.size && !memcmp(cached_buffers[i].data, file.data, file.size)) buffer = cached_buffers + i;
+    }
+
+    if (buffer != NULL) {
+        gltf_free(file.data);
+        cache_statistics.content_hits++;
+    } else {
+        forget_file_identity(&identity);
+        CachedBuffer* grown_buffers = (CachedBuffer*) gltf_realloc(cached_buffers, sizeof(CachedBuffer) * (cached_buffers_count + 1));
+        if (grown_buffers == NULL) {
+            gltf_free(file.data);
+            pthread_mutex_unlock(&cache_mutex);
+            set_allocator(&previous_allocator);
+            return NULL;
+        }
+        cached_buffers = grown_buffers;
+        buffer = cached_buffers + cached_buffers_count++;
+        *buffer = (CachedBuffer) { .data = file.data, .size = file.size, .hash = hash };
+        cache_statistics.cached_bytes += file.size;
+        cache_statistics.misses++;
+    }
+
+    // An unreferenced buffer stays cached for its content, until evicted
+    if (add_file_identity(buffer, &identity)) {
+        evict_cached_buffers();
+        pthread_mutex_unlock(&cache_mutex);
+        set_allocator(&previous_allocator);
+        return NULL;
+    }
+    buffer -> references++;
+    buffer -> last_use = ++cache_clock;
+    *size = buffer -> size;
+    const unsigned char* data = buffer -> data;
+
+    // The new buffer is referenced, so only older ones can go
+    evict_cached_buffers();
+    pthread_mutex_unlock(&cache_mutex);
+    set_allocator(&previous_allocator);
+
+    return data;
+}
+
+void release_cached_file(const unsigned char* data) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&cache_allocator);
+    pthread_mutex_lock(&cache_mutex);
+    for (unsigned int i = 0; i < cached_buffers_count; ++i) {
+        if (cached_buffers[i].data != data) continue;
+        if (cached_buffers[i].references > 0) cached_buffers[i].references--;
+        break;
+    }
+    evict_cached_buffers();
+    pthread_mutex_unlock(&cache_mutex);
+    set_allocator(&previous_allocator);
+    return;
+}
+
+// Frees the unreferenced buffers, the referenced ones stay until they are released
+void clear_buffer_cache(void) {
+    pthread_mutex_lock(&cache_mutex);
+    unsigned long long int capacity = cache_capacity;
+    pthread_mutex_unlock(&cache_mutex);
+    set_buffer_cache_capacity(0);
+    set_buffer_cache_capacity(capacity);
+
+    pthread_mutex_lock(&cache_mutex);
+    if (cached_buffers_count == 0) {
+        GltfAllocator previous_allocator = get_allocator();
+        set_allocator(&cache_allocator);
+        gltf_free(cached_buffers);
+        cached_buffers = NULL;
+        set_allocator(&previous_allocator);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return;
+}
+
+BufferCacheStatistics get_buffer_cache_statistics(void) {
+    pthread_mutex_lock(&cache_mutex);
+    BufferCacheStatistics statistics = cache_statistics;
+    statistics.buffers_count = cached_buffers_count;
+    pthread_mutex_unlock(&cache_mutex);
+    return statistics;
+}
+
+#endif //_BUFFER_CACHE_H_
@@ -0,0 +1,743 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <float.h>
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./simd.h"
+#include "./parallel.h"
+#include "./scene.h"
+#include "./bounds.h"
+#include "./mesh_optimizer.h"
+#include "./index_buffer.h"
+#include "./vertex_format.h"
+#include "./instancing.h"
+
+#define BVH_BINS_COUNT 16
+#define BVH_MAX_LEAF_SIZE 8
+#define BVH_TRAVERSAL_COST 1.0f // relative to a triangle test
+// Past this depth nodes are split in half instead of by SAH, which keeps the traversal stack bounded
+#define BVH_MAX_SAH_DEPTH 64
+#define BVH_STACK_SIZE 128
+// Subtrees smaller than this are built on the thread that split their parent
+#define BVH_PARALLEL_MIN_PRIMITIVES 4096
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int build_mesh_bvh(Mesh* mesh, unsigned int threads_count);
+void build_meshes_bvhs(Mesh* meshes, unsigned int meshes_count, unsigned int threads_count);
+bool intersect_mesh_bvh(Mesh* mesh, const float* origin, const float* direction, RayHit* hit);
+unsigned int intersect_mesh_bvh_packet(Mesh* mesh, const RayPacket* packet, RayHit* hits);
+SceneBvh build_scene_bvh(Scene* scene, const float* world_matrices, unsigned int threads_count);
+bool intersect_scene_bvh(SceneBvh* scene_bvh, Scene* scene, const float* origin, const float* direction, RayHit* hit);
+unsigned int intersect_scene_bvh_packet(SceneBvh* scene_bvh, Scene* scene, const RayPacket* packet, RayHit* hits);
+void deallocate_bvh(Bvh* bvh);
+void deallocate_scene_bvh(SceneBvh* scene_bvh);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct BvhBin {
+    float bounds_min[3];
+    float bounds_max[3];
+    unsigned int count;
+} BvhBin;
+
+typedef struct BvhBuildContext {
+    Bvh* bvh;
+    const float* bounds; // six floats per primitive, min then max
+    const float* centroids;
+    unsigned int parallel_depth; // levels whose two subtrees are built on separate threads
+} BvhBuildContext;
+
+// A subtree of count primitives owns the 2 * (count - 1) nodes from region for its descendants, so that
+// subtrees built in parallel never share a node. The unused ones are squeezed out by compact_bvh.
+typedef struct BvhBuildTask {
+    BvhBuildContext* context;
+    unsigned int node;
+    unsigned int first;
+    unsigned int count;
+    unsigned int region;
+    unsigned int depth;
+} BvhBuildTask;
+
+typedef struct MeshesBvhsJob {
+    Mesh* meshes;
+    bool large_meshes; // meshes with enough faces to be split across threads themselves
+} MeshesBvhsJob;
+
+static float get_half_area(const float* bounds_min, const float* bounds_max) {
+    float extent[3] = { bounds_max[0] - bounds_min[0], bounds_max[1] - bounds_min[1], bounds_max[2] - bounds_min[2] };
+    return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+}
+
+static unsigned int get_bin_index(float centroid, float centroid_min, float scale) {
+    int bin = (int) ((centroid - centroid_min) * scale);
+    return (bin < 0) ? 0 : ((bin >= BVH_BINS_COUNT) ? BVH_BINS_COUNT - 1 : (unsigned int) bin);
+}
+
+// Sweeps the bins of an axis from both sides, returns the SAH cost of the best split and its last left bin
+static float find_best_bin(const BvhBin* bins, unsigned int* best_bin) {
+    float right_costs[BVH_BINS_COUNT] = {0};
+    float bounds_min[3];
+    float bounds_max[3];
+    unsigned int count = 0;
+    reset_bounds(bounds_min, bounds_max);
+    for (unsigned int i = BVH_BINS_COUNT - 1; i > 0; --i) {
+        merge_bounds(bounds_min, bounds_max, bins[i].bounds_min, bins[i].bounds_max);
+        count += bins[i].count;
+        right_costs[i] = (count > 0) ? get_half_area(bounds_min, bounds_max) * count : 0.0f;
+    }
+
+    float best_cost = FLT_MAX;
+    unsigned int total_count = count + bins[0].count;
+    count = 0;
+    reset_bounds(bounds_min, bounds_max);
+    for (unsigned int i = 0; i < BVH_BINS_COUNT - 1; ++i) {
+        merge_bounds(bounds_min, bounds_max, bins[i].bounds_min, bins[i].bounds_max);
+        count += bins[i].count;
+        if (count == 0 || count == total_count) continue;
+        float cost = get_half_area(bounds_min, bounds_max) * count + right_costs[i + 1];
+        if (cost >= best_cost) continue;
+        best_cost = cost;
+        *best_bin = i;
+    }
+
+    return best_cost;
+}
+
+static void build_bvh_node(BvhBuildTask task);
+
+static void build_bvh_subtrees(unsigned int start, unsigned int end, void* context) {
+    BvhBuildTask* tasks = (BvhBuildTask*) context;
+    for (unsigned int i = start; i < end; ++i) build_bvh_node(tasks[i]);
+    return;
+}
+
+// Binned SAH: the centroids are binned along each axis and the node is split at the cheapest bin boundary,
+// or kept as a leaf when splitting costs more than testing every primitive
+static void build_bvh_node(BvhBuildTask task) {
+    BvhBuildContext* context = task.context;
+    unsigned int* primitives = context -> bvh -> primitives;
+    BvhNode* node = context -> bvh -> nodes + task.node;
+    float centroid_min[3];
+    float centroid_max[3];
+    reset_bounds(node -> bounds_min, node -> bounds_max);
+    reset_bounds(centroid_min, centroid_max);
+    for (unsigned int i = task.first; i < task.first + task.count; ++i) {
+        const float* bounds = context -> bounds + primitives[i] * 6;
+        const float* centroid = context -> centroids + primitives[i] * 3;
+        merge_bounds(node -> bounds_min, node -> bounds_max, bounds, bounds + 3);
+        merge_bounds(centroid_min, centroid_max, centroid, centroid);
+    }
+    node -> first = task.first;
+    node -> count = task.count;
+    if (task.count == 1) return;
+
+    int best_axis = -1;
+    unsigned int best_bin = 0;
+    float best_cost = FLT_MAX;
+    for (unsigned char axis = 0; axis < 3 && task.depth < BVH_MAX_SAH_DEPTH; ++axis) {
+        float extent = centroid_max[axis] - centroid_min[axis];
+        if (extent <= 0.0f) continue;
+
+        BvhBin bins[BVH_BINS_COUNT] = {0};
+        for (unsigned int i = 0; i < BVH_BINS_COUNT; ++i) reset_bounds(bins[i].bounds_min, bins[i].bounds_max);
+        float scale = BVH_BINS_COUNT / extent;
+        for (unsigned int i = task.first; i < task.first + task.count; ++i) {
+            const float* bounds = context -> bounds + primitives[i] * 6;
+            BvhBin* bin = bins + get_bin_index(context -> centroids[primitives[i] * 3 + axis], centroid_min[axis], scale);
+            merge_bounds(bin -> bounds_min, bin -> bounds_max, bounds, bounds + 3);
+            bin -> count++;
+        }
+
+        unsigned int bin = 0;
+        float cost = find_best_bin(bins, &bin);
+        if (cost >= best_cost) continue;
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = bin;
+    }
+
+    float area = get_half_area(node -> bounds_min, node -> bounds_max);
+    bool split = (best_axis >= 0 && area * BVH_TRAVERSAL_COST + best_cost < area * task.count);
+    if (!split && task.count <= BVH_MAX_LEAF_SIZE) return;
+
+    // Without a usable SAH split the primitives are cut in half as they are
+    unsigned int middle = task.first + task.count / 2;
+    if (best_axis >= 0) {
+        float scale = BVH_BINS_COUNT / (centroid_max[best_axis] - centroid_min[best_axis]);
+        unsigned int end = task.first + task.count;
+        middle = task.first;
+        while (middle < end) {
+            if (get_bin_index(context -> centroids[primitives[middle] * 3 + best_axis], centroid_min[best_axis], scale) <= best_bin) {
+                middle++;
+                continue;
+            }
+            unsigned int primitive = primitives[middle];
+            primitives[middle] = primitives[--end];
+            primitives[end] = primitive;
+        }
+    }
+
+    unsigned int left_count = middle - task.first;
+    node -> first = task.region;
+    node -> count = 0;
+    BvhBuildTask children[2] = {
+        { .context = context, .node = task.region, .first = task.first, .count = left_count, .region = task.region + 2, .depth = task.depth + 1 },
+        { .context = context, .node = task.region + 1, .first = middle, .count = task.count - left_count, .region = task.region + 2 * left_count, .depth = task.depth + 1 }
+    };
+    if (task.depth < context -> parallel_depth && task.count >= BVH_PARALLEL_MIN_PRIMITIVES) parallel_for(2, 2, build_bvh_subtrees, children);
+    else build_bvh_subtrees(0, 2, children);
+
+    return;
+}
+
+// Renumbers the nodes breadth first, dropping the slots reserved for subtrees that ended in larger leaves
+static void compact_bvh(Bvh* bvh) {
+    // Without memory the reserved slots are kept, the tree is valid either way
+    BvhNode* nodes = (BvhNode*) gltf_calloc(bvh -> nodes_count, sizeof(BvhNode));
+    if (nodes == NULL) return;
+    nodes[0] = (bvh -> nodes)[0];
+    unsigned int nodes_count = 1;
+    for (unsigned int i = 0; i < nodes_count; ++i) {
+        if (nodes[i].count > 0) continue;
+        nodes[nodes_count] = (bvh -> nodes)[nodes[i].first];
+        nodes[nodes_count + 1] = (bvh -> nodes)[nodes[i].first + 1];
+        nodes[i].first = nodes_count;
+        nodes_count += 2;
+    }
+
+    gltf_free(bvh -> nodes);
+    BvhNode* trimmed_nodes = (BvhNode*) gltf_realloc(nodes, sizeof(BvhNode) * nodes_count);
+    bvh -> nodes = (trimmed_nodes != NULL) ? trimmed_nodes : nodes;
+    bvh -> nodes_count = nodes_count;
+
+    return;
+}
+
+static void build_bvh(Bvh* bvh, const float* bounds, unsigned int primitives_count, unsigned int threads_count) {
+    deallocate_bvh(bvh);
+    if (primitives_count == 0) return;
+
+    float* centroids = (float*) gltf_calloc(primitives_count * 3, sizeof(float));
+    bvh -> nodes_count = primitives_count * 2 - 1;
+    bvh -> nodes = (BvhNode*) gltf_calloc(bvh -> nodes_count, sizeof(BvhNode));
+    bvh -> primitives_count = primitives_count;
+    bvh -> primitives = (unsigned int*) gltf_calloc(primitives_count, sizeof(unsigned int));
+    if (centroids == NULL || bvh -> nodes == NULL || bvh -> primitives == NULL) {
+        gltf_free(centroids);
+        deallocate_bvh(bvh);
+        return;
+    }
+
+    for (unsigned int i = 0; i < primitives_count * 3; ++i) centroids[i] = (bounds[(i / 3) * 6 + i % 3] + bounds[(i / 3) * 6 + 3 + i % 3]) * 0.5f;
+    for (unsigned int i = 0; i < primitives_count; ++i) (bvh -> primitives)[i] = i;
+
+    if (threads_count == 0) threads_count = get_cores_count();
+    BvhBuildContext context = { .bvh = bvh, .bounds = bounds, .centroids = centroids };
+    while ((2u << context.parallel_depth) <= threads_count) context.parallel_depth++;
+    build_bvh_node((BvhBuildTask) { .context = &context, .node = 0, .first = 0, .count = primitives_count, .region = 1, .depth = 0 });
+    compact_bvh(bvh);
+
+    gltf_free(centroids);
+
+    return;
+}
+
+// Reads the triangle straight from the index buffer and the positions, whatever their resident format
+static void get_bvh_triangle(Mesh* mesh, unsigned int face, float* positions) {
+    for (unsigned char c = 0; c < 3; ++c) {
+        unsigned int index = face * 3 + c;
+        unsigned int vertex = (mesh -> index_buffer.component_type == UNSIGNED_SHORT) ? ((unsigned short int*) mesh -> index_buffer.data)[index] : ((unsigned int*) mesh -> index_buffer.data)[index];
+        if (mesh -> vertices.component_type == FLOAT) memcpy(positions + c * 3, (float*) (mesh -> vertices.storage) + vertex * 3, sizeof(float) * 3);
+        else decode_vertex_attribute(&(mesh -> vertices), vertex, positions + c * 3);
+    }
+    return;
+}
+
+// Builds the BVH over the triangles of the index buffer, building the index buffer first when missing.
+// The top levels are split across threads_count workers (0 meaning one per core). Returns the nodes count.
+unsigned int build_mesh_bvh(Mesh* mesh, unsigned int threads_count) {
+    deallocate_bvh(&(mesh -> bvh));
+    if (!is_triangle_mesh(mesh)) return 0;
+    if (mesh -> index_buffer.data == NULL) build_index_buffer(mesh);
+
+    float* bounds = (float*) gltf_calloc(mesh -> faces_count * 6, sizeof(float));
+    if (mesh -> index_buffer.data == NULL || bounds == NULL) {
+        gltf_free(bounds);
+        return 0;
+    }
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        float triangle[9];
+        get_bvh_triangle(mesh, i, triangle);
+        reset_bounds(bounds + i * 6, bounds + i * 6 + 3);
+        for (unsigned char c = 0; c < 3; ++c) merge_bounds(bounds + i * 6, bounds + i * 6 + 3, triangle + c * 3, triangle + c * 3);
+    }
+    build_bvh(&(mesh -> bvh), bounds, mesh -> faces_count, threads_count);
+    gltf_free(bounds);
+
+    return mesh -> bvh.nodes_count;
+}
+
+static void build_meshes_bvhs_range(unsigned int start, unsigned int end, void* context) {
+    MeshesBvhsJob* job = (MeshesBvhsJob*) context;
+    for (unsigned int i = start; i < end; ++i) {
+        Mesh* mesh = job -> meshes + i;
+        if (mesh -> bvh.nodes != NULL || (mesh -> faces_count >= BVH_PARALLEL_MIN_PRIMITIVES) != job -> large_meshes) continue;
+        build_mesh_bvh(mesh, job -> large_meshes ? 0 : 1);
+    }
+    return;
+}
+
+// Small meshes are built one per worker, large ones one after the other with their top levels split across
+// the workers. Meshes that already have a BVH are kept.
+void build_meshes_bvhs(Mesh* meshes, unsigned int meshes_count, unsigned int threads_count) {
+    MeshesBvhsJob job = { .meshes = meshes, .large_meshes = FALSE };
+    parallel_for(meshes_count, threads_count, build_meshes_bvhs_range, &job);
+    job.large_meshes = TRUE;
+    build_meshes_bvhs_range(0, meshes_count, &job);
+    return;
+}
+
+static bool intersect_bvh_box(const BvhNode* node, const float* origin, const float* inverse_direction, float t_max, float* t_enter) {
+    float t_near = 0.0f;
+    float t_far = t_max;
+    for (unsigned char c = 0; c < 3; ++c) {
+        float t0 = (node -> bounds_min[c] - origin[c]) * inverse_direction[c];
+        float t1 = (node -> bounds_max[c] - origin[c]) * inverse_direction[c];
+        if (t0 > t1) {
+            float t = t0;
+            t0 = t1;
+            t1 = t;
+        }
+        if (t0 > t_near) t_near = t0;
+        if (t1 < t_far) t_far = t1;
+    }
+    *t_enter = t_near;
+    return t_near <= t_far;
+}
+
+// Möller-Trumbore, both faces hit. Updates t, u and v when the hit is closer than t.
+static bool intersect_triangle(const float* origin, const float* direction, const float* triangle, float* t, float* u, float* v) {
+    float e1[3] = { triangle[3] - triangle[0], triangle[4] - triangle[1], triangle[5] - triangle[2] };
+    float e2[3] = { triangle[6] - triangle[0], triangle[7] - triangle[1], triangle[8] - triangle[2] };
+    float p[3] = { direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0] };
+    float determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (determinant == 0.0f) return FALSE;
+
+    float inverse_determinant = 1.0f / determinant;
+    float s[3] = { origin[0] - triangle[0], origin[1] - triangle[1], origin[2] - triangle[2] };
+    float hit_u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse_determinant;
+    if (hit_u < 0.0f || hit_u > 1.0f) return FALSE;
+
+    float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+    float hit_v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse_determinant;
+    if (hit_v < 0.0f || hit_u + hit_v > 1.0f) return FALSE;
+
+    float hit_t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse_determinant;
+    if (!(hit_t > 0.0f && hit_t < *t)) return FALSE;
+    *t = hit_t;
+    *u = hit_u;
+    *v = hit_v;
+
+    return TRUE;
+}
+
+// Closest hit along origin + t * direction for t in (0, hit -> t), the nearer child is visited first and
+// nodes farther than the closest hit so far are skipped. Returns TRUE when a closer face was hit.
+bool intersect_mesh_bvh(Mesh* mesh, const float* origin, const float* direction, RayHit* hit) {
+    Bvh* bvh = &(mesh -> bvh);
+    float inverse_direction[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+    unsigned int stack[BVH_STACK_SIZE];
+    float stack_distances[BVH_STACK_SIZE];
+    unsigned int stack_size = 0;
+    float t_enter = 0.0f;
+    if (bvh -> nodes == NULL || !intersect_bvh_box(bvh -> nodes, origin, inverse_direction, hit -> t, &t_enter)) return FALSE;
+    stack[stack_size] = 0;
+    stack_distances[stack_size++] = t_enter;
+
+    bool found = FALSE;
+    while (stack_size > 0) {
+        --stack_size;
+        if (stack_distances[stack_size] > hit -> t) continue;
+        const BvhNode* node = bvh -> nodes + stack[stack_size];
+
+        if (node -> count > 0) {
+            for (unsigned int i = node -> first; i < node -> first + node -> count; ++i) {
+                float triangle[9];
+                get_bvh_triangle(mesh, (bvh -> primitives)[i], triangle);
+                if (!intersect_triangle(origin, direction, triangle, &(hit -> t), &(hit -> u), &(hit -> v))) continue;
+                hit -> face_index = (bvh -> primitives)[i];
+                found = TRUE;
+            }
+            continue;
+        }
+
+        float t_left = 0.0f;
+        float t_right = 0.0f;
+        bool left = intersect_bvh_box(bvh -> nodes + node -> first, origin, inverse_direction, hit -> t, &t_left);
+        bool right = intersect_bvh_box(bvh -> nodes + node -> first + 1, origin, inverse_direction, hit -> t, &t_right);
+        unsigned int near_child = (left && (!right || t_left <= t_right)) ? node -> first : node -> first + 1;
+        if (left && right) {
+            stack[stack_size] = (near_child == node -> first) ? node -> first + 1 : node -> first;
+            stack_distances[stack_size++] = (near_child == node -> first) ? t_right : t_left;
+        }
+        if (left || right) {
+            stack[stack_size] = near_child;
+            stack_distances[stack_size++] = (near_child == node -> first) ? t_left : t_right;
+        }
+    }
+
+    return found;
+}
+
+// Returns the lanes whose ray enters the box before their closest hit, and the nearest entry among them
+static unsigned int intersect_bvh_box_packet(const BvhNode* node, const Vec4* origin, const Vec4* inverse_direction, Vec4 t_max, float* t_enter) {
+    Vec4 t_near = vec4_set1(0.0f);
+    Vec4 t_far = t_max;
+    for (unsigned char c = 0; c < 3; ++c) {
+        Vec4 t0 = vec4_mul(vec4_sub(vec4_set1(node -> bounds_min[c]), origin[c]), inverse_direction[c]);
+        Vec4 t1 = vec4_mul(vec4_sub(vec4_set1(node -> bounds_max[c]), origin[c]), inverse_direction[c]);
+        t_near = vec4_max(t_near, vec4_min(t0, t1));
+        t_far = vec4_min(t_far, vec4_max(t0, t1));
+    }
+
+    unsigned int mask = ~vec4_less_mask(t_far, t_near) & 0xF;
+    float entries[4];
+    vec4_store(entries, t_near);
+    *t_enter = FLT_MAX;
+    for (unsigned char i = 0; i < 4; ++i) {
+        if ((mask >> i & 1) && entries[i] < *t_enter) *t_enter = entries[i];
+    }
+
+    return mask;
+}
+
+// Möller-Trumbore for four rays against one triangle, returns the lanes hitting it closer than t_max.
+// Parallel rays get an infinite or NaN distance, which fails the comparisons.
+static unsigned int intersect_triangle_packet(const Vec4* origin, const Vec4* direction, const float* triangle, Vec4 t_max, Vec4* t, Vec4* u, Vec4* v) {
+    Vec4 e1[3];
+    Vec4 e2[3];
+    Vec4 s[3];
+    for (unsigned char c = 0; c < 3; ++c) {
+        e1[c] = vec4_set1(triangle[3 + c] - triangle[c]);
+        e2[c] = vec4_set1(triangle[6 + c] - triangle[c]);
+        s[c] = vec4_sub(origin[c], vec4_set1(triangle[c]));
+    }
+
+    Vec4 p[3] = {
+        vec4_sub(vec4_mul(direction[1], e2[2]), vec4_mul(direction[2], e2[1])),
+        vec4_sub(vec4_mul(direction[2], e2[0]), vec4_mul(direction[0], e2[2])),
+        vec4_sub(vec4_mul(direction[0], e2[1]), vec4_mul(direction[1], e2[0]))
+    };
+    Vec4 q[3] = {
+        vec4_sub(vec4_mul(s[1], e1[2]), vec4_mul(s[2], e1[1])),
+        vec4_sub(vec4_mul(s[2], e1[0]), vec4_mul(s[0], e1[2])),
+        vec4_sub(vec4_mul(s[0], e1[1]), vec4_mul(s[1], e1[0]))
+    };
+    Vec4 determinant = vec4_madd(e1[0], p[0], vec4_madd(e1[1], p[1], vec4_mul(e1[2], p[2])));
+    Vec4 inverse_determinant = vec4_div(vec4_set1(1.0f), determinant);
+    *u = vec4_mul(vec4_madd(s[0], p[0], vec4_madd(s[1], p[1], vec4_mul(s[2], p[2]))), inverse_determinant);
+    *v = vec4_mul(vec4_madd(direction[0], q[0], vec4_madd(direction[1], q[1], vec4_mul(direction[2], q[2]))), inverse_determinant);
+    *t = vec4_mul(vec4_madd(e2[0], q[0], vec4_madd(e2[1], q[1], vec4_mul(e2[2], q[2]))), inverse_determinant);
+
+    Vec4 zero = vec4_set1(0.0f);
+    unsigned int misses = vec4_less_mask(*u, zero) | vec4_less_mask(*v, zero) | vec4_less_mask(vec4_set1(1.0f), vec4_add(*u, *v));
+    return vec4_less_mask(*t, t_max) & vec4_less_mask(zero, *t) & ~misses & 0xF;
+}
+
+// Traverses the BVH once for the active lanes, a node is visited when any of them reaches it.
+// Returns the lanes whose hit got closer.
+static unsigned int traverse_mesh_bvh_packet(Mesh* mesh, const Vec4* origin, const Vec4* direction, RayHit* hits, unsigned int active) {
+    Bvh* bvh = &(mesh -> bvh);
+    if (bvh -> nodes == NULL || active == 0) return 0;
+
+    float closest[4];
+    Vec4 inverse_direction[3];
+    for (unsigned char c = 0; c < 3; ++c) inverse_direction[c] = vec4_div(vec4_set1(1.0f), direction[c]);
+    // Inactive lanes look no farther than 0, so they never reach a node
+    for (unsigned char i = 0; i < 4; ++i) closest[i] = (active >> i & 1) ? hits[i].t : -1.0f;
+
+    unsigned int stack[BVH_STACK_SIZE];
+    float stack_distances[BVH_STACK_SIZE];
+    unsigned int stack_size = 0;
+    float t_enter = 0.0f;
+    if (!intersect_bvh_box_packet(bvh -> nodes, origin, inverse_direction, vec4_load(closest), &t_enter)) return 0;
+    stack[stack_size] = 0;
+    stack_distances[stack_size++] = t_enter;
+
+    unsigned int updated = 0;
+    while (stack_size > 0) {
+        --stack_size;
+        float farthest = -1.0f;
+        for (unsigned char i = 0; i < 4; ++i) farthest = (closest[i] > farthest) ? closest[i] : farthest;
+        if (stack_distances[stack_size] > farthest) continue;
+        const BvhNode* node = bvh -> nodes + stack[stack_size];
+
+        if (node -> count > 0) {
+            for (unsigned int i = node -> first; i < node -> first + node -> count; ++i) {
+                float triangle[9];
+                Vec4 t;
+                Vec4 u;
+                Vec4 v;
+                get_bvh_triangle(mesh, (bvh -> primitives)[i], triangle);
+                unsigned int mask = intersect_triangle_packet(origin, direction, triangle, vec4_load(closest), &t, &u, &v);
+                if (mask == 0) continue;
+
+                float ts[4];
+                float us[4];
+                float vs[4];
+                vec4_store(ts, t);
+                vec4_store(us, u);
+                vec4_store(vs, v);
+                for (unsigned char lane = 0; lane < 4; ++lane) {
+                    if (!(mask >> lane & 1)) continue;
+                    closest[lane] = ts[lane];
+                    hits[lane].t = ts[lane];
+                    hits[lane].u = us[lane];
+                    hits[lane].v = vs[lane];
+                    hits[lane].face_index = (bvh -> primitives)[i];
+                }
+                updated |= mask;
+            }
+            continue;
+        }
+
+        float t_left = 0.0f;
+        float t_right = 0.0f;
+        Vec4 t_max = vec4_load(closest);
+        bool left = intersect_bvh_box_packet(bvh -> nodes + node -> first, origin, inverse_direction, t_max, &t_left) != 0;
+        bool right = intersect_bvh_box_packet(bvh -> nodes + node -> first + 1, origin, inverse_direction, t_max, &t_right) != 0;
+        unsigned int near_child = (left && (!right || t_left <= t_right)) ? node -> first : node -> first + 1;
+        if (left && right) {
+            stack[stack_size] = (near_child == node -> first) ? node -> first + 1 : node -> first;
+            stack_distances[stack_size++] = (near_child == node -> first) ? t_right : t_left;
+        }
+        if (left || right) {
+            stack[stack_size] = near_child;
+            stack_distances[stack_size++] = (near_child == node -> first) ? t_left : t_right;
+        }
+    }
+
+    return updated;
+}
+
+// Four rays at once, each lane reads and updates its own hit. Returns the mask of the lanes that hit a closer face.
+unsigned int intersect_mesh_bvh_packet(Mesh* mesh, const RayPacket* packet, RayHit* hits) {
+    Vec4 origin[3] = { vec4_load(packet -> origins[0]), vec4_load(packet -> origins[1]), vec4_load(packet -> origins[2]) };
+    Vec4 direction[3] = { vec4_load(packet -> directions[0]), vec4_load(packet -> directions[1]), vec4_load(packet -> directions[2]) };
+    return traverse_mesh_bvh_packet(mesh, origin, direction, hits, 0xF);
+}
+
+// World matrices are affine, so the inverse is the inverse of the upper 3x3 plus the translation moved back
+static void invert_affine_matrix(const float* matrix, float* inverse) {
+    float a = matrix[0], b = matrix[4], c = matrix[8];
+    float d = matrix[1], e = matrix[5], f = matrix[9];
+    float g = matrix[2], h = matrix[6], i = matrix[10];
+    float cofactors[9] = { e * i - f * h, c * h - b * i, b * f - c * e, f * g - d * i, a * i - c * g, c * d - a * f, d * h - e * g, b * g - a * h, a * e - b * d };
+    float determinant = a * cofactors[0] + b * cofactors[3] + c * cofactors[6];
+    float inverse_determinant = (determinant != 0.0f) ? 1.0f / determinant : 0.0f;
+
+    memset(inverse, 0, sizeof(float) * 16);
+    for (unsigned char row = 0; row < 3; ++row) {
+        for (unsigned char column = 0; column < 3; ++column) inverse[column * 4 + row] = cofactors[row * 3 + column] * inverse_determinant;
+    }
+    for (unsigned char row = 0; row < 3; ++row) {
+        inverse[12 + row] = -(inverse[row] * matrix[12] + inverse[4 + row] * matrix[13] + inverse[8 + row] * matrix[14]);
+    }
+    inverse[15] = 1.0f;
+
+    return;
+}
+
+static void add_bvh_instance(SceneBvh* scene_bvh, const float* world_matrix, unsigned int node_index, unsigned int mesh_index, int instance_index) {
+    BvhInstance* instances = (BvhInstance*) gltf_realloc(scene_bvh -> instances, sizeof(BvhInstance) * (scene_bvh -> instances_count + 1));
+    if (instances == NULL) return;
+    scene_bvh -> instances = instances;
+    BvhInstance* instance = scene_bvh -> instances + scene_bvh -> instances_count++;
+    *instance = (BvhInstance) { .node_index = node_index, .mesh_index = mesh_index, .instance_index = instance_index };
+    memcpy(instance -> world_matrix, world_matrix, sizeof(float) * 16);
+    invert_affine_matrix(world_matrix, instance -> inverse_matrix);
+    return;
+}
+
+// Builds the missing mesh BVHs, then a BVH over every mesh drawn by a node, bounded by the root of its mesh BVH
+// moved into world space. GPU instances are expanded here, one entry per instance and mesh. world_matrices
+// comes from compute_world_matrices, NULL to compute it from the current node transforms.
+SceneBvh build_scene_bvh(Scene* scene, const float* world_matrices, unsigned int threads_count) {
+    SceneBvh scene_bvh = { .allocator = get_allocator() };
+
+    // The mesh BVHs belong to the scene
+    set_allocator(&(scene -> allocator));
+    build_meshes_bvhs(scene -> meshes, scene -> meshes_count, threads_count);
+    set_allocator(&(scene_bvh.allocator));
+
+    float* computed_matrices = (world_matrices == NULL) ? compute_world_matrices(scene) : NULL;
+    if (world_matrices == NULL) world_matrices = computed_matrices;
+    if (world_matrices == NULL) return scene_bvh;
+
+    for (unsigned int i = 0; i < scene -> nodes_count; ++i) {
+        Node* node = get_scene_node(scene, i);
+        if (node == NULL || node -> meshes_indices.count == 0) continue;
+
+        // Row-major 3x4 instance matrices, moved to column-major 4x4 ones
+        float* instance_matrices = NULL;
+        if (node -> instances.count > 0) {
+            instance_matrices = (float*) gltf_calloc((size_t) node -> instances.count * INSTANCE_MATRIX_SIZE, sizeof(float));
+            if (instance_matrices == NULL) continue;
+            compute_instance_matrices(&(node -> instances), world_matrices + i * 16, instance_matrices, 1);
+        }
+
+        for (unsigned int j = 0; j < node -> meshes_indices.count; ++j) {
+            unsigned int mesh_index = *GET_ELEMENT(unsigned int*, node -> meshes_indices, j);
+            if (mesh_index >= scene -> meshes_count || (scene -> meshes)[mesh_index].bvh.nodes == NULL) continue;
+            if (instance_matrices == NULL) add_bvh_instance(&scene_bvh, world_matrices + i * 16, i, mesh_index, -1);
+
+            for (unsigned int k = 0; instance_matrices != NULL && k < node -> instances.count; ++k) {
+                const float* rows = instance_matrices + (size_t) k * INSTANCE_MATRIX_SIZE;
+                float matrix[16] = {0};
+                for (unsigned char row = 0; row < 3; ++row) {
+                    for (unsigned char column = 0; column < 4; ++column) matrix[column * 4 + row] = rows[row * 4 + column];
+                }
+                matrix[15] = 1.0f;
+                add_bvh_instance(&scene_bvh, matrix, i, mesh_index, (int) k);
+            }
+        }
+        gltf_free(instance_matrices);
+    }
+    gltf_free(computed_matrices);
+
+    float* bounds = (float*) gltf_calloc(scene_bvh.instances_count * 6 + 1, sizeof(float));
+    for (unsigned int i = 0; bounds != NULL && i < scene_bvh.instances_count; ++i) {
+        BvhInstance* instance = scene_bvh.instances + i;
+        const BvhNode* root = (scene -> meshes)[instance -> mesh_index].bvh.nodes;
+        transform_bounds(instance -> world_matrix, root -> bounds_min, root -> bounds_max, bounds + i * 6, bounds + i * 6 + 3);
+    }
+    if (bounds != NULL) build_bvh(&(scene_bvh.bvh), bounds, scene_bvh.instances_count, threads_count);
+    gltf_free(bounds);
+    debug_print(CYAN, "scene bvh: %u instances, %u nodes\n", scene_bvh.instances_count, scene_bvh.bvh.nodes_count);
+
+    return scene_bvh;
+}
+
+static void transform_ray(const float* matrix, const float* origin, const float* direction, float* local_origin, float* local_direction) {
+    for (unsigned char row = 0; row < 3; ++row) {
+        local_origin[row] = matrix[12 + row];
+        local_direction[row] = 0.0f;
+        for (unsigned char k = 0; k < 3; ++k) {
+            local_origin[row] += matrix[k * 4 + row] * origin[k];
+            local_direction[row] += matrix[k * 4 + row] * direction[k];
+        }
+    }
+    return;
+}
+
+// Rays are moved into the space of each instance mesh without normalizing the direction, so the distances
+// stay comparable across instances. Returns TRUE when a closer face was hit.
+bool intersect_scene_bvh(SceneBvh* scene_bvh, Scene* scene, const float* origin, const float* direction, RayHit* hit) {
+    Bvh* bvh = &(scene_bvh -> bvh);
+    float inverse_direction[3] = { 1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2] };
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int stack_size = 0;
+    float t_enter = 0.0f;
+    if (bvh -> nodes == NULL || !intersect_bvh_box(bvh -> nodes, origin, inverse_direction, hit -> t, &t_enter)) return FALSE;
+    stack[stack_size++] = 0;
+
+    bool found = FALSE;
+    while (stack_size > 0) {
+        const BvhNode* node = bvh -> nodes + stack[--stack_size];
+        if (!intersect_bvh_box(node, origin, inverse_direction, hit -> t, &t_enter)) continue;
+        if (node -> count == 0) {
+            stack[stack_size++] = node -> first + 1;
+            stack[stack_size++] = node -> first;
+            continue;
+        }
+
+        for (unsigned int i = node -> first; i < node -> first + node -> count; ++i) {
+            BvhInstance* instance = scene_bvh -> instances + (bvh -> primitives)[i];
+            float local_origin[3];
+            float local_direction[3];
+            transform_ray(instance -> inverse_matrix, origin, direction, local_origin, local_direction);
+            if (!intersect_mesh_bvh(scene -> meshes + instance -> mesh_index, local_origin, local_direction, hit)) continue;
+            hit -> mesh_index = (int) instance -> mesh_index;
+            hit -> node_index = (int) instance -> node_index;
+            hit -> instance_index = instance -> instance_index;
+            found = TRUE;
+        }
+    }
+
+    return found;
+}
+
+// Four rays at once through the instances and their meshes. Returns the mask of the lanes that hit a closer face.
+unsigned int intersect_scene_bvh_packet(SceneBvh* scene_bvh, Scene* scene, const RayPacket* packet, RayHit* hits) {
+    Bvh* bvh = &(scene_bvh -> bvh);
+    Vec4 origin[3] = { vec4_load(packet -> origins[0]), vec4_load(packet -> origins[1]), vec4_load(packet -> origins[2]) };
+    Vec4 direction[3] = { vec4_load(packet -> directions[0]), vec4_load(packet -> directions[1]), vec4_load(packet -> directions[2]) };
+    Vec4 inverse_direction[3];
+    for (unsigned char c = 0; c < 3; ++c) inverse_direction[c] = vec4_div(vec4_set1(1.0f), direction[c]);
+    if (bvh -> nodes == NULL) return 0;
+
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int stack_size = 0;
+    stack[stack_size++] = 0;
+    unsigned int updated = 0;
+    while (stack_size > 0) {
+        const BvhNode* node = bvh -> nodes + stack[--stack_size];
+        float t_enter = 0.0f;
+        unsigned int active = intersect_bvh_box_packet(node, origin, inverse_direction, vec4_set(hits[0].t, hits[1].t, hits[2].t, hits[3].t), &t_enter);
+        if (active == 0) continue;
+        if (node -> count == 0) {
+            stack[stack_size++] = node -> first + 1;
+            stack[stack_size++] = node -> first;
+            continue;
+        }
+
+        for (unsigned int i = node -> first; i < node -> first + node -> count; ++i) {
+            BvhInstance* instance = scene_bvh -> instances + (bvh -> primitives)[i];
+            const float* matrix = instance -> inverse_matrix;
+            Vec4 local_origin[3];
+            Vec4 local_direction[3];
+            for (unsigned char row = 0; row < 3; ++row) {
+                local_origin[row] = vec4_set1(matrix[12 + row]);
+                local_direction[row] = vec4_set1(0.0f);
+                for (unsigned char k = 0; k < 3; ++k) {
+                    local_origin[row] = vec4_madd(vec4_set1(matrix[k * 4 + row]), origin[k], local_origin[row]);
+                    local_direction[row] = vec4_madd(vec4_set1(matrix[k * 4 + row]), direction[k], local_direction[row]);
+                }
+            }
+
+            unsigned int mask = traverse_mesh_bvh_packet(scene -> meshes + instance -> mesh_index, local_origin, local_direction, hits, active);
+            for (unsigned char lane = 0; lane < 4; ++lane) {
+                if (!(mask >> lane & 1)) continue;
+                hits[lane].mesh_index = (int) instance -> mesh_index;
+                hits[lane].node_index = (int) instance -> node_index;
+                hits[lane].instance_index = instance -> instance_index;
+            }
+            updated |= mask;
+        }
+    }
+
+    return updated;
+}
+
+void deallocate_bvh(Bvh* bvh) {
+    gltf_free(bvh -> nodes);
+    gltf_free(bvh -> primitives);
+    *bvh = (Bvh) {0};
+    return;
+}
+
+void deallocate_scene_bvh(SceneBvh* scene_bvh) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&(scene_bvh -> allocator));
+    deallocate_bvh(&(scene_bvh -> bvh));
+    gltf_free(scene_bvh -> instances);
+    set_allocator(&previous_allocator);
+    *scene_bvh = (SceneBvh) {0};
+    return;
+}
+
+#endif //_BVH_H_
@@ -47,8 +47,6 @@ void debug_print(Colors color, const char* format, ...) {
 
 #else
 
-#define NOT_USED(var) (void) var
-
 void debug_print(Colors color, const char* format, ...) {
     NOT_USED(color);
     NOT_USED(format);
@@ -4,16 +4,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
 #include "./types.h"
+#include "./allocator.h"
 #include "./debug_print.h"
 
+// File watching relies on inotify, elsewhere the watcher fails to open and every file counts as changed
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif //__linux__
+
+#define WRITER_BUFFER_CAPACITY (64 * 1024)
+#define WATCHER_EVENTS_CAPACITY 4096
+
 bool read_model_file(File* file_data) {
     FILE* file;
 
     int err = 0;
     if ((file = fopen(file_data -> file_path, "rb")) == NULL) {
-        err = ferror(file);
-        error_print("unable to open the file: %s, cause: %s\n", file_data -> file_path, strerror(err));
+        error_print("unable to open the file: %s, cause: %s\n", file_data -> file_path, strerror(errno));
         return TRUE;
     }
 
@@ -21,7 +33,12 @@ bool read_model_file(File* file_data) {
     file_data -> size = ftell(file);
     fseek(file, 0, SEEK_SET);
     
-    file_data -> data = (unsigned char*) calloc(file_data -> size, sizeof(unsigned char));
+    file_data -> data = (unsigned char*) gltf_calloc(file_data -> size, sizeof(unsigned char));
+    if (file_data -> data == NULL) {
+        file_data -> size = 0;
+        fclose(file);
+        return TRUE;
+    }
     
     unsigned int read_bytes = fread(file_data -> data, sizeof(unsigned char), file_data -> size, file);
     if (read_bytes != file_data -> size) {
@@ -39,10 +56,286 @@ bool read_model_file(File* file_data) {
     return FALSE;
 }
 
+// Reads only size bytes starting at offset, for the files of which just a part is used. Returns TRUE on error.
+bool read_file_range(File* file_data, unsigned long long int offset, unsigned int size) {
+    FILE* file = fopen(file_data -> file_path, "rb");
+    if (file == NULL) {
+        error_print("unable to open the file: %s, cause: %s\n", file_data -> file_path, strerror(errno));
+        return TRUE;
+    }
+
+    file_data -> size = size;
+    file_data -> data = (unsigned char*) gltf_calloc(size, sizeof(unsigned char));
+    if (file_data -> data == NULL) {
+        file_data -> size = 0;
+        fclose(file);
+        return TRUE;
+    }
+
+    unsigned int read_bytes = (fseek(file, (long int) offset, SEEK_SET) == 0) ? fread(file_data -> data, sizeof(unsigned char), size, file) : 0;
+    fclose(file);
+    if (read_bytes != size) {
+        error_print("read %u bytes instead of %u at %llu from %s\n", read_bytes, size, offset, file_data -> file_path);
+        return TRUE;
+    }
+
+    debug_print(YELLOW, "read %u bytes at %llu from %s\n", read_bytes, offset, file_data -> file_path);
+
+    return FALSE;
+}
+
 void deallocate_file(File* file_data, bool dealloc_data) {
     debug_print(BLUE, "deallocating file...\n");
-    if (dealloc_data) free(file_data -> data);
-    free(file_data -> file_path);
+    if (dealloc_data) gltf_free(file_data -> data);
+    gltf_free(file_data -> file_path);
+    return;
+}
+
+BufferedWriter* open_buffered_writer(const char* file_path) {
+    FILE* file = fopen(file_path, "wb");
+    if (file == NULL) {
+        error_print("unable to create the file: %s, cause: %s\n", file_path, strerror(errno));
+        return NULL;
+    }
+
+    BufferedWriter* writer = (BufferedWriter*) gltf_calloc(1, sizeof(BufferedWriter));
+    unsigned char* buffer = (unsigned char*) gltf_calloc(WRITER_BUFFER_CAPACITY, sizeof(unsigned char));
+    if (writer == NULL || buffer == NULL) {
+        gltf_free(writer);
+        gltf_free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    writer -> file = file;
+    writer -> buffer = buffer;
+
+    return writer;
+}
+
+static void flush_buffered_writer(BufferedWriter* writer) {
+    if (writer -> buffer_size > 0 && fwrite(writer -> buffer, sizeof(unsigned char), writer -> buffer_size, (FILE*) (writer -> file)) != writer -> buffer_size) writer -> error = TRUE;
+    writer -> buffer_size = 0;
+    return;
+}
+
+// Writes larger than the buffer skip it, so big blobs go straight from the caller memory to the file
+void buffered_write(BufferedWriter* writer, const void* data, size_t size) {
+    writer -> written += size;
+    if (writer -> buffer_size + size > WRITER_BUFFER_CAPACITY) flush_buffered_writer(writer);
+    if (size >= WRITER_BUFFER_CAPACITY) {
+        if (fwrite(data, sizeof(unsigned char), size, (FILE*) (writer -> file)) != size) writer -> error = TRUE;
+        return;
+    }
+
+    memcpy(writer -> buffer + writer -> buffer_size, data, size);
+    writer -> buffer_size += size;
+
+    return;
+}
+
+void buffered_printf(BufferedWriter* writer, const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (len < 0 || (size_t) len >= sizeof(text)) {
+        error_print("formatted output too long for the writer\n");
+        writer -> error = TRUE;
+        return;
+    }
+    buffered_write(writer, text, len);
+
+    return;
+}
+
+// Overwrites bytes already written, used for the sizes only known once the content has been streamed
+void patch_buffered_writer(BufferedWriter* writer, unsigned long long int offset, const void* data, size_t size) {
+    flush_buffered_writer(writer);
+    FILE* file = (FILE*) (writer -> file);
+    if (fseek(file, (long) offset, SEEK_SET) != 0 || fwrite(data, sizeof(unsigned char), size, file) != size || fseek(file, 0, SEEK_END) != 0) writer -> error = TRUE;
+    return;
+}
+
+// Returns TRUE if any write failed
+bool close_buffered_writer(BufferedWriter* writer) {
+    flush_buffered_writer(writer);
+    if (fclose((FILE*) (writer -> file)) != 0) writer -> error = TRUE;
+    bool error = writer -> error;
+    debug_print(YELLOW, "wrote %llu bytes\n", writer -> written);
+    gltf_free(writer -> buffer);
+    gltf_free(writer);
+    return error;
+}
+
+bool open_file_watcher(FileWatcher* watcher, const char* directory) {
+    *watcher = (FileWatcher) { .descriptor = -1, .directory = gltf_strdup(directory), .allocator = get_allocator() };
+#ifdef __linux__
+    watcher -> descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher -> descriptor < 0) {
+        error_print("unable to create the file watcher, cause: %s\n", strerror(errno));
+        return TRUE;
+    }
+    return FALSE;
+#else
+    error_print("file watching needs inotify\n");
+    return TRUE;
+#endif //__linux__
+}
+
+// Adds the file to the watched ones, the arrays are grown one at a time and keep their old size on failure
+static bool add_watched_file(FileWatcher* watcher, const char* file_path) {
+    char** files = (char**) gltf_realloc(watcher -> files, sizeof(char*) * (watcher -> files_count + 1));
+    if (files == NULL) return TRUE;
+    watcher -> files = files;
+
+    bool* changed_files = (bool*) gltf_realloc(watcher -> changed_files, sizeof(bool) * (watcher -> files_count + 1));
+    if (changed_files == NULL) return TRUE;
+    watcher -> changed_files = changed_files;
+
+    char* file = gltf_strdup(file_path);
+    if (file == NULL) return TRUE;
+    (watcher -> files)[watcher -> files_count] = file;
+    (watcher -> changed_files)[(watcher -> files_count)++] = FALSE;
+
+    return FALSE;
+}
+
+static bool add_watched_directory(FileWatcher* watcher, char* directory, int watch) {
+    char** watched_directories = (char**) gltf_realloc(watcher -> watched_directories, sizeof(char*) * (watcher -> watches_count + 1));
+    if (watched_directories == NULL) return TRUE;
+    watcher -> watched_directories = watched_directories;
+
+    int* watches = (int*) gltf_realloc(watcher -> watches, sizeof(int) * (watcher -> watches_count + 1));
+    if (watches == NULL) return TRUE;
+    watcher -> watches = watches;
+
+    (watcher -> watched_directories)[watcher -> watches_count] = directory;
+    (watcher -> watches)[(watcher -> watches_count)++] = watch;
+
+    return FALSE;
+}
+
+// Watches the directory holding the file as well, editors often replace files instead of writing them in place
+bool watch_file(FileWatcher* watcher, const char* file_path) {
+    for (unsigned int i = 0; i < watcher -> files_count; ++i) {
+        if (!strcmp((watcher -> files)[i], file_path)) return FALSE;
+    }
+
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&(watcher -> allocator));
+    if (add_watched_file(watcher, file_path)) {
+        set_allocator(&previous_allocator);
+        return TRUE;
+    }
+
+    const char* separator = strrchr(file_path, '/');
+    unsigned int directory_len = (separator != NULL) ? (unsigned int) (separator - file_path + 1) : 0;
+    for (unsigned int i = 0; i < watcher -> watches_count; ++i) {
+        if (strlen((watcher -> watched_directories)[i]) != directory_len || strncmp((watcher -> watched_directories)[i], file_path, directory_len)) continue;
+        set_allocator(&previous_allocator);
+        return FALSE;
+    }
+
+    char* directory = (char*) gltf_calloc(directory_len + 1, sizeof(char));
+    if (directory == NULL) {
+        set_allocator(&previous_allocator);
+        return TRUE;
+    }
+    memcpy(directory, file_path, directory_len);
+#ifdef __linux__
+    size_t path_len = strlen(watcher -> directory) + directory_len + 2;
+    char* path = (char*) gltf_calloc(path_len, sizeof(char));
+    int watch = -1;
+    if (path != NULL) {
+        snprintf(path, path_len, "%s%s", watcher -> directory, (directory_len > 0) ? directory : ".");
+        watch = (watcher -> descriptor >= 0) ? inotify_add_watch(watcher -> descriptor, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) : -1;
+        if (watch < 0) error_print("unable to watch %s, cause: %s\n", path, strerror(errno));
+    }
+    gltf_free(path);
+#else
+    int watch = -1;
+#endif //__linux__
+    if (watch < 0 || add_watched_directory(watcher, directory, watch)) {
+#ifdef __linux__
+        if (watch >= 0) inotify_rm_watch(watcher -> descriptor, watch);
+#endif //__linux__
+        gltf_free(directory);
+        set_allocator(&previous_allocator);
+        return TRUE;
+    }
+    set_allocator(&previous_allocator);
+
+    return FALSE;
+}
+
+// Waits up to timeout_ms for events, then drains them without blocking. Returns the count of changed files
+// still to be reloaded, events on unwatched files are ignored.
+unsigned int poll_file_watcher(FileWatcher* watcher, int timeout_ms) {
+#ifdef __linux__
+    struct pollfd poll_descriptor = { .fd = watcher -> descriptor, .events = POLLIN };
+    if (watcher -> descriptor >= 0 && poll(&poll_descriptor, 1, timeout_ms) > 0) {
+        // Aligned as inotify_event, several events are packed in each read
+        unsigned long long int events[WATCHER_EVENTS_CAPACITY / sizeof(unsigned long long int)];
+        ssize_t size = 0;
+        while ((size = read(watcher -> descriptor, events, sizeof(events))) > 0) {
+            for (ssize_t offset = 0; offset < size;) {
+                const struct inotify_event* event = (const struct inotify_event*) ((unsigned char*) events + offset);
+                offset += sizeof(struct inotify_event) + event -> len;
+                const char* directory = NULL;
+                for (unsigned int i = 0; i < watcher -> watches_count && directory == NULL; ++i) {
+                    if ((watcher -> watches)[i] == event -> wd) directory = (watcher -> watched_directories)[i];
+                }
+                if (directory == NULL || event -> len == 0) continue;
+
+                size_t directory_len = strlen(directory);
+                for (unsigned int i = 0; i < watcher -> files_count; ++i) {
+                    const char* file = (watcher -> files)[i];
+                    if (!strncmp(file, directory, directory_len) && !strcmp(file + directory_len, event -> name)) (watcher -> changed_files)[i] = TRUE;
+                }
+            }
+        }
+    }
+#else
+    NOT_USED(timeout_ms);
+#endif //__linux__
+
+    unsigned int changed_count = 0;
+    for (unsigned int i = 0; i < watcher -> files_count; ++i) changed_count += (watcher -> changed_files)[i];
+
+    return changed_count;
+}
+
+// Files never watched are new to the scene, so they count as changed, as everything does without a watcher
+bool is_file_changed(FileWatcher* watcher, const char* file_path) {
+    if (watcher == NULL || watcher -> descriptor < 0) return TRUE;
+    for (unsigned int i = 0; i < watcher -> files_count; ++i) {
+        if (!strcmp((watcher -> files)[i], file_path)) return (watcher -> changed_files)[i];
+    }
+    return TRUE;
+}
+
+void clear_file_changes(FileWatcher* watcher) {
+    for (unsigned int i = 0; i < watcher -> files_count; ++i) (watcher -> changed_files)[i] = FALSE;
+    return;
+}
+
+void close_file_watcher(FileWatcher* watcher) {
+#ifdef __linux__
+    if (watcher -> descriptor >= 0) close(watcher -> descriptor);
+#endif //__linux__
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&(watcher -> allocator));
+    for (unsigned int i = 0; i < watcher -> files_count; ++i) gltf_free((watcher -> files)[i]);
+    for (unsigned int i = 0; i < watcher -> watches_count; ++i) gltf_free((watcher -> watched_directories)[i]);
+    gltf_free(watcher -> files);
+    gltf_free(watcher -> changed_files);
+    gltf_free(watcher -> watched_directories);
+    gltf_free(watcher -> watches);
+    gltf_free(watcher -> directory);
+    *watcher = (FileWatcher) { .descriptor = -1 };
+    set_allocator(&previous_allocator);
     return;
 }
 
@@ -1,14 +1,39 @@
 #ifdef _GLTF_LIB_
 
+#include "./allocator.h"
 #include "./bitstream.h"
 #include "./debug_print.h"
+#include "./accessor_kernels.h"
 #include "./file_io.h"
+#include "./scene.h"
+#include "./animation.h"
+#include "./skinning.h"
+#include "./morph.h"
+#include "./bounds.h"
+#include "./mesh_optimizer.h"
+#include "./simplify.h"
+#include "./tangents.h"
+#include "./index_buffer.h"
+#include "./meshlets.h"
+#include "./vertex_format.h"
+#include "./instancing.h"
+#include "./bvh.h"
+#include "./png.h"
+#include "./ktx2.h"
+#include "./gltf_writer.h"
+#include "./buffer_cache.h"
 #include "./types.h"
 #include "./utils.h"
 #include "./gltf_loader.h"
 
 static void append_obj(Object* parent_obj, Object obj) {
-    parent_obj -> children = (Object*) realloc(parent_obj -> children, sizeof(Object) * (parent_obj -> children_count + 1));
+    // A child that can't be appended is released, the parse stops on the allocation failure
+    Object* children = (Object*) gltf_realloc(parent_obj -> children, sizeof(Object) * (parent_obj -> children_count + 1));
+    if (children == NULL) {
+        deallocate_object(&obj);
+        return;
+    }
+    parent_obj -> children = children;
     (parent_obj -> children)[parent_obj -> children_count] = obj;
     (parent_obj -> children)[parent_obj -> children_count].parent = parent_obj;
     (parent_obj -> children_count)++;
@@ -18,7 +43,7 @@ static void append_obj(Object* parent_obj, Object obj) {
 static ObjectType get_obj_type(BitStream* bit_stream) {
     ObjectType obj_type;
 
-    read_until(bit_stream, "\"-0123456789{[", NULL);
+    read_until(bit_stream, "\"-0123456789{[tfn]", NULL);
 
     switch (bit_stream -> current_byte) {
         case '\"': {
@@ -48,11 +73,22 @@ static ObjectType get_obj_type(BitStream* bit_stream) {
         case '8':
         case '9': {
             obj_type = NUMBER;
-            skip_back(bit_stream, 2);
+            break;
+        }
+
+        case 't':
+        case 'f': {
+            obj_type = BOOLEAN;
+            break;
+        }
+
+        case 'n': {
+            obj_type = NULL_OBJECT;
             break;
         }
         
         default: {
+            // Also returned on the closing bracket of an empty array
             obj_type = INVALID_OBJECT;
             break;
         }
@@ -61,33 +97,87 @@ static ObjectType get_obj_type(BitStream* bit_stream) {
     return obj_type;
 }
 
+static void read_scalar(BitStream* bit_stream, Object* obj) {
+    // The first character of the literal has already been consumed by get_obj_type
+    const char* start = (const char*) (bit_stream -> stream + bit_stream -> byte - 1);
+    const char* end = (const char*) (bit_stream -> stream + bit_stream -> size);
+    const char* literal_end = start;
+
+    if (obj -> obj_type == NUMBER) {
+        literal_end = parse_number(start, end, &(obj -> integer), &(obj -> real), &(obj -> is_integer));
+        if (literal_end == NULL) {
+            bool out_of_memory = has_allocation_failed();
+            if (!out_of_memory) error_print("invalid number at byte %u\n", bit_stream -> byte);
+            bit_stream -> error = out_of_memory ? OUT_OF_MEMORY : INVALID_LITERAL;
+            literal_end = start + 1;
+        }
+    } else {
+        // Keywords must be spelled out whole and followed by a delimiter, not just start with the right letter
+        const char* keyword = (obj -> obj_type == NULL_OBJECT) ? "null" : ((*start == 't') ? "true" : "false");
+        unsigned int keyword_size = (unsigned int) strlen(keyword);
+        obj -> boolean = (*start == 't');
+        literal_end = start + keyword_size;
+        bool matches = (literal_end <= end && !strncmp(start, keyword, keyword_size));
+        if (matches && literal_end < end && ((*literal_end | 0x20) >= 'a' && (*literal_end | 0x20) <= 'z')) matches = FALSE;
+        if (!matches) {
+            error_print("invalid literal at byte %u, expected '%s'\n", bit_stream -> byte, keyword);
+            bit_stream -> error = INVALID_LITERAL;
+            literal_end = (literal_end > end) ? end : literal_end;
+        }
+    }
+
+    if (literal_end > end) {
+        error_print("truncated literal at byte %u\n", bit_stream -> byte);
+        bit_stream -> error = EXCEEDED_LENGTH;
+        literal_end = end;
+    }
+
+    bit_stream -> byte = (unsigned int) ((unsigned char*) literal_end - bit_stream -> stream);
+    bit_stream -> current_byte = literal_end[-1];
+
+    return;
+}
+
+static void read_value(BitStream* bit_stream, Object* obj) {
+    if (obj -> obj_type == ARRAY) {
+        obj -> children = (Object*) gltf_calloc(1, sizeof(Object));
+        read_array(bit_stream, obj);
+    } else if (obj -> obj_type == DICTIONARY) {
+        obj -> children = (Object*) gltf_calloc(1, sizeof(Object));
+        read_dictionary(bit_stream, obj);
+    } else if (obj -> obj_type == STRING) {
+        obj -> value = gltf_calloc(350, sizeof(char));
+        read_until(bit_stream, "\"", (char**) &(obj -> value));
+    } else if (obj -> obj_type != INVALID_OBJECT) {
+        read_scalar(bit_stream, obj);
+    } else {
+        error_print("Invalid object type: %s.\n", objs_types[obj -> obj_type]);
+        bit_stream -> error = EXCEEDED_LENGTH;
+    }
+
+    return;
+}
+
 static void read_array(BitStream* bit_stream, Object* objects) {
-    // We can find a collection of dictionary, numbers or strings
-    ObjectType collection_type = get_obj_type(bit_stream);
-
-    if (collection_type == NUMBER || collection_type == STRING) {
-        while (bit_stream -> current_byte != ']') {
-            if (bit_stream -> error) return;
-            Object child_obj = (Object) { .children = NULL, .children_count = 0, .parent = objects, .identifier = NULL, .obj_type = collection_type };
-            child_obj.value = calloc(350, sizeof(char));
-            read_until(bit_stream, ",]", (char**) &(child_obj.value));
-            strip((char**) &(child_obj.value));
-            append_obj(objects, child_obj);
-        }
-    } else if (collection_type == DICTIONARY || collection_type == ARRAY) {
-        while (bit_stream -> current_byte != ']') {
-            if (bit_stream -> error) return;
-            char* child = (char*) calloc(350, sizeof(char));
+    // Each element is classified on its own, as arrays can mix dictionaries, arrays, strings and scalars
+    while (!(bit_stream -> error) && !has_allocation_failed()) {
+        ObjectType element_type = get_obj_type(bit_stream);
+        if (element_type == INVALID_OBJECT && bit_stream -> current_byte == ']') return;
+
+        Object child_obj = (Object) { .children = NULL, .children_count = 0, .parent = objects, .identifier = NULL, .obj_type = element_type };
+        if (element_type == DICTIONARY || element_type == ARRAY) {
+            char* child = (char*) gltf_calloc(350, sizeof(char));
+            if (child == NULL) return;
             int len = snprintf(child, 350, "%s child-%u", objects -> identifier, objects -> children_count);
-            child = (char*) realloc(child, sizeof(char) * (len + 1));
-            Object child_obj = (Object) { .children = NULL, .children_count = 0, .parent = objects, .identifier = child, .obj_type = collection_type };
-            if (collection_type == DICTIONARY) read_dictionary(bit_stream, &child_obj);
-            else read_array(bit_stream, &child_obj);
-            read_until(bit_stream, ",]", NULL);
-            append_obj(objects, child_obj);
+            child_obj.identifier = (char*) gltf_realloc(child, sizeof(char) * (len + 1));
+            if (child_obj.identifier == NULL) child_obj.identifier = child;
         }
-    } else {
-        error_print("Invalid object type: %s.\n", objs_types[collection_type]);
+
+        read_value(bit_stream, &child_obj);
+        append_obj(objects, child_obj);
+
+        read_until(bit_stream, ",]", NULL);
+        if (bit_stream -> current_byte == ']') return;
     }
 
     return;
@@ -95,7 +185,9 @@ static void read_array(BitStream* bit_stream, Object* objects) {
 
 static void read_dictionary(BitStream* bit_stream, Object* objects) {
     while (bit_stream -> current_byte != '}') {
-        if (bit_stream -> error) return;
+        if (bit_stream -> error || has_allocation_failed()) return;
+        read_until(bit_stream, "\"}", NULL);
+        if (bit_stream -> current_byte == '}') return;
         read_identifier(bit_stream, objects);
         read_until(bit_stream, ",}", NULL);
     }
@@ -104,30 +196,74 @@ static void read_dictionary(BitStream* bit_stream, Object* objects) {
 
 static void read_identifier(BitStream* bit_stream, Object* objects) {
     Object current_object = (Object) { .children = NULL, .children_count = 0, .parent = objects, .value = NULL };
-    read_until(bit_stream, "\"", NULL);
-    current_object.identifier = (char*) calloc(350, sizeof(char));
+    current_object.identifier = (char*) gltf_calloc(350, sizeof(char));
     read_until(bit_stream, "\"", (char**) &(current_object.identifier));
+    if (current_object.identifier == NULL) return;
 
     current_object.obj_type = get_obj_type(bit_stream);
+    current_object.raw = (const char*) (bit_stream -> stream + bit_stream -> byte - 1);
+    if (current_object.obj_type != INVALID_OBJECT && is_raw_member(objects, current_object.identifier)) skip_raw_value(bit_stream, &current_object);
+    else read_value(bit_stream, &current_object);
+    current_object.raw_size = (unsigned int) ((const char*) (bit_stream -> stream + bit_stream -> byte) - current_object.raw);
+
+    append_obj(objects, current_object);
+
+    return;
+}
+
+// Extras and the extensions the loader doesn't read are only skipped, callers parse them from their raw text
+static const char* decoded_extensions[] = { "KHR_texture_basisu", "EXT_mesh_gpu_instancing" };
+
+static bool is_raw_member(Object* objects, char* identifier) {
+    if (!strcmp(identifier, "extras")) return TRUE;
+    if (objects -> identifier == NULL || strcmp(objects -> identifier, "extensions")) return FALSE;
+    for (unsigned int i = 0; i < sizeof(decoded_extensions) / sizeof(decoded_extensions[0]); ++i) {
+        if (!strcmp(identifier, decoded_extensions[i])) return FALSE;
+    }
+    return TRUE;
+}
 
-    if (current_object.obj_type == ARRAY) {
-        current_object.children = (Object*) calloc(1, sizeof(Object));
-        read_array(bit_stream, &current_object);
-    } else if (current_object.obj_type == DICTIONARY) {
-        current_object.children = (Object*) calloc(1, sizeof(Object));
-        read_dictionary(bit_stream, &current_object);
-    } else if (current_object.obj_type == STRING) {
-        current_object.value = calloc(350, sizeof(char));
-        read_until(bit_stream, "\"", (char**) &(current_object.value));
-        skip_back(bit_stream, 1);
-    } else if (current_object.obj_type == NUMBER) {
-        current_object.value = calloc(350, sizeof(char));
-        read_until(bit_stream, ",\n", (char**) &(current_object.value));
-        strip((char**) &(current_object.value));
-        skip_back(bit_stream, 1);
+// The first character of the value has already been consumed by get_obj_type, the scan only matches the brackets
+// and jumps over the strings, without decoding or allocating anything
+static void skip_raw_value(BitStream* bit_stream, Object* obj) {
+    const unsigned char* cursor = bit_stream -> stream + bit_stream -> byte;
+    const unsigned char* end = bit_stream -> stream + bit_stream -> size;
+    unsigned int depth = (obj -> obj_type == DICTIONARY || obj -> obj_type == ARRAY) ? 1 : 0;
+    bool in_string = (obj -> obj_type == STRING);
+
+    if (depth == 0 && !in_string) {
+        while (cursor < end && !is_contained(*cursor, (unsigned char*) ",}] \t\r\n", 7)) cursor++;
     }
 
-    append_obj(objects, current_object);
+    while (cursor < end && (depth > 0 || in_string)) {
+        if (in_string) {
+            // A quote closes the string unless an odd number of backslashes escapes it
+            const unsigned char* quote = (const unsigned char*) memchr(cursor, '"', end - cursor);
+            if (quote == NULL) {
+                cursor = end;
+                break;
+            }
+            unsigned int backslashes = 0;
+            while (quote - backslashes > cursor && *(quote - backslashes - 1) == '\\') backslashes++;
+            in_string = (backslashes % 2 == 1);
+            cursor = quote + 1;
+            continue;
+        }
+
+        unsigned char current = *cursor++;
+        if (current == '"') in_string = TRUE;
+        else if (current == '{' || current == '[') depth++;
+        else if (current == '}' || current == ']') depth--;
+    }
+
+    if (depth > 0 || in_string) {
+        error_print("truncated value at byte %u\n", bit_stream -> byte);
+        bit_stream -> error = EXCEEDED_LENGTH;
+    }
+
+    bit_stream -> byte = (unsigned int) (cursor - bit_stream -> stream);
+    bit_stream -> current_byte = cursor[-1];
+    obj -> obj_type = RAW_OBJECT;
 
     return;
 }
@@ -136,7 +272,7 @@ static Object* get_object_from_identifier(char* identifier, Object* object) {
     Object* obj = object -> children;
 
     for (unsigned int child_count = 0; child_count < object -> children_count; ++obj, ++child_count) {
-        if (!strcmp(obj -> identifier, identifier)) {
+        if (obj -> identifier != NULL && !strcmp(obj -> identifier, identifier)) {
             return obj;
         }
     }
@@ -146,32 +282,37 @@ static Object* get_object_from_identifier(char* identifier, Object* object) {
 
 static Object* get_object_by_id(char* id, Object* main_object, bool print_warning) {
     Object* object = main_object;
-    BitStream* bit_stream = allocate_bit_stream((unsigned char*) id, strlen(id) + 1, FALSE);
 
-    while (bit_stream -> byte < bit_stream -> size - 1) {
+    // The path is walked in place, so that lookups never allocate
+    const char* segment = id;
+    while (*segment != '\0') {
         int index = -1;
-        char* identifier = (char*) calloc(350, sizeof(char));
-        read_until(bit_stream, "/[", &identifier);
-
-        if (bit_stream -> current_byte == '[') {
-            char* str_index = (char*) calloc(25, sizeof(char));
-            read_until(bit_stream, "]", &str_index);
-            get_next_byte(bit_stream); // Skip the '/' symbol
-            index = atoi(str_index);
-            free(str_index);
+        char identifier[350] = {0};
+        size_t identifier_size = strcspn(segment, "/[");
+        snprintf(identifier, sizeof(identifier), "%.*s", (int) identifier_size, segment);
+        segment += identifier_size;
+
+        if (*segment == '[') {
+            index = atoi(segment + 1);
+            segment += strcspn(segment, "]");
+            if (*segment == ']') segment++;
         }
+        if (*segment == '/') segment++;
         
         object = get_object_from_identifier(identifier, object);
         if (object == NULL) {
-            if (print_warning) debug_print(CYAN, "object not found...\n");
-            free(identifier);
+            if (print_warning) debug_print(CYAN, "object '%s' not found...\n", id);
             return NULL;
-        } else if (index != -1) object = object -> children + index;
-        
-        free(identifier);
+        } else if (index != -1) {
+            if ((unsigned int) index >= object -> children_count) {
+                if (print_warning) debug_print(CYAN, "index out of range in '%s'\n", id);
+                return NULL;
+            }
+            object = object -> children + index;
+        }
     }
 
-    if (object -> value == NULL && object -> children_count == 0) {
+    if ((object -> obj_type == STRING && object -> value == NULL) || ((object -> obj_type == ARRAY || object -> obj_type == DICTIONARY) && object -> children_count == 0)) {
         debug_print(CYAN, "invalid index\n");
         return NULL;
     }
@@ -184,29 +325,82 @@ static void* get_array(Object* arr_obj, bool use_float) {
         return NULL;
     }
 
-    void* arr = calloc(arr_obj -> children_count, sizeof(unsigned int));
-    for (unsigned int i = 0; i < arr_obj -> children_count; ++i) {
-        if (use_float) ((float*) arr)[i] = (float) atof((char*) ((arr_obj -> children)[i].value));
-        else ((unsigned int*) arr)[i] = atoi((char*) ((arr_obj -> children)[i].value));
+    void* arr = gltf_calloc(arr_obj -> children_count, sizeof(unsigned int));
+    for (unsigned int i = 0; arr != NULL && i < arr_obj -> children_count; ++i) {
+        if (use_float) ((float*) arr)[i] = (float) get_real(arr_obj -> children + i, 0.0);
+        else ((unsigned int*) arr)[i] = (unsigned int) get_integer(arr_obj -> children + i, 0);
     }
     
     return arr;
 }
 
-static void* get_value(Object* obj) {
-    if (obj == NULL) return NULL;
-    return obj -> value;
+static long long int get_integer(Object* obj, long long int default_value) {
+    if (obj == NULL || obj -> obj_type != NUMBER) return default_value;
+    return obj -> is_integer ? obj -> integer : (long long int) obj -> real;
 }
 
+static double get_real(Object* obj, double default_value) {
+    if (obj == NULL || obj -> obj_type != NUMBER) return default_value;
+    return obj -> real;
+}
+
+static bool get_boolean(Object* obj, bool default_value) {
+    if (obj == NULL || obj -> obj_type != BOOLEAN) return default_value;
+    return obj -> boolean;
+}
 
-static Node create_node(Object* nodes_obj, unsigned int node_index) {
+// Accessors are deinterleaved into the component arrays, with a plain copy loop for the float ones
+static void decode_instances(Array accessors, Object* node_obj, Instances* instances) {
+    Object* attributes_obj = get_object_by_id("extensions/EXT_mesh_gpu_instancing/attributes", node_obj, FALSE);
+    if (attributes_obj == NULL) return;
+
+    char* names[] = { "TRANSLATION", "ROTATION", "SCALE" };
+    unsigned char components_count[] = { 3, 4, 3 };
+    Accessor* attributes[3] = {0};
+    unsigned int count = 0;
+    for (unsigned char i = 0; i < 3; ++i) {
+        long long int accessor_index = get_integer(get_object_by_id(names[i], attributes_obj, FALSE), -1);
+        if (accessor_index < 0 || (unsigned int) accessor_index >= accessors.count) continue;
+        attributes[i] = GET_ELEMENT(Accessor*, accessors, accessor_index);
+        if (count != 0 && attributes[i] -> elements_count != count) {
+            error_print("instancing attributes with different counts: %u and %u\n", count, attributes[i] -> elements_count);
+            return;
+        }
+        count = attributes[i] -> elements_count;
+    }
+    if (count == 0) return;
+
+    allocate_instances(instances, count);
+    if (instances -> storage == NULL) return;
+    float** components[] = { instances -> translations, instances -> rotations, instances -> scales };
+    for (unsigned char i = 0; i < 3; ++i) {
+        Accessor* accessor = attributes[i];
+        if (accessor == NULL) continue;
+        unsigned char stride = elements_count[accessor -> data_type];
+        if (stride < components_count[i]) continue;
+
+        for (unsigned char c = 0; c < components_count[i]; ++c) read_accessor_floats(accessor, c, stride, count, components[i][c]);
+    }
+
+    return;
+}
+
+static Node create_node(Array accessors, Object* nodes_obj, unsigned int node_index) {
     Node node = {0};
     Object* node_obj = nodes_obj -> children + node_index;
+    node.index = node_index;
+    node.skin_index = get_integer(get_object_by_id("skin", node_obj, FALSE), -1);
+
+    Object* weights_obj = get_object_by_id("weights", node_obj, FALSE);
+    if (weights_obj != NULL) {
+        node.weights = (float*) get_array(weights_obj, TRUE);
+        node.weights_count = (node.weights != NULL) ? weights_obj -> children_count : 0;
+    }
 
     Object* translation_obj = get_object_by_id("translation", node_obj, FALSE);
     if (translation_obj != NULL) {
         for (unsigned char i = 0; i < 3; ++i) {
-            node.translation_vec[i] = atof((char*) ((translation_obj -> children + i) -> value));
+            node.translation_vec[i] = get_real(translation_obj -> children + i, 0.0);
         }
     } else {
         for (unsigned char i = 0; i < 3; ++i) {
@@ -217,7 +411,7 @@ static Node create_node(Object* nodes_obj, unsigned int node_index) {
     Object* rotation_obj = get_object_by_id("rotation", node_obj, FALSE);
     if (rotation_obj != NULL) {
         for (unsigned char i = 0; i < 4; ++i) {
-            node.rotation_quat[i] = atof((char*) ((rotation_obj -> children + i) -> value));
+            node.rotation_quat[i] = get_real(rotation_obj -> children + i, 0.0);
         }
     } else {
         for (unsigned char i = 0; i < 3; ++i) {
@@ -229,7 +423,7 @@ static Node create_node(Object* nodes_obj, unsigned int node_index) {
     Object* scale_obj = get_object_by_id("scale", node_obj, FALSE);
     if (scale_obj != NULL) {
         for (unsigned char i = 0; i < 3; ++i) {
-            node.scale_vec[i] = atof((char*) ((scale_obj -> children + i) -> value));
+            node.scale_vec[i] = get_real(scale_obj -> children + i, 0.0);
         }
     } else {
         for (unsigned char i = 0; i < 3; ++i) {
@@ -240,7 +434,7 @@ static Node create_node(Object* nodes_obj, unsigned int node_index) {
     Object* matrix_obj = get_object_by_id("matrix", node_obj, FALSE);
     if (matrix_obj != NULL) {
         for (unsigned char i = 0; i < 16; ++i) {
-            node.transformation_matrix[i] = atof((char*) ((matrix_obj -> children + i) -> value));
+            node.transformation_matrix[i] = get_real(matrix_obj -> children + i, 0.0);
         }
     } else {
         for (unsigned char i = 0; i < 4; ++i) {
@@ -251,11 +445,11 @@ static Node create_node(Object* nodes_obj, unsigned int node_index) {
     // Decode other children
     Object* node_children = get_object_by_id("children", node_obj, FALSE);
     if (node_children != NULL) {
-        node.children_count = node_children -> children_count;
-        node.childrens = (Node*) calloc(node.children_count, sizeof(Node));
+        node.childrens = (Node*) gltf_calloc(node_children -> children_count, sizeof(Node));
+        node.children_count = (node.childrens != NULL) ? node_children -> children_count : 0;
         for (unsigned int i = 0; i < node.children_count; ++i) {
-            unsigned int child_index = atoi((char*) ((node_children -> children)[i].value));
-            (node.childrens)[i] = create_node(nodes_obj, child_index);
+            unsigned int child_index = get_integer(node_children -> children + i, 0);
+            (node.childrens)[i] = create_node(accessors, nodes_obj, child_index);
         }
     } else {
         node.children_count = 0;
@@ -269,59 +463,490 @@ static Node create_node(Object* nodes_obj, unsigned int node_index) {
         if (meshes -> obj_type == ARRAY) {
             unsigned int meshes_count = meshes -> children_count;
             for (unsigned int i = 0; i < meshes_count; ++i) {
-                unsigned int* mesh_index = (unsigned int*) calloc(1, sizeof(unsigned int));
-                *mesh_index = atoi((char*) ((meshes -> children)[i].value));
-                append_element(&(node.meshes_indices), mesh_index);
+                unsigned int* mesh_index = (unsigned int*) gltf_calloc(1, sizeof(unsigned int));
+                if (mesh_index == NULL) break;
+                *mesh_index = get_integer(meshes -> children + i, 0);
+                if (append_element(&(node.meshes_indices), mesh_index)) gltf_free(mesh_index);
             }
+        } else {
+            unsigned int* mesh_index = (unsigned int*) gltf_calloc(1, sizeof(unsigned int));
+            if (mesh_index != NULL) *mesh_index = get_integer(meshes, 0);
+            if (mesh_index != NULL && append_element(&(node.meshes_indices), mesh_index)) gltf_free(mesh_index);
         }
-        unsigned int* mesh_index = (unsigned int*) calloc(1, sizeof(unsigned int));
-        *mesh_index = atoi((char*) (meshes -> value));
-        append_element(&(node.meshes_indices), mesh_index);
     } else {
         node.meshes_indices = (Array) { .count = 0, .data = NULL };
     }
 
+    decode_instances(accessors, node_obj, &(node.instances));
+
     return node;
 }
 
-static Array decode_buffer_views(Object main_obj, char* path) {
+static void register_nodes(Node* node, Node** nodes_table, unsigned int nodes_count) {
+    for (unsigned int i = 0; i < node -> children_count; ++i) {
+        Node* child = node -> childrens + i;
+        if (child -> index < nodes_count) nodes_table[child -> index] = child;
+        register_nodes(child, nodes_table, nodes_count);
+    }
+    return;
+}
+
+/* Selective loading */
+
+// Returns TRUE the first time an object is selected, so the references are only followed once
+static bool select_object(LoadSelection* selection, SelectionKind kind, long long int index) {
+    if (index < 0 || (unsigned long long int) index >= selection -> counts[kind] || (selection -> selected[kind])[index]) return FALSE;
+    (selection -> selected[kind])[index] = TRUE;
+    return TRUE;
+}
+
+// Without a selection everything is loaded
+static bool is_selected(LoadSelection* selection, SelectionKind kind, unsigned int index) {
+    return selection == NULL || (index < selection -> counts[kind] && (selection -> selected[kind])[index]);
+}
+
+static void select_node(Object* nodes_obj, unsigned int node_index, LoadSelection* selection) {
+    if (!select_object(selection, SELECT_NODES, node_index)) return;
+    Object* node_obj = nodes_obj -> children + node_index;
+    select_object(selection, SELECT_MESHES, get_integer(get_object_by_id("mesh", node_obj, FALSE), -1));
+    select_object(selection, SELECT_SKINS, get_integer(get_object_by_id("skin", node_obj, FALSE), -1));
+
+    Object* instancing_obj = get_object_by_id("extensions/EXT_mesh_gpu_instancing/attributes", node_obj, FALSE);
+    for (unsigned int i = 0; instancing_obj != NULL && i < instancing_obj -> children_count; ++i) select_object(selection, SELECT_ACCESSORS, get_integer(instancing_obj -> children + i, -1));
+
+    Object* children_obj = get_object_by_id("children", node_obj, FALSE);
+    for (unsigned int i = 0; children_obj != NULL && i < children_obj -> children_count; ++i) select_node(nodes_obj, get_integer(children_obj -> children + i, 0), selection);
+
+    return;
+}
+
+static void append_accessor(long long int** accessors, unsigned int* accessors_count, Object* accessor_obj) {
+    if (accessor_obj == NULL) return;
+    long long int* grown_accessors = (long long int*) gltf_realloc(*accessors, sizeof(long long int) * (*accessors_count + 1));
+    if (grown_accessors == NULL) return;
+    *accessors = grown_accessors;
+    (*accessors)[(*accessors_count)++] = get_integer(accessor_obj, -1);
+    return;
+}
+
+// Indices, attributes and morph targets accessors of every primitive, in order and possibly repeated
+static unsigned int get_mesh_accessors(Object* mesh_obj, long long int** accessors) {
+    unsigned int accessors_count = 0;
+    *accessors = (long long int*) gltf_calloc(1, sizeof(long long int));
+    Object* primitives_obj = get_object_by_id("primitives", mesh_obj, FALSE);
+    for (unsigned int i = 0; primitives_obj != NULL && i < primitives_obj -> children_count; ++i) {
+        Object* primitive_obj = primitives_obj -> children + i;
+        append_accessor(accessors, &accessors_count, get_object_by_id("indices", primitive_obj, FALSE));
+        Object* attributes_obj = get_object_by_id("attributes", primitive_obj, FALSE);
+        for (unsigned int j = 0; attributes_obj != NULL && j < attributes_obj -> children_count; ++j) append_accessor(accessors, &accessors_count, attributes_obj -> children + j);
+        Object* targets_obj = get_object_by_id("targets", primitive_obj, FALSE);
+        for (unsigned int j = 0; targets_obj != NULL && j < targets_obj -> children_count; ++j) {
+            for (unsigned int k = 0; k < targets_obj -> children[j].children_count; ++k) append_accessor(accessors, &accessors_count, targets_obj -> children[j].children + k);
+        }
+    }
+    return accessors_count;
+}
+
+// Follows the references from the nodes under the roots down to the buffers: each kind only refers to the
+// following ones, so a single pass per kind in this order reaches everything. Without roots every node, mesh,
+// skin, material and texture is selected. The skipped meshes keep their materials but not their accessors,
+// and are left unselected.
+static LoadSelection* select_reachable_objects(Object main_obj, unsigned int* roots, unsigned int roots_count, bool* skipped_meshes) {
+    char* kind_names[SELECTION_KINDS] = { "nodes", "meshes", "skins", "materials", "textures", "images", "animations", "accessors", "bufferViews", "buffers" };
+    LoadSelection* selection = (LoadSelection*) gltf_calloc(1, sizeof(LoadSelection));
+    if (selection == NULL) return NULL;
+    Object* objects[SELECTION_KINDS] = {0};
+    for (unsigned char i = 0; i < SELECTION_KINDS; ++i) {
+        objects[i] = get_object_by_id(kind_names[i], &main_obj, FALSE);
+        selection -> counts[i] = (objects[i] != NULL) ? objects[i] -> children_count : 0;
+        selection -> selected[i] = (bool*) gltf_calloc(selection -> counts[i] + 1, sizeof(bool));
+    }
+    if (has_allocation_failed()) {
+        deallocate_selection(selection);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; roots != NULL && i < roots_count; ++i) {
+        if (roots[i] < selection -> counts[SELECT_NODES]) select_node(objects[SELECT_NODES], roots[i], selection);
+    }
+
+    for (unsigned int i = 0; roots == NULL && i < selection -> counts[SELECT_NODES]; ++i) select_node(objects[SELECT_NODES], i, selection);
+    for (unsigned char kind = SELECT_MESHES; roots == NULL && kind <= SELECT_TEXTURES; ++kind) {
+        for (unsigned int i = 0; i < selection -> counts[kind]; ++i) select_object(selection, (SelectionKind) kind, i);
+    }
+
+    for (unsigned int i = 0; i < selection -> counts[SELECT_MESHES]; ++i) {
+        if (!(selection -> selected[SELECT_MESHES])[i]) continue;
+        Object* primitives_obj = get_object_by_id("primitives", objects[SELECT_MESHES] -> children + i, FALSE);
+        for (unsigned int j = 0; primitives_obj != NULL && j < primitives_obj -> children_count; ++j) select_object(selection, SELECT_MATERIALS, get_integer(get_object_by_id("material", primitives_obj -> children + j, FALSE), -1));
+        if (skipped_meshes != NULL && skipped_meshes[i]) {
+            (selection -> selected[SELECT_MESHES])[i] = FALSE;
+            continue;
+        }
+
+        long long int* accessors = NULL;
+        unsigned int accessors_count = get_mesh_accessors(objects[SELECT_MESHES] -> children + i, &accessors);
+        for (unsigned int j = 0; j < accessors_count; ++j) select_object(selection, SELECT_ACCESSORS, accessors[j]);
+        gltf_free(accessors);
+    }
+
+    for (unsigned int i = 0; i < selection -> counts[SELECT_SKINS]; ++i) {
+        if ((selection -> selected[SELECT_SKINS])[i]) select_object(selection, SELECT_ACCESSORS, get_integer(get_object_by_id("inverseBindMatrices", objects[SELECT_SKINS] -> children + i, FALSE), -1));
+    }
+
+    char* texture_ids[] = { "pbrMetallicRoughness/baseColorTexture/index", "pbrMetallicRoughness/metallicRoughnessTexture/index", "normalTexture/index", "occlusionTexture/index", "emissiveTexture/index" };
+    for (unsigned int i = 0; i < selection -> counts[SELECT_MATERIALS]; ++i) {
+        if (!(selection -> selected[SELECT_MATERIALS])[i]) continue;
+        for (unsigned char j = 0; j < sizeof(texture_ids) / sizeof(texture_ids[0]); ++j) select_object(selection, SELECT_TEXTURES, get_integer(get_object_by_id(texture_ids[j], objects[SELECT_MATERIALS] -> children + i, FALSE), -1));
+    }
+
+    // Same source as collect_textures, the KTX2 one when present
+    for (unsigned int i = 0; i < selection -> counts[SELECT_TEXTURES]; ++i) {
+        if (!(selection -> selected[SELECT_TEXTURES])[i]) continue;
+        Object* source_obj = get_object_by_id("extensions/KHR_texture_basisu/source", objects[SELECT_TEXTURES] -> children + i, FALSE);
+        if (source_obj == NULL) source_obj = get_object_by_id("source", objects[SELECT_TEXTURES] -> children + i, FALSE);
+        select_object(selection, SELECT_IMAGES, get_integer(source_obj, -1));
+    }
+
+    for (unsigned int i = 0; i < selection -> counts[SELECT_IMAGES]; ++i) {
+        if ((selection -> selected[SELECT_IMAGES])[i]) select_object(selection, SELECT_BUFFER_VIEWS, get_integer(get_object_by_id("bufferView", objects[SELECT_IMAGES] -> children + i, FALSE), -1));
+    }
+
+    // Animations are kept when they drive any of the loaded nodes
+    for (unsigned int i = 0; i < selection -> counts[SELECT_ANIMATIONS]; ++i) {
+        Object* animation_obj = objects[SELECT_ANIMATIONS] -> children + i;
+        Object* channels_obj = get_object_by_id("channels", animation_obj, FALSE);
+        bool animates_selection = FALSE;
+        for (unsigned int j = 0; channels_obj != NULL && j < channels_obj -> children_count && !animates_selection; ++j) {
+            Object* target_node_obj = get_object_by_id("target/node", channels_obj -> children + j, FALSE);
+            animates_selection = (target_node_obj != NULL && is_selected(selection, SELECT_NODES, get_integer(target_node_obj, 0)));
+        }
+        if (!animates_selection) continue;
+
+        select_object(selection, SELECT_ANIMATIONS, i);
+        Object* samplers_obj = get_object_by_id("samplers", animation_obj, FALSE);
+        for (unsigned int j = 0; samplers_obj != NULL && j < samplers_obj -> children_count; ++j) {
+            select_object(selection, SELECT_ACCESSORS, get_integer(get_object_by_id("input", samplers_obj -> children + j, FALSE), -1));
+            select_object(selection, SELECT_ACCESSORS, get_integer(get_object_by_id("output", samplers_obj -> children + j, FALSE), -1));
+        }
+    }
+
+    for (unsigned int i = 0; i < selection -> counts[SELECT_ACCESSORS]; ++i) {
+        if (!(selection -> selected[SELECT_ACCESSORS])[i]) continue;
+        Object* accessor_obj = objects[SELECT_ACCESSORS] -> children + i;
+        select_object(selection, SELECT_BUFFER_VIEWS, get_integer(get_object_by_id("bufferView", accessor_obj, FALSE), -1));
+        select_object(selection, SELECT_BUFFER_VIEWS, get_integer(get_object_by_id("sparse/indices/bufferView", accessor_obj, FALSE), -1));
+        select_object(selection, SELECT_BUFFER_VIEWS, get_integer(get_object_by_id("sparse/values/bufferView", accessor_obj, FALSE), -1));
+    }
+
+    for (unsigned int i = 0; i < selection -> counts[SELECT_BUFFER_VIEWS]; ++i) {
+        if ((selection -> selected[SELECT_BUFFER_VIEWS])[i]) select_object(selection, SELECT_BUFFERS, get_integer(get_object_by_id("buffer", objects[SELECT_BUFFER_VIEWS] -> children + i, FALSE), 0));
+    }
+
+    return selection;
+}
+
+static void deallocate_selection(LoadSelection* selection) {
+    if (selection == NULL) return;
+    for (unsigned char i = 0; i < SELECTION_KINDS; ++i) gltf_free(selection -> selected[i]);
+    gltf_free(selection);
+    return;
+}
+
+/* Reloading */
+
+// The identifiers of array elements hold their index, so only the dictionary keys are hashed
+static unsigned long long int hash_object(Object* obj, unsigned long long int hash) {
+    if (obj == NULL) return hash_data((const unsigned char*) "", 1, hash);
+    hash = hash_data((const unsigned char*) &(obj -> obj_type), sizeof(ObjectType), hash);
+    if (obj -> obj_type == STRING) hash = hash_data((const unsigned char*) obj -> value, strlen((char*) (obj -> value)) + 1, hash);
+    else if (obj -> obj_type == NUMBER) hash = hash_data((const unsigned char*) &(obj -> real), sizeof(double), hash_data((const unsigned char*) &(obj -> integer), sizeof(long long int), hash));
+    else if (obj -> obj_type == BOOLEAN) hash = hash_data(&(obj -> boolean), sizeof(bool), hash);
+    else if (obj -> obj_type == RAW_OBJECT) hash = hash_data((const unsigned char*) obj -> raw, obj -> raw_size, hash);
+
+    for (unsigned int i = 0; i < obj -> children_count; ++i) {
+        if (obj -> obj_type == DICTIONARY) hash = hash_data((const unsigned char*) obj -> children[i].identifier, strlen(obj -> children[i].identifier) + 1, hash);
+        hash = hash_object(obj -> children + i, hash);
+    }
+
+    return hash;
+}
+
+// Buffer views read by the accessor, -1 for the missing ones
+static void get_accessor_views(Object* accessors_obj, long long int accessor_index, long long int views[3]) {
+    Object* accessor_obj = (accessors_obj != NULL && accessor_index >= 0 && accessor_index < accessors_obj -> children_count) ? accessors_obj -> children + accessor_index : NULL;
+    views[0] = get_integer(get_object_by_id("bufferView", accessor_obj, FALSE), -1);
+    views[1] = get_integer(get_object_by_id("sparse/indices/bufferView", accessor_obj, FALSE), -1);
+    views[2] = get_integer(get_object_by_id("sparse/values/bufferView", accessor_obj, FALSE), -1);
+    return;
+}
+
+// Covers the mesh entry and the accessors, buffer views and buffers entries it reads through, but not their bytes
+static unsigned long long int hash_mesh_description(Object main_obj, unsigned int mesh_index) {
+    Object* accessors_obj = get_object_by_id("accessors", &main_obj, FALSE);
+    Object* views_obj = get_object_by_id("bufferViews", &main_obj, FALSE);
+    Object* buffers_obj = get_object_by_id("buffers", &main_obj, FALSE);
+    Object* mesh_obj = get_object_by_id("meshes", &main_obj, FALSE) -> children + mesh_index;
+    unsigned long long int hash = hash_object(mesh_obj, HASH_SEED);
+
+    long long int* accessors = NULL;
+    unsigned int accessors_count = get_mesh_accessors(mesh_obj, &accessors);
+    for (unsigned int i = 0; i < accessors_count; ++i) {
+        if (accessors_obj == NULL || accessors[i] < 0 || accessors[i] >= accessors_obj -> children_count) continue;
+        hash = hash_object(accessors_obj -> children + accessors[i], hash);
+        long long int views[3] = {0};
+        get_accessor_views(accessors_obj, accessors[i], views);
+        for (unsigned char j = 0; j < 3; ++j) {
+            if (views_obj == NULL || views[j] < 0 || views[j] >= views_obj -> children_count) continue;
+            Object* view_obj = views_obj -> children + views[j];
+            long long int buffer_index = get_integer(get_object_by_id("buffer", view_obj, FALSE), 0);
+            hash = hash_object(view_obj, hash);
+            if (buffers_obj != NULL && buffer_index >= 0 && buffer_index < buffers_obj -> children_count) hash = hash_object(buffers_obj -> children + buffer_index, hash);
+        }
+    }
+    gltf_free(accessors);
+
+    return hash;
+}
+
+// The buffer views of the mesh must have been read
+static unsigned long long int hash_mesh_data(Object main_obj, unsigned int mesh_index, Array buffer_views) {
+    Object* accessors_obj = get_object_by_id("accessors", &main_obj, FALSE);
+    unsigned long long int hash = HASH_SEED;
+
+    long long int* accessors = NULL;
+    unsigned int accessors_count = get_mesh_accessors(get_object_by_id("meshes", &main_obj, FALSE) -> children + mesh_index, &accessors);
+    for (unsigned int i = 0; i < accessors_count; ++i) {
+        long long int views[3] = {0};
+        get_accessor_views(accessors_obj, accessors[i], views);
+        for (unsigned char j = 0; j < 3; ++j) {
+            if (views[j] < 0 || views[j] >= buffer_views.count) continue;
+            BitStream* view_stream = GET_ELEMENT(BitStream*, buffer_views, views[j]);
+            if (view_stream -> size > 0) hash = hash_data(view_stream -> stream, view_stream -> size, hash);
+        }
+    }
+    gltf_free(accessors);
+
+    return hash;
+}
+
+static bool are_mesh_buffers_changed(Object main_obj, unsigned int mesh_index, FileWatcher* watcher) {
+    Object* accessors_obj = get_object_by_id("accessors", &main_obj, FALSE);
+    Object* views_obj = get_object_by_id("bufferViews", &main_obj, FALSE);
+    Object* buffers_obj = get_object_by_id("buffers", &main_obj, FALSE);
+    bool changed = (watcher == NULL);
+
+    long long int* accessors = NULL;
+    unsigned int accessors_count = get_mesh_accessors(get_object_by_id("meshes", &main_obj, FALSE) -> children + mesh_index, &accessors);
+    for (unsigned int i = 0; i < accessors_count && !changed; ++i) {
+        long long int views[3] = {0};
+        get_accessor_views(accessors_obj, accessors[i], views);
+        for (unsigned char j = 0; j < 3 && !changed; ++j) {
+            if (views_obj == NULL || views[j] < 0 || views[j] >= views_obj -> children_count) continue;
+            long long int buffer_index = get_integer(get_object_by_id("buffer", views_obj -> children + views[j], FALSE), 0);
+            Object* uri_obj = (buffers_obj != NULL && buffer_index >= 0 && buffer_index < buffers_obj -> children_count) ? get_object_by_id("uri", buffers_obj -> children + buffer_index, FALSE) : NULL;
+            changed = (uri_obj == NULL || is_file_changed(watcher, (char*) (uri_obj -> value)));
+        }
+    }
+    gltf_free(accessors);
+
+    return changed;
+}
+
+// Meshes loaded without tracking changes have no hashes, the claimed ones already replace another mesh
+static int find_previous_mesh(Scene* previous_scene, unsigned long long int description_hash, bool* claimed_meshes) {
+    for (unsigned int i = 0; previous_scene != NULL && i < previous_scene -> meshes_count; ++i) {
+        Mesh* mesh = previous_scene -> meshes + i;
+        if (!claimed_meshes[i] && mesh -> data_hash != 0 && mesh -> description_hash == description_hash) return (int) i;
+    }
+    return -1;
+}
+
+// Moves the decoded pixels and KTX2 data of the image files that did not change out of the previous scene
+static void reuse_textures(Scene* scene, GltfSource* source) {
+    source -> reused_textures = (bool*) gltf_calloc(scene -> textures_count + 1, sizeof(bool));
+    if (source -> reused_textures == NULL) return;
+    size_t path_len = strlen(source -> path);
+    for (unsigned int i = 0; source -> previous_scene != NULL && i < scene -> textures_count; ++i) {
+        Texture* texture = scene -> textures + i;
+        if (texture -> texture_path == NULL || texture -> encoded != NULL || is_file_changed(source -> watcher, texture -> texture_path + path_len)) continue;
+
+        for (unsigned int j = 0; j < source -> previous_scene -> textures_count; ++j) {
+            Texture* previous_texture = source -> previous_scene -> textures + j;
+            if (previous_texture -> texture_path == NULL || strcmp(previous_texture -> texture_path, texture -> texture_path)) continue;
+            if (previous_texture -> image.pixels == NULL && previous_texture -> ktx2.levels == NULL) continue;
+            texture -> image = previous_texture -> image;
+            texture -> ktx2 = previous_texture -> ktx2;
+            texture -> encoded = previous_texture -> encoded;
+            texture -> encoded_size = previous_texture -> encoded_size;
+            texture -> borrowed_encoded = previous_texture -> borrowed_encoded;
+            previous_texture -> image = (Image) {0};
+            previous_texture -> ktx2 = (Ktx2Texture) {0};
+            previous_texture -> encoded = NULL;
+            (source -> reused_textures)[i] = TRUE;
+            break;
+        }
+    }
+    return;
+}
+
+static bool is_mesh_reused(GltfSource* source, unsigned int mesh_index) {
+    return source -> reused_meshes != NULL && (source -> reused_meshes)[mesh_index];
+}
+
+// Uris of a glTF decoded from memory go through the caller resolver, the returned memory is borrowed
+static bool resolve_uri(GltfSource* source, const char* uri, const unsigned char** data, unsigned int* size) {
+    *data = NULL;
+    *size = 0;
+    if (source -> resolver == NULL || source -> resolver -> resolve == NULL) {
+        error_print("no resolver for the uri: %s\n", uri);
+        return TRUE;
+    }
+
+    if ((source -> resolver -> resolve)(uri, data, size, source -> resolver -> user_data) || *data == NULL) {
+        error_print("failed to resolve the uri: %s\n", uri);
+        *data = NULL;
+        *size = 0;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+// Returns TRUE when the stream could not be allocated or stored, the stream is released but not its bytes
+static bool append_stream(Array* streams, BitStream* stream) {
+    if (stream == NULL) return TRUE;
+    if (!append_element(streams, (void*) stream)) return FALSE;
+    gltf_free(stream);
+    return TRUE;
+}
+
+// Buffer views borrow the memory of their buffer, so the buffers must outlive them. With a selection only the
+// span of each buffer covering the selected views is read, the other views are left empty. Buffers of a glTF
+// decoded from memory borrow the GLB binary chunk or the resolved memory instead, cached buffers are always read whole.
+static Array decode_buffer_views(Object main_obj, GltfSource* source, Array* buffers, LoadSelection* selection) {
     Array buffer_views = init_arr();
-    Array buffers = init_arr();
 
-    // Store buffers
     Object* buffers_obj = get_object_by_id("buffers", &main_obj, TRUE);
-    for (unsigned int i = 0; i < buffers_obj -> children_count; ++i) {
-        char* uri = (char*) (get_object_by_id("uri", buffers_obj -> children + i, TRUE) -> value);
-        unsigned int byte_length = atoi((char*) (get_object_by_id("byteLength", buffers_obj -> children + i, TRUE) -> value));
-        
+    Object* buffer_views_obj = get_object_by_id("bufferViews", &main_obj, TRUE);
+    unsigned int buffers_count = (buffers_obj != NULL) ? buffers_obj -> children_count : 0;
+    unsigned int buffer_views_count = (buffer_views_obj != NULL) ? buffer_views_obj -> children_count : 0;
+
+    // Span of each buffer used by the selected views
+    unsigned long long int* spans = (unsigned long long int*) gltf_calloc(buffers_count * 2 + 1, sizeof(unsigned long long int));
+    source -> buffers_ownership = (BufferOwnership*) gltf_calloc(buffers_count + 1, sizeof(BufferOwnership));
+    if (spans == NULL || source -> buffers_ownership == NULL) {
+        gltf_free(spans);
+        return buffer_views;
+    }
+    for (unsigned int i = 0; i < buffers_count; ++i) spans[i * 2] = ~0ULL;
+    for (unsigned int i = 0; selection != NULL && i < buffer_views_count; ++i) {
+        unsigned int buffer_index = get_integer(get_object_by_id("buffer", buffer_views_obj -> children + i, TRUE), 0);
+        if (!is_selected(selection, SELECT_BUFFER_VIEWS, i) || buffer_index >= buffers_count) continue;
+        unsigned long long int byte_offset = get_integer(get_object_by_id("byteOffset", buffer_views_obj -> children + i, FALSE), 0);
+        unsigned long long int byte_end = byte_offset + get_integer(get_object_by_id("byteLength", buffer_views_obj -> children + i, TRUE), 0);
+        if (byte_offset < spans[buffer_index * 2]) spans[buffer_index * 2] = byte_offset;
+        if (byte_end > spans[buffer_index * 2 + 1]) spans[buffer_index * 2 + 1] = byte_end;
+    }
+
+    // Store buffers, up to the first allocation failure so that buffers and their ownership stay in step
+    for (unsigned int i = 0; i < buffers_count && !has_allocation_failed(); ++i) {
+        if (!is_selected(selection, SELECT_BUFFERS, i)) {
+            append_stream(buffers, allocate_bit_stream(NULL, 0, FALSE));
+            continue;
+        }
+
+        Object* uri_obj = get_object_by_id("uri", buffers_obj -> children + i, FALSE);
+        unsigned int byte_length = get_integer(get_object_by_id("byteLength", buffers_obj -> children + i, TRUE), 0);
+
+        if (source -> path == NULL) {
+            const unsigned char* data = source -> binary_chunk;
+            unsigned int size = source -> binary_chunk_size;
+            if (uri_obj != NULL) resolve_uri(source, (char*) (uri_obj -> value), &data, &size);
+            else if (data == NULL) error_print("buffer %u has no uri and there is no GLB binary chunk\n", i);
+            if (size < byte_length) {
+                error_print("buffer %u holds %u bytes instead of %u\n", i, size, byte_length);
+                byte_length = size;
+            }
+            spans[i * 2] = 0;
+            (source -> buffers_ownership)[i] = BUFFER_BORROWED;
+            append_stream(buffers, allocate_bit_stream((unsigned char*) data, byte_length, FALSE));
+            continue;
+        }
+
+        if (source -> track_changes && uri_obj != NULL) {
+            char** buffers_uris = (char**) gltf_realloc(source -> buffers_uris, sizeof(char*) * (source -> buffers_count + 1));
+            if (buffers_uris != NULL) source -> buffers_uris = buffers_uris;
+            char* uri = (buffers_uris != NULL) ? gltf_strdup((char*) (uri_obj -> value)) : NULL;
+            if (uri != NULL) (source -> buffers_uris)[(source -> buffers_count)++] = uri;
+        }
+
+        if (uri_obj == NULL) {
+            error_print("buffer %u has no uri\n", i);
+            append_stream(buffers, allocate_bit_stream(NULL, 0, FALSE));
+            continue;
+        }
+
         File buffer_data = {0};
-        buffer_data.file_path = (char*) calloc(350, sizeof(char));
-        int len = snprintf(buffer_data.file_path, 350, "%s%s", path, uri);
-        buffer_data.file_path = (char*) realloc(buffer_data.file_path, sizeof(char) * len);
-        read_model_file(&buffer_data);
-        
-        BitStream* bit_stream = allocate_bit_stream(buffer_data.data, byte_length, TRUE);
-        append_element(&buffers, (void*) bit_stream);
-        deallocate_file(&buffer_data, TRUE);
+        buffer_data.file_path = (char*) gltf_calloc(350, sizeof(char));
+        if (buffer_data.file_path == NULL) break;
+        int len = snprintf(buffer_data.file_path, 350, "%s%s", source -> path, (char*) (uri_obj -> value));
+        char* shrunk_path = (char*) gltf_realloc(buffer_data.file_path, sizeof(char) * (len + 1));
+        if (shrunk_path != NULL) buffer_data.file_path = shrunk_path;
+
+        // A file that may have changed within the modification time granularity is compared by content
+        const unsigned char* cached_data = NULL;
+        unsigned int cached_size = 0;
+        if (source -> cache_buffers) {
+            bool check_content = source -> track_changes && is_file_changed(source -> watcher, (char*) (uri_obj -> value));
+            cached_data = acquire_cached_file(buffer_data.file_path, check_content, &cached_size);
+        }
+
+        if (cached_data != NULL) {
+            spans[i * 2] = 0;
+            buffer_data.data = (unsigned char*) cached_data;
+            buffer_data.size = cached_size;
+            (source -> buffers_ownership)[i] = BUFFER_CACHED;
+        } else if (selection != NULL && spans[i * 2] < spans[i * 2 + 1] && spans[i * 2 + 1] <= byte_length) {
+            byte_length = (unsigned int) (spans[i * 2 + 1] - spans[i * 2]);
+            read_file_range(&buffer_data, spans[i * 2], byte_length);
+        } else {
+            spans[i * 2] = 0;
+            read_model_file(&buffer_data);
+        }
+        if (buffer_data.size < byte_length) {
+            error_print("buffer %s holds %u bytes instead of %u\n", buffer_data.file_path, buffer_data.size, byte_length);
+            byte_length = buffer_data.size;
+        }
+
+        // The stream takes ownership of the file data, which is released here when it can't be stored
+        if (append_stream(buffers, allocate_bit_stream(buffer_data.data, byte_length, FALSE))) {
+            if ((source -> buffers_ownership)[i] == BUFFER_CACHED) release_cached_file(buffer_data.data);
+            else gltf_free(buffer_data.data);
+        }
+        deallocate_file(&buffer_data, FALSE);
     }
 
     // Store buffer views
-    Object* buffer_views_obj = get_object_by_id("bufferViews", &main_obj, TRUE);
-    for (unsigned int i = 0; i < buffer_views_obj -> children_count; ++i) {
-        unsigned int buffer_index = atoi((char*)(get_object_by_id("buffer", buffer_views_obj -> children + i, TRUE) -> value));
-        unsigned int byte_length = atoi((char*)(get_object_by_id("byteLength", buffer_views_obj -> children + i, TRUE) -> value));
-        unsigned int byte_offset = s_atoi((char*)(get_value(get_object_by_id("byteOffset", buffer_views_obj -> children + i, TRUE))));
+    for (unsigned int i = 0; i < buffer_views_count && !has_allocation_failed(); ++i) {
+        if (!is_selected(selection, SELECT_BUFFER_VIEWS, i)) {
+            append_stream(&buffer_views, allocate_bit_stream(NULL, 0, FALSE));
+            continue;
+        }
 
-        unsigned char* bit_stream_data = GET_ELEMENT(BitStream*, buffers, buffer_index) -> stream + byte_offset;
-        BitStream* buffer_view_stream = allocate_bit_stream(bit_stream_data, byte_length, TRUE);
-        append_element(&buffer_views, buffer_view_stream);
-    }
+        unsigned int buffer_index = get_integer(get_object_by_id("buffer", buffer_views_obj -> children + i, TRUE), 0);
+        unsigned int byte_length = get_integer(get_object_by_id("byteLength", buffer_views_obj -> children + i, TRUE), 0);
+        unsigned int byte_offset = get_integer(get_object_by_id("byteOffset", buffer_views_obj -> children + i, TRUE), 0);
 
-    // Deallocate buffers
-    for (unsigned int i = 0; i < buffers.count; ++i) {
-        deallocate_bit_stream(GET_ELEMENT(BitStream*, buffers, i));
+        // Offsets are relative to the part of the buffer that was read
+        const unsigned char* view_data = (buffer_index < buffers -> count && byte_offset >= spans[buffer_index * 2]) ? get_bytes_range(GET_ELEMENT(BitStream*, (*buffers), buffer_index), byte_offset - spans[buffer_index * 2], byte_length) : NULL;
+        if (view_data == NULL) {
+            error_print("buffer view %u out of its buffer %u\n", i, buffer_index);
+            byte_length = 0;
+        }
+        append_stream(&buffer_views, allocate_bit_stream((unsigned char*) view_data, byte_length, FALSE));
     }
-    deallocate_arr(buffers);
+    gltf_free(spans);
 
     return buffer_views;
 }
@@ -337,279 +962,1291 @@ static DataType get_data_type(char* data_type_str) {
     else return SCALAR;
 }
 
-static void decode_accessors(Object main_obj, char* path, Array* accessors) {
-    Array buffer_views = decode_buffer_views(main_obj, path);
+// Buffer views only borrow the buffers memory, as the buffers do when decoded from memory or shared by the cache
+static void deallocate_buffer_views(Array buffer_views, Array buffers, GltfSource* source) {
+    for (unsigned int i = 0; i < buffer_views.count; ++i) {
+        gltf_free(GET_ELEMENT(BitStream*, buffer_views, i));
+    }
+    deallocate_arr(buffer_views);
+
+    for (unsigned int i = 0; i < buffers.count; ++i) {
+        BitStream* buffer = GET_ELEMENT(BitStream*, buffers, i);
+        BufferOwnership ownership = (source -> buffers_ownership != NULL) ? (source -> buffers_ownership)[i] : BUFFER_OWNED;
+        if (ownership == BUFFER_CACHED) release_cached_file(buffer -> stream);
+        if (ownership == BUFFER_OWNED) deallocate_bit_stream(buffer);
+        else gltf_free(buffer);
+    }
+    deallocate_arr(buffers);
+    gltf_free(source -> buffers_ownership);
+    source -> buffers_ownership = NULL;
+
+    return;
+}
 
+static void decode_accessors(Object main_obj, Array buffer_views, Array* accessors, LoadSelection* selection) {
     Object* accessors_obj = get_object_by_id("accessors", &main_obj, TRUE);
-    for (unsigned int i = 0; i < accessors_obj -> children_count; ++i) {
-        unsigned int buffer_view_index = atoi((char*) (get_object_by_id("bufferView", accessors_obj -> children + i, TRUE) -> value));
-        ComponentType component_type = atoi((char*) (get_object_by_id("componentType", accessors_obj -> children + i, TRUE) -> value)) % 5120;
-        unsigned int total_elements = atoi((char*) (get_object_by_id("count", accessors_obj -> children + i, TRUE) -> value));
-        unsigned int byte_offset = s_atoi((char*)(get_value(get_object_by_id("byteOffset", accessors_obj -> children + i, TRUE))));
-        DataType data_type = get_data_type((char*) (get_object_by_id("type", accessors_obj -> children + i, TRUE) -> value));
-        BitStream* buffer_view_stream = GET_ELEMENT(BitStream*, buffer_views, buffer_view_index);
-        buffer_view_stream -> byte = byte_offset;
-
-        Accessor* accessor = (Accessor*) calloc(1, sizeof(Accessor));
+    for (unsigned int i = 0; accessors_obj != NULL && i < accessors_obj -> children_count && !has_allocation_failed(); ++i) {
+        // Accessors outside the selection, or without a type, are kept empty so that the indices still match
+        bool selected = is_selected(selection, SELECT_ACCESSORS, i);
+        Object* type_obj = selected ? get_object_by_id("type", accessors_obj -> children + i, FALSE) : NULL;
+        bool has_type = (type_obj != NULL && type_obj -> obj_type == STRING && type_obj -> value != NULL);
+        if (selected && !has_type) error_print("accessor %u has no valid type, it is left empty\n", i);
+        if (!has_type) {
+            Accessor* empty_accessor = (Accessor*) gltf_calloc(1, sizeof(Accessor));
+            if (empty_accessor != NULL && append_element(accessors, empty_accessor)) gltf_free(empty_accessor);
+            continue;
+        }
+
+        long long int buffer_view_index = get_integer(get_object_by_id("bufferView", accessors_obj -> children + i, FALSE), -1);
+        ComponentType component_type = get_integer(get_object_by_id("componentType", accessors_obj -> children + i, TRUE), 0) % 5120;
+        unsigned int total_elements = get_integer(get_object_by_id("count", accessors_obj -> children + i, TRUE), 0);
+        unsigned int byte_offset = get_integer(get_object_by_id("byteOffset", accessors_obj -> children + i, FALSE), 0);
+        DataType data_type = get_data_type((char*) (type_obj -> value));
+
+        Accessor* accessor = (Accessor*) gltf_calloc(1, sizeof(Accessor));
+        if (accessor == NULL) break;
         *accessor = (Accessor) { .component_type = component_type, .elements_count = total_elements, .data_type = data_type };
-        accessor -> data = get_next_n_byte(buffer_view_stream, total_elements * elements_count[data_type], byte_lengths[component_type]);
-        append_element(accessors, accessor);
-    }
+        accessor -> normalized = get_boolean(get_object_by_id("normalized", accessors_obj -> children + i, FALSE), FALSE);
+
+        // Accessors without a buffer view are initialized with zeros, and usually carry sparse values
+        if (buffer_view_index >= 0 && (unsigned int) buffer_view_index < buffer_views.count) {
+            BitStream* buffer_view_stream = GET_ELEMENT(BitStream*, buffer_views, buffer_view_index);
+            unsigned long long int length = (unsigned long long int) total_elements * elements_count[data_type] * byte_lengths[component_type];
+            accessor -> data = gltf_calloc(total_elements * elements_count[data_type], byte_lengths[component_type]);
+            if (accessor -> data != NULL && read_bytes_range(buffer_view_stream, byte_offset, length, accessor -> data)) error_print("accessor %u out of its buffer view %lld\n", i, buffer_view_index);
+        } else {
+            accessor -> data = gltf_calloc(total_elements * elements_count[data_type], byte_lengths[component_type]);
+        }
+        if (accessor -> data == NULL) {
+            gltf_free(accessor);
+            break;
+        }
 
-    // Deallocate buffer_views
-    for (unsigned int i = 0; i < buffer_views.count; ++i) {
-        deallocate_bit_stream(GET_ELEMENT(BitStream*, buffer_views, i));
+        Object* sparse_obj = get_object_by_id("sparse", accessors_obj -> children + i, FALSE);
+        if (sparse_obj != NULL) apply_sparse_values(sparse_obj, buffer_views, accessor);
+        read_accessor_bounds(accessors_obj -> children + i, accessor);
+
+        if (append_element(accessors, accessor)) {
+            gltf_free(accessor -> data);
+            gltf_free(accessor);
+        }
     }
-    deallocate_arr(buffer_views);
     
     return;
 }
 
+static float normalize_component(float value, ComponentType component_type, bool normalized) {
+    if (!normalized) return value;
+    else if (component_type == BYTE) return (value / 127.0f < -1.0f) ? -1.0f : value / 127.0f;
+    else if (component_type == UNSIGNED_BYTE) return value / 255.0f;
+    else if (component_type == SHORT) return (value / 32767.0f < -1.0f) ? -1.0f : value / 32767.0f;
+    else if (component_type == UNSIGNED_SHORT) return value / 65535.0f;
+    return value;
+}
+
+// min/max are expressed in the accessor component type, they are stored already normalized
+static void read_accessor_bounds(Object* accessor_obj, Accessor* accessor) {
+    Object* min_obj = get_object_by_id("min", accessor_obj, FALSE);
+    Object* max_obj = get_object_by_id("max", accessor_obj, FALSE);
+    if (min_obj == NULL || max_obj == NULL) return;
+
+    unsigned int components_count = elements_count[accessor -> data_type];
+    if (components_count > 4 || min_obj -> children_count < components_count || max_obj -> children_count < components_count) return;
+
+    for (unsigned int i = 0; i < components_count; ++i) {
+        (accessor -> min)[i] = normalize_component((float) get_real(min_obj -> children + i, 0.0), accessor -> component_type, accessor -> normalized);
+        (accessor -> max)[i] = normalize_component((float) get_real(max_obj -> children + i, 0.0), accessor -> component_type, accessor -> normalized);
+    }
+    accessor -> has_bounds = TRUE;
+
+    return;
+}
+
+static void apply_sparse_values(Object* sparse_obj, Array buffer_views, Accessor* accessor) {
+    unsigned int sparse_count = get_integer(get_object_by_id("count", sparse_obj, TRUE), 0);
+    unsigned int indices_view = get_integer(get_object_by_id("indices/bufferView", sparse_obj, TRUE), 0);
+    unsigned int indices_offset = get_integer(get_object_by_id("indices/byteOffset", sparse_obj, FALSE), 0);
+    ComponentType indices_type = get_integer(get_object_by_id("indices/componentType", sparse_obj, TRUE), 5125) % 5120;
+    unsigned int values_view = get_integer(get_object_by_id("values/bufferView", sparse_obj, TRUE), 0);
+    unsigned int values_offset = get_integer(get_object_by_id("values/byteOffset", sparse_obj, FALSE), 0);
+    if (indices_view >= buffer_views.count || values_view >= buffer_views.count) {
+        error_print("invalid sparse accessor buffer views\n");
+        return;
+    }
+
+    unsigned int element_size = elements_count[accessor -> data_type] * byte_lengths[accessor -> component_type];
+    const unsigned char* indices = get_bytes_range(GET_ELEMENT(BitStream*, buffer_views, indices_view), indices_offset, (unsigned long long int) sparse_count * byte_lengths[indices_type]);
+    const unsigned char* values = get_bytes_range(GET_ELEMENT(BitStream*, buffer_views, values_view), values_offset, (unsigned long long int) sparse_count * element_size);
+    if (indices == NULL || values == NULL) {
+        error_print("sparse accessor out of its buffer views\n");
+        return;
+    }
+
+    for (unsigned int i = 0; i < sparse_count; ++i) {
+        unsigned int index = 0;
+        if (indices_type == UNSIGNED_BYTE) index = indices[i];
+        else if (indices_type == UNSIGNED_SHORT) index = GET_US_ELEMENT_LE(indices, i * 2);
+        else index = GET_UI_ELEMENT_LE(indices, i * 4);
+        if (index >= accessor -> elements_count) continue;
+        memcpy((unsigned char*) (accessor -> data) + index * element_size, values + i * element_size, element_size);
+    }
+
+    return;
+}
+
+// The components are converted by the kernel of the accessor component type, picked once for the whole accessor
 static void extract_elements(Accessor* obj_accessor, ArrayExtended* arr_ext) {
-    arr_ext -> arr = init_arr();
+    unsigned char element_size = elements_count[obj_accessor -> data_type];
+    unsigned char byte_size = byte_lengths[obj_accessor -> component_type];
+
+    // Elements are stored contiguously, arr holds a pointer to each one of them
+    arr_ext -> storage = gltf_calloc(obj_accessor -> elements_count, element_size * byte_size);
+    arr_ext -> arr = (Array) { .count = obj_accessor -> elements_count };
+    arr_ext -> arr.data = (void**) gltf_calloc(obj_accessor -> elements_count, sizeof(void*));
+    if (arr_ext -> storage == NULL || arr_ext -> arr.data == NULL) {
+        gltf_free(arr_ext -> storage);
+        gltf_free(arr_ext -> arr.data);
+        *arr_ext = (ArrayExtended) {0};
+        return;
+    }
+
+    ComponentsKernel kernel = get_components_kernel(obj_accessor -> component_type);
+    if (kernel != NULL) kernel((unsigned char*) (obj_accessor -> data), obj_accessor -> elements_count * element_size, arr_ext -> storage);
     for (unsigned int s = 0; s < obj_accessor -> elements_count; ++s) {
-        unsigned char element_size = elements_count[obj_accessor -> data_type];
-        unsigned char byte_size = byte_lengths[obj_accessor -> component_type];
-        void* element = calloc(element_size, byte_size);
-        unsigned char* data = (unsigned char*) (obj_accessor -> data); 
-        unsigned int offset = s * element_size * byte_size;
-
-        for (unsigned char t = 0; t < element_size; ++t) {
-            unsigned int current_index = (t * byte_size) + offset;
-            if (obj_accessor -> component_type == BYTE) ((char*) element)[t] = data[current_index];
-            else if (obj_accessor -> component_type == UNSIGNED_BYTE) ((unsigned char*) element)[t] = data[current_index];
-            else if (obj_accessor -> component_type == SHORT) ((short int*) element)[t] = (short int) GET_US_ELEMENT_LE(data, current_index);
-            else if (obj_accessor -> component_type == UNSIGNED_SHORT) ((unsigned short int*) element)[t] = GET_US_ELEMENT_LE(data, current_index);
-            else if (obj_accessor -> component_type == UNSIGNED_INT) ((unsigned int*) element)[t] = GET_UI_ELEMENT_LE(data, current_index);
-            else if (obj_accessor -> component_type == FLOAT) {
-                unsigned int value = GET_UI_ELEMENT_LE(data, current_index);
-                ((float*) element)[t] = *((float*) (&value));
-            }
-        }
-        
-        append_element(&(arr_ext -> arr), element);
+        (arr_ext -> arr.data)[s] = (unsigned char*) (arr_ext -> storage) + s * element_size * byte_size;
     }
 
     arr_ext -> component_type = obj_accessor -> component_type; 
     arr_ext -> data_type = obj_accessor -> data_type;
+    arr_ext -> normalized = obj_accessor -> normalized;
     
     return;
 }
 
-static Face* create_faces(Accessor* indices_accessor, Topology topology, unsigned int* faces_count) {
-    Face* faces = (Face*) calloc(1, sizeof(Face)); 
-    *faces_count = 0;
-    unsigned char* data = (unsigned char*) (indices_accessor -> data);
-    unsigned int total_faces = indices_accessor -> elements_count;
-    if (topology == TRIANGLE_STRIP || topology == TRIANGLE_FAN) total_faces -= 2;
-    else if (topology == LINE_STRIP) total_faces -= 1;
+// Reads a single component as a float, mapping normalized integers to [0, 1] or [-1, 1]
+static float get_accessor_float(Accessor* accessor, unsigned int component_index) {
+    float value = 0.0f;
+    read_accessor_floats(accessor, component_index, 1, 1, &value);
+    return value;
+}
+
+// Reads count components as floats, stride apart starting from first, with the kernel picked once for the accessor
+static void read_accessor_floats(Accessor* accessor, unsigned int first, unsigned int stride, unsigned int count, float* values) {
+    FloatsKernel kernel = get_floats_kernel(accessor -> component_type, accessor -> normalized);
+    if (kernel != NULL) kernel((unsigned char*) (accessor -> data), first, stride, count, values);
+    return;
+}
+
+// Weights can be stored as normalized integers, they are always converted to floats for the skinning kernels
+static void extract_weights(Accessor* weights_accessor, Weights* weights) {
+    unsigned int components = elements_count[weights_accessor -> data_type];
+    weights -> storage = gltf_calloc(weights_accessor -> elements_count * components, sizeof(float));
+    weights -> arr = (Array) { .count = weights_accessor -> elements_count };
+    weights -> arr.data = (void**) gltf_calloc(weights_accessor -> elements_count, sizeof(void*));
+    weights -> component_type = FLOAT;
+    weights -> data_type = weights_accessor -> data_type;
+    if (weights -> storage == NULL || weights -> arr.data == NULL) {
+        gltf_free(weights -> storage);
+        gltf_free(weights -> arr.data);
+        *weights = (Weights) {0};
+        return;
+    }
+
+    float* storage = (float*) (weights -> storage);
+    read_accessor_floats(weights_accessor, 0, 1, weights_accessor -> elements_count * components, storage);
+    for (unsigned int i = 0; i < weights_accessor -> elements_count; ++i) (weights -> arr.data)[i] = storage + i * components;
+
+    return;
+}
+
+// The indices are widened once by the kernel of their component type, non-indexed primitives use the vertices
+// in order, then the kernel of the topology assembles the faces into the single block of faces_indices
+static Face* create_faces(Accessor* indices_accessor, unsigned int vertices_count, Topology topology, unsigned int* faces_count, unsigned int** faces_indices) {
+    FacesKernel faces_kernel = get_faces_kernel(topology);
+    IndicesKernel indices_kernel = (indices_accessor != NULL) ? get_indices_kernel(indices_accessor -> component_type) : NULL;
+    unsigned int indices_count = (indices_accessor != NULL) ? indices_accessor -> elements_count : vertices_count;
+    if (faces_kernel == NULL || (indices_accessor != NULL && indices_kernel == NULL)) {
+        error_print("unsupported primitive mode %u or indices component type\n", topology);
+        indices_count = 0;
+    }
+
+    unsigned int total_faces = indices_count;
+    if (topology == TRIANGLE_STRIP || topology == TRIANGLE_FAN) total_faces = (indices_count > 2) ? indices_count - 2 : 0;
+    else if (topology == LINE_STRIP) total_faces = (indices_count > 1) ? indices_count - 1 : 0;
     else if (topology == LINES) total_faces /= 2;
     else if (topology == TRIANGLES) total_faces /= 3;
 
-    for (unsigned int i = 0; i < total_faces; ++i, ++(*faces_count)) {
-        faces = (Face*) realloc(faces, sizeof(Face) * (*faces_count + 1));
-        faces[i].topology = topology;
-        faces[i].indices = (unsigned int*) calloc(topology_size[topology], sizeof(unsigned int));
-        if (topology == LINE_STRIP) {
-            faces[i].indices[0] = GET_UI_ELEMENT_LE(data, i * sizeof(unsigned int));
-            faces[i].indices[1] = GET_UI_ELEMENT_LE(data, (i + 1) * sizeof(unsigned int));
-        } else if (topology == LINE_LOOP) {
-            faces[i].indices[0] = GET_UI_ELEMENT_LE(data, i * sizeof(unsigned int));
-            faces[i].indices[1] = GET_UI_ELEMENT_LE(data, ((i + 1) % indices_accessor -> elements_count) * sizeof(unsigned int));
-        } else if (topology == LINES) {
-            faces[i].indices[0] = GET_UI_ELEMENT_LE(data, 2 * i * sizeof(unsigned int));
-            faces[i].indices[1] = GET_UI_ELEMENT_LE(data, ((2 * i) + 1) * sizeof(unsigned int));
-        } else if (topology == TRIANGLES) {
-            faces[i].indices[0] = GET_UI_ELEMENT_LE(data, 3 * i * sizeof(unsigned int));
-            faces[i].indices[1] = GET_UI_ELEMENT_LE(data, ((3 * i) + 1) * sizeof(unsigned int));
-            faces[i].indices[2] = GET_UI_ELEMENT_LE(data, ((3 * i) + 2) * sizeof(unsigned int));
-        } else if (topology == TRIANGLE_STRIP) {
-            faces[i].indices[0] = GET_UI_ELEMENT_LE(data, i * sizeof(unsigned int));
-            faces[i].indices[1] = GET_UI_ELEMENT_LE(data, (i + (1 + i % 2)) * sizeof(unsigned int));
-            faces[i].indices[2] = GET_UI_ELEMENT_LE(data, (i + (2 - i % 2)) * sizeof(unsigned int));
-        } else if (topology == TRIANGLE_FAN) {
-            faces[i].indices[0] = GET_UI_ELEMENT_LE(data, (i + 1) * sizeof(unsigned int));
-            faces[i].indices[1] = GET_UI_ELEMENT_LE(data, (i + 2) * sizeof(unsigned int));
-            faces[i].indices[2] = GET_UI_ELEMENT_LE(data, 0);
-        } else if (topology == POINTS) faces[i].indices[0] = GET_UI_ELEMENT_LE(data, i * sizeof(unsigned int));
+    *faces_indices = NULL;
+    Face* faces = (Face*) gltf_calloc(total_faces + 1, sizeof(Face)); 
+    *faces_count = (faces != NULL) ? total_faces : 0;
+    if (faces == NULL || total_faces == 0) return faces;
+
+    unsigned int* indices = (unsigned int*) gltf_calloc(indices_count, sizeof(unsigned int));
+    *faces_indices = (unsigned int*) gltf_calloc((unsigned long long int) total_faces * topology_size[topology], sizeof(unsigned int));
+    if (indices == NULL || *faces_indices == NULL) {
+        gltf_free(indices);
+        gltf_free(*faces_indices);
+        gltf_free(faces);
+        *faces_indices = NULL;
+        *faces_count = 0;
+        return NULL;
     }
+    if (indices_kernel != NULL) indices_kernel((unsigned char*) (indices_accessor -> data), indices_count, indices);
+    else for (unsigned int i = 0; i < indices_count; ++i) indices[i] = i;
+    faces_kernel(indices, indices_count, faces, total_faces, *faces_indices);
+    gltf_free(indices);
 
     return faces;
 }
 
-static Mesh* decode_mesh(Array accessors, Object main_obj, unsigned int* meshes_count) {
-    Mesh* meshes = (Mesh*) calloc(1, sizeof(Mesh));
+// Reads the deltas of a morph target attribute, returns NULL when the attribute is not displaced
+static float* get_morph_deltas(Array accessors, Object* target_obj, char* attribute, unsigned int vertices_count) {
+    Object* attribute_obj = get_object_by_id(attribute, target_obj, FALSE);
+    long long int accessor_index = get_integer(attribute_obj, -1);
+    if (attribute_obj == NULL) return NULL;
+    else if (accessor_index < 0 || accessor_index >= accessors.count) {
+        error_print("morph target %s accessor %lld out of range\n", attribute, accessor_index);
+        return NULL;
+    }
+
+    Accessor* accessor = GET_ELEMENT(Accessor*, accessors, accessor_index);
+    float* deltas = (float*) gltf_calloc(vertices_count * 3, sizeof(float));
+    if (deltas == NULL) return NULL;
+    unsigned int components_count = ((accessor -> elements_count < vertices_count) ? accessor -> elements_count : vertices_count) * 3;
+    read_accessor_floats(accessor, 0, 1, components_count, deltas);
+
+    return deltas;
+}
+
+static bool is_vertex_displaced(float* deltas, unsigned int vertex) {
+    return deltas != NULL && (deltas[vertex * 3] != 0.0f || deltas[vertex * 3 + 1] != 0.0f || deltas[vertex * 3 + 2] != 0.0f);
+}
+
+static void compact_morph_deltas(float** deltas, unsigned int* sparse_indices, unsigned int sparse_count) {
+    if (*deltas == NULL) return;
+    float* compacted = (float*) gltf_calloc(sparse_count * 3, sizeof(float));
+    if (compacted == NULL) return;
+    for (unsigned int i = 0; i < sparse_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) compacted[i * 3 + c] = (*deltas)[sparse_indices[i] * 3 + c];
+    }
+    gltf_free(*deltas);
+    *deltas = compacted;
+    return;
+}
+
+// Targets that displace less than a quarter of the vertices are stored as sparse streams
+static void decode_morph_targets(Array accessors, Object* primitive_obj, Object* mesh_obj, Mesh* mesh) {
+    Object* targets_obj = get_object_by_id("targets", primitive_obj, FALSE);
+    if (targets_obj == NULL) return;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    mesh -> targets = (MorphTarget*) gltf_calloc(targets_obj -> children_count, sizeof(MorphTarget));
+    mesh -> default_weights = (float*) gltf_calloc(targets_obj -> children_count, sizeof(float));
+    if (mesh -> targets == NULL || mesh -> default_weights == NULL) return;
+    mesh -> targets_count = targets_obj -> children_count;
+    for (unsigned int i = 0; i < mesh -> targets_count; ++i) {
+        MorphTarget* target = mesh -> targets + i;
+        target -> position_deltas = get_morph_deltas(accessors, targets_obj -> children + i, "POSITION", vertices_count);
+        target -> normal_deltas = get_morph_deltas(accessors, targets_obj -> children + i, "NORMAL", vertices_count);
+        target -> tangent_deltas = get_morph_deltas(accessors, targets_obj -> children + i, "TANGENT", vertices_count);
+
+        unsigned int* displaced = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+        unsigned int displaced_count = 0;
+        for (unsigned int v = 0; displaced != NULL && v < vertices_count; ++v) {
+            if (is_vertex_displaced(target -> position_deltas, v) || is_vertex_displaced(target -> normal_deltas, v) || is_vertex_displaced(target -> tangent_deltas, v)) {
+                displaced[displaced_count++] = v;
+            }
+        }
+
+        // Without memory for the compacted deltas the target stays dense
+        if (displaced != NULL && displaced_count * 4 < vertices_count) {
+            target -> sparse_indices = (unsigned int*) gltf_realloc(displaced, sizeof(unsigned int) * displaced_count);
+            if (target -> sparse_indices == NULL) target -> sparse_indices = displaced;
+            target -> sparse_count = displaced_count;
+            compact_morph_deltas(&(target -> position_deltas), target -> sparse_indices, displaced_count);
+            compact_morph_deltas(&(target -> normal_deltas), target -> sparse_indices, displaced_count);
+            compact_morph_deltas(&(target -> tangent_deltas), target -> sparse_indices, displaced_count);
+        } else gltf_free(displaced);
+    }
+
+    Object* weights_obj = get_object_by_id("weights", mesh_obj, FALSE);
+    for (unsigned int i = 0; weights_obj != NULL && i < mesh -> targets_count && i < weights_obj -> children_count; ++i) {
+        (mesh -> default_weights)[i] = get_real(weights_obj -> children + i, 0.0);
+    }
+
+    return;
+}
+
+// Nodes without their own weights start from the default weights of their mesh
+static void initialize_morph_weights(Node* node, Mesh* meshes, unsigned int meshes_count) {
+    if (node -> meshes_indices.count > 0) {
+        unsigned int mesh_index = *GET_ELEMENT(unsigned int*, node -> meshes_indices, 0);
+        Mesh* mesh = (mesh_index < meshes_count) ? meshes + mesh_index : NULL;
+        if (mesh != NULL && mesh -> targets_count > 0) {
+            float* weights = (float*) gltf_calloc(mesh -> targets_count, sizeof(float));
+            for (unsigned int i = 0; weights != NULL && i < mesh -> targets_count; ++i) {
+                weights[i] = (i < node -> weights_count) ? (node -> weights)[i] : (mesh -> default_weights)[i];
+            }
+            gltf_free(node -> weights);
+            node -> weights = weights;
+            node -> weights_count = (weights != NULL) ? mesh -> targets_count : 0;
+        }
+    }
+
+    for (unsigned int i = 0; i < node -> children_count; ++i) {
+        initialize_morph_weights(node -> childrens + i, meshes, meshes_count);
+    }
+
+    return;
+}
+
+// Uses the POSITION min/max required by glTF, scanning the vertices only when the exporter omitted them
+static void compute_mesh_bounds(Accessor* vertex_accessor, Mesh* mesh) {
+    if (vertex_accessor -> has_bounds) {
+        for (unsigned char i = 0; i < 3; ++i) {
+            mesh -> bounds_min[i] = (vertex_accessor -> min)[i];
+            mesh -> bounds_max[i] = (vertex_accessor -> max)[i];
+        }
+    } else if (vertex_accessor -> component_type == FLOAT) {
+        compute_positions_bounds((float*) (mesh -> vertices.storage), mesh -> vertices.arr.count, mesh -> bounds_min, mesh -> bounds_max);
+    } else {
+        reset_bounds(mesh -> bounds_min, mesh -> bounds_max);
+        for (unsigned int i = 0; i < vertex_accessor -> elements_count * 3; ++i) {
+            float value = get_accessor_float(vertex_accessor, i);
+            if (value < mesh -> bounds_min[i % 3]) mesh -> bounds_min[i % 3] = value;
+            if (value > mesh -> bounds_max[i % 3]) mesh -> bounds_max[i % 3] = value;
+        }
+    }
+    return;
+}
+
+// NULL when the attribute is missing or its accessor is out of range
+static Accessor* get_attribute_accessor(Array accessors, Object* accessor_obj, char* attribute) {
+    if (accessor_obj == NULL) return NULL;
+    long long int accessor_index = get_integer(accessor_obj, -1);
+    if (accessor_index < 0 || accessor_index >= accessors.count) {
+        error_print("%s accessor %lld out of range\n", attribute, accessor_index);
+        return NULL;
+    }
+
+    // Accessors rejected by decode_accessors are kept without data
+    Accessor* accessor = GET_ELEMENT(Accessor*, accessors, accessor_index);
+    if (accessor -> data == NULL) {
+        error_print("%s accessor %lld is empty\n", attribute, accessor_index);
+        return NULL;
+    }
+    return accessor;
+}
+
+static Mesh* decode_mesh(Array accessors, Object main_obj, unsigned int* meshes_count, LoadSelection* selection) {
+    Mesh* meshes = (Mesh*) gltf_calloc(1, sizeof(Mesh));
     Object* meshes_obj = get_object_by_id("meshes", &main_obj, TRUE);
-    for (unsigned int i = 0; i < meshes_obj -> children_count; ++i, ++(*meshes_count)) {
-        meshes = (Mesh*) realloc(meshes, sizeof(Mesh) * (*meshes_count + 1));
+    for (unsigned int i = 0; meshes != NULL && i < meshes_obj -> children_count && !has_allocation_failed(); ++i, ++(*meshes_count)) {
+        Mesh* grown_meshes = (Mesh*) gltf_realloc(meshes, sizeof(Mesh) * (*meshes_count + 1));
+        if (grown_meshes == NULL) break;
+        meshes = grown_meshes;
+        meshes[i] = (Mesh) {0};
+        if (!is_selected(selection, SELECT_MESHES, i)) continue;
         Object* primitives = get_object_by_id("primitives", meshes_obj -> children + i, TRUE);
         for (unsigned int j = 0; j < primitives -> children_count; ++j) {
-            unsigned int material_index = atoi((char*) (get_object_by_id("material", primitives -> children + j, TRUE) -> value));
-            Topology topology = atoi((char*) (get_object_by_id("mode", primitives -> children + j, TRUE) -> value));
-            unsigned int indices_index = atoi((char*) (get_object_by_id("indices", primitives -> children + j, TRUE) -> value));
-            unsigned int vertices_index = atoi((char*) (get_object_by_id("attributes/POSITION", primitives -> children + j, TRUE) -> value));
-            unsigned int normal_index = atoi((char*) (get_object_by_id("attributes/NORMAL", primitives -> children + j, TRUE) -> value));
-            unsigned int tangent_index = atoi((char*) (get_object_by_id("attributes/TANGENT", primitives -> children + j, TRUE) -> value));
-            unsigned int tex_coords_index = atoi((char*) (get_object_by_id("attributes/TEXCOORD_0", primitives -> children + j, TRUE) -> value));
-
-            Accessor* vertex_accessor = GET_ELEMENT(Accessor*, accessors, vertices_index);
-            extract_elements(vertex_accessor, &(meshes[i].vertices));            
-            Accessor* normal_accessor = GET_ELEMENT(Accessor*, accessors, normal_index);
-            extract_elements(normal_accessor, &(meshes[i].normals));            
-            Accessor* tangent_accessor = GET_ELEMENT(Accessor*, accessors, tangent_index);
-            extract_elements(tangent_accessor, &(meshes[i].tangents));            
-            Accessor* tex_coords_accessor = GET_ELEMENT(Accessor*, accessors, tex_coords_index);
-            extract_elements(tex_coords_accessor, &(meshes[i].texture_coords));
-            Accessor* indices_accessor = GET_ELEMENT(Accessor*, accessors, indices_index);
-            meshes[i].faces = create_faces(indices_accessor, topology, &(meshes[i].faces_count));
+            // Only the last primitive is kept, the attributes, targets and faces of the previous ones are released
+            if (j > 0) {
+                deallocate_mesh(meshes + i);
+                meshes[i] = (Mesh) {0};
+            }
+
+            Object* material_obj = get_object_by_id("material", primitives -> children + j, FALSE);
+            unsigned int material_index = get_integer(material_obj, 0);
+            Topology topology = get_integer(get_object_by_id("mode", primitives -> children + j, FALSE), TRIANGLES);
+            Object* primitive_obj = primitives -> children + j;
+            Object* indices_obj = get_object_by_id("indices", primitive_obj, FALSE);
+            Accessor* indices_accessor = get_attribute_accessor(accessors, indices_obj, "indices");
+            Accessor* vertex_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/POSITION", primitive_obj, TRUE), "POSITION");
+            if (vertex_accessor == NULL || (indices_obj != NULL && indices_accessor == NULL)) {
+                error_print("skipping primitive %u of mesh %u\n", j, i);
+                continue;
+            }
+
+            extract_elements(vertex_accessor, &(meshes[i].vertices));
+            compute_mesh_bounds(vertex_accessor, meshes + i);
+
+            // Missing normals and tangents can be generated once every mesh is decoded, see generate_missing_attributes
+            Accessor* normal_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/NORMAL", primitive_obj, FALSE), "NORMAL");
+            Accessor* tangent_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/TANGENT", primitive_obj, FALSE), "TANGENT");
+            Accessor* tex_coords_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/TEXCOORD_0", primitive_obj, FALSE), "TEXCOORD_0");
+            Accessor* colors_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/COLOR_0", primitive_obj, FALSE), "COLOR_0");
+            if (normal_accessor != NULL) extract_elements(normal_accessor, &(meshes[i].normals));
+            if (tangent_accessor != NULL) extract_elements(tangent_accessor, &(meshes[i].tangents));
+            if (tex_coords_accessor != NULL) extract_elements(tex_coords_accessor, &(meshes[i].texture_coords));
+            if (colors_accessor != NULL) extract_elements(colors_accessor, &(meshes[i].colors));
+
+            // Skinning reads four influences for every vertex
+            Accessor* joints_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/JOINTS_0", primitive_obj, FALSE), "JOINTS_0");
+            Accessor* weights_accessor = get_attribute_accessor(accessors, get_object_by_id("attributes/WEIGHTS_0", primitive_obj, FALSE), "WEIGHTS_0");
+            if (joints_accessor != NULL && weights_accessor != NULL) {
+                if (joints_accessor -> data_type != VEC4 || weights_accessor -> data_type != VEC4 || joints_accessor -> elements_count != vertex_accessor -> elements_count || weights_accessor -> elements_count != vertex_accessor -> elements_count) {
+                    error_print("JOINTS_0 and WEIGHTS_0 of mesh %u don't hold four influences per vertex\n", i);
+                } else {
+                    extract_elements(joints_accessor, &(meshes[i].joints));
+                    extract_weights(weights_accessor, &(meshes[i].weights));
+                }
+            }
+
+            decode_morph_targets(accessors, primitive_obj, meshes_obj -> children + i, meshes + i);
+
+            meshes[i].faces = create_faces(indices_accessor, meshes[i].vertices.arr.count, topology, &(meshes[i].faces_count), &(meshes[i].faces_indices));
             meshes[i].material_index = material_index;
+            meshes[i].has_material = (material_obj != NULL);
         }
     }
 
     return meshes;
 }
 
-static Texture* collect_textures(Object main_obj, unsigned int* texture_count, char* path) {
-    Texture* textures = (Texture*) calloc(1, sizeof(Texture));
-    Object* textures_obj = get_object_by_id("textures", &main_obj, TRUE);
-    Object* sampler_obj = get_object_by_id("samplers", &main_obj, TRUE);
-    Object* images_obj = get_object_by_id("images", &main_obj, TRUE);
-
-    for (unsigned int i = 0; i < textures_obj ->children_count; ++i, ++(*texture_count)) {
-        textures = (Texture*) realloc(textures, sizeof(Texture) * (*texture_count + 1));
-        unsigned int sampler_id = atoi((char*) (get_object_by_id("sampler", textures_obj -> children + i, TRUE) -> value));
-        unsigned int source_id = atoi((char*) (get_object_by_id("source", textures_obj -> children + i, TRUE) -> value));
-        textures[i].mag_filter = atoi((char*) (get_object_by_id("magFilter", sampler_obj -> children + sampler_id, TRUE) -> value));
-        textures[i].min_filter = atoi((char*) (get_object_by_id("minFilter", sampler_obj -> children + sampler_id, TRUE) -> value));
-        textures[i].wrap_s = atoi((char*) (get_object_by_id("wrapS", sampler_obj -> children + sampler_id, TRUE) -> value));
-        textures[i].wrap_t = atoi((char*) (get_object_by_id("wrapT", sampler_obj -> children + sampler_id, TRUE) -> value));
-        textures[i].texture_path = (char*) calloc(350, sizeof(char));
-        int path_len = snprintf(textures[i].texture_path, 350, "%s%s", path, (char*) (get_object_by_id("uri", images_obj -> children + source_id, TRUE) -> value));
-        textures[i].texture_path = (char*) realloc(textures[i].texture_path, sizeof(char) * path_len);
+// Images stored in a buffer view are copied into Texture.encoded, as the buffers are released after decoding
+// Images decoded from memory keep their uri as texture_path and borrow the resolved bytes as encoded
+static void collect_image(Object* image_obj, Texture* texture, GltfSource* source, Array buffer_views) {
+    Object* mime_type_obj = get_object_by_id("mimeType", image_obj, FALSE);
+    texture -> mime_type = (mime_type_obj != NULL) ? gltf_strdup((char*) (mime_type_obj -> value)) : NULL;
+
+    Object* uri_obj = get_object_by_id("uri", image_obj, FALSE);
+    if (uri_obj != NULL && source -> path == NULL) {
+        texture -> texture_path = gltf_strdup((char*) (uri_obj -> value));
+        const unsigned char* data = NULL;
+        if (texture -> texture_path == NULL || resolve_uri(source, texture -> texture_path, &data, &(texture -> encoded_size))) return;
+        texture -> encoded = (unsigned char*) data;
+        texture -> borrowed_encoded = TRUE;
+        return;
+    } else if (uri_obj != NULL) {
+        texture -> texture_path = (char*) gltf_calloc(350, sizeof(char));
+        if (texture -> texture_path == NULL) return;
+        int path_len = snprintf(texture -> texture_path, 350, "%s%s", source -> path, (char*) (uri_obj -> value));
+        char* shrunk_path = (char*) gltf_realloc(texture -> texture_path, sizeof(char) * (path_len + 1));
+        if (shrunk_path != NULL) texture -> texture_path = shrunk_path;
+        return;
+    }
+
+    long long int buffer_view_index = get_integer(get_object_by_id("bufferView", image_obj, TRUE), -1);
+    if (buffer_view_index < 0 || (unsigned int) buffer_view_index >= buffer_views.count) {
+        error_print("image without uri nor a valid buffer view\n");
+        return;
+    }
+
+    BitStream* buffer_view_stream = GET_ELEMENT(BitStream*, buffer_views, buffer_view_index);
+    if (buffer_view_stream -> size == 0) return;
+    texture -> encoded = (unsigned char*) gltf_calloc(buffer_view_stream -> size, sizeof(unsigned char));
+    if (texture -> encoded == NULL) return;
+    texture -> encoded_size = buffer_view_stream -> size;
+    memcpy(texture -> encoded, buffer_view_stream -> stream, texture -> encoded_size);
+
+    return;
+}
+
+static Texture* collect_textures(Object main_obj, unsigned int* texture_count, GltfSource* source, Array buffer_views, LoadSelection* selection) {
+    Texture* textures = (Texture*) gltf_calloc(1, sizeof(Texture));
+    Object* textures_obj = get_object_by_id("textures", &main_obj, FALSE);
+    Object* sampler_obj = get_object_by_id("samplers", &main_obj, FALSE);
+    Object* images_obj = get_object_by_id("images", &main_obj, FALSE);
+
+    for (unsigned int i = 0; textures != NULL && textures_obj != NULL && i < textures_obj ->children_count; ++i, ++(*texture_count)) {
+        Texture* grown_textures = (Texture*) gltf_realloc(textures, sizeof(Texture) * (*texture_count + 1));
+        if (grown_textures == NULL) break;
+        textures = grown_textures;
+        textures[i] = (Texture) {0};
+        if (!is_selected(selection, SELECT_TEXTURES, i)) continue;
+        unsigned int sampler_id = get_integer(get_object_by_id("sampler", textures_obj -> children + i, TRUE), 0);
+        if (sampler_obj != NULL && sampler_id < sampler_obj -> children_count) {
+            textures[i].mag_filter = get_integer(get_object_by_id("magFilter", sampler_obj -> children + sampler_id, TRUE), 0);
+            textures[i].min_filter = get_integer(get_object_by_id("minFilter", sampler_obj -> children + sampler_id, TRUE), 0);
+            textures[i].wrap_s = get_integer(get_object_by_id("wrapS", sampler_obj -> children + sampler_id, TRUE), 0);
+            textures[i].wrap_t = get_integer(get_object_by_id("wrapT", sampler_obj -> children + sampler_id, TRUE), 0);
+        }
         textures[i].tex_coord = -1;
+
+        // The KTX2 source of KHR_texture_basisu replaces the fallback one, which may even be missing
+        Object* source_obj = get_object_by_id("extensions/KHR_texture_basisu/source", textures_obj -> children + i, FALSE);
+        if (source_obj == NULL) source_obj = get_object_by_id("source", textures_obj -> children + i, TRUE);
+        unsigned int source_id = get_integer(source_obj, 0);
+        if (images_obj == NULL || source_id >= images_obj -> children_count) {
+            error_print("texture %u refers to the missing image %u\n", i, source_id);
+            continue;
+        }
+        collect_image(images_obj -> children + source_id, textures + i, source, buffer_views);
     }
     
     return textures;
 }
 
-static Material* decode_materials(Object main_obj, unsigned int* materials_count, char* path) {
-    Material* materials = (Material*) calloc(1, sizeof(Material));
+// Returns the texture referenced by the index, NULL when it is missing or out of range
+static Texture* get_material_texture(Object* index_obj, Texture* textures, unsigned int textures_count, unsigned int material_index) {
+    if (index_obj == NULL) return NULL;
+    long long int texture_index = get_integer(index_obj, -1);
+    if (texture_index < 0 || texture_index >= textures_count) {
+        error_print("material %u refers to the missing texture %lld\n", material_index, texture_index);
+        return NULL;
+    }
+    return textures + texture_index;
+}
 
-    unsigned int texture_count = 0;
-    Texture* textures = collect_textures(main_obj, &texture_count, path);
+static Material* decode_materials(Object main_obj, unsigned int* materials_count, Texture* textures, unsigned int textures_count, LoadSelection* selection) {
+    Material* materials = (Material*) gltf_calloc(1, sizeof(Material));
 
-    Object* materials_obj = get_object_by_id("materials", &main_obj, TRUE);
-    for (unsigned int i = 0; i < materials_obj -> children_count; ++i, ++(*materials_count)) {
-        materials = (Material*) realloc(materials, sizeof(Material) * (*materials_count + 1));
+    // Scenes without materials are valid, their primitives are left without one
+    Object* materials_obj = get_object_by_id("materials", &main_obj, FALSE);
+    for (unsigned int i = 0; materials != NULL && materials_obj != NULL && i < materials_obj -> children_count; ++i, ++(*materials_count)) {
+        Material* grown_materials = (Material*) gltf_realloc(materials, sizeof(Material) * (*materials_count + 1));
+        if (grown_materials == NULL) break;
+        materials = grown_materials;
+        materials[i] = (Material) {0};
+        if (!is_selected(selection, SELECT_MATERIALS, i)) continue;
 
         Object* pbr_metallic_roughness_obj = get_object_by_id("pbrMetallicRoughness", materials_obj -> children + i, FALSE);
         if (pbr_metallic_roughness_obj != NULL) {
-            unsigned int base_color_texture_index = atoi((char*) (get_object_by_id("baseColorTexture/index", pbr_metallic_roughness_obj, TRUE) -> value));
-            materials[i].pbr_metallic_roughness.base_color_texture = textures[base_color_texture_index];
+            Texture* base_color_texture = get_material_texture(get_object_by_id("baseColorTexture/index", pbr_metallic_roughness_obj, FALSE), textures, textures_count, i);
+            if (base_color_texture != NULL) {
+                materials[i].pbr_metallic_roughness.base_color_texture = *base_color_texture;
+                materials[i].pbr_metallic_roughness.base_color_texture.tex_coord = get_integer(get_object_by_id("baseColorTexture/texCoord", pbr_metallic_roughness_obj, FALSE), 0); 
+            }
 
             materials[i].pbr_metallic_roughness.base_color_factor = (float*) get_array(get_object_by_id("baseColorFactor", pbr_metallic_roughness_obj, FALSE), TRUE);
-            materials[i].pbr_metallic_roughness.base_color_texture.tex_coord = s_atoi((char*) get_value(get_object_by_id("baseColorTexture/texCoord", pbr_metallic_roughness_obj, FALSE))); 
-            materials[i].pbr_metallic_roughness.metallic_factor = s_atoi((char*) get_value(get_object_by_id("metallicFactor", pbr_metallic_roughness_obj, FALSE))); 
-            materials[i].pbr_metallic_roughness.roughness_factor = s_atoi((char*) get_value(get_object_by_id("roughnessFactor", pbr_metallic_roughness_obj, FALSE))); 
-            materials[i].pbr_metallic_roughness.roughness_factor = s_atoi((char*) get_value(get_object_by_id("roughnessFactor", pbr_metallic_roughness_obj, FALSE))); 
-
-            Object* metallic_roughness_texture_index_obj = get_object_by_id("metallicRoughnessTexture/index", pbr_metallic_roughness_obj, FALSE);
-            if (metallic_roughness_texture_index_obj != NULL) {
-                materials[i].pbr_metallic_roughness.metallic_roughness_texture = textures[atoi((char*) (metallic_roughness_texture_index_obj -> value))];
-                materials[i].pbr_metallic_roughness.metallic_roughness_texture.tex_coord = s_atoi((char*) get_value(get_object_by_id("metallicRoughnessTexture/texCoord", pbr_metallic_roughness_obj, FALSE))); 
+            materials[i].pbr_metallic_roughness.metallic_factor = get_real(get_object_by_id("metallicFactor", pbr_metallic_roughness_obj, FALSE), 1.0); 
+            materials[i].pbr_metallic_roughness.roughness_factor = get_real(get_object_by_id("roughnessFactor", pbr_metallic_roughness_obj, FALSE), 1.0); 
+
+            Texture* metallic_roughness_texture = get_material_texture(get_object_by_id("metallicRoughnessTexture/index", pbr_metallic_roughness_obj, FALSE), textures, textures_count, i);
+            if (metallic_roughness_texture != NULL) {
+                materials[i].pbr_metallic_roughness.metallic_roughness_texture = *metallic_roughness_texture;
+                materials[i].pbr_metallic_roughness.metallic_roughness_texture.tex_coord = get_integer(get_object_by_id("metallicRoughnessTexture/texCoord", pbr_metallic_roughness_obj, FALSE), 0); 
             } 
         }  
 
-        Object* normal_texture_index_obj = get_object_by_id("normalTexture/index", materials_obj -> children + i, FALSE);
-        if (normal_texture_index_obj != NULL) {
-            materials[i].normal_texture.texture = textures[atoi((char*) (normal_texture_index_obj -> value))];
-            materials[i].normal_texture.texture.tex_coord = s_atoi((char*) get_value(get_object_by_id("normalTexture/texCoord", materials_obj -> children + i, FALSE))); 
-            materials[i].normal_texture.scale = s_atoi((char*) get_value(get_object_by_id("normalTexture/scale", materials_obj -> children + i, FALSE))); 
+        Texture* normal_texture = get_material_texture(get_object_by_id("normalTexture/index", materials_obj -> children + i, FALSE), textures, textures_count, i);
+        if (normal_texture != NULL) {
+            materials[i].normal_texture.texture = *normal_texture;
+            materials[i].normal_texture.texture.tex_coord = get_integer(get_object_by_id("normalTexture/texCoord", materials_obj -> children + i, FALSE), 0); 
+            materials[i].normal_texture.scale = get_real(get_object_by_id("normalTexture/scale", materials_obj -> children + i, FALSE), 1.0); 
         }       
         
-        Object* occlusion_texture_index_obj = get_object_by_id("occlusionTexture/index", materials_obj -> children + i, FALSE);
-        if (occlusion_texture_index_obj != NULL) {
-            materials[i].occlusion_texture.texture = textures[atoi((char*) (occlusion_texture_index_obj -> value))];
-            materials[i].occlusion_texture.texture.tex_coord = s_atoi((char*) get_value(get_object_by_id("occlusionTexture/texCoord", materials_obj -> children + i, FALSE))); 
-            materials[i].occlusion_texture.strength = s_atoi((char*) get_value(get_object_by_id("occlusionTexture/strength", materials_obj -> children + i, FALSE))); 
+        Texture* occlusion_texture = get_material_texture(get_object_by_id("occlusionTexture/index", materials_obj -> children + i, FALSE), textures, textures_count, i);
+        if (occlusion_texture != NULL) {
+            materials[i].occlusion_texture.texture = *occlusion_texture;
+            materials[i].occlusion_texture.texture.tex_coord = get_integer(get_object_by_id("occlusionTexture/texCoord", materials_obj -> children + i, FALSE), 0); 
+            materials[i].occlusion_texture.strength = get_real(get_object_by_id("occlusionTexture/strength", materials_obj -> children + i, FALSE), 1.0); 
         }       
 
-        Object* emissive_texture_index_obj = get_object_by_id("emissiveTexture/index", materials_obj -> children + i, FALSE);
-        if (emissive_texture_index_obj != NULL) {
-            materials[i].emissive_texture = textures[atoi((char*) (emissive_texture_index_obj -> value))];
-            materials[i].emissive_texture.tex_coord = s_atoi((char*) get_value(get_object_by_id("emissiveTexture/texCoord", materials_obj -> children + i, FALSE))); 
+        Texture* emissive_texture = get_material_texture(get_object_by_id("emissiveTexture/index", materials_obj -> children + i, FALSE), textures, textures_count, i);
+        if (emissive_texture != NULL) {
+            materials[i].emissive_texture = *emissive_texture;
+            materials[i].emissive_texture.tex_coord = get_integer(get_object_by_id("emissiveTexture/texCoord", materials_obj -> children + i, FALSE), 0); 
         }       
 
-        materials[i].emissive_factor = (float*) get_array(get_object_by_id("emissiveFactor", pbr_metallic_roughness_obj, FALSE), TRUE);
+        materials[i].emissive_factor = (float*) get_array(get_object_by_id("emissiveFactor", materials_obj -> children + i, FALSE), TRUE);
         Object* alpha_mode_obj = get_object_by_id("alphaMode", materials_obj -> children + i, FALSE);
-        materials[i].alpha_mode = (alpha_mode_obj != NULL) ? (char*) (alpha_mode_obj -> value) : NULL;
-        materials[i].alpha_cutoff = s_atoi((char*) get_value(get_object_by_id("alphaCutoff", materials_obj -> children + i, FALSE))); 
-        Object* double_sided_obj = get_object_by_id("doubleSided", materials_obj -> children + i, FALSE);
-        materials[i].double_sided = (double_sided_obj != NULL) ? str_to_bool((char*) (double_sided_obj ->  value), "true") : FALSE;
+        materials[i].alpha_mode = (alpha_mode_obj != NULL) ? gltf_strdup((char*) (alpha_mode_obj -> value)) : NULL;
+        materials[i].alpha_cutoff = get_real(get_object_by_id("alphaCutoff", materials_obj -> children + i, FALSE), 0.5); 
+        materials[i].double_sided = get_boolean(get_object_by_id("doubleSided", materials_obj -> children + i, FALSE), FALSE);
     }
 
-    // Deallocate textures
-    free(textures);
-
     return materials;
 }
 
-static Scene decode_scene(Object main_obj, char* path) {
+static Animation* decode_animations(Array accessors, Object main_obj, unsigned int* animations_count, LoadSelection* selection) {
+    *animations_count = 0;
+    Object* animations_obj = get_object_by_id("animations", &main_obj, FALSE);
+    if (animations_obj == NULL) return NULL;
+
+    Animation* animations = (Animation*) gltf_calloc(animations_obj -> children_count, sizeof(Animation));
+    for (unsigned int i = 0; animations != NULL && i < animations_obj -> children_count; ++i, ++(*animations_count)) {
+        if (!is_selected(selection, SELECT_ANIMATIONS, i)) continue;
+        Object* animation_obj = animations_obj -> children + i;
+        Object* name_obj = get_object_by_id("name", animation_obj, FALSE);
+        animations[i].name = (name_obj != NULL) ? gltf_strdup((char*) (name_obj -> value)) : NULL;
+
+        Object* samplers_obj = get_object_by_id("samplers", animation_obj, TRUE);
+        unsigned int samplers_count = (samplers_obj != NULL) ? samplers_obj -> children_count : 0;
+        animations[i].samplers = (AnimationSampler*) gltf_calloc(samplers_count, sizeof(AnimationSampler));
+        if (animations[i].samplers == NULL) samplers_count = 0;
+        for (unsigned int j = 0; j < samplers_count; ++j, ++(animations[i].samplers_count)) {
+            AnimationSampler* sampler = animations[i].samplers + j;
+            long long int input_index = get_integer(get_object_by_id("input", samplers_obj -> children + j, TRUE), -1);
+            long long int output_index = get_integer(get_object_by_id("output", samplers_obj -> children + j, TRUE), -1);
+            Object* interpolation_obj = get_object_by_id("interpolation", samplers_obj -> children + j, FALSE);
+            char* interpolation = (interpolation_obj != NULL) ? (char*) (interpolation_obj -> value) : "LINEAR";
+            if (!strcmp(interpolation, "STEP")) sampler -> interpolation = INTERPOLATION_STEP;
+            else if (!strcmp(interpolation, "CUBICSPLINE")) sampler -> interpolation = INTERPOLATION_CUBICSPLINE;
+            else sampler -> interpolation = INTERPOLATION_LINEAR;
+
+            // Samplers with an accessor out of range are left without keyframes, their channels are skipped when sampling
+            if (input_index < 0 || input_index >= accessors.count || output_index < 0 || output_index >= accessors.count) {
+                error_print("animation %u sampler %u accessors %lld and %lld out of range\n", i, j, input_index, output_index);
+                continue;
+            }
+            Accessor* input_accessor = GET_ELEMENT(Accessor*, accessors, input_index);
+            Accessor* output_accessor = GET_ELEMENT(Accessor*, accessors, output_index);
+            sampler -> inputs = (float*) gltf_calloc(input_accessor -> elements_count, sizeof(float));
+            sampler -> keyframes_count = (sampler -> inputs != NULL) ? input_accessor -> elements_count : 0;
+            read_accessor_floats(input_accessor, 0, 1, sampler -> keyframes_count, sampler -> inputs);
+            if (sampler -> keyframes_count > 0 && (sampler -> inputs)[sampler -> keyframes_count - 1] > animations[i].duration) {
+                animations[i].duration = (sampler -> inputs)[sampler -> keyframes_count - 1];
+            }
+
+            // Vectors and quaternions are padded to four floats so that the sampler can load whole registers,
+            // morph target weights are stored with one float per target
+            unsigned int keys_count = sampler -> keyframes_count * ((sampler -> interpolation == INTERPOLATION_CUBICSPLINE) ? 3 : 1);
+            unsigned int components = elements_count[output_accessor -> data_type];
+            unsigned int values_count = output_accessor -> elements_count * components;
+            unsigned int value_size = (components > 1) ? components : ((keys_count > 0) ? values_count / keys_count : 0);
+            sampler -> values_stride = (components > 1) ? 4 : value_size;
+            sampler -> outputs = (float*) gltf_calloc(keys_count * sampler -> values_stride + 4, sizeof(float));
+            for (unsigned int k = 0; sampler -> outputs != NULL && k < keys_count && (k + 1) * value_size <= values_count; ++k) {
+                read_accessor_floats(output_accessor, k * value_size, 1, value_size, sampler -> outputs + k * sampler -> values_stride);
+            }
+        }
+
+        Object* channels_obj = get_object_by_id("channels", animation_obj, TRUE);
+        unsigned int channels_count = (channels_obj != NULL) ? channels_obj -> children_count : 0;
+        animations[i].channels = (AnimationChannel*) gltf_calloc(channels_count, sizeof(AnimationChannel));
+        if (animations[i].channels == NULL) channels_count = 0;
+        for (unsigned int j = 0; j < channels_count; ++j) {
+            Object* target_node_obj = get_object_by_id("target/node", channels_obj -> children + j, FALSE);
+            Object* path_obj = get_object_by_id("target/path", channels_obj -> children + j, FALSE);
+            unsigned int sampler_index = get_integer(get_object_by_id("sampler", channels_obj -> children + j, TRUE), 0);
+            if (target_node_obj == NULL || path_obj == NULL || sampler_index >= animations[i].samplers_count) continue;
+
+            AnimationChannel channel = { .sampler_index = sampler_index, .target_node = get_integer(target_node_obj, 0) };
+            char* path = (char*) (path_obj -> value);
+            if (!strcmp(path, "translation")) channel.path = TRANSLATION_PATH;
+            else if (!strcmp(path, "rotation")) channel.path = ROTATION_PATH;
+            else if (!strcmp(path, "scale")) channel.path = SCALE_PATH;
+            else if (!strcmp(path, "weights")) channel.path = WEIGHTS_PATH;
+            else continue;
+
+            (animations[i].channels)[(animations[i].channels_count)++] = channel;
+        }
+    }
+
+    return animations;
+}
+
+static Skin* decode_skins(Array accessors, Object main_obj, unsigned int* skins_count, LoadSelection* selection) {
+    *skins_count = 0;
+    Object* skins_obj = get_object_by_id("skins", &main_obj, FALSE);
+    if (skins_obj == NULL) return NULL;
+    Object* nodes_obj = get_object_by_id("nodes", &main_obj, FALSE);
+    unsigned int nodes_count = (nodes_obj != NULL) ? nodes_obj -> children_count : 0;
+
+    Skin* skins = (Skin*) gltf_calloc(skins_obj -> children_count, sizeof(Skin));
+    for (unsigned int i = 0; skins != NULL && i < skins_obj -> children_count; ++i, ++(*skins_count)) {
+        if (!is_selected(selection, SELECT_SKINS, i)) continue;
+        Object* joints_obj = get_object_by_id("joints", skins_obj -> children + i, TRUE);
+        skins[i].joints = (unsigned int*) get_array(joints_obj, FALSE);
+        skins[i].joints_count = (joints_obj != NULL && skins[i].joints != NULL) ? joints_obj -> children_count : 0;
+        skins[i].skeleton = get_integer(get_object_by_id("skeleton", skins_obj -> children + i, FALSE), -1);
+
+        // A skin with a joint out of range is left without joints
+        bool valid_joints = TRUE;
+        for (unsigned int j = 0; j < skins[i].joints_count; ++j) valid_joints = valid_joints && (skins[i].joints)[j] < nodes_count;
+        if (!valid_joints) {
+            error_print("skin %u has a joint out of range\n", i);
+            gltf_free(skins[i].joints);
+            skins[i].joints = NULL;
+            skins[i].joints_count = 0;
+        }
+
+        // Missing inverse bind matrices are identity matrices
+        skins[i].inverse_bind_matrices = (float*) gltf_calloc(skins[i].joints_count * 16, sizeof(float));
+        if (skins[i].inverse_bind_matrices == NULL) continue;
+        Accessor* accessor = get_attribute_accessor(accessors, get_object_by_id("inverseBindMatrices", skins_obj -> children + i, FALSE), "inverseBindMatrices");
+        if (accessor != NULL && accessor -> data_type != MAT4) accessor = NULL;
+        unsigned int available_count = (accessor == NULL) ? 0 : ((accessor -> elements_count < skins[i].joints_count) ? accessor -> elements_count : skins[i].joints_count);
+        if (available_count > 0) read_accessor_floats(accessor, 0, 1, available_count * 16, skins[i].inverse_bind_matrices);
+        for (unsigned int j = available_count; j < skins[i].joints_count; ++j) {
+            for (unsigned char k = 0; k < 16; k += 5) skins[i].inverse_bind_matrices[j * 16 + k] = 1.0f;
+        }
+    }
+
+    return skins;
+}
+
+// The root nodes of options -> scene_index, or the node named options -> root_node_name
+static unsigned int* find_root_nodes(Object main_obj, GltfLoadOptions* options, unsigned int* roots_count) {
+    *roots_count = 0;
+    Object* nodes_obj = get_object_by_id("nodes", &main_obj, TRUE);
+    unsigned int nodes_count = (nodes_obj != NULL) ? nodes_obj -> children_count : 0;
+    unsigned int* roots = (unsigned int*) gltf_calloc(nodes_count + 1, sizeof(unsigned int));
+    if (roots == NULL) return NULL;
+
+    if (options != NULL && options -> root_node_name != NULL) {
+        for (unsigned int i = 0; i < nodes_count; ++i) {
+            Object* name_obj = get_object_by_id("name", nodes_obj -> children + i, FALSE);
+            if (name_obj == NULL || strcmp((char*) (name_obj -> value), options -> root_node_name)) continue;
+            roots[(*roots_count)++] = i;
+            return roots;
+        }
+        error_print("no node named '%s'\n", options -> root_node_name);
+        return roots;
+    }
+
+    Object* scenes_obj = get_object_by_id("scenes", &main_obj, TRUE);
+    unsigned int scene_index = (options != NULL) ? options -> scene_index : 0;
+    if (scenes_obj == NULL || scene_index >= scenes_obj -> children_count) {
+        error_print("scene %u not found\n", scene_index);
+        return roots;
+    }
+
+    Object* scene_nodes_obj = get_object_by_id("nodes", scenes_obj -> children + scene_index, TRUE);
+    for (unsigned int i = 0; scene_nodes_obj != NULL && i < scene_nodes_obj -> children_count && i < nodes_count; ++i) {
+        unsigned int node_index = get_integer(scene_nodes_obj -> children + i, 0);
+        if (node_index < nodes_count) roots[(*roots_count)++] = node_index;
+    }
+
+    return roots;
+}
+
+// A single root becomes Scene.root_node, several ones are gathered under an identity node whose index is
+// past the glTF nodes, so that it never collides with them
+static Node create_root_node(Array accessors, Object* nodes_obj, unsigned int* roots, unsigned int roots_count) {
+    if (roots_count == 1) return create_node(accessors, nodes_obj, roots[0]);
+
+    Node root = { .index = nodes_obj -> children_count, .skin_index = -1, .rotation_quat = { 0.0f, 0.0f, 0.0f, 1.0f }, .scale_vec = { 1.0f, 1.0f, 1.0f } };
+    for (unsigned char i = 0; i < 4; ++i) root.transformation_matrix[i * 4 + i] = 1.0f;
+    root.childrens = (Node*) gltf_calloc(roots_count + 1, sizeof(Node));
+    root.children_count = (root.childrens != NULL) ? roots_count : 0;
+    for (unsigned int i = 0; i < root.children_count; ++i) (root.childrens)[i] = create_node(accessors, nodes_obj, roots[i]);
+
+    return root;
+}
+
+static Scene decode_scene(Object main_obj, GltfSource* source, GltfLoadOptions* options) {
     Scene scene = {0};
 
+    Object* nodes_obj = get_object_by_id("nodes", &main_obj, TRUE);
+    unsigned int roots_count = 0;
+    unsigned int* roots = find_root_nodes(main_obj, options, &roots_count);
+    if (nodes_obj == NULL || roots_count == 0) {
+        gltf_free(roots);
+        return scene;
+    }
+
+    bool reachable_only = (options != NULL && options -> load_reachable_only);
+    LoadSelection* selection = reachable_only ? select_reachable_objects(main_obj, roots, roots_count, NULL) : NULL;
+
+    // When tracking changes, meshes matching a previous one are reused without reading their buffers if those
+    // did not change, or else once their bytes are found identical
+    Object* meshes_obj = get_object_by_id("meshes", &main_obj, FALSE);
+    unsigned int meshes_count = (meshes_obj != NULL) ? meshes_obj -> children_count : 0;
+    unsigned long long int* description_hashes = NULL;
+    unsigned long long int* data_hashes = NULL;
+    int* previous_meshes = NULL;
+    bool* claimed_meshes = NULL;
+    if (source -> track_changes) {
+        description_hashes = (unsigned long long int*) gltf_calloc(meshes_count + 1, sizeof(unsigned long long int));
+        data_hashes = (unsigned long long int*) gltf_calloc(meshes_count + 1, sizeof(unsigned long long int));
+        previous_meshes = (int*) gltf_calloc(meshes_count + 1, sizeof(int));
+        source -> reused_meshes = (bool*) gltf_calloc(meshes_count + 1, sizeof(bool));
+        claimed_meshes = (bool*) gltf_calloc(((source -> previous_scene != NULL) ? source -> previous_scene -> meshes_count : 0) + 1, sizeof(bool));
+        for (unsigned int i = 0; i < meshes_count && !has_allocation_failed(); ++i) {
+            previous_meshes[i] = -1;
+            if (!is_selected(selection, SELECT_MESHES, i)) continue;
+            description_hashes[i] = hash_mesh_description(main_obj, i);
+            previous_meshes[i] = find_previous_mesh(source -> previous_scene, description_hashes[i], claimed_meshes);
+            if (previous_meshes[i] < 0) continue;
+            (source -> reused_meshes)[i] = !are_mesh_buffers_changed(main_obj, i, source -> watcher);
+            claimed_meshes[previous_meshes[i]] = (source -> reused_meshes)[i];
+        }
+        deallocate_selection(selection);
+        selection = select_reachable_objects(main_obj, reachable_only ? roots : NULL, roots_count, source -> reused_meshes);
+    }
+
+    Array buffers = init_arr();
+    Array buffer_views = decode_buffer_views(main_obj, source, &buffers, selection);
+
+    bool reuse_more = FALSE;
+    for (unsigned int i = 0; source -> track_changes && i < meshes_count && !has_allocation_failed(); ++i) {
+        if (!is_selected(selection, SELECT_MESHES, i)) continue;
+        data_hashes[i] = hash_mesh_data(main_obj, i, buffer_views);
+        if (previous_meshes[i] < 0 || claimed_meshes[previous_meshes[i]] || (source -> previous_scene -> meshes)[previous_meshes[i]].data_hash != data_hashes[i]) continue;
+        claimed_meshes[previous_meshes[i]] = TRUE;
+        (source -> reused_meshes)[i] = TRUE;
+        reuse_more = TRUE;
+    }
+
+    // The views are already read, the new selection only spares decoding the accessors of the reused meshes
+    if (reuse_more) {
+        deallocate_selection(selection);
+        selection = select_reachable_objects(main_obj, reachable_only ? roots : NULL, roots_count, source -> reused_meshes);
+    }
+
     Array accessors = init_arr();
-    decode_accessors(main_obj, path, &accessors);
+    decode_accessors(main_obj, buffer_views, &accessors, selection);
 
-    unsigned int root_node_index = atoi((char*) (get_object_by_id("scenes[0]/nodes[0]", &main_obj, TRUE) -> value));
-    debug_print(WHITE, "root node: %u\n", root_node_index);
+    // Nothing is decoded past a failed allocation, the caller releases what the scene already holds
+    if (has_allocation_failed()) {
+        for (unsigned int i = 0; i < accessors.count; ++i) {
+            gltf_free(GET_ELEMENT(Accessor*, accessors, i) -> data);
+            gltf_free(GET_ELEMENT(Accessor*, accessors, i));
+        }
+        deallocate_arr(accessors);
+        deallocate_buffer_views(buffer_views, buffers, source);
+        deallocate_selection(selection);
+        gltf_free(roots);
+        gltf_free(description_hashes);
+        gltf_free(data_hashes);
+        gltf_free(previous_meshes);
+        gltf_free(claimed_meshes);
+        return scene;
+    }
 
-    Object* nodes_obj = get_object_by_id("nodes", &main_obj, TRUE);
-    scene.root_node = create_node(nodes_obj, root_node_index);
+    debug_print(WHITE, "root nodes: %u, first: %u\n", roots_count, roots[0]);
+    scene.root_node = create_root_node(accessors, nodes_obj, roots, roots_count);
+    gltf_free(roots);
 
     debug_print(WHITE, "root node: children count: %u, meshes_count: %u\n", scene.root_node.children_count, scene.root_node.meshes_indices.count);
 
+    scene.nodes = (Node**) gltf_calloc(nodes_obj -> children_count, sizeof(Node*));
+    scene.nodes_count = (scene.nodes != NULL) ? nodes_obj -> children_count : 0;
+    register_nodes(&(scene.root_node), scene.nodes, scene.nodes_count);
+
     // decode meshes
     scene.meshes_count = 0;
-    scene.meshes = decode_mesh(accessors, main_obj, &scene.meshes_count);
+    scene.meshes = decode_mesh(accessors, main_obj, &scene.meshes_count, selection);
+
+    // Missing normals are only generated on request, and tangents only for the meshes drawn with a normal texture
+    unsigned char* generated_attributes = (unsigned char*) gltf_calloc(scene.meshes_count + 1, sizeof(unsigned char));
+    Object* materials_obj = get_object_by_id("materials", &main_obj, FALSE);
+    for (unsigned int i = 0; generated_attributes != NULL && options != NULL && i < scene.meshes_count; ++i) {
+        Mesh* mesh = scene.meshes + i;
+        Object* material_obj = (mesh -> has_material && materials_obj != NULL && mesh -> material_index < materials_obj -> children_count) ? materials_obj -> children + mesh -> material_index : NULL;
+        if (options -> generate_normals) generated_attributes[i] |= GENERATE_NORMALS;
+        if (options -> generate_tangents && material_obj != NULL && get_object_by_id("normalTexture", material_obj, FALSE) != NULL) generated_attributes[i] |= GENERATE_TANGENTS;
+    }
+    if (generated_attributes != NULL) generate_missing_attributes(scene.meshes, scene.meshes_count, generated_attributes, options != NULL && options -> smooth_normals, 0);
+    gltf_free(generated_attributes);
+
+    for (unsigned int i = 0; source -> track_changes && i < scene.meshes_count; ++i) {
+        if (!is_mesh_reused(source, i)) {
+            scene.meshes[i].description_hash = description_hashes[i];
+            scene.meshes[i].data_hash = data_hashes[i];
+            continue;
+        }
+        Mesh* previous_mesh = source -> previous_scene -> meshes + previous_meshes[i];
+        scene.meshes[i] = *previous_mesh;
+        *previous_mesh = (Mesh) {0};
+    }
+    initialize_morph_weights(&(scene.root_node), scene.meshes, scene.meshes_count);
+
+    // decode animations
+    scene.animations_count = 0;
+    scene.animations = decode_animations(accessors, main_obj, &scene.animations_count, selection);
+
+    // decode skins
+    scene.skins_count = 0;
+    scene.skins = decode_skins(accessors, main_obj, &scene.skins_count, selection);
 
     // deallocate accessors
     for (unsigned int i = 0; i < accessors.count; ++i) {
-        free(GET_ELEMENT(Accessor*, accessors, i) -> data);
-        free(GET_ELEMENT(Accessor*, accessors, i));
+        gltf_free(GET_ELEMENT(Accessor*, accessors, i) -> data);
+        gltf_free(GET_ELEMENT(Accessor*, accessors, i));
     }
     deallocate_arr(accessors);
 
-    // decode materials
+    // decode materials, the textures are owned by the scene and shared between materials
+    scene.textures_count = 0;
+    scene.textures = collect_textures(main_obj, &scene.textures_count, source, buffer_views, selection);
+    if (source -> track_changes) reuse_textures(&scene, source);
+    deallocate_buffer_views(buffer_views, buffers, source);
+    gltf_free(description_hashes);
+    gltf_free(data_hashes);
+    gltf_free(previous_meshes);
+    gltf_free(claimed_meshes);
     scene.materials_count = 0;
-    scene.materials = decode_materials(main_obj, &scene.materials_count, path);
+    scene.materials = decode_materials(main_obj, &scene.materials_count, scene.textures, scene.textures_count, selection);
+    deallocate_selection(selection);
+
+    // world bounds of the rest pose
+    float* world_matrices = compute_world_matrices(&scene);
+    if (world_matrices != NULL) update_world_bounds(&scene, world_matrices);
+    gltf_free(world_matrices);
     
     return scene;
 }
 
+static RawJson get_raw_json(Object* obj, char* identifier, bool keep) {
+    Object* member = (keep && obj != NULL) ? get_object_from_identifier(identifier, obj) : NULL;
+    return (member != NULL) ? (RawJson) { .data = member -> raw, .size = member -> raw_size } : (RawJson) {0};
+}
+
+// Spans are refreshed on reused meshes as well, as they pointed inside the JSON of the previous scene
+static void collect_raw_json(Scene* scene, Object* main_obj, bool keep) {
+    scene -> extras = get_raw_json(main_obj, "extras", keep);
+    scene -> extensions = get_raw_json(main_obj, "extensions", keep);
+
+    Object* nodes_obj = get_object_from_identifier("nodes", main_obj);
+    for (unsigned int i = 0; nodes_obj != NULL && i < nodes_obj -> children_count; ++i) {
+        Node* node = get_scene_node(scene, i);
+        if (node == NULL) continue;
+        node -> extras = get_raw_json(nodes_obj -> children + i, "extras", keep);
+        node -> extensions = get_raw_json(nodes_obj -> children + i, "extensions", keep);
+    }
+
+    Object* meshes_obj = get_object_from_identifier("meshes", main_obj);
+    for (unsigned int i = 0; i < scene -> meshes_count; ++i) {
+        Object* mesh_obj = (meshes_obj != NULL && i < meshes_obj -> children_count) ? meshes_obj -> children + i : NULL;
+        scene -> meshes[i].extras = get_raw_json(mesh_obj, "extras", keep);
+        scene -> meshes[i].extensions = get_raw_json(mesh_obj, "extensions", keep);
+    }
+
+    Object* materials_obj = get_object_from_identifier("materials", main_obj);
+    for (unsigned int i = 0; materials_obj != NULL && i < scene -> materials_count && i < materials_obj -> children_count; ++i) {
+        scene -> materials[i].extras = get_raw_json(materials_obj -> children + i, "extras", keep);
+        scene -> materials[i].extensions = get_raw_json(materials_obj -> children + i, "extensions", keep);
+    }
+
+    Object* textures_obj = get_object_from_identifier("textures", main_obj);
+    for (unsigned int i = 0; textures_obj != NULL && i < scene -> textures_count && i < textures_obj -> children_count; ++i) {
+        scene -> textures[i].extras = get_raw_json(textures_obj -> children + i, "extras", keep);
+        scene -> textures[i].extensions = get_raw_json(textures_obj -> children + i, "extensions", keep);
+    }
+
+    return;
+}
+
+static void deallocate_object(Object* obj) {
+    for (unsigned int i = 0; i < obj -> children_count; ++i) {
+        deallocate_object(obj -> children + i);
+    }
+    gltf_free(obj -> children);
+    gltf_free(obj -> identifier);
+    gltf_free(obj -> value);
+    return;
+}
+
+static void deallocate_node(Node* node) {
+    for (unsigned int i = 0; i < node -> children_count; ++i) {
+        deallocate_node(node -> childrens + i);
+    }
+    gltf_free(node -> childrens);
+    gltf_free(node -> weights);
+
+    for (unsigned int i = 0; i < node -> meshes_indices.count; ++i) {
+        gltf_free(GET_ELEMENT(unsigned int*, node -> meshes_indices, i));
+    }
+    gltf_free(node -> meshes_indices.data);
+    deallocate_instances(&(node -> instances));
+
+    return;
+}
+
+void deallocate_scene(Scene* scene) {
+    debug_print(BLUE, "deallocating scene...\n");
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&(scene -> allocator));
+
+    deallocate_node(&(scene -> root_node));
+    gltf_free(scene -> nodes);
+
+    for (unsigned int i = 0; i < scene -> meshes_count; ++i) deallocate_mesh(scene -> meshes + i);
+    gltf_free(scene -> meshes);
+
+    for (unsigned int i = 0; i < scene -> materials_count; ++i) {
+        gltf_free((scene -> materials)[i].pbr_metallic_roughness.base_color_factor);
+        gltf_free((scene -> materials)[i].emissive_factor);
+        gltf_free((scene -> materials)[i].alpha_mode);
+    }
+    gltf_free(scene -> materials);
+
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        gltf_free((scene -> textures)[i].texture_path);
+        gltf_free((scene -> textures)[i].mime_type);
+        gltf_free((scene -> textures)[i].image.pixels);
+        deallocate_ktx2(&((scene -> textures)[i].ktx2));
+        if (!(scene -> textures)[i].borrowed_encoded) gltf_free((scene -> textures)[i].encoded);
+    }
+    gltf_free(scene -> textures);
+
+    for (unsigned int i = 0; i < scene -> animations_count; ++i) {
+        for (unsigned int j = 0; j < (scene -> animations)[i].samplers_count; ++j) {
+            gltf_free((scene -> animations)[i].samplers[j].inputs);
+            gltf_free((scene -> animations)[i].samplers[j].outputs);
+        }
+        gltf_free((scene -> animations)[i].samplers);
+        gltf_free((scene -> animations)[i].channels);
+        gltf_free((scene -> animations)[i].name);
+    }
+    gltf_free(scene -> animations);
+
+    for (unsigned int i = 0; i < scene -> skins_count; ++i) {
+        gltf_free((scene -> skins)[i].joints);
+        gltf_free((scene -> skins)[i].inverse_bind_matrices);
+    }
+    gltf_free(scene -> skins);
+    gltf_free(scene -> json);
+
+    set_allocator(&previous_allocator);
+    *scene = (Scene) {0};
+
+    return;
+}
+
+// Releases a scene whose load ran out of memory, callers get an empty scene instead
+static Scene discard_scene(Scene* scene) {
+    error_print("out of memory while decoding the scene\n");
+    deallocate_scene(scene);
+    return (Scene) {0};
+}
+
+// Finds the JSON chunk and the optional binary chunk of a GLB container. Returns TRUE on error.
+static bool parse_glb(const unsigned char* data, unsigned int size, const unsigned char** json, unsigned int* json_size, GltfSource* source) {
+    if (size < 20 || read_le32(data + 4) != 2 || read_le32(data + 8) > size) {
+        error_print("invalid glb header\n");
+        return TRUE;
+    }
+
+    size = read_le32(data + 8);
+    *json_size = read_le32(data + 12);
+    if (read_le32(data + 16) != GLB_JSON_CHUNK || *json_size > size - 20) {
+        error_print("the glb does not start with a json chunk\n");
+        return TRUE;
+    }
+    *json = data + 20;
+
+    // The binary chunk, if any, follows the JSON one padded to 4 bytes
+    unsigned int offset = 20 + *json_size;
+    if (size - offset >= 8 && read_le32(data + offset + 4) == GLB_BIN_CHUNK) {
+        unsigned int binary_chunk_size = read_le32(data + offset);
+        if (binary_chunk_size > size - offset - 8) {
+            error_print("glb binary chunk exceeds the file length: %u\n", size);
+            return TRUE;
+        }
+        source -> binary_chunk = data + offset + 8;
+        source -> binary_chunk_size = binary_chunk_size;
+    }
+    debug_print(WHITE, "glb: json %u bytes, binary chunk %u bytes\n", *json_size, source -> binary_chunk_size);
+
+    return FALSE;
+}
+
+// Parses the JSON, which is only read, then decodes the scene and runs the load-time passes
+static Scene decode_gltf_json(unsigned char* json, unsigned int json_size, GltfSource* source, GltfLoadOptions* options) {
+    Scene scene = {0};
+
+    // The parser skips whitespace up to the first identifier, so any JSON starting with a brace is accepted
+    BitStream bit_stream = { .stream = json, .size = json_size, .error = NO_ERROR };
+    if (json_size == 0 || get_next_byte_uc(&bit_stream) != '{') {
+        error_print("invalid gltf file\n");
+        return scene;
+    }
+
+    // The spans of the extras and extensions point inside the parsed text, so a kept JSON is copied before parsing
+    bool keep_raw_json = (options != NULL && options -> keep_raw_json);
+    char* kept_json = NULL;
+    if (keep_raw_json) {
+        kept_json = (char*) gltf_calloc(json_size + 1, sizeof(char));
+        if (kept_json == NULL) return scene;
+        memcpy(kept_json, json, json_size);
+        bit_stream.stream = (unsigned char*) kept_json;
+    }
+
+    Object default_object = (Object) { .children = gltf_calloc(1, sizeof(Object)), .children_count = 0, .parent = NULL, .value = NULL, .identifier = NULL, .obj_type = DICTIONARY };
+    read_dictionary(&bit_stream, &default_object);
+    if (bit_stream.error || has_allocation_failed()) {
+        error_print((bit_stream.error && bit_stream.error != OUT_OF_MEMORY) ? "invalid gltf json\n" : "out of memory while parsing the gltf json\n");
+        deallocate_object(&default_object);
+        gltf_free(kept_json);
+        return scene;
+    }
+
+    scene = decode_scene(default_object, source, options);
+    scene.allocator = get_allocator();
+    scene.json = kept_json;
+    scene.json_size = keep_raw_json ? json_size : 0;
+    collect_raw_json(&scene, &default_object, keep_raw_json);
+    deallocate_object(&default_object);
+    if (has_allocation_failed()) return discard_scene(&scene);
+
+    // Meshes reused from a previous scene already went through these passes
+    for (unsigned int i = 0; options != NULL && options -> weld_vertices && i < scene.meshes_count; ++i) {
+        if (is_mesh_reused(source, i)) continue;
+        unsigned int vertices_count = scene.meshes[i].vertices.arr.count;
+        unsigned int welded_count = weld_vertices(scene.meshes + i, options -> weld_epsilon);
+        debug_print(CYAN, "mesh %u: welded %u vertices into %u\n", i, vertices_count, welded_count);
+    }
+
+    for (unsigned int i = 0; options != NULL && options -> optimize_meshes && i < scene.meshes_count; ++i) {
+        if (is_mesh_reused(source, i)) continue;
+        VertexCacheStatistics before = {0};
+        VertexCacheStatistics after = {0};
+        optimize_mesh(scene.meshes + i, &before, &after);
+        debug_print(CYAN, "mesh %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", i, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+
+    for (unsigned int i = 0; options != NULL && options -> lods_count > 0 && i < scene.meshes_count; ++i) {
+        if (is_mesh_reused(source, i)) continue;
+        generate_lods(scene.meshes + i, options -> lods_count, (options -> lod_ratio > 0.0f) ? options -> lod_ratio : 0.5f);
+    }
+
+    unsigned long long int saved_bytes = 0;
+    for (unsigned int i = 0; i < scene.meshes_count; ++i) {
+        Mesh* mesh = scene.meshes + i;
+        if (is_mesh_reused(source, i)) continue;
+        saved_bytes += build_index_buffer(mesh);
+        if (options == NULL || !options -> split_meshes || split_mesh(mesh, MAX_SHORT_INDEXED_VERTICES) == 0) continue;
+        // The parts are copies, the 32-bit indices of the base mesh stay
+        debug_print(CYAN, "mesh %u: split into %u parts, adding %llu bytes\n", i, mesh -> parts_count, get_mesh_parts_size(mesh));
+    }
+    debug_print(CYAN, "16-bit indices saved %llu bytes\n", saved_bytes);
+
+    // Positions are still floats here, meshes reused from a previous scene keep their meshlets
+    if (options != NULL && options -> meshlet_max_vertices > 0) {
+        build_meshes_meshlets(scene.meshes, scene.meshes_count, options -> meshlet_max_vertices, options -> meshlet_max_triangles, 0);
+        unsigned int meshlets_count = 0;
+        for (unsigned int i = 0; i < scene.meshes_count; ++i) meshlets_count += scene.meshes[i].meshlets.count;
+        debug_print(CYAN, "built %u meshlets\n", meshlets_count);
+    }
+    if (options != NULL && options -> build_bvhs) build_meshes_bvhs(scene.meshes, scene.meshes_count, 0);
+
+    saved_bytes = 0;
+    for (unsigned int i = 0; options != NULL && i < scene.meshes_count; ++i) {
+        if (!is_mesh_reused(source, i)) saved_bytes += compress_vertex_attributes(scene.meshes + i, &(options -> vertex_formats));
+    }
+    debug_print(CYAN, "compact vertex formats saved %llu bytes\n", saved_bytes);
+
+    if (options != NULL && options -> decode_textures) decode_textures(&scene, 0);
+    if (options != NULL && options -> instance_matrices) {
+        float* world_matrices = compute_world_matrices(&scene);
+        for (unsigned int i = 0; world_matrices != NULL && i < scene.nodes_count; ++i) {
+            Node* node = get_scene_node(&scene, i);
+            if (node == NULL || node -> instances.count == 0) continue;
+            node -> instances.matrices = (float*) gltf_calloc((size_t) node -> instances.count * INSTANCE_MATRIX_SIZE, sizeof(float));
+            if (node -> instances.matrices == NULL) continue;
+            compute_instance_matrices(&(node -> instances), world_matrices + i * 16, node -> instances.matrices, 0);
+        }
+        gltf_free(world_matrices);
+    }
+
+    if (options != NULL && options -> load_ktx2_textures) load_ktx2_textures(&scene, options -> inflate_ktx2_levels, 0);
+    if (has_allocation_failed()) return discard_scene(&scene);
+
+    return scene;
+}
+
 Scene decode_gltf(char* path) {
-    char* file_path = (char*) calloc(175, sizeof(char));
+    return decode_gltf_with_options(path, NULL);
+}
+
+Scene decode_gltf_with_options(char* path, GltfLoadOptions* options) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator((options != NULL) ? options -> allocator : NULL);
+    set_allocation_failed(FALSE);
+
+    char* file_path = (char*) gltf_calloc(175, sizeof(char));
+    if (file_path == NULL) {
+        set_allocator(&previous_allocator);
+        return (Scene) {0};
+    }
     int len = snprintf(file_path, 175, "%sscene.gltf", path);
-    file_path = (char*) realloc(file_path, sizeof(char) * len);
+    char* shrunk_path = (char*) gltf_realloc(file_path, sizeof(char) * (len + 1));
+    if (shrunk_path != NULL) file_path = shrunk_path;
 
     File file_data = (File) {.file_path = file_path};
     read_model_file(&file_data);
 
-    BitStream* bit_stream = allocate_bit_stream(file_data.data, file_data.size, FALSE);
-    deallocate_file(&file_data, FALSE);
+    GltfSource source = { .path = path, .cache_buffers = options != NULL && options -> cache_buffers };
+    Scene scene = decode_gltf_json(file_data.data, file_data.size, &source, options);
+    deallocate_file(&file_data, TRUE);
 
-    Scene scene = {0};
+    set_allocator(&previous_allocator);
 
-    if (get_next_bytes_us(bit_stream) != (unsigned short int)(('{' << 8) | '\n')) {
-        error_print("invalid gltf file\n");
-        deallocate_bit_stream(bit_stream);
-        return scene; 
+    return scene;
+}
+
+// Decodes path again, moving the meshes and textures unchanged since previous_scene out of it, which must then be
+// deallocated as usual. The options must match the ones previous_scene was loaded with. Without a previous scene
+// this is a plain load that also hashes the meshes sources for the next reload. The watcher, if any, is told
+// about every file of the new scene and its changes are cleared.
+Scene reload_gltf(char* path, Scene* previous_scene, FileWatcher* watcher, GltfLoadOptions* options, SceneDiff* diff) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator((options != NULL) ? options -> allocator : NULL);
+    set_allocation_failed(FALSE);
+
+    char* file_path = (char*) gltf_calloc(175, sizeof(char));
+    if (file_path == NULL) {
+        set_allocator(&previous_allocator);
+        return (Scene) {0};
     }
+    int len = snprintf(file_path, 175, "%sscene.gltf", path);
+    char* shrunk_path = (char*) gltf_realloc(file_path, sizeof(char) * (len + 1));
+    if (shrunk_path != NULL) file_path = shrunk_path;
 
-    Object default_object = (Object) { .children = calloc(1, sizeof(Object)), .children_count = 0, .parent = NULL, .value = NULL, .identifier = "main", .obj_type = DICTIONARY };
-    read_dictionary(bit_stream, &default_object);
-    deallocate_bit_stream(bit_stream);
+    File file_data = (File) {.file_path = file_path};
+    read_model_file(&file_data);
+
+    GltfSource source = { .path = path, .track_changes = TRUE, .previous_scene = previous_scene, .watcher = watcher, .cache_buffers = options != NULL && options -> cache_buffers };
+    Scene scene = decode_gltf_json(file_data.data, file_data.size, &source, options);
+    deallocate_file(&file_data, TRUE);
+
+    unsigned int changed_count = (watcher != NULL) ? poll_file_watcher(watcher, 0) : 0;
+    if (diff != NULL) {
+        *diff = (SceneDiff) { .meshes_count = scene.meshes_count, .textures_count = scene.textures_count, .changed_files_count = changed_count, .allocator = get_allocator() };
+        diff -> reused_meshes = (source.reused_meshes != NULL) ? source.reused_meshes : (bool*) gltf_calloc(scene.meshes_count + 1, sizeof(bool));
+        diff -> reused_textures = (source.reused_textures != NULL) ? source.reused_textures : (bool*) gltf_calloc(scene.textures_count + 1, sizeof(bool));
+    } else {
+        gltf_free(source.reused_meshes);
+        gltf_free(source.reused_textures);
+    }
+
+    // The watcher allocates through its own allocator
+    if (watcher != NULL) {
+        size_t path_len = strlen(path);
+        watch_file(watcher, "scene.gltf");
+        for (unsigned int i = 0; i < scene.textures_count; ++i) {
+            if ((scene.textures)[i].texture_path != NULL) watch_file(watcher, (scene.textures)[i].texture_path + path_len);
+        }
+        for (unsigned int i = 0; i < source.buffers_count; ++i) watch_file(watcher, (source.buffers_uris)[i]);
+        clear_file_changes(watcher);
+    }
+    for (unsigned int i = 0; i < source.buffers_count; ++i) gltf_free((source.buffers_uris)[i]);
+    gltf_free(source.buffers_uris);
+
+    unsigned int reused_count = 0;
+    for (unsigned int i = 0; diff != NULL && i < scene.meshes_count; ++i) reused_count += (diff -> reused_meshes)[i];
+    debug_print(CYAN, "reload: %u changed files, %u of %u meshes reused\n", changed_count, reused_count, scene.meshes_count);
+    set_allocator(&previous_allocator);
+
+    return scene;
+}
+
+void deallocate_scene_diff(SceneDiff* diff) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&(diff -> allocator));
+    gltf_free(diff -> reused_meshes);
+    gltf_free(diff -> reused_textures);
+    *diff = (SceneDiff) {0};
+    set_allocator(&previous_allocator);
+    return;
+}
+
+Scene decode_gltf_from_memory(const unsigned char* json_or_glb, unsigned int size, GltfUriResolver* resolver) {
+    return decode_gltf_from_memory_with_options(json_or_glb, size, resolver, NULL);
+}
+
+// Nothing is copied: the JSON is parsed in place and the buffers borrow the GLB binary chunk or the memory
+// returned by the resolver, which only has to outlive this call, or the scene when it resolves images
+Scene decode_gltf_from_memory_with_options(const unsigned char* json_or_glb, unsigned int size, GltfUriResolver* resolver, GltfLoadOptions* options) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator((options != NULL) ? options -> allocator : NULL);
+
+    set_allocation_failed(FALSE);
+    Scene scene = {0};
+    GltfSource source = { .resolver = resolver };
+    const unsigned char* json = json_or_glb;
+    unsigned int json_size = size;
+    if (size >= 4 && read_le32(json_or_glb) == GLB_MAGIC && parse_glb(json_or_glb, size, &json, &json_size, &source)) {
+        set_allocator(&previous_allocator);
+        return scene;
+    }
 
-    scene = decode_scene(default_object, path);
+    scene = decode_gltf_json((unsigned char*) json, json_size, &source, options);
+    set_allocator(&previous_allocator);
 
     return scene;
 }
@@ -0,0 +1,771 @@
+#ifndef _GLTF_WRITER_H_
+#define _GLTF_WRITER_H_
+
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./file_io.h"
+#include "./scene.h"
+#include "./bounds.h"
+#include "./index_buffer.h"
+#include "./vertex_format.h"
+#include "./ktx2.h"
+
+#define GLB_MAGIC 0x46546C67 // "glTF"
+#define GLB_JSON_CHUNK 0x4E4F534A // "JSON"
+#define GLB_BIN_CHUNK 0x004E4942 // "BIN\0"
+#define BUFFER_VIEW_ALIGNMENT 4
+#define MESH_ACCESSORS_COUNT 8 // the seven attributes plus the indices
+#define INDICES_ACCESSOR 7
+
+/* -------------------------------------------------------------------------- */
+
+bool encode_gltf(Scene* scene, char* path, bool binary);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct WriterAccessor {
+    const unsigned char* data; // NULL for accessors without a buffer view
+    ArrayExtended* decoded_attribute; // when not NULL the elements are decoded to floats while writing
+    unsigned int count;
+    unsigned int element_size; // bytes written per element
+    unsigned int source_stride; // bytes between two elements of data
+    ComponentType component_type;
+    DataType data_type;
+    bool normalized;
+    int target; // bufferView target, -1 when not a vertex or index buffer
+    bool has_bounds;
+    float min[4];
+    float max[4];
+    const unsigned int* sparse_indices;
+    const float* sparse_values;
+    unsigned int sparse_count;
+    unsigned int buffer_view; // first buffer view, the sparse indices and values follow the data one
+} WriterAccessor;
+
+// Every accessor and buffer view is planned before the JSON is written, so that the whole document can be
+// streamed in one pass and the binary data copied straight from the scene afterwards
+typedef struct WriterLayout {
+    WriterAccessor* accessors;
+    unsigned int accessors_count;
+    unsigned int buffer_views_count;
+    unsigned long long int byte_length;
+    int* mesh_accessors; // MESH_ACCESSORS_COUNT per mesh, -1 when the attribute is missing
+    int* target_accessors; // position, normal and tangent deltas of each morph target, flattened over the meshes
+    int* sampler_accessors; // input and output of each animation sampler, flattened over the animations
+    int* skin_accessors; // inverse bind matrices of each skin
+    int* image_views; // buffer view of each texture image held only in Texture.encoded, -1 when written as a uri
+} WriterLayout;
+
+static const char* attribute_names[] = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD_0", "COLOR_0", "JOINTS_0", "WEIGHTS_0" };
+static const char* paths_names[] = { "translation", "rotation", "scale", "weights" };
+static const char* data_types_names[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+
+static unsigned long long int align_offset(unsigned long long int offset) {
+    return (offset + BUFFER_VIEW_ALIGNMENT - 1) & ~((unsigned long long int) BUFFER_VIEW_ALIGNMENT - 1);
+}
+
+// Returns -1 when out of memory, the failure is left in has_allocation_failed for plan_layout
+static int add_accessor(WriterLayout* layout, WriterAccessor accessor) {
+    WriterAccessor* accessors = (WriterAccessor*) gltf_realloc(layout -> accessors, sizeof(WriterAccessor) * (layout -> accessors_count + 1));
+    if (accessors == NULL) return -1;
+    layout -> accessors = accessors;
+    (layout -> accessors)[layout -> accessors_count] = accessor;
+    return (int) (layout -> accessors_count++);
+}
+
+static int add_float_accessor(WriterLayout* layout, const float* data, unsigned int count, DataType data_type, unsigned int source_stride) {
+    if (data == NULL || count == 0) return -1;
+    unsigned int element_size = elements_count[data_type] * sizeof(float);
+    WriterAccessor accessor = { .data = (const unsigned char*) data, .count = count, .element_size = element_size, .source_stride = source_stride, .component_type = FLOAT, .data_type = data_type, .target = -1 };
+    return add_accessor(layout, accessor);
+}
+
+// Half floats and octahedral vectors aren't valid core glTF, and vertex elements must be four-byte aligned,
+// so those attributes are written back as floats
+static int add_attribute_accessor(WriterLayout* layout, ArrayExtended* attribute) {
+    if (attribute -> storage == NULL || attribute -> arr.count == 0) return -1;
+
+    unsigned int element_size = elements_count[attribute -> data_type] * byte_lengths[attribute -> component_type];
+    WriterAccessor accessor = { .data = (const unsigned char*) (attribute -> storage), .count = attribute -> arr.count, .element_size = element_size, .source_stride = element_size, .component_type = attribute -> component_type, .data_type = attribute -> data_type, .normalized = attribute -> normalized, .target = 34962 };
+
+    if (attribute -> component_type == HALF_FLOAT || attribute -> encoding != ENCODING_NONE || element_size % BUFFER_VIEW_ALIGNMENT != 0) {
+        DataType data_type = attribute -> data_type;
+        if (attribute -> encoding == ENCODING_OCTAHEDRAL) data_type = (attribute -> data_type == VEC2) ? VEC3 : VEC4;
+        accessor.decoded_attribute = attribute;
+        accessor.component_type = FLOAT;
+        accessor.data_type = data_type;
+        accessor.normalized = FALSE;
+        accessor.element_size = elements_count[data_type] * sizeof(float);
+    }
+
+    return add_accessor(layout, accessor);
+}
+
+static int add_deltas_accessor(WriterLayout* layout, MorphTarget* target, const float* deltas, unsigned int vertices_count, bool with_bounds) {
+    if (deltas == NULL) return -1;
+
+    WriterAccessor accessor = { .count = vertices_count, .element_size = 3 * sizeof(float), .source_stride = 3 * sizeof(float), .component_type = FLOAT, .data_type = VEC3, .target = -1 };
+    unsigned int deltas_count = vertices_count;
+    if (target -> sparse_indices != NULL) {
+        accessor.sparse_indices = target -> sparse_indices;
+        accessor.sparse_values = deltas;
+        accessor.sparse_count = target -> sparse_count;
+        deltas_count = target -> sparse_count;
+    } else {
+        accessor.data = (const unsigned char*) deltas;
+    }
+
+    // POSITION targets require their bounds, the vertices left out of a sparse target stay at zero
+    if (with_bounds) {
+        accessor.has_bounds = TRUE;
+        if (deltas_count > 0) compute_positions_bounds(deltas, deltas_count, accessor.min, accessor.max);
+        else reset_bounds(accessor.min, accessor.max);
+        if (deltas_count < vertices_count) {
+            const float zero[3] = { 0.0f, 0.0f, 0.0f };
+            merge_bounds(accessor.min, accessor.max, zero, zero);
+        }
+    }
+
+    return add_accessor(layout, accessor);
+}
+
+static void plan_mesh(WriterLayout* layout, Mesh* mesh, int* mesh_accessors, int* target_accessors) {
+    ArrayExtended* attributes[] = { &(mesh -> vertices), &(mesh -> normals), &(mesh -> tangents), &(mesh -> texture_coords), &(mesh -> colors), &(mesh -> joints), &(mesh -> weights) };
+    for (unsigned char i = 0; i < sizeof(attributes) / sizeof(attributes[0]); ++i) mesh_accessors[i] = add_attribute_accessor(layout, attributes[i]);
+
+    if (mesh_accessors[0] >= 0 && !is_bounds_empty(mesh -> bounds_min, mesh -> bounds_max)) {
+        WriterAccessor* positions = layout -> accessors + mesh_accessors[0];
+        positions -> has_bounds = TRUE;
+        memcpy(positions -> min, mesh -> bounds_min, sizeof(float) * 3);
+        memcpy(positions -> max, mesh -> bounds_max, sizeof(float) * 3);
+    }
+
+    if (mesh -> index_buffer.data == NULL && mesh -> faces_count > 0) build_index_buffer(mesh);
+    mesh_accessors[INDICES_ACCESSOR] = -1;
+    if (mesh -> index_buffer.data != NULL && mesh -> index_buffer.count > 0) {
+        unsigned int index_size = byte_lengths[mesh -> index_buffer.component_type];
+        WriterAccessor indices = { .data = (const unsigned char*) (mesh -> index_buffer.data), .count = mesh -> index_buffer.count, .element_size = index_size, .source_stride = index_size, .component_type = mesh -> index_buffer.component_type, .data_type = SCALAR, .target = 34963 };
+        mesh_accessors[INDICES_ACCESSOR] = add_accessor(layout, indices);
+    }
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    for (unsigned int i = 0; i < mesh -> targets_count; ++i) {
+        MorphTarget* target = mesh -> targets + i;
+        target_accessors[i * 3] = add_deltas_accessor(layout, target, target -> position_deltas, vertices_count, TRUE);
+        target_accessors[i * 3 + 1] = add_deltas_accessor(layout, target, target -> normal_deltas, vertices_count, FALSE);
+        target_accessors[i * 3 + 2] = add_deltas_accessor(layout, target, target -> tangent_deltas, vertices_count, FALSE);
+    }
+
+    return;
+}
+
+// The sampler doesn't know what it animates, the channels targeting it tell how its outputs are shaped
+static DataType get_sampler_data_type(Animation* animation, unsigned int sampler_index) {
+    for (unsigned int i = 0; i < animation -> channels_count; ++i) {
+        if ((animation -> channels)[i].sampler_index != sampler_index) continue;
+        AnimationPath path = (animation -> channels)[i].path;
+        if (path == WEIGHTS_PATH) return SCALAR;
+        return (path == ROTATION_PATH) ? VEC4 : VEC3;
+    }
+    return ((animation -> samplers)[sampler_index].values_stride == 4) ? VEC4 : SCALAR;
+}
+
+static void plan_animation(WriterLayout* layout, Animation* animation, int* sampler_accessors) {
+    for (unsigned int i = 0; i < animation -> samplers_count; ++i) {
+        AnimationSampler* sampler = animation -> samplers + i;
+        sampler_accessors[i * 2] = add_float_accessor(layout, sampler -> inputs, sampler -> keyframes_count, SCALAR, sizeof(float));
+        if (sampler_accessors[i * 2] >= 0) {
+            WriterAccessor* inputs = layout -> accessors + sampler_accessors[i * 2];
+            inputs -> has_bounds = TRUE;
+            inputs -> min[0] = (sampler -> inputs)[0];
+            inputs -> max[0] = (sampler -> inputs)[sampler -> keyframes_count - 1];
+        }
+
+        // Vector outputs are padded to four floats in memory, weights are one float per target
+        unsigned int keys_count = sampler -> keyframes_count * ((sampler -> interpolation == INTERPOLATION_CUBICSPLINE) ? 3 : 1);
+        DataType data_type = get_sampler_data_type(animation, i);
+        if (data_type == SCALAR) sampler_accessors[i * 2 + 1] = add_float_accessor(layout, sampler -> outputs, keys_count * sampler -> values_stride, SCALAR, sizeof(float));
+        else sampler_accessors[i * 2 + 1] = add_float_accessor(layout, sampler -> outputs, keys_count, data_type, sampler -> values_stride * sizeof(float));
+    }
+
+    return;
+}
+
+static unsigned int count_morph_targets(Scene* scene) {
+    unsigned int targets_count = 0;
+    for (unsigned int i = 0; i < scene -> meshes_count; ++i) targets_count += (scene -> meshes)[i].targets_count;
+    return targets_count;
+}
+
+static unsigned int count_animation_samplers(Scene* scene) {
+    unsigned int samplers_count = 0;
+    for (unsigned int i = 0; i < scene -> animations_count; ++i) samplers_count += (scene -> animations)[i].samplers_count;
+    return samplers_count;
+}
+
+// Returns TRUE when out of memory, what was planned is still released by deallocate_layout
+static bool plan_layout(Scene* scene, WriterLayout* layout_out) {
+    WriterLayout layout = {0};
+    layout.mesh_accessors = (int*) gltf_calloc(scene -> meshes_count * MESH_ACCESSORS_COUNT, sizeof(int));
+    layout.target_accessors = (int*) gltf_calloc(count_morph_targets(scene) * 3, sizeof(int));
+    layout.sampler_accessors = (int*) gltf_calloc(count_animation_samplers(scene) * 2, sizeof(int));
+    layout.skin_accessors = (int*) gltf_calloc(scene -> skins_count, sizeof(int));
+    layout.image_views = (int*) gltf_calloc(scene -> textures_count, sizeof(int));
+    *layout_out = layout;
+    if (has_allocation_failed()) return TRUE;
+
+    unsigned int targets_offset = 0;
+    for (unsigned int i = 0; i < scene -> meshes_count; ++i) {
+        plan_mesh(&layout, scene -> meshes + i, layout.mesh_accessors + i * MESH_ACCESSORS_COUNT, layout.target_accessors + targets_offset * 3);
+        targets_offset += (scene -> meshes)[i].targets_count;
+    }
+
+    unsigned int samplers_offset = 0;
+    for (unsigned int i = 0; i < scene -> animations_count; ++i) {
+        plan_animation(&layout, scene -> animations + i, layout.sampler_accessors + samplers_offset * 2);
+        samplers_offset += (scene -> animations)[i].samplers_count;
+    }
+
+    for (unsigned int i = 0; i < scene -> skins_count; ++i) {
+        Skin* skin = scene -> skins + i;
+        (layout.skin_accessors)[i] = add_float_accessor(&layout, skin -> inverse_bind_matrices, skin -> joints_count, MAT4, 16 * sizeof(float));
+    }
+
+    // Accessors missing for lack of memory would shift the indices of the following ones
+    *layout_out = layout;
+    if (has_allocation_failed()) return TRUE;
+
+    // Buffer views follow the accessors order, each one starting aligned
+    for (unsigned int i = 0; i < layout.accessors_count; ++i) {
+        WriterAccessor* accessor = layout.accessors + i;
+        accessor -> buffer_view = layout.buffer_views_count;
+        if (accessor -> data != NULL) {
+            layout.byte_length = align_offset(layout.byte_length) + (unsigned long long int) accessor -> count * accessor -> element_size;
+            layout.buffer_views_count++;
+        }
+        if (accessor -> sparse_count > 0) {
+            layout.byte_length = align_offset(layout.byte_length) + (unsigned long long int) accessor -> sparse_count * sizeof(unsigned int);
+            layout.byte_length = align_offset(layout.byte_length) + (unsigned long long int) accessor -> sparse_count * accessor -> element_size;
+            layout.buffer_views_count += 2;
+        }
+    }
+
+    // Images without a path go into the buffer after the accessors, one view each
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        Texture* texture = scene -> textures + i;
+        (layout.image_views)[i] = -1;
+        if (texture -> texture_path != NULL || texture -> encoded == NULL || texture -> encoded_size == 0) continue;
+        (layout.image_views)[i] = (int) (layout.buffer_views_count++);
+        layout.byte_length = align_offset(layout.byte_length) + texture -> encoded_size;
+    }
+    layout.byte_length = align_offset(layout.byte_length);
+    *layout_out = layout;
+
+    return FALSE;
+}
+
+static void deallocate_layout(WriterLayout* layout) {
+    gltf_free(layout -> accessors);
+    gltf_free(layout -> mesh_accessors);
+    gltf_free(layout -> target_accessors);
+    gltf_free(layout -> sampler_accessors);
+    gltf_free(layout -> skin_accessors);
+    gltf_free(layout -> image_views);
+    return;
+}
+
+/* JSON */
+
+static void write_json_string(BufferedWriter* writer, const char* str) {
+    buffered_write(writer, "\"", 1);
+    for (; *str != '\0'; ++str) {
+        if (*str == '"' || *str == '\\') buffered_printf(writer, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20) buffered_printf(writer, "\\u%04x", (unsigned char) *str);
+        else buffered_write(writer, str, 1);
+    }
+    buffered_write(writer, "\"", 1);
+    return;
+}
+
+static void write_json_floats(BufferedWriter* writer, const char* name, const float* values, unsigned int count) {
+    buffered_printf(writer, "\"%s\": [", name);
+    for (unsigned int i = 0; i < count; ++i) buffered_printf(writer, (i == 0) ? "%.9g" : ", %.9g", values[i]);
+    buffered_write(writer, "]", 1);
+    return;
+}
+
+static void write_accessors(BufferedWriter* writer, WriterLayout* layout) {
+    buffered_printf(writer, "  \"accessors\": [");
+    for (unsigned int i = 0; i < layout -> accessors_count; ++i) {
+        WriterAccessor* accessor = layout -> accessors + i;
+        buffered_printf(writer, "%s\n    {", (i == 0) ? "" : ",");
+        if (accessor -> data != NULL) buffered_printf(writer, "\"bufferView\": %u, ", accessor -> buffer_view);
+        buffered_printf(writer, "\"componentType\": %u, \"count\": %u, \"type\": \"%s\"", 5120 + accessor -> component_type, accessor -> count, data_types_names[accessor -> data_type]);
+        if (accessor -> normalized) buffered_printf(writer, ", \"normalized\": true");
+        if (accessor -> has_bounds) {
+            buffered_write(writer, ", ", 2);
+            write_json_floats(writer, "min", accessor -> min, elements_count[accessor -> data_type]);
+            buffered_write(writer, ", ", 2);
+            write_json_floats(writer, "max", accessor -> max, elements_count[accessor -> data_type]);
+        }
+        if (accessor -> sparse_count > 0) {
+            unsigned int indices_view = accessor -> buffer_view + ((accessor -> data != NULL) ? 1 : 0);
+            buffered_printf(writer, ", \"sparse\": {\"count\": %u, \"indices\": {\"bufferView\": %u, \"componentType\": 5125}, \"values\": {\"bufferView\": %u}}", accessor -> sparse_count, indices_view, indices_view + 1);
+        }
+        buffered_write(writer, "}", 1);
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+static void write_buffer_views(BufferedWriter* writer, Scene* scene, WriterLayout* layout) {
+    unsigned long long int offset = 0;
+    unsigned int view_index = 0;
+    buffered_printf(writer, "  \"bufferViews\": [");
+    for (unsigned int i = 0; i < layout -> accessors_count; ++i) {
+        WriterAccessor* accessor = layout -> accessors + i;
+        unsigned long long int lengths[3] = { 0 };
+        unsigned char views_count = 0;
+        if (accessor -> data != NULL) lengths[views_count++] = (unsigned long long int) accessor -> count * accessor -> element_size;
+        if (accessor -> sparse_count > 0) {
+            lengths[views_count++] = (unsigned long long int) accessor -> sparse_count * sizeof(unsigned int);
+            lengths[views_count++] = (unsigned long long int) accessor -> sparse_count * accessor -> element_size;
+        }
+
+        for (unsigned char j = 0; j < views_count; ++j, ++view_index) {
+            offset = align_offset(offset);
+            buffered_printf(writer, "%s\n    {\"buffer\": 0, \"byteOffset\": %llu, \"byteLength\": %llu", (view_index == 0) ? "" : ",", offset, lengths[j]);
+            if (j == 0 && accessor -> data != NULL && accessor -> target >= 0) buffered_printf(writer, ", \"target\": %d", accessor -> target);
+            buffered_write(writer, "}", 1);
+            offset += lengths[j];
+        }
+    }
+    for (unsigned int i = 0; i < scene -> textures_count; ++i, ++view_index) {
+        if ((layout -> image_views)[i] < 0) continue;
+        offset = align_offset(offset);
+        buffered_printf(writer, "%s\n    {\"buffer\": 0, \"byteOffset\": %llu, \"byteLength\": %u}", (view_index == 0) ? "" : ",", offset, (scene -> textures)[i].encoded_size);
+        offset += (scene -> textures)[i].encoded_size;
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+static void write_nodes(BufferedWriter* writer, Scene* scene) {
+    const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    const float no_translation[3] = { 0.0f, 0.0f, 0.0f };
+    const float no_rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float no_scale[3] = { 1.0f, 1.0f, 1.0f };
+
+    // Nodes outside the decoded scene are kept as empty nodes, so that skins and animations keep their indices
+    buffered_printf(writer, "  \"nodes\": [");
+    for (unsigned int i = 0; i < scene -> nodes_count; ++i) {
+        Node* node = get_scene_node(scene, i);
+        buffered_printf(writer, "%s\n    {", (i == 0) ? "" : ",");
+        if (node == NULL) {
+            buffered_write(writer, "}", 1);
+            continue;
+        }
+
+        const char* separator = "";
+        if (node -> children_count > 0) {
+            buffered_printf(writer, "\"children\": [");
+            for (unsigned int j = 0; j < node -> children_count; ++j) buffered_printf(writer, (j == 0) ? "%u" : ", %u", node -> childrens[j].index);
+            buffered_write(writer, "]", 1);
+            separator = ", ";
+        }
+        if (node -> meshes_indices.count > 0) {
+            buffered_printf(writer, "%s\"mesh\": %u", separator, *GET_ELEMENT(unsigned int*, node -> meshes_indices, 0));
+            separator = ", ";
+        }
+        if (node -> skin_index >= 0) {
+            buffered_printf(writer, "%s\"skin\": %d", separator, node -> skin_index);
+            separator = ", ";
+        }
+
+        struct { const char* name; const float* values; const float* default_values; unsigned int count; } properties[] = {
+            { "matrix", node -> transformation_matrix, identity, 16 },
+            { "translation", node -> translation_vec, no_translation, 3 },
+            { "rotation", node -> rotation_quat, no_rotation, 4 },
+            { "scale", node -> scale_vec, no_scale, 3 }
+        };
+        for (unsigned char j = 0; j < sizeof(properties) / sizeof(properties[0]); ++j) {
+            if (!memcmp(properties[j].values, properties[j].default_values, sizeof(float) * properties[j].count)) continue;
+            buffered_printf(writer, "%s", separator);
+            write_json_floats(writer, properties[j].name, properties[j].values, properties[j].count);
+            separator = ", ";
+        }
+
+        if (node -> weights_count > 0) {
+            buffered_printf(writer, "%s", separator);
+            write_json_floats(writer, "weights", node -> weights, node -> weights_count);
+        }
+        buffered_write(writer, "}", 1);
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+static void write_meshes(BufferedWriter* writer, Scene* scene, WriterLayout* layout) {
+    const unsigned char modes[] = { 0, 0, 1, 4 }; // by indices per face: POINTS, LINES or TRIANGLES
+    int* target_accessors = layout -> target_accessors;
+
+    buffered_printf(writer, "  \"meshes\": [");
+    for (unsigned int i = 0; i < scene -> meshes_count; ++i) {
+        Mesh* mesh = scene -> meshes + i;
+        int* mesh_accessors = layout -> mesh_accessors + i * MESH_ACCESSORS_COUNT;
+        unsigned char mode = (mesh -> faces_count > 0) ? modes[topology_size[mesh -> faces[0].topology]] : 4;
+
+        buffered_printf(writer, "%s\n    {\"primitives\": [{\"attributes\": {", (i == 0) ? "" : ",");
+        const char* separator = "";
+        for (unsigned char j = 0; j < INDICES_ACCESSOR; ++j) {
+            if (mesh_accessors[j] < 0) continue;
+            buffered_printf(writer, "%s\"%s\": %d", separator, attribute_names[j], mesh_accessors[j]);
+            separator = ", ";
+        }
+        buffered_write(writer, "}", 1);
+        if (mesh -> has_material && mesh -> material_index < scene -> materials_count) buffered_printf(writer, ", \"material\": %u", mesh -> material_index);
+        buffered_printf(writer, ", \"mode\": %u", mode);
+        if (mesh_accessors[INDICES_ACCESSOR] >= 0) buffered_printf(writer, ", \"indices\": %d", mesh_accessors[INDICES_ACCESSOR]);
+
+        if (mesh -> targets_count > 0) {
+            buffered_printf(writer, ", \"targets\": [");
+            for (unsigned int j = 0; j < mesh -> targets_count; ++j, target_accessors += 3) {
+                buffered_printf(writer, "%s{", (j == 0) ? "" : ", ");
+                separator = "";
+                for (unsigned char k = 0; k < 3; ++k) {
+                    if (target_accessors[k] < 0) continue;
+                    buffered_printf(writer, "%s\"%s\": %d", separator, attribute_names[k], target_accessors[k]);
+                    separator = ", ";
+                }
+                buffered_write(writer, "}", 1);
+            }
+            buffered_write(writer, "]", 1);
+        }
+        buffered_write(writer, "}]", 2);
+
+        if (mesh -> targets_count > 0 && mesh -> default_weights != NULL) {
+            buffered_write(writer, ", ", 2);
+            write_json_floats(writer, "weights", mesh -> default_weights, mesh -> targets_count);
+        }
+        buffered_write(writer, "}", 1);
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+static bool write_texture_info(BufferedWriter* writer, Scene* scene, const char* name, Texture* texture, const char* separator) {
+    int texture_index = get_scene_texture_index(scene, texture);
+    if (texture_index < 0) return FALSE;
+    buffered_printf(writer, "%s\"%s\": {\"index\": %d, \"texCoord\": %u", separator, name, texture_index, texture -> tex_coord);
+    return TRUE;
+}
+
+static void write_materials(BufferedWriter* writer, Scene* scene) {
+    buffered_printf(writer, "  \"materials\": [");
+    for (unsigned int i = 0; i < scene -> materials_count; ++i) {
+        Material* material = scene -> materials + i;
+        PbrMetallicRoughness* pbr = &(material -> pbr_metallic_roughness);
+        buffered_printf(writer, "%s\n    {\"pbrMetallicRoughness\": {\"metallicFactor\": %.9g, \"roughnessFactor\": %.9g", (i == 0) ? "" : ",", pbr -> metallic_factor, pbr -> roughness_factor);
+        if (pbr -> base_color_factor != NULL) {
+            buffered_write(writer, ", ", 2);
+            write_json_floats(writer, "baseColorFactor", pbr -> base_color_factor, 4);
+        }
+        if (write_texture_info(writer, scene, "baseColorTexture", &(pbr -> base_color_texture), ", ")) buffered_write(writer, "}", 1);
+        if (write_texture_info(writer, scene, "metallicRoughnessTexture", &(pbr -> metallic_roughness_texture), ", ")) buffered_write(writer, "}", 1);
+        buffered_write(writer, "}", 1);
+
+        if (write_texture_info(writer, scene, "normalTexture", &(material -> normal_texture.texture), ", ")) buffered_printf(writer, ", \"scale\": %.9g}", material -> normal_texture.scale);
+        if (write_texture_info(writer, scene, "occlusionTexture", &(material -> occlusion_texture.texture), ", ")) buffered_printf(writer, ", \"strength\": %.9g}", material -> occlusion_texture.strength);
+        if (write_texture_info(writer, scene, "emissiveTexture", &(material -> emissive_texture), ", ")) buffered_write(writer, "}", 1);
+        if (material -> emissive_factor != NULL) {
+            buffered_write(writer, ", ", 2);
+            write_json_floats(writer, "emissiveFactor", material -> emissive_factor, 3);
+        }
+
+        if (material -> alpha_mode != NULL) {
+            buffered_printf(writer, ", \"alphaMode\": ");
+            write_json_string(writer, material -> alpha_mode);
+            if (!strcmp(material -> alpha_mode, "MASK")) buffered_printf(writer, ", \"alphaCutoff\": %.9g", material -> alpha_cutoff);
+        }
+        buffered_printf(writer, ", \"doubleSided\": %s}", material -> double_sided ? "true" : "false");
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+// Images stored in a buffer view require their mimeType, missing ones are told by the file signature
+static const char* get_image_mime_type(Texture* texture) {
+    if (texture -> mime_type != NULL) return texture -> mime_type;
+    if (is_ktx2_texture(texture) || (texture -> encoded_size >= 5 && !memcmp(texture -> encoded, "\xABKTX ", 5))) return "image/ktx2";
+    if (texture -> encoded_size >= 4 && !memcmp(texture -> encoded, "\x89PNG", 4)) return "image/png";
+    return "image/jpeg";
+}
+
+// Each texture gets its own sampler and image, paths inside the output directory are written relative to it
+// and images held only in memory are written to the buffer
+static void write_textures(BufferedWriter* writer, Scene* scene, WriterLayout* layout, const char* path) {
+    unsigned int path_len = strlen(path);
+
+    buffered_printf(writer, "  \"textures\": [");
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        if (is_ktx2_texture(scene -> textures + i)) buffered_printf(writer, "%s\n    {\"sampler\": %u, \"extensions\": {\"KHR_texture_basisu\": {\"source\": %u}}}", (i == 0) ? "" : ",", i, i);
+        else buffered_printf(writer, "%s\n    {\"sampler\": %u, \"source\": %u}", (i == 0) ? "" : ",", i, i);
+    }
+    buffered_printf(writer, "\n  ],\n  \"samplers\": [");
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        Texture* texture = scene -> textures + i;
+        buffered_printf(writer, "%s\n    {", (i == 0) ? "" : ",");
+        unsigned int values[] = { texture -> mag_filter, texture -> min_filter, texture -> wrap_s, texture -> wrap_t };
+        const char* names[] = { "magFilter", "minFilter", "wrapS", "wrapT" };
+        const char* separator = "";
+        for (unsigned char j = 0; j < 4; ++j) {
+            if (values[j] == 0) continue;
+            buffered_printf(writer, "%s\"%s\": %u", separator, names[j], values[j]);
+            separator = ", ";
+        }
+        buffered_write(writer, "}", 1);
+    }
+    buffered_printf(writer, "\n  ],\n  \"images\": [");
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        Texture* texture = scene -> textures + i;
+        if ((layout -> image_views)[i] >= 0) {
+            buffered_printf(writer, "%s\n    {\"bufferView\": %d, \"mimeType\": ", (i == 0) ? "" : ",", (layout -> image_views)[i]);
+            write_json_string(writer, get_image_mime_type(texture));
+            buffered_write(writer, "}", 1);
+            continue;
+        }
+
+        if (texture -> texture_path == NULL) warning_print("image %u has neither a path nor its bytes, it is not written\n", i);
+        const char* uri = (texture -> texture_path != NULL) ? texture -> texture_path : "";
+        if (path_len > 0 && !strncmp(uri, path, path_len)) uri += path_len;
+        buffered_printf(writer, "%s\n    {\"uri\": ", (i == 0) ? "" : ",");
+        write_json_string(writer, uri);
+        if (texture -> mime_type != NULL) {
+            buffered_printf(writer, ", \"mimeType\": ");
+            write_json_string(writer, texture -> mime_type);
+        }
+        buffered_write(writer, "}", 1);
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+static void write_animations(BufferedWriter* writer, Scene* scene, WriterLayout* layout) {
+    const char* interpolations[] = { "STEP", "LINEAR", "CUBICSPLINE" };
+    int* sampler_accessors = layout -> sampler_accessors;
+
+    buffered_printf(writer, "  \"animations\": [");
+    for (unsigned int i = 0; i < scene -> animations_count; ++i) {
+        Animation* animation = scene -> animations + i;
+        buffered_printf(writer, "%s\n    {", (i == 0) ? "" : ",");
+        if (animation -> name != NULL) {
+            buffered_printf(writer, "\"name\": ");
+            write_json_string(writer, animation -> name);
+            buffered_write(writer, ", ", 2);
+        }
+
+        buffered_printf(writer, "\"samplers\": [");
+        for (unsigned int j = 0; j < animation -> samplers_count; ++j, sampler_accessors += 2) {
+            buffered_printf(writer, "%s{\"input\": %d, \"output\": %d, \"interpolation\": \"%s\"}", (j == 0) ? "" : ", ", sampler_accessors[0], sampler_accessors[1], interpolations[(animation -> samplers)[j].interpolation]);
+        }
+        buffered_printf(writer, "], \"channels\": [");
+        for (unsigned int j = 0; j < animation -> channels_count; ++j) {
+            AnimationChannel* channel = animation -> channels + j;
+            buffered_printf(writer, "%s{\"sampler\": %u, \"target\": {\"node\": %u, \"path\": \"%s\"}}", (j == 0) ? "" : ", ", channel -> sampler_index, channel -> target_node, paths_names[channel -> path]);
+        }
+        buffered_printf(writer, "]}");
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+static void write_skins(BufferedWriter* writer, Scene* scene, WriterLayout* layout) {
+    buffered_printf(writer, "  \"skins\": [");
+    for (unsigned int i = 0; i < scene -> skins_count; ++i) {
+        Skin* skin = scene -> skins + i;
+        buffered_printf(writer, "%s\n    {\"joints\": [", (i == 0) ? "" : ",");
+        for (unsigned int j = 0; j < skin -> joints_count; ++j) buffered_printf(writer, (j == 0) ? "%u" : ", %u", (skin -> joints)[j]);
+        buffered_write(writer, "]", 1);
+        if ((layout -> skin_accessors)[i] >= 0) buffered_printf(writer, ", \"inverseBindMatrices\": %d", (layout -> skin_accessors)[i]);
+        if (skin -> skeleton >= 0) buffered_printf(writer, ", \"skeleton\": %d", skin -> skeleton);
+        buffered_write(writer, "}", 1);
+    }
+    buffered_printf(writer, "\n  ],\n");
+
+    return;
+}
+
+// The document always starts with "{\n", as decode_gltf expects
+static void write_json(BufferedWriter* writer, Scene* scene, WriterLayout* layout, char* path, bool binary) {
+    buffered_printf(writer, "{\n  \"asset\": {\"version\": \"2.0\", \"generator\": \"glTF loader\"},\n");
+    // A root past the glTF nodes only gathers the scene roots, see create_root_node
+    buffered_printf(writer, "  \"scene\": 0,\n  \"scenes\": [{\"nodes\": [");
+    if (scene -> root_node.index < scene -> nodes_count) buffered_printf(writer, "%u", scene -> root_node.index);
+    for (unsigned int i = 0; scene -> root_node.index >= scene -> nodes_count && i < scene -> root_node.children_count; ++i) buffered_printf(writer, (i == 0) ? "%u" : ", %u", scene -> root_node.childrens[i].index);
+    buffered_printf(writer, "]}],\n");
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        if (!is_ktx2_texture(scene -> textures + i)) continue;
+        buffered_printf(writer, "  \"extensionsUsed\": [\"KHR_texture_basisu\"],\n  \"extensionsRequired\": [\"KHR_texture_basisu\"],\n");
+        break;
+    }
+    write_nodes(writer, scene);
+    write_meshes(writer, scene, layout);
+    write_materials(writer, scene);
+    write_textures(writer, scene, layout, path);
+    write_animations(writer, scene, layout);
+    write_skins(writer, scene, layout);
+    write_accessors(writer, layout);
+    write_buffer_views(writer, scene, layout);
+
+    if (layout -> byte_length == 0) buffered_printf(writer, "  \"buffers\": []\n}\n");
+    else if (binary) buffered_printf(writer, "  \"buffers\": [{\"byteLength\": %llu}]\n}\n", layout -> byte_length);
+    else buffered_printf(writer, "  \"buffers\": [{\"uri\": \"scene.bin\", \"byteLength\": %llu}]\n}\n", layout -> byte_length);
+
+    return;
+}
+
+/* Binary data */
+
+static void write_padding(BufferedWriter* writer, unsigned long long int* offset, char padding) {
+    const char zeros[BUFFER_VIEW_ALIGNMENT] = { padding, padding, padding, padding };
+    unsigned long long int aligned = align_offset(*offset);
+    buffered_write(writer, zeros, aligned - *offset);
+    *offset = aligned;
+    return;
+}
+
+// Contiguous data is handed to the writer in one call, padded and compact attributes go element by element
+static void write_elements(BufferedWriter* writer, WriterAccessor* accessor, unsigned long long int* offset) {
+    write_padding(writer, offset, 0);
+    if (accessor -> decoded_attribute != NULL) {
+        for (unsigned int i = 0; i < accessor -> count; ++i) {
+            float values[4] = {0};
+            decode_vertex_attribute(accessor -> decoded_attribute, i, values);
+            buffered_write(writer, values, accessor -> element_size);
+        }
+    } else if (accessor -> source_stride == accessor -> element_size) {
+        buffered_write(writer, accessor -> data, (size_t) accessor -> count * accessor -> element_size);
+    } else {
+        for (unsigned int i = 0; i < accessor -> count; ++i) buffered_write(writer, accessor -> data + (size_t) i * accessor -> source_stride, accessor -> element_size);
+    }
+    *offset += (unsigned long long int) accessor -> count * accessor -> element_size;
+    return;
+}
+
+static void write_binary(BufferedWriter* writer, Scene* scene, WriterLayout* layout) {
+    unsigned long long int offset = 0;
+    for (unsigned int i = 0; i < layout -> accessors_count; ++i) {
+        WriterAccessor* accessor = layout -> accessors + i;
+        if (accessor -> data != NULL || accessor -> decoded_attribute != NULL) write_elements(writer, accessor, &offset);
+        if (accessor -> sparse_count > 0) {
+            write_padding(writer, &offset, 0);
+            buffered_write(writer, accessor -> sparse_indices, accessor -> sparse_count * sizeof(unsigned int));
+            offset += accessor -> sparse_count * sizeof(unsigned int);
+            write_padding(writer, &offset, 0);
+            buffered_write(writer, accessor -> sparse_values, (size_t) accessor -> sparse_count * accessor -> element_size);
+            offset += (unsigned long long int) accessor -> sparse_count * accessor -> element_size;
+        }
+    }
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        if ((layout -> image_views)[i] < 0) continue;
+        write_padding(writer, &offset, 0);
+        buffered_write(writer, (scene -> textures)[i].encoded, (scene -> textures)[i].encoded_size);
+        offset += (scene -> textures)[i].encoded_size;
+    }
+    write_padding(writer, &offset, 0);
+    return;
+}
+
+static bool encode_glb(Scene* scene, WriterLayout* layout, char* path) {
+    char* file_path = (char*) gltf_calloc(strlen(path) + 11, sizeof(char));
+    if (file_path == NULL) return TRUE;
+    sprintf(file_path, "%sscene.glb", path);
+    BufferedWriter* writer = open_buffered_writer(file_path);
+    gltf_free(file_path);
+    if (writer == NULL) return TRUE;
+
+    // The JSON length is patched in once the chunk has been streamed
+    unsigned int header[5] = { GLB_MAGIC, 2, 0, 0, GLB_JSON_CHUNK };
+    buffered_write(writer, header, sizeof(header));
+    write_json(writer, scene, layout, path, TRUE);
+    unsigned long long int json_end = writer -> written;
+    write_padding(writer, &json_end, ' ');
+    unsigned int json_length = (unsigned int) (json_end - sizeof(header));
+
+    if (layout -> byte_length > 0) {
+        unsigned int bin_header[2] = { (unsigned int) layout -> byte_length, GLB_BIN_CHUNK };
+        buffered_write(writer, bin_header, sizeof(bin_header));
+        write_binary(writer, scene, layout);
+    }
+
+    unsigned int total_length = (unsigned int) writer -> written;
+    patch_buffered_writer(writer, 8, &total_length, sizeof(unsigned int));
+    patch_buffered_writer(writer, 12, &json_length, sizeof(unsigned int));
+
+    return close_buffered_writer(writer);
+}
+
+static bool encode_separate_files(Scene* scene, WriterLayout* layout, char* path) {
+    char* file_path = (char*) gltf_calloc(strlen(path) + 11, sizeof(char));
+    if (file_path == NULL) return TRUE;
+    sprintf(file_path, "%sscene.gltf", path);
+    BufferedWriter* writer = open_buffered_writer(file_path);
+    if (writer == NULL) {
+        gltf_free(file_path);
+        return TRUE;
+    }
+    write_json(writer, scene, layout, path, FALSE);
+    bool error = close_buffered_writer(writer);
+
+    if (layout -> byte_length > 0 && !error) {
+        sprintf(file_path, "%sscene.bin", path);
+        writer = open_buffered_writer(file_path);
+        if (writer != NULL) {
+            write_binary(writer, scene, layout);
+            error = close_buffered_writer(writer);
+        } else {
+            error = TRUE;
+        }
+    }
+    gltf_free(file_path);
+
+    return error;
+}
+
+// Writes the scene into the directory at path, as scene.gltf plus scene.bin or as a single scene.glb.
+// The layout is planned up front, then the JSON and the vertex data are streamed through a fixed-size
+// buffer, so memory doesn't grow with the scene. Returns TRUE on error.
+bool encode_gltf(Scene* scene, char* path, bool binary) {
+    GltfAllocator previous_allocator = get_allocator();
+    set_allocator(&(scene -> allocator));
+
+    set_allocation_failed(FALSE);
+    WriterLayout layout = {0};
+    bool error = FALSE;
+    if (plan_layout(scene, &layout)) {
+        error_print("out of memory while planning the buffer layout\n");
+        error = TRUE;
+    } else if (binary && layout.byte_length > 0xFFFFFFFFULL - 0x10000000ULL) {
+        error_print("the binary chunk is too large for a glb file, %llu bytes\n", layout.byte_length);
+        error = TRUE;
+    } else {
+        error = binary ? encode_glb(scene, &layout, path) : encode_separate_files(scene, &layout, path);
+    }
+    debug_print(CYAN, "encoded %u accessors and %u buffer views, %llu bytes of binary data\n", layout.accessors_count, layout.buffer_views_count, layout.byte_length);
+    deallocate_layout(&layout);
+
+    set_allocator(&previous_allocator);
+
+    return error;
+}
+
+#endif //_GLTF_WRITER_H_
@@ -0,0 +1,285 @@
+#ifndef _INDEX_BUFFER_H_
+#define _INDEX_BUFFER_H_
+
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./bounds.h"
+#include "./mesh_optimizer.h"
+#include "./morph.h"
+
+// 0xFFFF stays free for primitive restart
+#define MAX_SHORT_INDEXED_VERTICES 0xFFFF
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int build_index_buffer(Mesh* mesh);
+unsigned int split_mesh(Mesh* mesh, unsigned int max_vertices);
+unsigned long long int get_mesh_parts_size(Mesh* mesh);
+void deallocate_mesh(Mesh* mesh);
+
+/* -------------------------------------------------------------------------- */
+
+// Flattens the faces into the narrowest index type addressing every vertex, returns the bytes saved over 32-bit indices
+unsigned int build_index_buffer(Mesh* mesh) {
+    gltf_free(mesh -> index_buffer.data);
+    mesh -> index_buffer = (IndexBuffer) {0};
+    if (mesh -> faces_count == 0) return 0;
+
+    unsigned int indices_count = 0;
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) indices_count += topology_size[(mesh -> faces)[i].topology];
+
+    bool narrow = (mesh -> vertices.arr.count <= MAX_SHORT_INDEXED_VERTICES);
+    mesh -> index_buffer.data = gltf_calloc(indices_count, narrow ? sizeof(unsigned short int) : sizeof(unsigned int));
+    if (mesh -> index_buffer.data == NULL) return 0;
+    mesh -> index_buffer.component_type = narrow ? UNSIGNED_SHORT : UNSIGNED_INT;
+    mesh -> index_buffer.count = indices_count;
+
+    unsigned int index = 0;
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        Face* face = mesh -> faces + i;
+        for (unsigned char c = 0; c < topology_size[face -> topology]; ++c, ++index) {
+            if (narrow) ((unsigned short int*) (mesh -> index_buffer.data))[index] = (unsigned short int) (face -> indices)[c];
+            else ((unsigned int*) (mesh -> index_buffer.data))[index] = (face -> indices)[c];
+        }
+    }
+
+    return narrow ? indices_count * (sizeof(unsigned int) - sizeof(unsigned short int)) : 0;
+}
+
+static void gather_attribute(ArrayExtended* source, ArrayExtended* destination, const unsigned int* vertices, unsigned int vertices_count, unsigned int source_vertices_count) {
+    if (source -> storage == NULL || source -> arr.count != source_vertices_count) return;
+
+    unsigned int element_size = elements_count[source -> data_type] * byte_lengths[source -> component_type];
+    *destination = *source;
+    destination -> storage = gltf_calloc(vertices_count, element_size);
+    destination -> arr = (Array) { .count = vertices_count };
+    destination -> arr.data = (void**) gltf_calloc(vertices_count, sizeof(void*));
+    if (destination -> storage == NULL || destination -> arr.data == NULL) {
+        gltf_free(destination -> storage);
+        gltf_free(destination -> arr.data);
+        *destination = (ArrayExtended) {0};
+        return;
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        unsigned char* element = (unsigned char*) (destination -> storage) + i * element_size;
+        memcpy(element, (unsigned char*) (source -> storage) + vertices[i] * element_size, element_size);
+        (destination -> arr.data)[i] = element;
+    }
+
+    return;
+}
+
+static float* gather_deltas(const float* deltas, const unsigned int* vertices, unsigned int vertices_count) {
+    if (deltas == NULL) return NULL;
+    float* gathered = (float*) gltf_calloc(vertices_count * 3, sizeof(float));
+    for (unsigned int i = 0; gathered != NULL && i < vertices_count; ++i) memcpy(gathered + i * 3, deltas + vertices[i] * 3, sizeof(float) * 3);
+    return gathered;
+}
+
+// Sparse targets keep only the entries of the vertices in the part, renumbered through local_indices and sorted
+// again, as the part numbers its vertices in the order the faces use them
+static void gather_sparse_target(MorphTarget* source, MorphTarget* destination, const unsigned int* local_indices) {
+    destination -> sparse_indices = (unsigned int*) gltf_calloc(source -> sparse_count + 1, sizeof(unsigned int));
+    float* deltas[3] = { source -> position_deltas, source -> normal_deltas, source -> tangent_deltas };
+    float* gathered[3] = {0};
+    bool failed = (destination -> sparse_indices == NULL);
+    for (unsigned char i = 0; i < 3; ++i) {
+        gathered[i] = (deltas[i] != NULL) ? (float*) gltf_calloc(source -> sparse_count * 3 + 1, sizeof(float)) : NULL;
+        failed |= (deltas[i] != NULL && gathered[i] == NULL);
+    }
+
+    // Without memory the target of the part is left empty
+    if (failed) {
+        for (unsigned char i = 0; i < 3; ++i) gltf_free(gathered[i]);
+        gltf_free(destination -> sparse_indices);
+        destination -> sparse_indices = NULL;
+        return;
+    }
+
+    for (unsigned int i = 0; i < source -> sparse_count; ++i) {
+        unsigned int local_index = local_indices[(source -> sparse_indices)[i]];
+        if (local_index == UNMAPPED_VERTEX) continue;
+        for (unsigned char j = 0; j < 3; ++j) {
+            if (gathered[j] != NULL) memcpy(gathered[j] + destination -> sparse_count * 3, deltas[j] + i * 3, sizeof(float) * 3);
+        }
+        (destination -> sparse_indices)[(destination -> sparse_count)++] = local_index;
+    }
+
+    destination -> position_deltas = gathered[0];
+    destination -> normal_deltas = gathered[1];
+    destination -> tangent_deltas = gathered[2];
+    sort_sparse_target(destination);
+
+    return;
+}
+
+static Mesh create_mesh_part(Mesh* mesh, const unsigned int* vertices, unsigned int vertices_count, unsigned int* local_indices, unsigned int first_face, unsigned int faces_count) {
+    Mesh part = { .material_index = mesh -> material_index, .has_material = mesh -> has_material, .targets_count = mesh -> targets_count, .faces_count = faces_count };
+    for (unsigned int i = 0; i < vertices_count; ++i) local_indices[vertices[i]] = i;
+
+    gather_attribute(&(mesh -> vertices), &(part.vertices), vertices, vertices_count, mesh -> vertices.arr.count);
+    gather_attribute(&(mesh -> normals), &(part.normals), vertices, vertices_count, mesh -> vertices.arr.count);
+    gather_attribute(&(mesh -> tangents), &(part.tangents), vertices, vertices_count, mesh -> vertices.arr.count);
+    gather_attribute(&(mesh -> texture_coords), &(part.texture_coords), vertices, vertices_count, mesh -> vertices.arr.count);
+    gather_attribute(&(mesh -> colors), &(part.colors), vertices, vertices_count, mesh -> vertices.arr.count);
+    gather_attribute(&(mesh -> joints), &(part.joints), vertices, vertices_count, mesh -> vertices.arr.count);
+    gather_attribute(&(mesh -> weights), &(part.weights), vertices, vertices_count, mesh -> vertices.arr.count);
+
+    if (mesh -> targets_count > 0) {
+        part.targets = (MorphTarget*) gltf_calloc(mesh -> targets_count, sizeof(MorphTarget));
+        part.default_weights = (float*) gltf_calloc(mesh -> targets_count, sizeof(float));
+        if (part.targets == NULL || part.default_weights == NULL) part.targets_count = 0;
+        else memcpy(part.default_weights, mesh -> default_weights, sizeof(float) * mesh -> targets_count);
+        for (unsigned int i = 0; i < part.targets_count; ++i) {
+            MorphTarget* target = mesh -> targets + i;
+            if (target -> sparse_indices != NULL) {
+                gather_sparse_target(target, part.targets + i, local_indices);
+                continue;
+            }
+            part.targets[i].position_deltas = gather_deltas(target -> position_deltas, vertices, vertices_count);
+            part.targets[i].normal_deltas = gather_deltas(target -> normal_deltas, vertices, vertices_count);
+            part.targets[i].tangent_deltas = gather_deltas(target -> tangent_deltas, vertices, vertices_count);
+        }
+    }
+
+    // Without memory the part is left without faces
+    unsigned long long int faces_indices_count = 0;
+    for (unsigned int i = 0; i < faces_count; ++i) faces_indices_count += topology_size[(mesh -> faces)[first_face + i].topology];
+    part.faces = (Face*) gltf_calloc(faces_count, sizeof(Face));
+    part.faces_indices = (unsigned int*) gltf_calloc(faces_indices_count, sizeof(unsigned int));
+    if (part.faces == NULL || part.faces_indices == NULL) part.faces_count = 0;
+    for (unsigned int i = 0, offset = 0; i < part.faces_count; ++i) {
+        Face* face = mesh -> faces + first_face + i;
+        part.faces[i].topology = face -> topology;
+        part.faces[i].indices = part.faces_indices + offset;
+        offset += topology_size[face -> topology];
+        for (unsigned char c = 0; c < topology_size[face -> topology]; ++c) {
+            unsigned int vertex = (face -> indices)[c];
+            part.faces[i].indices[c] = (vertex < mesh -> vertices.arr.count) ? local_indices[vertex] : 0;
+        }
+    }
+
+    if (part.vertices.component_type == FLOAT) compute_positions_bounds((float*) part.vertices.storage, vertices_count, part.bounds_min, part.bounds_max);
+    build_index_buffer(&part);
+
+    for (unsigned int i = 0; i < vertices_count; ++i) local_indices[vertices[i]] = UNMAPPED_VERTEX;
+
+    return part;
+}
+
+// Splits a mesh with more than max_vertices vertices into parts, each with its own copy of the attributes
+// and 16-bit indices. Faces are kept in order, so the vertex cache optimization carries over to the parts.
+// The base mesh is left untouched, so the parts add to its memory. Returns the number of parts.
+unsigned int split_mesh(Mesh* mesh, unsigned int max_vertices) {
+    if (max_vertices < 3) max_vertices = 3;
+    if (mesh -> vertices.arr.count <= max_vertices || mesh -> faces_count == 0) return 0;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    unsigned int* local_indices = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    unsigned int* part_vertices = (unsigned int*) gltf_calloc(max_vertices, sizeof(unsigned int));
+    if (local_indices == NULL || part_vertices == NULL) {
+        gltf_free(local_indices);
+        gltf_free(part_vertices);
+        return 0;
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) local_indices[i] = UNMAPPED_VERTEX;
+
+    unsigned int part_vertices_count = 0;
+    unsigned int first_face = 0;
+    for (unsigned int i = 0; i <= mesh -> faces_count; ++i) {
+        Face* face = mesh -> faces + i;
+        unsigned int new_vertices_count = 0;
+        for (unsigned char c = 0; i < mesh -> faces_count && c < topology_size[face -> topology]; ++c) {
+            if ((face -> indices)[c] < vertices_count && local_indices[(face -> indices)[c]] == UNMAPPED_VERTEX) new_vertices_count++;
+        }
+
+        if (i == mesh -> faces_count || part_vertices_count + new_vertices_count > max_vertices) {
+            Mesh* parts = (Mesh*) gltf_realloc(mesh -> parts, sizeof(Mesh) * (mesh -> parts_count + 1));
+            if (parts == NULL) break;
+            mesh -> parts = parts;
+            (mesh -> parts)[mesh -> parts_count++] = create_mesh_part(mesh, part_vertices, part_vertices_count, local_indices, first_face, i - first_face);
+            part_vertices_count = 0;
+            first_face = i;
+        }
+        if (i == mesh -> faces_count) break;
+
+        // Local indices are assigned in create_mesh_part, here they only mark the vertices already in the part
+        for (unsigned char c = 0; c < topology_size[face -> topology]; ++c) {
+            unsigned int vertex = (face -> indices)[c];
+            if (vertex >= vertices_count || local_indices[vertex] != UNMAPPED_VERTEX) continue;
+            local_indices[vertex] = part_vertices_count;
+            part_vertices[part_vertices_count++] = vertex;
+        }
+    }
+
+    gltf_free(part_vertices);
+    gltf_free(local_indices);
+
+    return mesh -> parts_count;
+}
+
+// Bytes held by the parts on top of the base mesh: attributes, indices, faces and morph targets
+unsigned long long int get_mesh_parts_size(Mesh* mesh) {
+    unsigned long long int size = sizeof(Mesh) * mesh -> parts_count;
+    for (unsigned int i = 0; i < mesh -> parts_count; ++i) {
+        Mesh* part = mesh -> parts + i;
+        ArrayExtended* attributes[] = { &(part -> vertices), &(part -> normals), &(part -> tangents), &(part -> texture_coords), &(part -> colors), &(part -> joints), &(part -> weights) };
+        for (unsigned char j = 0; j < sizeof(attributes) / sizeof(attributes[0]); ++j) {
+            if (attributes[j] -> storage == NULL) continue;
+            unsigned long long int element_size = elements_count[attributes[j] -> data_type] * byte_lengths[attributes[j] -> component_type];
+            size += attributes[j] -> arr.count * (element_size + sizeof(void*));
+        }
+
+        size += (unsigned long long int) part -> index_buffer.count * byte_lengths[part -> index_buffer.component_type];
+        size += (unsigned long long int) part -> faces_count * sizeof(Face);
+        for (unsigned int j = 0; j < part -> faces_count; ++j) size += topology_size[(part -> faces)[j].topology] * sizeof(unsigned int);
+
+        size += (unsigned long long int) part -> targets_count * (sizeof(MorphTarget) + sizeof(float));
+        for (unsigned int j = 0; j < part -> targets_count; ++j) {
+            MorphTarget* target = part -> targets + j;
+            unsigned long long int deltas_count = (target -> sparse_indices != NULL) ? target -> sparse_count : part -> vertices.arr.count;
+            if (target -> sparse_indices != NULL) size += deltas_count * sizeof(unsigned int);
+            size += deltas_count * 3 * sizeof(float) * ((target -> position_deltas != NULL) + (target -> normal_deltas != NULL) + (target -> tangent_deltas != NULL));
+        }
+    }
+    return size;
+}
+
+void deallocate_mesh(Mesh* mesh) {
+    ArrayExtended* attributes[] = { &(mesh -> vertices), &(mesh -> normals), &(mesh -> tangents), &(mesh -> texture_coords), &(mesh -> colors), &(mesh -> joints), &(mesh -> weights) };
+    for (unsigned char j = 0; j < sizeof(attributes) / sizeof(attributes[0]); ++j) {
+        gltf_free(attributes[j] -> storage);
+        gltf_free(attributes[j] -> arr.data);
+    }
+
+    for (unsigned int j = 0; j < mesh -> targets_count; ++j) {
+        gltf_free((mesh -> targets)[j].position_deltas);
+        gltf_free((mesh -> targets)[j].normal_deltas);
+        gltf_free((mesh -> targets)[j].tangent_deltas);
+        gltf_free((mesh -> targets)[j].sparse_indices);
+    }
+    gltf_free(mesh -> targets);
+    gltf_free(mesh -> default_weights);
+
+    gltf_free(mesh -> faces_indices);
+    gltf_free(mesh -> faces);
+
+    for (unsigned int j = 0; j < mesh -> lods_count; ++j) gltf_free((mesh -> lods)[j].indices);
+    gltf_free(mesh -> lods);
+    gltf_free(mesh -> index_buffer.data);
+
+    gltf_free(mesh -> meshlets.meshlets);
+    gltf_free(mesh -> meshlets.vertices);
+    gltf_free(mesh -> meshlets.triangles);
+    gltf_free(mesh -> bvh.nodes);
+    gltf_free(mesh -> bvh.primitives);
+
+    for (unsigned int j = 0; j < mesh -> parts_count; ++j) deallocate_mesh(mesh -> parts + j);
+    gltf_free(mesh -> parts);
+
+    return;
+}
+
+#endif //_INDEX_BUFFER_H_
@@ -0,0 +1,121 @@
+#ifndef _INSTANCING_H_
+#define _INSTANCING_H_
+
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./parallel.h"
+#include "./simd.h"
+
+#define INSTANCES_BATCH_SIZE 4
+#define INSTANCE_MATRIX_SIZE 12
+#define MIN_BATCHES_PER_THREAD 1024
+
+/* -------------------------------------------------------------------------- */
+
+void allocate_instances(Instances* instances, unsigned int count);
+void compute_instance_matrices(Instances* instances, const float* world_matrix, float* matrices, unsigned int threads_count);
+void deallocate_instances(Instances* instances);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct InstanceMatricesJob {
+    Instances* instances;
+    const float* world_matrix;
+    float* matrices;
+} InstanceMatricesJob;
+
+// Allocates the ten component arrays in a single block, initialized to the identity transform
+void allocate_instances(Instances* instances, unsigned int count) {
+    unsigned int padded_count = (count + INSTANCES_BATCH_SIZE - 1) & ~(INSTANCES_BATCH_SIZE - 1);
+    *instances = (Instances) { .count = count };
+    instances -> storage = (float*) gltf_calloc((size_t) padded_count * 10, sizeof(float));
+    if (instances -> storage == NULL) {
+        instances -> count = 0;
+        return;
+    }
+
+    float* component = instances -> storage;
+    for (unsigned char i = 0; i < 3; ++i, component += padded_count) instances -> translations[i] = component;
+    for (unsigned char i = 0; i < 4; ++i, component += padded_count) instances -> rotations[i] = component;
+    for (unsigned char i = 0; i < 3; ++i, component += padded_count) instances -> scales[i] = component;
+    for (unsigned int i = 0; i < padded_count; ++i) {
+        (instances -> rotations[3])[i] = 1.0f;
+        for (unsigned char j = 0; j < 3; ++j) (instances -> scales[j])[i] = 1.0f;
+    }
+
+    return;
+}
+
+// Each lane holds a different instance: the local TRS matrices are built in structure of arrays form,
+// multiplied by the node world matrix and transposed into one 3x4 row per register on the way out
+static void compute_instance_matrices_batches(unsigned int start, unsigned int end, void* context) {
+    InstanceMatricesJob* job = (InstanceMatricesJob*) context;
+    Instances* instances = job -> instances;
+    const float* world = job -> world_matrix;
+    Vec4 two = vec4_set1(2.0f);
+    Vec4 one = vec4_set1(1.0f);
+
+    for (unsigned int batch = start; batch < end; ++batch) {
+        unsigned int first = batch * INSTANCES_BATCH_SIZE;
+        Vec4 x = vec4_load(instances -> rotations[0] + first);
+        Vec4 y = vec4_load(instances -> rotations[1] + first);
+        Vec4 z = vec4_load(instances -> rotations[2] + first);
+        Vec4 w = vec4_load(instances -> rotations[3] + first);
+        Vec4 scale[3] = { vec4_load(instances -> scales[0] + first), vec4_load(instances -> scales[1] + first), vec4_load(instances -> scales[2] + first) };
+
+        Vec4 xx = vec4_mul(x, x), yy = vec4_mul(y, y), zz = vec4_mul(z, z);
+        Vec4 xy = vec4_mul(x, y), xz = vec4_mul(x, z), yz = vec4_mul(y, z);
+        Vec4 wx = vec4_mul(w, x), wy = vec4_mul(w, y), wz = vec4_mul(w, z);
+
+        // local[row][column], the last column is the translation
+        Vec4 local[3][4] = {
+            { vec4_sub(one, vec4_mul(two, vec4_add(yy, zz))), vec4_mul(two, vec4_sub(xy, wz)), vec4_mul(two, vec4_add(xz, wy)), vec4_load(instances -> translations[0] + first) },
+            { vec4_mul(two, vec4_add(xy, wz)), vec4_sub(one, vec4_mul(two, vec4_add(xx, zz))), vec4_mul(two, vec4_sub(yz, wx)), vec4_load(instances -> translations[1] + first) },
+            { vec4_mul(two, vec4_sub(xz, wy)), vec4_mul(two, vec4_add(yz, wx)), vec4_sub(one, vec4_mul(two, vec4_add(xx, yy))), vec4_load(instances -> translations[2] + first) }
+        };
+        for (unsigned char r = 0; r < 3; ++r) {
+            for (unsigned char c = 0; c < 3; ++c) local[r][c] = vec4_mul(local[r][c], scale[c]);
+        }
+
+        float rows[INSTANCES_BATCH_SIZE * INSTANCE_MATRIX_SIZE];
+        for (unsigned char r = 0; r < 3; ++r) {
+            Vec4 row[4];
+            for (unsigned char c = 0; c < 4; ++c) {
+                // The world matrix is column-major and affine
+                Vec4 value = (c == 3) ? vec4_set1(world[12 + r]) : vec4_set1(0.0f);
+                for (unsigned char k = 0; k < 3; ++k) value = vec4_madd(vec4_set1(world[k * 4 + r]), local[k][c], value);
+                row[c] = value;
+            }
+            vec4_transpose(row, row + 1, row + 2, row + 3);
+            for (unsigned char i = 0; i < INSTANCES_BATCH_SIZE; ++i) vec4_store(rows + i * INSTANCE_MATRIX_SIZE + r * 4, row[i]);
+        }
+
+        unsigned int batch_count = (instances -> count - first < INSTANCES_BATCH_SIZE) ? instances -> count - first : INSTANCES_BATCH_SIZE;
+        memcpy(job -> matrices + (size_t) first * INSTANCE_MATRIX_SIZE, rows, sizeof(float) * batch_count * INSTANCE_MATRIX_SIZE);
+    }
+
+    return;
+}
+
+// Writes count row-major 3x4 matrices, world_matrix * T * R * S of each instance, four instances at a time.
+// world_matrix is the column-major world matrix of the instanced node, NULL to keep the instances local.
+void compute_instance_matrices(Instances* instances, const float* world_matrix, float* matrices, unsigned int threads_count) {
+    const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    InstanceMatricesJob job = { .instances = instances, .world_matrix = (world_matrix != NULL) ? world_matrix : identity, .matrices = matrices };
+    unsigned int batches_count = (instances -> count + INSTANCES_BATCH_SIZE - 1) / INSTANCES_BATCH_SIZE;
+    unsigned int max_threads_count = batches_count / MIN_BATCHES_PER_THREAD + 1;
+    if (threads_count == 0) threads_count = get_cores_count();
+    if (threads_count > max_threads_count) threads_count = max_threads_count;
+    parallel_for(batches_count, threads_count, compute_instance_matrices_batches, &job);
+    return;
+}
+
+void deallocate_instances(Instances* instances) {
+    gltf_free(instances -> storage);
+    gltf_free(instances -> matrices);
+    *instances = (Instances) {0};
+    return;
+}
+
+#endif //_INSTANCING_H_
@@ -0,0 +1,227 @@
+#ifndef _KTX2_H_
+#define _KTX2_H_
+
+#include <string.h>
+#include <strings.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./bitstream.h"
+#include "./file_io.h"
+#include "./parallel.h"
+#include "./scene.h"
+#include "./png.h"
+
+// Zstandard supercompression needs libzstd: build with -D"_ZSTD_SUPPORT_" and link with -lzstd
+#ifdef _ZSTD_SUPPORT_
+#include <zstd.h>
+#endif //_ZSTD_SUPPORT_
+
+#define KTX2_IDENTIFIER_SIZE 12
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+#define KTX2_MAX_LEVELS 32
+
+/* -------------------------------------------------------------------------- */
+
+bool is_ktx2_texture(Texture* texture);
+bool parse_ktx2(const unsigned char* data, unsigned int size, Ktx2Texture* ktx2);
+bool inflate_ktx2_levels(Ktx2Texture* ktx2, unsigned int threads_count);
+bool load_ktx2_texture(Texture* texture, bool inflate_levels, unsigned int threads_count);
+void load_ktx2_textures(Scene* scene, bool inflate_levels, unsigned int threads_count);
+void deallocate_ktx2(Ktx2Texture* ktx2);
+
+/* -------------------------------------------------------------------------- */
+
+bool is_ktx2_texture(Texture* texture) {
+    if (texture -> mime_type != NULL) return !strcmp(texture -> mime_type, "image/ktx2");
+    size_t len = (texture -> texture_path != NULL) ? strlen(texture -> texture_path) : 0;
+    return len >= 5 && !strcasecmp(texture -> texture_path + len - 5, ".ktx2");
+}
+
+static unsigned int read_le32(const unsigned char* data) {
+    return (unsigned int) data[0] | ((unsigned int) data[1] << 8) | ((unsigned int) data[2] << 16) | ((unsigned int) data[3] << 24);
+}
+
+static unsigned long long int read_le64(const unsigned char* data) {
+    return (unsigned long long int) read_le32(data) | ((unsigned long long int) read_le32(data + 4) << 32);
+}
+
+// Ranges past the 4 GB the BitStream can address are out of the file anyway
+static const unsigned char* get_ktx2_range(BitStream* stream, unsigned long long int offset, unsigned long long int length) {
+    if (length == 0) return NULL;
+    if (offset > stream -> size) {
+        error_print("ktx2 range at %llu exceeds the file length: %u\n", offset, stream -> size);
+        return NULL;
+    }
+    return get_bytes_range(stream, (unsigned int) offset, length);
+}
+
+// Reads the header, the index and the level index, every range of ktx2 points into data. Returns TRUE on error.
+bool parse_ktx2(const unsigned char* data, unsigned int size, Ktx2Texture* ktx2) {
+    const unsigned char identifier[KTX2_IDENTIFIER_SIZE] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    *ktx2 = (Ktx2Texture) {0};
+    BitStream stream = { .stream = (unsigned char*) data, .size = size };
+    const unsigned char* header = get_bytes_range(&stream, 0, KTX2_HEADER_SIZE);
+    if (header == NULL || memcmp(header, identifier, KTX2_IDENTIFIER_SIZE)) {
+        error_print("invalid ktx2 identifier\n");
+        return TRUE;
+    }
+
+    ktx2 -> vk_format = read_le32(header + 12);
+    ktx2 -> type_size = read_le32(header + 16);
+    ktx2 -> width = read_le32(header + 20);
+    ktx2 -> height = read_le32(header + 24);
+    ktx2 -> depth = read_le32(header + 28);
+    ktx2 -> layers_count = read_le32(header + 32);
+    ktx2 -> faces_count = read_le32(header + 36);
+    ktx2 -> levels_count = read_le32(header + 40);
+    unsigned int scheme = read_le32(header + 44);
+
+    // A levels count of 0 asks the loader to generate the mip chain, only the base level is stored
+    if (ktx2 -> levels_count == 0) ktx2 -> levels_count = 1;
+    if (ktx2 -> width == 0 || (ktx2 -> faces_count != 1 && ktx2 -> faces_count != 6) || ktx2 -> levels_count > KTX2_MAX_LEVELS || scheme > SUPERCOMPRESSION_ZLIB) {
+        error_print("unsupported ktx2 header: %ux%u, %u faces, %u levels, supercompression %u\n", ktx2 -> width, ktx2 -> height, ktx2 -> faces_count, ktx2 -> levels_count, scheme);
+        return TRUE;
+    }
+    ktx2 -> supercompression = (Supercompression) scheme;
+
+    ktx2 -> data_format_descriptor_size = read_le32(header + 52);
+    ktx2 -> data_format_descriptor = get_ktx2_range(&stream, read_le32(header + 48), ktx2 -> data_format_descriptor_size);
+    ktx2 -> key_values_size = read_le32(header + 60);
+    ktx2 -> key_values = get_ktx2_range(&stream, read_le32(header + 56), ktx2 -> key_values_size);
+    ktx2 -> supercompression_data_size = read_le64(header + 72);
+    ktx2 -> supercompression_data = get_ktx2_range(&stream, read_le64(header + 64), ktx2 -> supercompression_data_size);
+    bool error = (ktx2 -> data_format_descriptor == NULL && ktx2 -> data_format_descriptor_size > 0) || (ktx2 -> key_values == NULL && ktx2 -> key_values_size > 0) || (ktx2 -> supercompression_data == NULL && ktx2 -> supercompression_data_size > 0);
+    if (ktx2 -> supercompression == SUPERCOMPRESSION_BASISLZ && (ktx2 -> supercompression_data == NULL || ktx2 -> vk_format != 0)) error = TRUE;
+
+    const unsigned char* level_index = get_bytes_range(&stream, KTX2_HEADER_SIZE, (unsigned long long int) ktx2 -> levels_count * KTX2_LEVEL_INDEX_ENTRY_SIZE);
+    if (level_index == NULL) error = TRUE;
+
+    ktx2 -> levels = (Ktx2Level*) gltf_calloc(ktx2 -> levels_count, sizeof(Ktx2Level));
+    if (ktx2 -> levels == NULL) error = TRUE;
+    for (unsigned int i = 0; i < ktx2 -> levels_count && !error; ++i) {
+        const unsigned char* entry = level_index + i * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        Ktx2Level* level = ktx2 -> levels + i;
+        level -> size = read_le64(entry + 8);
+        level -> uncompressed_size = read_le64(entry + 16);
+        level -> data = get_ktx2_range(&stream, read_le64(entry), level -> size);
+        if (level -> data == NULL) error = TRUE;
+        if (ktx2 -> supercompression == SUPERCOMPRESSION_NONE && level -> uncompressed_size != level -> size) error = TRUE;
+    }
+
+    if (error) {
+        error_print("corrupted ktx2 index\n");
+        deallocate_ktx2(ktx2);
+        return TRUE;
+    }
+    debug_print(CYAN, "ktx2: %ux%u, vk format %u, %u levels, supercompression %u\n", ktx2 -> width, ktx2 -> height, ktx2 -> vk_format, ktx2 -> levels_count, ktx2 -> supercompression);
+
+    return FALSE;
+}
+
+static bool inflate_ktx2_level(Supercompression supercompression, Ktx2Level* level) {
+    if (level -> uncompressed_size == 0 || level -> uncompressed_size > 0xFFFFFFFFULL) return TRUE;
+    unsigned char* inflated = (unsigned char*) gltf_calloc(level -> uncompressed_size, sizeof(unsigned char));
+    if (inflated == NULL) return TRUE;
+
+    bool error = TRUE;
+    if (supercompression == SUPERCOMPRESSION_ZLIB) {
+        error = zlib_inflate(level -> data, level -> size, inflated, level -> uncompressed_size);
+    }
+#ifdef _ZSTD_SUPPORT_
+    else if (supercompression == SUPERCOMPRESSION_ZSTD) {
+        size_t result = ZSTD_decompress(inflated, level -> uncompressed_size, level -> data, level -> size);
+        error = ZSTD_isError(result) || result != level -> uncompressed_size;
+    }
+#endif //_ZSTD_SUPPORT_
+
+    if (error) {
+        gltf_free(inflated);
+        return TRUE;
+    }
+
+    level -> data = inflated;
+    level -> size = level -> uncompressed_size;
+    level -> inflated = TRUE;
+
+    return FALSE;
+}
+
+typedef struct Ktx2InflateJob {
+    Ktx2Texture* ktx2;
+    bool* errors;
+} Ktx2InflateJob;
+
+static void inflate_ktx2_levels_range(unsigned int start, unsigned int end, void* context) {
+    Ktx2InflateJob* job = (Ktx2InflateJob*) context;
+    for (unsigned int i = start; i < end; ++i) {
+        if (!(job -> ktx2 -> levels)[i].inflated) (job -> errors)[i] = inflate_ktx2_level(job -> ktx2 -> supercompression, job -> ktx2 -> levels + i);
+    }
+    return;
+}
+
+// Undoes the Zstandard or zlib supercompression, one level per task: the inflated levels own their data,
+// the others keep borrowing the container. BasisLZ is left to the transcoder. Returns TRUE on error.
+bool inflate_ktx2_levels(Ktx2Texture* ktx2, unsigned int threads_count) {
+    if (ktx2 -> supercompression != SUPERCOMPRESSION_ZSTD && ktx2 -> supercompression != SUPERCOMPRESSION_ZLIB) return FALSE;
+#ifndef _ZSTD_SUPPORT_
+    if (ktx2 -> supercompression == SUPERCOMPRESSION_ZSTD) {
+        error_print("zstd supercompressed levels need a build with _ZSTD_SUPPORT_\n");
+        return TRUE;
+    }
+#endif //_ZSTD_SUPPORT_
+
+    Ktx2InflateJob job = { .ktx2 = ktx2, .errors = (bool*) gltf_calloc(ktx2 -> levels_count, sizeof(bool)) };
+    if (job.errors == NULL) return TRUE;
+    parallel_for(ktx2 -> levels_count, threads_count, inflate_ktx2_levels_range, &job);
+
+    bool error = FALSE;
+    for (unsigned int i = 0; i < ktx2 -> levels_count; ++i) {
+        if (!job.errors[i]) continue;
+        error_print("failed to inflate ktx2 level %u\n", i);
+        error = TRUE;
+    }
+    gltf_free(job.errors);
+
+    return error;
+}
+
+// Images stored in a buffer view are already in Texture.encoded, the others are read from texture_path
+bool load_ktx2_texture(Texture* texture, bool inflate_levels, unsigned int threads_count) {
+    if (texture -> encoded == NULL) {
+        File file = { .file_path = texture -> texture_path };
+        if (texture -> texture_path == NULL || read_model_file(&file)) {
+            gltf_free(file.data);
+            return TRUE;
+        }
+        texture -> encoded = file.data;
+        texture -> encoded_size = file.size;
+    }
+
+    if (parse_ktx2(texture -> encoded, texture -> encoded_size, &(texture -> ktx2))) return TRUE;
+    return inflate_levels && inflate_ktx2_levels(&(texture -> ktx2), threads_count);
+}
+
+// Textures are loaded one after the other, the levels of each one are inflated in parallel
+void load_ktx2_textures(Scene* scene, bool inflate_levels, unsigned int threads_count) {
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        Texture* texture = scene -> textures + i;
+        if (!is_ktx2_texture(texture) || texture -> ktx2.levels != NULL) continue;
+        if (load_ktx2_texture(texture, inflate_levels, threads_count)) error_print("failed to load the ktx2 texture %u\n", i);
+    }
+    share_textures_with_materials(scene);
+
+    return;
+}
+
+void deallocate_ktx2(Ktx2Texture* ktx2) {
+    for (unsigned int i = 0; ktx2 -> levels != NULL && i < ktx2 -> levels_count; ++i) {
+        if ((ktx2 -> levels)[i].inflated) gltf_free((void*) (ktx2 -> levels)[i].data);
+    }
+    gltf_free(ktx2 -> levels);
+    *ktx2 = (Ktx2Texture) {0};
+    return;
+}
+
+#endif //_KTX2_H_
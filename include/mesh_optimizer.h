@@ -0,0 +1,448 @@
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+
+#include <math.h>
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./morph.h"
+
+#define VERTEX_CACHE_SIZE 32
+#define ANALYSIS_CACHE_SIZE 16
+#define UNMAPPED_VERTEX 0xFFFFFFFF
+#define WELD_STREAMS_COUNT 7
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int weld_vertices(Mesh* mesh, float epsilon);
+VertexCacheStatistics analyze_vertex_cache(Mesh* mesh, unsigned int cache_size);
+void optimize_vertex_cache(Mesh* mesh);
+void optimize_vertex_fetch(Mesh* mesh);
+void optimize_mesh(Mesh* mesh, VertexCacheStatistics* before, VertexCacheStatistics* after);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct WeldContext {
+    ArrayExtended* streams[WELD_STREAMS_COUNT]; // the first one is always the positions
+    unsigned int element_sizes[WELD_STREAMS_COUNT];
+    unsigned int streams_count;
+    bool snap_positions;
+    float inv_epsilon;
+} WeldContext;
+
+// Only triangle lists can be reordered, strips and fans are already split in independent triangles by create_faces
+static bool is_triangle_mesh(Mesh* mesh) {
+    if (mesh -> faces_count == 0 || mesh -> vertices.storage == NULL) return FALSE;
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        if (topology_size[(mesh -> faces)[i].topology] != 3) return FALSE;
+        for (unsigned char c = 0; c < 3; ++c) {
+            if ((mesh -> faces)[i].indices[c] >= mesh -> vertices.arr.count) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static unsigned int hash_bytes(const unsigned char* bytes, unsigned int size, unsigned int hash) {
+    // FNV-1a
+    for (unsigned int i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static void get_position_cell(WeldContext* context, unsigned int vertex, long long int* cell) {
+    const float* position = (const float*) (context -> streams[0] -> storage) + vertex * 3;
+    for (unsigned char c = 0; c < 3; ++c) cell[c] = (long long int) floorf(position[c] * context -> inv_epsilon);
+    return;
+}
+
+static const unsigned char* get_stream_element(WeldContext* context, unsigned int stream, unsigned int vertex) {
+    return (const unsigned char*) (context -> streams[stream] -> storage) + vertex * context -> element_sizes[stream];
+}
+
+static unsigned int hash_vertex(WeldContext* context, unsigned int vertex) {
+    unsigned int hash = 2166136261u;
+    unsigned int first_stream = 0;
+    if (context -> snap_positions) {
+        long long int cell[3];
+        get_position_cell(context, vertex, cell);
+        hash = hash_bytes((const unsigned char*) cell, sizeof(cell), hash);
+        first_stream = 1;
+    }
+    for (unsigned int i = first_stream; i < context -> streams_count; ++i) {
+        hash = hash_bytes(get_stream_element(context, i, vertex), context -> element_sizes[i], hash);
+    }
+    return hash;
+}
+
+static bool compare_vertices(WeldContext* context, unsigned int a, unsigned int b) {
+    unsigned int first_stream = 0;
+    if (context -> snap_positions) {
+        long long int cell_a[3];
+        long long int cell_b[3];
+        get_position_cell(context, a, cell_a);
+        get_position_cell(context, b, cell_b);
+        if (cell_a[0] != cell_b[0] || cell_a[1] != cell_b[1] || cell_a[2] != cell_b[2]) return FALSE;
+        first_stream = 1;
+    }
+    for (unsigned int i = first_stream; i < context -> streams_count; ++i) {
+        if (memcmp(get_stream_element(context, i, a), get_stream_element(context, i, b), context -> element_sizes[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+// Copies the unique vertices of the attribute into compacted, leaving the attribute untouched. Returns TRUE when out of memory.
+static bool compact_attribute(ArrayExtended* attribute, const unsigned int* unique_vertices, unsigned int unique_count, ArrayExtended* compacted) {
+    unsigned int element_size = elements_count[attribute -> data_type] * byte_lengths[attribute -> component_type];
+    *compacted = *attribute;
+    compacted -> storage = gltf_calloc(unique_count, element_size);
+    compacted -> arr.data = (void**) gltf_calloc(unique_count, sizeof(void*));
+    if (compacted -> storage == NULL || compacted -> arr.data == NULL) {
+        gltf_free(compacted -> storage);
+        gltf_free(compacted -> arr.data);
+        *compacted = (ArrayExtended) {0};
+        return TRUE;
+    }
+
+    unsigned char* storage = (unsigned char*) (compacted -> storage);
+    for (unsigned int i = 0; i < unique_count; ++i) {
+        memcpy(storage + i * element_size, (unsigned char*) (attribute -> storage) + unique_vertices[i] * element_size, element_size);
+        (compacted -> arr.data)[i] = storage + i * element_size;
+    }
+    compacted -> arr.count = unique_count;
+
+    return FALSE;
+}
+
+// Merges the vertices whose whole attribute tuple (position, normal, tangent, UV, color, joints and weights) is
+// identical, through an open-addressing hash table with linear probing. A positive epsilon also welds the
+// positions falling in the same epsilon-sized grid cell, keeping the first position of the cell.
+// Meshes with morph targets are left untouched, as their deltas would need to be part of the tuple.
+// Returns the new vertices count.
+unsigned int weld_vertices(Mesh* mesh, float epsilon) {
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    if (mesh -> vertices.storage == NULL || mesh -> targets_count > 0) return vertices_count;
+
+    WeldContext context = { .snap_positions = (epsilon > 0.0f && mesh -> vertices.component_type == FLOAT), .inv_epsilon = (epsilon > 0.0f) ? 1.0f / epsilon : 0.0f };
+    ArrayExtended* streams[WELD_STREAMS_COUNT] = { &(mesh -> vertices), &(mesh -> normals), &(mesh -> tangents), &(mesh -> texture_coords), &(mesh -> colors), &(mesh -> joints), &(mesh -> weights) };
+    for (unsigned int i = 0; i < WELD_STREAMS_COUNT; ++i) {
+        if (streams[i] -> storage == NULL || streams[i] -> arr.count != vertices_count) continue;
+        context.streams[context.streams_count] = streams[i];
+        context.element_sizes[context.streams_count++] = elements_count[streams[i] -> data_type] * byte_lengths[streams[i] -> component_type];
+    }
+
+    unsigned int table_size = 1;
+    while (table_size < vertices_count * 2) table_size <<= 1;
+    unsigned int* table = (unsigned int*) gltf_calloc(table_size, sizeof(unsigned int));
+    unsigned int* remap = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    unsigned int* unique_vertices = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    unsigned int unique_count = 0;
+    if (table == NULL || remap == NULL || unique_vertices == NULL) {
+        gltf_free(unique_vertices);
+        gltf_free(remap);
+        gltf_free(table);
+        return vertices_count;
+    }
+
+    // Slots hold the unique vertex index plus one, zero marks an empty slot
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        unsigned int slot = hash_vertex(&context, i) & (table_size - 1);
+        while (table[slot] != 0 && !compare_vertices(&context, unique_vertices[table[slot] - 1], i)) slot = (slot + 1) & (table_size - 1);
+        if (table[slot] == 0) {
+            unique_vertices[unique_count++] = i;
+            table[slot] = unique_count;
+        }
+        remap[i] = table[slot] - 1;
+    }
+
+    // Every stream is compacted before any is replaced, so that without memory the mesh is left as it was
+    ArrayExtended compacted[WELD_STREAMS_COUNT] = {0};
+    bool failed = FALSE;
+    for (unsigned int i = 0; unique_count < vertices_count && !failed && i < context.streams_count; ++i) {
+        failed = compact_attribute(context.streams[i], unique_vertices, unique_count, compacted + i);
+    }
+
+    if (failed) {
+        for (unsigned int i = 0; i < context.streams_count; ++i) {
+            gltf_free(compacted[i].storage);
+            gltf_free(compacted[i].arr.data);
+        }
+        unique_count = vertices_count;
+    } else if (unique_count < vertices_count) {
+        for (unsigned int i = 0; i < context.streams_count; ++i) {
+            gltf_free(context.streams[i] -> storage);
+            gltf_free(context.streams[i] -> arr.data);
+            *(context.streams[i]) = compacted[i];
+        }
+        for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+            Face* face = mesh -> faces + i;
+            for (unsigned char c = 0; c < topology_size[face -> topology]; ++c) {
+                if ((face -> indices)[c] < vertices_count) (face -> indices)[c] = remap[(face -> indices)[c]];
+            }
+        }
+    }
+
+    gltf_free(unique_vertices);
+    gltf_free(remap);
+    gltf_free(table);
+
+    return unique_count;
+}
+
+// Simulates a FIFO cache of cache_size entries: ACMR is the average of transformed vertices per triangle,
+// ATVR the ratio between transformed and referenced vertices (1.0 is optimal)
+VertexCacheStatistics analyze_vertex_cache(Mesh* mesh, unsigned int cache_size) {
+    VertexCacheStatistics statistics = {0};
+    if (!is_triangle_mesh(mesh)) return statistics;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    unsigned int* timestamps = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    if (timestamps == NULL) return statistics;
+    unsigned int timestamp = cache_size + 1;
+    unsigned int misses_count = 0;
+    unsigned int referenced_count = 0;
+
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) {
+            unsigned int vertex = (mesh -> faces)[i].indices[c];
+            if (timestamps[vertex] == 0) referenced_count++;
+            if (timestamp - timestamps[vertex] > cache_size) {
+                timestamps[vertex] = timestamp++;
+                misses_count++;
+            }
+        }
+    }
+
+    statistics.acmr = (float) misses_count / mesh -> faces_count;
+    statistics.atvr = (float) misses_count / referenced_count;
+    gltf_free(timestamps);
+
+    return statistics;
+}
+
+static float get_vertex_score(int cache_position, unsigned int remaining_triangles) {
+    if (remaining_triangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        // The last triangle vertices get a fixed score, so that the next triangle doesn't reuse the same edge
+        if (cache_position < 3) score = 0.75f;
+        else score = powf(1.0f - (float) (cache_position - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+
+    // Vertices with few triangles left are favored, to get rid of them before they leave the cache
+    return score + 2.0f / sqrtf((float) remaining_triangles);
+}
+
+static void remove_adjacent_triangle(unsigned int* adjacency, unsigned int remaining_triangles, unsigned int triangle) {
+    for (unsigned int i = 0; i < remaining_triangles; ++i) {
+        if (adjacency[i] != triangle) continue;
+        adjacency[i] = adjacency[remaining_triangles - 1];
+        return;
+    }
+    return;
+}
+
+// Greedy triangle reordering from Tom Forsyth "Linear-Speed Vertex Cache Optimisation": each step emits the
+// best scoring triangle among the ones touching the modeled LRU cache, falling back to the next triangle not
+// yet emitted in file order
+void optimize_vertex_cache(Mesh* mesh) {
+    if (!is_triangle_mesh(mesh)) return;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    unsigned int triangles_count = mesh -> faces_count;
+    Face* faces = mesh -> faces;
+
+    // Triangles adjacent to each vertex, packed by vertex
+    unsigned int* remaining_triangles = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    unsigned int* adjacency_offsets = (unsigned int*) gltf_calloc(vertices_count + 1, sizeof(unsigned int));
+    unsigned int* adjacency = (unsigned int*) gltf_calloc(triangles_count * 3, sizeof(unsigned int));
+    int* cache_positions = (int*) gltf_calloc(vertices_count, sizeof(int));
+    float* vertex_scores = (float*) gltf_calloc(vertices_count, sizeof(float));
+    bool* emitted = (bool*) gltf_calloc(triangles_count, sizeof(bool));
+    Face* ordered_faces = (Face*) gltf_calloc(triangles_count, sizeof(Face));
+
+    // Without memory the triangles keep their order
+    if (remaining_triangles == NULL || adjacency_offsets == NULL || adjacency == NULL || cache_positions == NULL || vertex_scores == NULL || emitted == NULL || ordered_faces == NULL) {
+        gltf_free(ordered_faces);
+        gltf_free(emitted);
+        gltf_free(vertex_scores);
+        gltf_free(cache_positions);
+        gltf_free(adjacency);
+        gltf_free(adjacency_offsets);
+        gltf_free(remaining_triangles);
+        return;
+    }
+
+    for (unsigned int i = 0; i < triangles_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) remaining_triangles[faces[i].indices[c]]++;
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) adjacency_offsets[i + 1] = adjacency_offsets[i] + remaining_triangles[i];
+    for (unsigned int i = 0; i < vertices_count; ++i) remaining_triangles[i] = 0;
+    for (unsigned int i = 0; i < triangles_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) {
+            unsigned int vertex = faces[i].indices[c];
+            adjacency[adjacency_offsets[vertex] + remaining_triangles[vertex]++] = i;
+        }
+    }
+
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        cache_positions[i] = -1;
+        vertex_scores[i] = get_vertex_score(-1, remaining_triangles[i]);
+    }
+
+    unsigned int cache[VERTEX_CACHE_SIZE + 3];
+    unsigned int cache_count = 0;
+    unsigned int fallback_cursor = 0;
+    int best_triangle = -1;
+
+    for (unsigned int emitted_count = 0; emitted_count < triangles_count; ++emitted_count) {
+        if (best_triangle < 0) {
+            while (emitted[fallback_cursor]) fallback_cursor++;
+            best_triangle = fallback_cursor;
+        }
+
+        unsigned int* triangle = faces[best_triangle].indices;
+        ordered_faces[emitted_count] = faces[best_triangle];
+        emitted[best_triangle] = TRUE;
+
+        // The emitted triangle vertices move to the front of the cache, pushing the others back
+        unsigned int new_cache[VERTEX_CACHE_SIZE + 3];
+        unsigned int new_cache_count = 0;
+        for (unsigned char c = 0; c < 3; ++c) {
+            unsigned int vertex = triangle[c];
+            remove_adjacent_triangle(adjacency + adjacency_offsets[vertex], remaining_triangles[vertex], best_triangle);
+            remaining_triangles[vertex]--;
+            if (c > 0 && vertex == triangle[0]) continue;
+            if (c > 1 && vertex == triangle[1]) continue;
+            new_cache[new_cache_count++] = vertex;
+        }
+        for (unsigned int i = 0; i < cache_count; ++i) {
+            unsigned int vertex = cache[i];
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) new_cache[new_cache_count++] = vertex;
+        }
+
+        for (unsigned int i = 0; i < new_cache_count; ++i) {
+            unsigned int vertex = new_cache[i];
+            cache_positions[vertex] = (i < VERTEX_CACHE_SIZE) ? (int) i : -1;
+            vertex_scores[vertex] = get_vertex_score(cache_positions[vertex], remaining_triangles[vertex]);
+        }
+
+        // Only the triangles touching the cache changed score, the best one of them comes next
+        best_triangle = -1;
+        float best_score = 0.0f;
+        for (unsigned int i = 0; i < new_cache_count && i < VERTEX_CACHE_SIZE; ++i) {
+            unsigned int vertex = new_cache[i];
+            for (unsigned int j = 0; j < remaining_triangles[vertex]; ++j) {
+                unsigned int candidate = adjacency[adjacency_offsets[vertex] + j];
+                unsigned int* indices = faces[candidate].indices;
+                float score = vertex_scores[indices[0]] + vertex_scores[indices[1]] + vertex_scores[indices[2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best_triangle = candidate;
+                }
+            }
+        }
+
+        cache_count = (new_cache_count < VERTEX_CACHE_SIZE) ? new_cache_count : VERTEX_CACHE_SIZE;
+        memcpy(cache, new_cache, sizeof(unsigned int) * cache_count);
+    }
+
+    gltf_free(mesh -> faces);
+    mesh -> faces = ordered_faces;
+
+    gltf_free(emitted);
+    gltf_free(vertex_scores);
+    gltf_free(cache_positions);
+    gltf_free(adjacency);
+    gltf_free(adjacency_offsets);
+    gltf_free(remaining_triangles);
+
+    return;
+}
+
+static void remap_attribute(ArrayExtended* attribute, const unsigned int* remap, unsigned int vertices_count) {
+    if (attribute -> storage == NULL || attribute -> arr.count != vertices_count) return;
+
+    unsigned int element_size = elements_count[attribute -> data_type] * byte_lengths[attribute -> component_type];
+    unsigned char* storage = (unsigned char*) gltf_calloc(vertices_count, element_size);
+    if (storage == NULL) return;
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        memcpy(storage + remap[i] * element_size, (unsigned char*) (attribute -> storage) + i * element_size, element_size);
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) (attribute -> arr.data)[i] = storage + i * element_size;
+
+    gltf_free(attribute -> storage);
+    attribute -> storage = storage;
+
+    return;
+}
+
+static void remap_deltas(float** deltas, const unsigned int* remap, unsigned int vertices_count) {
+    if (*deltas == NULL) return;
+    float* remapped = (float*) gltf_calloc(vertices_count * 3, sizeof(float));
+    if (remapped == NULL) return;
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) remapped[remap[i] * 3 + c] = (*deltas)[i * 3 + c];
+    }
+    gltf_free(*deltas);
+    *deltas = remapped;
+    return;
+}
+
+// Renumbers the vertices in the order the triangles first reference them, moving every attribute stream
+// and morph target along, unreferenced vertices are kept at the end
+void optimize_vertex_fetch(Mesh* mesh) {
+    if (!is_triangle_mesh(mesh)) return;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    unsigned int* remap = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    if (remap == NULL) return;
+    for (unsigned int i = 0; i < vertices_count; ++i) remap[i] = UNMAPPED_VERTEX;
+
+    unsigned int next_vertex = 0;
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) {
+            unsigned int* index = (mesh -> faces)[i].indices + c;
+            if (remap[*index] == UNMAPPED_VERTEX) remap[*index] = next_vertex++;
+            *index = remap[*index];
+        }
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        if (remap[i] == UNMAPPED_VERTEX) remap[i] = next_vertex++;
+    }
+
+    remap_attribute(&(mesh -> vertices), remap, vertices_count);
+    remap_attribute(&(mesh -> normals), remap, vertices_count);
+    remap_attribute(&(mesh -> tangents), remap, vertices_count);
+    remap_attribute(&(mesh -> texture_coords), remap, vertices_count);
+    remap_attribute(&(mesh -> colors), remap, vertices_count);
+    remap_attribute(&(mesh -> joints), remap, vertices_count);
+    remap_attribute(&(mesh -> weights), remap, vertices_count);
+
+    for (unsigned int i = 0; i < mesh -> targets_count; ++i) {
+        MorphTarget* target = mesh -> targets + i;
+        if (target -> sparse_indices != NULL) {
+            for (unsigned int j = 0; j < target -> sparse_count; ++j) (target -> sparse_indices)[j] = remap[(target -> sparse_indices)[j]];
+            sort_sparse_target(target);
+            continue;
+        }
+        remap_deltas(&(target -> position_deltas), remap, vertices_count);
+        remap_deltas(&(target -> normal_deltas), remap, vertices_count);
+        remap_deltas(&(target -> tangent_deltas), remap, vertices_count);
+    }
+
+    gltf_free(remap);
+
+    return;
+}
+
+// Vertex cache reordering followed by the fetch reordering, before and after can be NULL
+void optimize_mesh(Mesh* mesh, VertexCacheStatistics* before, VertexCacheStatistics* after) {
+    if (before != NULL) *before = analyze_vertex_cache(mesh, ANALYSIS_CACHE_SIZE);
+    optimize_vertex_cache(mesh);
+    optimize_vertex_fetch(mesh);
+    if (after != NULL) *after = analyze_vertex_cache(mesh, ANALYSIS_CACHE_SIZE);
+    return;
+}
+
+#endif //_MESH_OPTIMIZER_H_
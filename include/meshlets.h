@@ -0,0 +1,297 @@
+#ifndef _MESHLETS_H_
+#define _MESHLETS_H_
+
+#include <math.h>
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./parallel.h"
+#include "./mesh_optimizer.h"
+
+#define DEFAULT_MESHLET_MAX_TRIANGLES 124
+#define MAX_MESHLET_VERTICES 255
+#define MAX_MESHLET_TRIANGLES 512
+// Below this spread the cone is too wide to ever cull anything
+#define MIN_CONE_SPREAD 0.1f
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int build_meshlets(Mesh* mesh, unsigned int max_vertices, unsigned int max_triangles);
+void build_meshes_meshlets(Mesh* meshes, unsigned int meshes_count, unsigned int max_vertices, unsigned int max_triangles, unsigned int threads_count);
+void deallocate_meshlets(Meshlets* meshlets);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct MeshletsJob {
+    Mesh* meshes;
+    unsigned int max_vertices;
+    unsigned int max_triangles;
+} MeshletsJob;
+
+static float distance_squared(const float* a, const float* b) {
+    float d[3] = { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+// Ritter's sphere: starts from the two farthest apart vertices found in two sweeps, then grows to cover the others
+static void compute_meshlet_sphere(Meshlet* meshlet, const float* positions, const unsigned int* vertices) {
+    const float* first = positions + vertices[0] * 3;
+    const float* a = first;
+    const float* b = first;
+    for (unsigned int i = 0; i < meshlet -> vertices_count; ++i) {
+        if (distance_squared(positions + vertices[i] * 3, first) > distance_squared(a, first)) a = positions + vertices[i] * 3;
+    }
+    for (unsigned int i = 0; i < meshlet -> vertices_count; ++i) {
+        if (distance_squared(positions + vertices[i] * 3, a) > distance_squared(b, a)) b = positions + vertices[i] * 3;
+    }
+
+    for (unsigned char c = 0; c < 3; ++c) meshlet -> center[c] = (a[c] + b[c]) * 0.5f;
+    meshlet -> radius = sqrtf(distance_squared(a, b)) * 0.5f;
+    for (unsigned int i = 0; i < meshlet -> vertices_count; ++i) {
+        const float* position = positions + vertices[i] * 3;
+        float distance = sqrtf(distance_squared(position, meshlet -> center));
+        if (distance <= meshlet -> radius) continue;
+        float shift = (distance - meshlet -> radius) * 0.5f / distance;
+        for (unsigned char c = 0; c < 3; ++c) meshlet -> center[c] += (position[c] - meshlet -> center[c]) * shift;
+        meshlet -> radius = (meshlet -> radius + distance) * 0.5f;
+    }
+
+    return;
+}
+
+// The axis is the average of the triangle normals and the cutoff the sine of the widest angle from it, the apex
+// is pulled back along the axis until every triangle plane is behind it
+static void compute_meshlet_cone(Meshlet* meshlet, const float* positions, const unsigned int* vertices, const unsigned char* triangles, const float* normals) {
+    float axis[3] = {0};
+    for (unsigned int i = 0; i < meshlet -> triangles_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) axis[c] += normals[i * 3 + c];
+    }
+
+    memcpy(meshlet -> cone_apex, meshlet -> center, sizeof(float) * 3);
+    meshlet -> cone_cutoff = 1.0f;
+    float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (length <= 1e-20f) return;
+    for (unsigned char c = 0; c < 3; ++c) meshlet -> cone_axis[c] = axis[c] / length;
+
+    float min_dot = 1.0f;
+    for (unsigned int i = 0; i < meshlet -> triangles_count; ++i) {
+        const float* normal = normals + i * 3;
+        if (normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 0.0f) continue;
+        float dot = normal[0] * meshlet -> cone_axis[0] + normal[1] * meshlet -> cone_axis[1] + normal[2] * meshlet -> cone_axis[2];
+        if (dot < min_dot) min_dot = dot;
+    }
+    if (min_dot <= MIN_CONE_SPREAD) return;
+
+    float max_t = 0.0f;
+    for (unsigned int i = 0; i < meshlet -> triangles_count; ++i) {
+        const float* normal = normals + i * 3;
+        const float* corner = positions + vertices[triangles[i * 3]] * 3;
+        float dot = normal[0] * meshlet -> cone_axis[0] + normal[1] * meshlet -> cone_axis[1] + normal[2] * meshlet -> cone_axis[2];
+        if (dot <= 0.0f) continue;
+        float t = ((meshlet -> center[0] - corner[0]) * normal[0] + (meshlet -> center[1] - corner[1]) * normal[1] + (meshlet -> center[2] - corner[2]) * normal[2]) / dot;
+        if (t > max_t) max_t = t;
+    }
+    for (unsigned char c = 0; c < 3; ++c) meshlet -> cone_apex[c] = meshlet -> center[c] - meshlet -> cone_axis[c] * max_t;
+    meshlet -> cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+
+    return;
+}
+
+static void compute_face_normal(const float* positions, const unsigned int* indices, float* normal) {
+    const float* p0 = positions + indices[0] * 3;
+    const float* p1 = positions + indices[1] * 3;
+    const float* p2 = positions + indices[2] * 3;
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    for (unsigned char c = 0; c < 3; ++c) normal[c] = (length > 1e-20f) ? normal[c] / length : 0.0f;
+    return;
+}
+
+// Closes the current meshlet, computing its bounds and forgetting the local indices of its vertices,
+// normals holds room for the normals of max_triangles faces
+static void finish_meshlet(Meshlets* meshlets, const float* positions, const float* face_normals, const unsigned int* meshlet_faces, unsigned int* local_indices, float* normals) {
+    Meshlet* meshlet = meshlets -> meshlets + meshlets -> count;
+    const unsigned int* vertices = meshlets -> vertices + meshlet -> vertices_offset;
+    const unsigned char* triangles = meshlets -> triangles + meshlet -> triangles_offset;
+
+    for (unsigned int i = 0; i < meshlet -> triangles_count; ++i) memcpy(normals + i * 3, face_normals + meshlet_faces[i] * 3, sizeof(float) * 3);
+    compute_meshlet_sphere(meshlet, positions, vertices);
+    compute_meshlet_cone(meshlet, positions, vertices, triangles, normals);
+
+    for (unsigned int i = 0; i < meshlet -> vertices_count; ++i) local_indices[vertices[i]] = UNMAPPED_VERTEX;
+    meshlets -> vertices_count += meshlet -> vertices_count;
+    meshlets -> triangles_count += meshlet -> triangles_count;
+    meshlets -> count++;
+
+    return;
+}
+
+static void deallocate_meshlets_scratch(unsigned int* adjacency_offsets, unsigned int* live_counts, unsigned int* adjacency, float* face_normals, unsigned int* local_indices, bool* used_faces, unsigned int* meshlet_faces, float* meshlet_normals) {
+    gltf_free(adjacency_offsets);
+    gltf_free(live_counts);
+    gltf_free(adjacency);
+    gltf_free(face_normals);
+    gltf_free(local_indices);
+    gltf_free(used_faces);
+    gltf_free(meshlet_faces);
+    gltf_free(meshlet_normals);
+    return;
+}
+
+// Partitions the faces of a triangle mesh into meshlets, growing each one greedily with the unused triangles
+// adjacent to its vertices: the fewest new vertices first, then the normal closest to the meshlet average to
+// keep the cones tight. When no neighbour fits, the next unused face in order starts or extends the meshlet,
+// so the vertex cache order carries over. Returns the number of meshlets.
+unsigned int build_meshlets(Mesh* mesh, unsigned int max_vertices, unsigned int max_triangles) {
+    deallocate_meshlets(&(mesh -> meshlets));
+    if (!is_triangle_mesh(mesh) || mesh -> vertices.component_type != FLOAT) return 0;
+    if (max_vertices < 3) max_vertices = 3;
+    if (max_vertices > MAX_MESHLET_VERTICES) max_vertices = MAX_MESHLET_VERTICES;
+    if (max_triangles == 0) max_triangles = DEFAULT_MESHLET_MAX_TRIANGLES;
+    if (max_triangles > MAX_MESHLET_TRIANGLES) max_triangles = MAX_MESHLET_TRIANGLES;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    unsigned int faces_count = mesh -> faces_count;
+    const float* positions = (const float*) mesh -> vertices.storage;
+
+    // Faces around each vertex, the live counts drop as the faces are used
+    unsigned int* adjacency_offsets = (unsigned int*) gltf_calloc(vertices_count + 1, sizeof(unsigned int));
+    unsigned int* live_counts = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    unsigned int* adjacency = (unsigned int*) gltf_calloc(faces_count * 3, sizeof(unsigned int));
+    float* face_normals = (float*) gltf_calloc(faces_count * 3, sizeof(float));
+    unsigned int* local_indices = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    bool* used_faces = (bool*) gltf_calloc(faces_count, sizeof(bool));
+    unsigned int* meshlet_faces = (unsigned int*) gltf_calloc(max_triangles, sizeof(unsigned int));
+    float* meshlet_normals = (float*) gltf_calloc(max_triangles * 3, sizeof(float));
+
+    // Every face in its own meshlet is the worst case, the arrays are trimmed at the end
+    Meshlets* meshlets = &(mesh -> meshlets);
+    meshlets -> meshlets = (Meshlet*) gltf_calloc(faces_count, sizeof(Meshlet));
+    meshlets -> vertices = (unsigned int*) gltf_calloc(faces_count * 3, sizeof(unsigned int));
+    meshlets -> triangles = (unsigned char*) gltf_calloc(faces_count * 3, sizeof(unsigned char));
+
+    // Without memory the mesh gets no meshlets
+    bool failed = (adjacency_offsets == NULL || live_counts == NULL || adjacency == NULL || face_normals == NULL || local_indices == NULL || used_faces == NULL || meshlet_faces == NULL || meshlet_normals == NULL);
+    if (failed || meshlets -> meshlets == NULL || meshlets -> vertices == NULL || meshlets -> triangles == NULL) {
+        deallocate_meshlets(meshlets);
+        deallocate_meshlets_scratch(adjacency_offsets, live_counts, adjacency, face_normals, local_indices, used_faces, meshlet_faces, meshlet_normals);
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) live_counts[(mesh -> faces)[i].indices[c]]++;
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) adjacency_offsets[i + 1] = adjacency_offsets[i] + live_counts[i];
+    memset(live_counts, 0, sizeof(unsigned int) * vertices_count);
+    for (unsigned int i = 0; i < faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) {
+            unsigned int vertex = (mesh -> faces)[i].indices[c];
+            adjacency[adjacency_offsets[vertex] + live_counts[vertex]++] = i;
+        }
+    }
+
+    for (unsigned int i = 0; i < faces_count; ++i) compute_face_normal(positions, (mesh -> faces)[i].indices, face_normals + i * 3);
+
+    for (unsigned int i = 0; i < vertices_count; ++i) local_indices[i] = UNMAPPED_VERTEX;
+
+    unsigned int next_face = 0;
+    float normal_sum[3] = {0};
+    for (unsigned int placed = 0; placed < faces_count; ++placed) {
+        Meshlet* meshlet = meshlets -> meshlets + meshlets -> count;
+        int best_face = -1;
+        unsigned int best_new_count = 4;
+        float best_dot = -2.0f;
+        for (unsigned int i = 0; i < meshlet -> vertices_count; ++i) {
+            unsigned int vertex = (meshlets -> vertices)[meshlet -> vertices_offset + i];
+            if (live_counts[vertex] == 0) continue;
+            for (unsigned int j = adjacency_offsets[vertex]; j < adjacency_offsets[vertex + 1]; ++j) {
+                unsigned int face = adjacency[j];
+                if (used_faces[face]) continue;
+                unsigned int new_count = 0;
+                for (unsigned char c = 0; c < 3; ++c) new_count += (local_indices[(mesh -> faces)[face].indices[c]] == UNMAPPED_VERTEX);
+                if (meshlet -> vertices_count + new_count > max_vertices) continue;
+                const float* normal = face_normals + face * 3;
+                float dot = normal[0] * normal_sum[0] + normal[1] * normal_sum[1] + normal[2] * normal_sum[2];
+                if (new_count > best_new_count || (new_count == best_new_count && dot <= best_dot)) continue;
+                best_face = (int) face;
+                best_new_count = new_count;
+                best_dot = dot;
+            }
+        }
+
+        if (best_face < 0) {
+            while (used_faces[next_face]) next_face++;
+            unsigned int new_count = 0;
+            for (unsigned char c = 0; c < 3; ++c) new_count += (local_indices[(mesh -> faces)[next_face].indices[c]] == UNMAPPED_VERTEX);
+            if (meshlet -> vertices_count + new_count > max_vertices) {
+                finish_meshlet(meshlets, positions, face_normals, meshlet_faces, local_indices, meshlet_normals);
+                meshlet = meshlets -> meshlets + meshlets -> count;
+                *meshlet = (Meshlet) { .vertices_offset = meshlets -> vertices_count, .triangles_offset = meshlets -> triangles_count * 3 };
+                memset(normal_sum, 0, sizeof(normal_sum));
+            }
+            best_face = (int) next_face;
+        }
+
+        Face* face = mesh -> faces + best_face;
+        for (unsigned char c = 0; c < 3; ++c) {
+            unsigned int vertex = (face -> indices)[c];
+            if (local_indices[vertex] == UNMAPPED_VERTEX) {
+                local_indices[vertex] = meshlet -> vertices_count;
+                (meshlets -> vertices)[meshlet -> vertices_offset + meshlet -> vertices_count++] = vertex;
+            }
+            (meshlets -> triangles)[meshlet -> triangles_offset + meshlet -> triangles_count * 3 + c] = (unsigned char) local_indices[vertex];
+            live_counts[vertex]--;
+            normal_sum[c] += face_normals[best_face * 3 + c];
+        }
+        meshlet_faces[meshlet -> triangles_count++] = (unsigned int) best_face;
+        used_faces[best_face] = TRUE;
+
+        if (meshlet -> triangles_count == max_triangles || placed + 1 == faces_count) {
+            finish_meshlet(meshlets, positions, face_normals, meshlet_faces, local_indices, meshlet_normals);
+            if (placed + 1 < faces_count) (meshlets -> meshlets)[meshlets -> count] = (Meshlet) { .vertices_offset = meshlets -> vertices_count, .triangles_offset = meshlets -> triangles_count * 3 };
+            memset(normal_sum, 0, sizeof(normal_sum));
+        }
+    }
+
+    // The arrays are only trimmed when there is memory to do so
+    Meshlet* trimmed_meshlets = (Meshlet*) gltf_realloc(meshlets -> meshlets, sizeof(Meshlet) * (meshlets -> count + 1));
+    if (trimmed_meshlets != NULL) meshlets -> meshlets = trimmed_meshlets;
+    unsigned int* trimmed_vertices = (unsigned int*) gltf_realloc(meshlets -> vertices, sizeof(unsigned int) * (meshlets -> vertices_count + 1));
+    if (trimmed_vertices != NULL) meshlets -> vertices = trimmed_vertices;
+    unsigned char* trimmed_triangles = (unsigned char*) gltf_realloc(meshlets -> triangles, sizeof(unsigned char) * (meshlets -> triangles_count * 3 + 1));
+    if (trimmed_triangles != NULL) meshlets -> triangles = trimmed_triangles;
+
+    deallocate_meshlets_scratch(adjacency_offsets, live_counts, adjacency, face_normals, local_indices, used_faces, meshlet_faces, meshlet_normals);
+
+    return meshlets -> count;
+}
+
+static void build_meshes_meshlets_range(unsigned int start, unsigned int end, void* context) {
+    MeshletsJob* job = (MeshletsJob*) context;
+    for (unsigned int i = start; i < end; ++i) {
+        if ((job -> meshes)[i].meshlets.meshlets == NULL) build_meshlets(job -> meshes + i, job -> max_vertices, job -> max_triangles);
+    }
+    return;
+}
+
+// One mesh per task across threads_count workers (0 meaning one per core), meshes that already have meshlets are kept
+void build_meshes_meshlets(Mesh* meshes, unsigned int meshes_count, unsigned int max_vertices, unsigned int max_triangles, unsigned int threads_count) {
+    MeshletsJob job = { .meshes = meshes, .max_vertices = max_vertices, .max_triangles = max_triangles };
+    parallel_for(meshes_count, threads_count, build_meshes_meshlets_range, &job);
+    return;
+}
+
+void deallocate_meshlets(Meshlets* meshlets) {
+    gltf_free(meshlets -> meshlets);
+    gltf_free(meshlets -> vertices);
+    gltf_free(meshlets -> triangles);
+    *meshlets = (Meshlets) {0};
+    return;
+}
+
+#endif //_MESHLETS_H_
@@ -0,0 +1,150 @@
+#ifndef _MORPH_H_
+#define _MORPH_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./simd.h"
+
+#define MORPH_WEIGHT_EPSILON 1e-6f
+
+/* -------------------------------------------------------------------------- */
+
+void blend_morph_targets(Mesh* mesh, const float* weights, unsigned int weights_count, float* morphed_positions, float* morphed_normals, float* morphed_tangents);
+void sort_sparse_target(MorphTarget* target);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct SparseEntry {
+    unsigned int vertex;
+    unsigned int entry; // position of the entry before sorting, to move its deltas along
+} SparseEntry;
+
+// The base attribute and the deltas are flat float arrays, so the blend runs four floats at a time
+// regardless of the vertex layout, with a scalar tail for the remaining components.
+static void accumulate_dense_deltas(float* output, const float* deltas, float weight, unsigned int vertices_count, unsigned char output_stride) {
+    if (deltas == NULL) return;
+
+    if (output_stride == 3) {
+        unsigned int components_count = vertices_count * 3;
+        Vec4 weight_vec = vec4_set1(weight);
+        unsigned int i = 0;
+        for (; i + 4 <= components_count; i += 4) vec4_store(output + i, vec4_madd(vec4_load(deltas + i), weight_vec, vec4_load(output + i)));
+        for (; i < components_count; ++i) output[i] += deltas[i] * weight;
+        return;
+    }
+
+    // Tangents keep their handedness in w, which is never displaced
+    for (unsigned int v = 0; v < vertices_count; ++v) {
+        for (unsigned char c = 0; c < 3; ++c) output[v * output_stride + c] += deltas[v * 3 + c] * weight;
+    }
+
+    return;
+}
+
+static void accumulate_sparse_deltas(float* output, const float* deltas, const unsigned int* indices, unsigned int sparse_count, float weight, unsigned char output_stride) {
+    if (deltas == NULL) return;
+    for (unsigned int i = 0; i < sparse_count; ++i) {
+        float* vertex = output + indices[i] * output_stride;
+        for (unsigned char c = 0; c < 3; ++c) vertex[c] += deltas[i * 3 + c] * weight;
+    }
+    return;
+}
+
+static void copy_base_attribute(float* output, ArrayExtended* attribute, unsigned int vertices_count, unsigned char stride) {
+    unsigned int components_count = elements_count[attribute -> data_type];
+    for (unsigned int v = 0; v < vertices_count; ++v) {
+        for (unsigned char c = 0; c < stride; ++c) {
+            output[v * stride + c] = (c < components_count) ? ((float*) (attribute -> storage))[v * components_count + c] : 1.0f;
+        }
+    }
+    return;
+}
+
+// Writes base attributes plus the weighted target deltas into caller-provided arrays: three floats per vertex
+// for positions and normals, four for tangents. Any output can be NULL to skip the attribute, as are attributes
+// missing from the mesh. Targets whose weight is close to zero are skipped entirely.
+void blend_morph_targets(Mesh* mesh, const float* weights, unsigned int weights_count, float* morphed_positions, float* morphed_normals, float* morphed_tangents) {
+    if (mesh -> vertices.component_type != FLOAT) {
+        warning_print("only float attributes can be morphed\n");
+        return;
+    }
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    if (mesh -> normals.storage == NULL || mesh -> normals.component_type != FLOAT) morphed_normals = NULL;
+    if (mesh -> tangents.storage == NULL || mesh -> tangents.component_type != FLOAT) morphed_tangents = NULL;
+
+    if (morphed_positions != NULL) copy_base_attribute(morphed_positions, &(mesh -> vertices), vertices_count, 3);
+    if (morphed_normals != NULL) copy_base_attribute(morphed_normals, &(mesh -> normals), vertices_count, 3);
+    if (morphed_tangents != NULL) copy_base_attribute(morphed_tangents, &(mesh -> tangents), vertices_count, 4);
+
+    unsigned int targets_count = (weights_count < mesh -> targets_count) ? weights_count : mesh -> targets_count;
+    for (unsigned int i = 0; i < targets_count; ++i) {
+        float weight = weights[i];
+        if (weight < MORPH_WEIGHT_EPSILON && weight > -MORPH_WEIGHT_EPSILON) continue;
+
+        MorphTarget* target = mesh -> targets + i;
+        if (target -> sparse_indices != NULL) {
+            if (morphed_positions != NULL) accumulate_sparse_deltas(morphed_positions, target -> position_deltas, target -> sparse_indices, target -> sparse_count, weight, 3);
+            if (morphed_normals != NULL) accumulate_sparse_deltas(morphed_normals, target -> normal_deltas, target -> sparse_indices, target -> sparse_count, weight, 3);
+            if (morphed_tangents != NULL) accumulate_sparse_deltas(morphed_tangents, target -> tangent_deltas, target -> sparse_indices, target -> sparse_count, weight, 4);
+        } else {
+            if (morphed_positions != NULL) accumulate_dense_deltas(morphed_positions, target -> position_deltas, weight, vertices_count, 3);
+            if (morphed_normals != NULL) accumulate_dense_deltas(morphed_normals, target -> normal_deltas, weight, vertices_count, 3);
+            if (morphed_tangents != NULL) accumulate_dense_deltas(morphed_tangents, target -> tangent_deltas, weight, vertices_count, 4);
+        }
+    }
+
+    return;
+}
+
+static int compare_sparse_entries(const void* a, const void* b) {
+    unsigned int first = ((const SparseEntry*) a) -> vertex;
+    unsigned int second = ((const SparseEntry*) b) -> vertex;
+    return (first > second) - (first < second);
+}
+
+// Renumbering the vertices leaves the sparse indices out of order, while glTF requires them to be strictly
+// increasing: the entries are sorted by vertex, moving their deltas along
+void sort_sparse_target(MorphTarget* target) {
+    if (target -> sparse_indices == NULL || target -> sparse_count < 2) return;
+
+    bool sorted = TRUE;
+    for (unsigned int i = 1; sorted && i < target -> sparse_count; ++i) sorted = (target -> sparse_indices)[i - 1] < (target -> sparse_indices)[i];
+    if (sorted) return;
+
+    // Every buffer is allocated first, so that without memory the target is left as it is
+    float** deltas[] = { &(target -> position_deltas), &(target -> normal_deltas), &(target -> tangent_deltas) };
+    float* sorted_deltas[3] = {0};
+    SparseEntry* entries = (SparseEntry*) gltf_calloc(target -> sparse_count, sizeof(SparseEntry));
+    bool failed = (entries == NULL);
+    for (unsigned char i = 0; i < 3; ++i) {
+        if (*(deltas[i]) == NULL) continue;
+        sorted_deltas[i] = (float*) gltf_calloc(target -> sparse_count * 3, sizeof(float));
+        failed = failed || sorted_deltas[i] == NULL;
+    }
+    if (failed) {
+        for (unsigned char i = 0; i < 3; ++i) gltf_free(sorted_deltas[i]);
+        gltf_free(entries);
+        return;
+    }
+
+    for (unsigned int i = 0; i < target -> sparse_count; ++i) entries[i] = (SparseEntry) { .vertex = (target -> sparse_indices)[i], .entry = i };
+    qsort(entries, target -> sparse_count, sizeof(SparseEntry), compare_sparse_entries);
+
+    for (unsigned char i = 0; i < 3; ++i) {
+        if (*(deltas[i]) == NULL) continue;
+        for (unsigned int j = 0; j < target -> sparse_count; ++j) memcpy(sorted_deltas[i] + j * 3, *(deltas[i]) + entries[j].entry * 3, sizeof(float) * 3);
+        gltf_free(*(deltas[i]));
+        *(deltas[i]) = sorted_deltas[i];
+    }
+    for (unsigned int i = 0; i < target -> sparse_count; ++i) (target -> sparse_indices)[i] = entries[i].vertex;
+
+    gltf_free(entries);
+
+    return;
+}
+
+#endif //_MORPH_H_
@@ -0,0 +1,82 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <pthread.h>
+#include <unistd.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+
+#define MAX_THREADS 64
+
+typedef void (*ParallelTask)(unsigned int start, unsigned int end, void* context);
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int get_cores_count();
+void parallel_for(unsigned int count, unsigned int threads_count, ParallelTask task, void* context);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct ParallelJob {
+    ParallelTask task;
+    void* context;
+    unsigned int start;
+    unsigned int end;
+    GltfAllocator allocator;
+    bool allocation_failed;
+} ParallelJob;
+
+unsigned int get_cores_count() {
+    long int cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (unsigned int) cores : 1;
+}
+
+static void* run_parallel_job(void* arg) {
+    ParallelJob* job = (ParallelJob*) arg;
+    // Workers allocate through the same allocator as the thread that spawned them
+    set_allocator(&(job -> allocator));
+    (job -> task)(job -> start, job -> end, job -> context);
+    job -> allocation_failed = has_allocation_failed();
+    return NULL;
+}
+
+// Splits [0, count) in contiguous ranges, one per thread, the calling thread processes the first range.
+// A threads_count of 0 uses one thread per core.
+void parallel_for(unsigned int count, unsigned int threads_count, ParallelTask task, void* context) {
+    if (count == 0) return;
+    if (threads_count == 0) threads_count = get_cores_count();
+    if (threads_count > MAX_THREADS) threads_count = MAX_THREADS;
+    if (threads_count > count) threads_count = count;
+
+    ParallelJob jobs[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    bool spawned[MAX_THREADS] = {0};
+    unsigned int chunk_size = (count + threads_count - 1) / threads_count;
+
+    for (unsigned int i = 0; i < threads_count; ++i) {
+        unsigned int start = i * chunk_size;
+        unsigned int end = (start + chunk_size < count) ? start + chunk_size : count;
+        jobs[i] = (ParallelJob) { .task = task, .context = context, .start = start, .end = end, .allocator = get_allocator() };
+        if (i == 0 || start >= end) continue;
+        if (pthread_create(threads + i, NULL, run_parallel_job, jobs + i)) {
+            warning_print("failed to spawn worker thread, running the range %u-%u inline\n", start, end);
+            task(start, end, context);
+            continue;
+        }
+        spawned[i] = TRUE;
+    }
+
+    task(jobs[0].start, jobs[0].end, context);
+
+    for (unsigned int i = 1; i < threads_count; ++i) {
+        if (!spawned[i]) continue;
+        pthread_join(threads[i], NULL);
+        // The failures of the workers are reported to the calling thread, which owns the load
+        if (jobs[i].allocation_failed) set_allocation_failed(TRUE);
+    }
+
+    return;
+}
+
+#endif //_PARALLEL_H_
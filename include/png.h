@@ -0,0 +1,642 @@
+#ifndef _PNG_H_
+#define _PNG_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./bitstream.h"
+#include "./file_io.h"
+#include "./parallel.h"
+#include "./scene.h"
+#include "./simd.h"
+
+#define HUFFMAN_FAST_BITS 10
+#define HUFFMAN_MAX_SYMBOLS 288
+#define MAX_IMAGE_SIDE (1 << 24)
+#define MAX_IMAGE_PIXELS (1ULL << 28)
+#define PNG_SIGNATURE_SIZE 8
+
+/* -------------------------------------------------------------------------- */
+
+bool decode_png(const unsigned char* data, unsigned int size, Image* image);
+bool load_png(const char* path, Image* image);
+void decode_textures(Scene* scene, unsigned int threads_count);
+
+/* -------------------------------------------------------------------------- */
+
+// Canonical Huffman decoding table: codes up to HUFFMAN_FAST_BITS long resolve with a single lookup of
+// the next bits, the longer ones by comparing the bit-reversed code against the last code of each length
+typedef struct HuffmanTable {
+    unsigned short int fast[1 << HUFFMAN_FAST_BITS]; // (length << 9) | symbol, 0 for longer codes
+    unsigned short int first_code[16];
+    unsigned int max_code[17]; // exclusive bound of the codes of each length, aligned to 16 bits
+    unsigned short int first_symbol[16];
+    unsigned char sizes[HUFFMAN_MAX_SYMBOLS];
+    unsigned short int symbols[HUFFMAN_MAX_SYMBOLS];
+} HuffmanTable;
+
+typedef struct Inflater {
+    BitReader reader;
+    unsigned char* output;
+    size_t output_size;
+    size_t output_capacity; // the PNG header gives the exact size, the output never grows
+} Inflater;
+
+typedef struct PngHeader {
+    unsigned int width;
+    unsigned int height;
+    unsigned char bit_depth;
+    unsigned char color_type;
+    unsigned char channels;
+    bool interlaced;
+    unsigned char palette[256 * 4];
+    unsigned int palette_count;
+    bool has_transparent_key;
+    unsigned short int transparent_key[3]; // tRNS color of grayscale and RGB images
+} PngHeader;
+
+static const unsigned short int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short int distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char code_lengths_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static unsigned int reverse_bits(unsigned int value, unsigned char bits_count) {
+    unsigned int reversed = 0;
+    for (unsigned char i = 0; i < bits_count; ++i, value >>= 1) reversed = (reversed << 1) | (value & 1);
+    return reversed;
+}
+
+// Returns TRUE if the code lengths don't describe a valid prefix code
+static bool build_huffman_table(HuffmanTable* table, const unsigned char* lengths, unsigned int symbols_count) {
+    unsigned int counts[17] = {0};
+    unsigned int next_code[16] = {0};
+    memset(table -> fast, 0, sizeof(table -> fast));
+
+    for (unsigned int i = 0; i < symbols_count; ++i) counts[lengths[i]]++;
+    counts[0] = 0;
+
+    unsigned int code = 0;
+    unsigned int symbol = 0;
+    for (unsigned char i = 1; i < 16; ++i) {
+        if (counts[i] > (1u << i)) return TRUE;
+        next_code[i] = code;
+        table -> first_code[i] = (unsigned short int) code;
+        table -> first_symbol[i] = (unsigned short int) symbol;
+        code += counts[i];
+        if (counts[i] > 0 && code - 1 >= (1u << i)) return TRUE;
+        table -> max_code[i] = code << (16 - i);
+        code <<= 1;
+        symbol += counts[i];
+    }
+    table -> max_code[16] = 0x10000;
+
+    for (unsigned int i = 0; i < symbols_count; ++i) {
+        unsigned char length = lengths[i];
+        if (length == 0) continue;
+        unsigned int index = next_code[length] - table -> first_code[length] + table -> first_symbol[length];
+        (table -> sizes)[index] = length;
+        (table -> symbols)[index] = (unsigned short int) i;
+        if (length <= HUFFMAN_FAST_BITS) {
+            unsigned short int entry = (unsigned short int) ((length << 9) | i);
+            for (unsigned int j = reverse_bits(next_code[length], length); j < (1u << HUFFMAN_FAST_BITS); j += (1u << length)) (table -> fast)[j] = entry;
+        }
+        next_code[length]++;
+    }
+
+    return FALSE;
+}
+
+// Returns the decoded symbol, or -1 for an invalid code. The caller keeps at least 15 bits buffered.
+static int decode_huffman_symbol(BitReader* reader, HuffmanTable* table) {
+    unsigned short int entry = (table -> fast)[peek_bits(reader, HUFFMAN_FAST_BITS)];
+    if (entry != 0) {
+        consume_bits(reader, entry >> 9);
+        return entry & 511;
+    }
+
+    unsigned int code = reverse_bits(peek_bits(reader, 16), 16);
+    unsigned char length = HUFFMAN_FAST_BITS + 1;
+    while (length < 16 && code >= (table -> max_code)[length]) length++;
+    if (length >= 16) return -1;
+
+    unsigned int index = (code >> (16 - length)) - (table -> first_code)[length] + (table -> first_symbol)[length];
+    if (index >= HUFFMAN_MAX_SYMBOLS || (table -> sizes)[index] != length) return -1;
+    consume_bits(reader, length);
+
+    return (table -> symbols)[index];
+}
+
+static bool inflate_block(Inflater* inflater, HuffmanTable* lengths_table, HuffmanTable* distances_table) {
+    BitReader* reader = &(inflater -> reader);
+    while (TRUE) {
+        // 56 buffered bits cover the longest length code, its extra bits, distance code and extra bits
+        refill_bits(reader);
+        int symbol = decode_huffman_symbol(reader, lengths_table);
+        if (symbol < 0) return TRUE;
+
+        if (symbol < 256) {
+            if (inflater -> output_size >= inflater -> output_capacity) return TRUE;
+            (inflater -> output)[(inflater -> output_size)++] = (unsigned char) symbol;
+            continue;
+        }
+        if (symbol == 256) return FALSE;
+
+        symbol -= 257;
+        if (symbol >= 29) return TRUE;
+        size_t length = length_base[symbol] + read_bits(reader, length_extra[symbol]);
+
+        int distance_symbol = decode_huffman_symbol(reader, distances_table);
+        if (distance_symbol < 0 || distance_symbol >= 30) return TRUE;
+        size_t distance = distance_base[distance_symbol] + read_bits(reader, distance_extra[distance_symbol]);
+        if (distance > inflater -> output_size || length > inflater -> output_capacity - inflater -> output_size) return TRUE;
+
+        unsigned char* destination = inflater -> output + inflater -> output_size;
+        const unsigned char* source = destination - distance;
+        if (distance == 1) memset(destination, *source, length);
+        else if (distance >= length) memcpy(destination, source, length);
+        else for (size_t i = 0; i < length; ++i) destination[i] = source[i];
+        inflater -> output_size += length;
+    }
+}
+
+static bool read_dynamic_tables(BitReader* reader, HuffmanTable* lengths_table, HuffmanTable* distances_table) {
+    unsigned int lengths_count = read_bits(reader, 5) + 257;
+    unsigned int distances_count = read_bits(reader, 5) + 1;
+    unsigned int code_lengths_count = read_bits(reader, 4) + 4;
+
+    unsigned char code_lengths[19] = {0};
+    for (unsigned int i = 0; i < code_lengths_count; ++i) code_lengths[code_lengths_order[i]] = (unsigned char) read_bits(reader, 3);
+    HuffmanTable code_lengths_table;
+    if (build_huffman_table(&code_lengths_table, code_lengths, 19)) return TRUE;
+
+    unsigned char lengths[HUFFMAN_MAX_SYMBOLS + 32] = {0};
+    unsigned int total = lengths_count + distances_count;
+    for (unsigned int i = 0; i < total;) {
+        refill_bits(reader);
+        int symbol = decode_huffman_symbol(reader, &code_lengths_table);
+        if (symbol < 0) return TRUE;
+        if (symbol < 16) {
+            lengths[i++] = (unsigned char) symbol;
+            continue;
+        }
+
+        unsigned int repeat = 0;
+        unsigned char value = 0;
+        if (symbol == 16) {
+            if (i == 0) return TRUE;
+            repeat = 3 + read_bits(reader, 2);
+            value = lengths[i - 1];
+        } else if (symbol == 17) {
+            repeat = 3 + read_bits(reader, 3);
+        } else {
+            repeat = 11 + read_bits(reader, 7);
+        }
+        if (repeat > total - i) return TRUE;
+        memset(lengths + i, value, repeat);
+        i += repeat;
+    }
+
+    if (lengths[256] == 0) return TRUE;
+    return build_huffman_table(lengths_table, lengths, lengths_count) || build_huffman_table(distances_table, lengths + lengths_count, distances_count);
+}
+
+// Decompresses a zlib stream into output, whose size must be known in advance. Returns TRUE on error.
+static bool zlib_inflate(const unsigned char* data, size_t size, unsigned char* output, size_t output_capacity) {
+    if (size < 2 || (data[0] & 15) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 32)) {
+        error_print("invalid zlib header\n");
+        return TRUE;
+    }
+
+    Inflater inflater = { .output = output, .output_capacity = output_capacity };
+    init_bit_reader(&(inflater.reader), data + 2, size - 2);
+    BitReader* reader = &(inflater.reader);
+
+    HuffmanTable* tables = (HuffmanTable*) gltf_calloc(2, sizeof(HuffmanTable));
+    if (tables == NULL) return TRUE;
+    bool error = FALSE;
+    bool last_block = FALSE;
+    while (!last_block && !error) {
+        refill_bits(reader);
+        last_block = (bool) read_bits(reader, 1);
+        unsigned int block_type = read_bits(reader, 2);
+
+        if (block_type == 0) {
+            consume_bits(reader, reader -> bits_count & 7);
+            unsigned int length = read_bits(reader, 16);
+            unsigned int inverted_length = read_bits(reader, 16);
+            error = (length != (~inverted_length & 0xFFFF)) || length > output_capacity - inflater.output_size;
+            if (!error) error = read_aligned_bytes(reader, output + inflater.output_size, length);
+            inflater.output_size += length;
+        } else if (block_type == 1) {
+            unsigned char lengths[HUFFMAN_MAX_SYMBOLS + 32];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            memset(lengths + HUFFMAN_MAX_SYMBOLS, 5, 32);
+            build_huffman_table(tables, lengths, HUFFMAN_MAX_SYMBOLS);
+            build_huffman_table(tables + 1, lengths + HUFFMAN_MAX_SYMBOLS, 32);
+            error = inflate_block(&inflater, tables, tables + 1);
+        } else if (block_type == 2) {
+            error = read_dynamic_tables(reader, tables, tables + 1) || inflate_block(&inflater, tables, tables + 1);
+        } else {
+            error = TRUE;
+        }
+        if (is_bit_reader_overrun(reader)) error = TRUE;
+    }
+    gltf_free(tables);
+
+    if (error) error_print("corrupted deflate stream\n");
+    else if (inflater.output_size != output_capacity) warning_print("inflated %lu bytes instead of %lu\n", (unsigned long) inflater.output_size, (unsigned long) output_capacity);
+
+    return error;
+}
+
+/* Unfiltering */
+
+static unsigned char paeth_predictor(int a, int b, int c) {
+    int pa = abs(b - c);
+    int pb = abs(a - c);
+    int pc = abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc) return (unsigned char) a;
+    return (unsigned char) ((pb <= pc) ? b : c);
+}
+
+#if SIMD_ENABLED && defined(__SSE2__)
+
+static inline __m128i load_pixel(const unsigned char* pixel, unsigned int bpp) {
+    int value = 0;
+    memcpy(&value, pixel, bpp);
+    return _mm_cvtsi32_si128(value);
+}
+
+static inline void store_pixel(unsigned char* pixel, __m128i value, unsigned int bpp) {
+    int result = _mm_cvtsi128_si32(value);
+    memcpy(pixel, &result, bpp);
+    return;
+}
+
+static inline __m128i select_epi16(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i abs_epi16(__m128i value) {
+    return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value));
+}
+
+// Sub, Average and Paeth depend on the pixel on the left, so the bytes of a 3 or 4 byte pixel are
+// processed together, while Up has no dependency and goes 16 bytes at a time
+static bool unfilter_row_simd(unsigned char filter, unsigned char* row, const unsigned char* prior, unsigned int row_bytes, unsigned int bpp) {
+    if (filter == 2) {
+        unsigned int i = 0;
+        for (; i + 16 <= row_bytes; i += 16) _mm_storeu_si128((__m128i*) (row + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*) (row + i)), _mm_loadu_si128((const __m128i*) (prior + i))));
+        for (; i < row_bytes; ++i) row[i] += prior[i];
+        return TRUE;
+    }
+    if (bpp != 3 && bpp != 4) return FALSE;
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i left = zero;
+    __m128i upper_left = zero;
+    for (unsigned int i = 0; i < row_bytes; i += bpp) {
+        __m128i pixel = load_pixel(row + i, bpp);
+        if (filter == 1) {
+            left = _mm_add_epi8(pixel, left);
+        } else if (filter == 3) {
+            __m128i upper = load_pixel(prior + i, bpp);
+            __m128i average = _mm_avg_epu8(left, upper);
+            average = _mm_sub_epi8(average, _mm_and_si128(_mm_xor_si128(left, upper), _mm_set1_epi8(1)));
+            left = _mm_add_epi8(pixel, average);
+        } else {
+            __m128i upper = _mm_unpacklo_epi8(load_pixel(prior + i, bpp), zero);
+            __m128i a = _mm_unpacklo_epi8(left, zero);
+            __m128i pa = _mm_sub_epi16(upper, upper_left);
+            __m128i pb = _mm_sub_epi16(a, upper_left);
+            __m128i pc = abs_epi16(_mm_add_epi16(pa, pb));
+            pa = abs_epi16(pa);
+            pb = abs_epi16(pb);
+            __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            __m128i predictor = select_epi16(_mm_cmpeq_epi16(pa, smallest), a, select_epi16(_mm_cmpeq_epi16(pb, smallest), upper, upper_left));
+            left = _mm_add_epi8(pixel, _mm_packus_epi16(predictor, predictor));
+            upper_left = upper;
+        }
+        store_pixel(row + i, left, bpp);
+    }
+
+    return TRUE;
+}
+
+#endif //SIMD_ENABLED && __SSE2__
+
+// prior is the previous unfiltered row, all zeros for the first one
+static bool unfilter_row(unsigned char filter, unsigned char* row, const unsigned char* prior, unsigned int row_bytes, unsigned int bpp) {
+    if (filter == 0) return FALSE;
+    if (filter > 4) return TRUE;
+
+#if SIMD_ENABLED && defined(__SSE2__)
+    if (unfilter_row_simd(filter, row, prior, row_bytes, bpp)) return FALSE;
+#endif //SIMD_ENABLED && __SSE2__
+
+    for (unsigned int i = 0; i < row_bytes; ++i) {
+        int left = (i >= bpp) ? row[i - bpp] : 0;
+        int upper_left = (i >= bpp) ? prior[i - bpp] : 0;
+        if (filter == 1) row[i] += left;
+        else if (filter == 2) row[i] += prior[i];
+        else if (filter == 3) row[i] += (left + prior[i]) >> 1;
+        else row[i] += paeth_predictor(left, prior[i], upper_left);
+    }
+
+    return FALSE;
+}
+
+/* Pixel conversion */
+
+static unsigned int read_sample(const unsigned char* row, unsigned int index, unsigned char bit_depth) {
+    if (bit_depth == 8) return row[index];
+    if (bit_depth == 16) return (row[index * 2] << 8) | row[index * 2 + 1];
+    unsigned int bit = index * bit_depth;
+    return (row[bit >> 3] >> (8 - bit_depth - (bit & 7))) & ((1u << bit_depth) - 1);
+}
+
+static unsigned char scale_sample(unsigned int sample, unsigned char bit_depth) {
+    if (bit_depth == 8) return (unsigned char) sample;
+    if (bit_depth == 16) return (unsigned char) (sample >> 8);
+    return (unsigned char) (sample * 255 / ((1u << bit_depth) - 1));
+}
+
+// Writes the pixels of an unfiltered row to RGBA8, every dx pixels of the image starting from destination
+static void convert_row(PngHeader* header, const unsigned char* row, unsigned int pixels_count, unsigned char* destination, unsigned int dx) {
+    if (header -> color_type == 6 && header -> bit_depth == 8 && dx == 1) {
+        memcpy(destination, row, pixels_count * 4);
+        return;
+    }
+
+    unsigned char depth = header -> bit_depth;
+    for (unsigned int x = 0; x < pixels_count; ++x, destination += dx * 4) {
+        unsigned int samples[4] = {0};
+        for (unsigned char c = 0; c < header -> channels; ++c) samples[c] = read_sample(row, x * header -> channels + c, depth);
+
+        switch (header -> color_type) {
+            case 0: {
+                unsigned char gray = scale_sample(samples[0], depth);
+                bool transparent = header -> has_transparent_key && samples[0] == header -> transparent_key[0];
+                destination[0] = destination[1] = destination[2] = gray;
+                destination[3] = transparent ? 0 : 255;
+                break;
+            }
+
+            case 2: {
+                bool transparent = header -> has_transparent_key && samples[0] == header -> transparent_key[0] && samples[1] == header -> transparent_key[1] && samples[2] == header -> transparent_key[2];
+                for (unsigned char c = 0; c < 3; ++c) destination[c] = scale_sample(samples[c], depth);
+                destination[3] = transparent ? 0 : 255;
+                break;
+            }
+
+            case 3: {
+                unsigned int index = (samples[0] < header -> palette_count) ? samples[0] : 0;
+                memcpy(destination, header -> palette + index * 4, 4);
+                break;
+            }
+
+            case 4: {
+                destination[0] = destination[1] = destination[2] = scale_sample(samples[0], depth);
+                destination[3] = scale_sample(samples[1], depth);
+                break;
+            }
+
+            default: {
+                for (unsigned char c = 0; c < 4; ++c) destination[c] = scale_sample(samples[c], depth);
+                break;
+            }
+        }
+    }
+
+    return;
+}
+
+static unsigned int get_row_bytes(PngHeader* header, unsigned int width) {
+    return (unsigned int) (((unsigned long long int) width * header -> channels * header -> bit_depth + 7) / 8);
+}
+
+// Non-interlaced images are a single pass covering every pixel, Adam7 ones seven passes on sparser grids
+static bool unfilter_image(PngHeader* header, unsigned char* data, size_t data_size, Image* image) {
+    const unsigned char start_x[7] = { 0, 4, 0, 2, 0, 1, 0 };
+    const unsigned char start_y[7] = { 0, 0, 4, 0, 2, 0, 1 };
+    const unsigned char step_x[7] = { 8, 8, 4, 4, 2, 2, 1 };
+    const unsigned char step_y[7] = { 8, 8, 8, 4, 4, 2, 2 };
+    unsigned int passes_count = header -> interlaced ? 7 : 1;
+    unsigned int bpp = (header -> channels * header -> bit_depth + 7) / 8;
+    unsigned char* zero_row = (unsigned char*) gltf_calloc(get_row_bytes(header, header -> width) + 1, sizeof(unsigned char));
+    if (zero_row == NULL) return TRUE;
+
+    size_t offset = 0;
+    bool error = FALSE;
+    for (unsigned int pass = 0; pass < passes_count && !error; ++pass) {
+        unsigned int x0 = header -> interlaced ? start_x[pass] : 0;
+        unsigned int y0 = header -> interlaced ? start_y[pass] : 0;
+        unsigned int dx = header -> interlaced ? step_x[pass] : 1;
+        unsigned int dy = header -> interlaced ? step_y[pass] : 1;
+        if (x0 >= header -> width || y0 >= header -> height) continue;
+
+        unsigned int pass_width = (header -> width - x0 + dx - 1) / dx;
+        unsigned int pass_height = (header -> height - y0 + dy - 1) / dy;
+        unsigned int row_bytes = get_row_bytes(header, pass_width);
+        const unsigned char* prior = zero_row;
+        for (unsigned int y = 0; y < pass_height; ++y) {
+            if (offset + row_bytes + 1 > data_size) {
+                error = TRUE;
+                break;
+            }
+            unsigned char* row = data + offset + 1;
+            if (unfilter_row(data[offset], row, prior, row_bytes, bpp)) {
+                error_print("invalid png filter %u\n", data[offset]);
+                error = TRUE;
+                break;
+            }
+            convert_row(header, row, pass_width, image -> pixels + ((size_t) (y0 + y * dy) * header -> width + x0) * 4, dx);
+            prior = row;
+            offset += row_bytes + 1;
+        }
+    }
+    gltf_free(zero_row);
+
+    return error;
+}
+
+static size_t get_filtered_size(PngHeader* header) {
+    if (!header -> interlaced) return (size_t) (get_row_bytes(header, header -> width) + 1) * header -> height;
+
+    const unsigned char start_x[7] = { 0, 4, 0, 2, 0, 1, 0 };
+    const unsigned char start_y[7] = { 0, 0, 4, 0, 2, 0, 1 };
+    const unsigned char step_x[7] = { 8, 8, 4, 4, 2, 2, 1 };
+    const unsigned char step_y[7] = { 8, 8, 8, 4, 4, 2, 2 };
+    size_t size = 0;
+    for (unsigned char pass = 0; pass < 7; ++pass) {
+        if (start_x[pass] >= header -> width || start_y[pass] >= header -> height) continue;
+        unsigned int pass_width = (header -> width - start_x[pass] + step_x[pass] - 1) / step_x[pass];
+        unsigned int pass_height = (header -> height - start_y[pass] + step_y[pass] - 1) / step_y[pass];
+        size += (size_t) (get_row_bytes(header, pass_width) + 1) * pass_height;
+    }
+
+    return size;
+}
+
+/* Chunks */
+
+static unsigned int read_big_endian(const unsigned char* data) {
+    return ((unsigned int) data[0] << 24) | ((unsigned int) data[1] << 16) | ((unsigned int) data[2] << 8) | data[3];
+}
+
+static bool read_png_header(PngHeader* header, const unsigned char* data, unsigned int length) {
+    if (length != 13) return TRUE;
+    header -> width = read_big_endian(data);
+    header -> height = read_big_endian(data + 4);
+    header -> bit_depth = data[8];
+    header -> color_type = data[9];
+    header -> interlaced = (data[12] == 1);
+
+    const unsigned char channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    header -> channels = (header -> color_type < 7) ? channels[header -> color_type] : 0;
+    bool valid_depth = (header -> bit_depth == 8) || (header -> bit_depth == 16 && header -> color_type != 3) || (header -> bit_depth < 8 && (header -> color_type == 0 || header -> color_type == 3) && (header -> bit_depth & (header -> bit_depth - 1)) == 0);
+    if (header -> channels == 0 || !valid_depth || data[10] != 0 || data[11] != 0 || data[12] > 1) return TRUE;
+
+    if (header -> width == 0 || header -> height == 0 || header -> width > MAX_IMAGE_SIDE || header -> height > MAX_IMAGE_SIDE) return TRUE;
+    return (unsigned long long int) header -> width * header -> height > MAX_IMAGE_PIXELS;
+}
+
+static void read_png_transparency(PngHeader* header, const unsigned char* data, unsigned int length) {
+    if (header -> color_type == 3) {
+        for (unsigned int i = 0; i < length && i < 256; ++i) header -> palette[i * 4 + 3] = data[i];
+    } else if (header -> color_type == 0 && length >= 2) {
+        header -> transparent_key[0] = (data[0] << 8) | data[1];
+        header -> has_transparent_key = TRUE;
+    } else if (header -> color_type == 2 && length >= 6) {
+        for (unsigned char c = 0; c < 3; ++c) header -> transparent_key[c] = (data[c * 2] << 8) | data[c * 2 + 1];
+        header -> has_transparent_key = TRUE;
+    }
+    return;
+}
+
+// Decodes any standard PNG to RGBA8, 16-bit samples are truncated to 8 bits. CRCs are not checked.
+// Returns TRUE on error, leaving the image empty.
+bool decode_png(const unsigned char* data, unsigned int size, Image* image) {
+    const unsigned char signature[PNG_SIGNATURE_SIZE] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    *image = (Image) {0};
+    BitStream stream = { .stream = (unsigned char*) data, .size = size };
+    const unsigned char* chunk_data = get_bytes_range(&stream, 0, PNG_SIGNATURE_SIZE);
+    if (chunk_data == NULL || memcmp(chunk_data, signature, PNG_SIGNATURE_SIZE)) {
+        error_print("invalid png signature\n");
+        return TRUE;
+    }
+
+    PngHeader header = {0};
+    unsigned char* compressed = NULL;
+    size_t compressed_size = 0;
+    bool has_header = FALSE;
+    bool error = FALSE;
+    for (unsigned int offset = PNG_SIGNATURE_SIZE; !error;) {
+        const unsigned char* chunk = get_bytes_range(&stream, offset, 8);
+        unsigned int length = (chunk != NULL) ? read_big_endian(chunk) : 0;
+        chunk_data = (chunk != NULL) ? get_bytes_range(&stream, offset + 8, (unsigned long long int) length + 4) : NULL;
+        if (chunk_data == NULL) {
+            error = TRUE;
+            break;
+        }
+        offset += length + 12;
+
+        if (!memcmp(chunk + 4, "IHDR", 4)) {
+            error = read_png_header(&header, chunk_data, length);
+            has_header = TRUE;
+        } else if (!memcmp(chunk + 4, "PLTE", 4)) {
+            header.palette_count = (length / 3 < 256) ? length / 3 : 256;
+            for (unsigned int i = 0; i < header.palette_count; ++i) {
+                memcpy(header.palette + i * 4, chunk_data + i * 3, 3);
+                header.palette[i * 4 + 3] = 255;
+            }
+        } else if (!memcmp(chunk + 4, "tRNS", 4)) {
+            read_png_transparency(&header, chunk_data, length);
+        } else if (!memcmp(chunk + 4, "IDAT", 4)) {
+            unsigned char* grown = (unsigned char*) gltf_realloc(compressed, compressed_size + length);
+            if (grown == NULL) {
+                error = TRUE;
+                break;
+            }
+            compressed = grown;
+            memcpy(compressed + compressed_size, chunk_data, length);
+            compressed_size += length;
+        } else if (!memcmp(chunk + 4, "IEND", 4)) {
+            break;
+        } else if (!(chunk[4] & 32)) {
+            error_print("unsupported critical png chunk %.4s\n", (const char*) chunk + 4);
+            error = TRUE;
+        }
+    }
+
+    error = error || !has_header || compressed_size == 0;
+    if (!error) {
+        size_t filtered_size = get_filtered_size(&header);
+        unsigned char* filtered = (unsigned char*) gltf_calloc(filtered_size, sizeof(unsigned char));
+        image -> width = header.width;
+        image -> height = header.height;
+        image -> pixels = (unsigned char*) gltf_calloc((size_t) header.width * header.height, 4);
+        error = filtered == NULL || image -> pixels == NULL;
+        error = error || zlib_inflate(compressed, compressed_size, filtered, filtered_size) || unfilter_image(&header, filtered, filtered_size, image);
+        gltf_free(filtered);
+    }
+    gltf_free(compressed);
+
+    if (error) {
+        error_print("failed to decode the png\n");
+        gltf_free(image -> pixels);
+        *image = (Image) {0};
+    }
+
+    return error;
+}
+
+bool load_png(const char* path, Image* image) {
+    *image = (Image) {0};
+    File file = { .file_path = (char*) path };
+    if (read_model_file(&file)) {
+        gltf_free(file.data);
+        return TRUE;
+    }
+
+    bool error = decode_png(file.data, file.size, image);
+    gltf_free(file.data);
+    if (!error) debug_print(CYAN, "decoded %s, %ux%u\n", path, image -> width, image -> height);
+
+    return error;
+}
+
+static void decode_textures_range(unsigned int start, unsigned int end, void* context) {
+    Texture* textures = (Texture*) context;
+    for (unsigned int i = start; i < end; ++i) {
+        if (textures[i].image.pixels != NULL) continue;
+        const char* path = textures[i].texture_path;
+        size_t len = (path != NULL) ? strlen(path) : 0;
+        bool is_png = (textures[i].mime_type != NULL) ? !strcmp(textures[i].mime_type, "image/png") : (len >= 4 && !strcasecmp(path + len - 4, ".png"));
+        if (is_png && textures[i].encoded != NULL) {
+            decode_png(textures[i].encoded, textures[i].encoded_size, &(textures[i].image));
+        } else if (len >= 4 && !strcasecmp(path + len - 4, ".png")) {
+            load_png(path, &(textures[i].image));
+        } else {
+            debug_print(CYAN, "skipping texture %u, only png textures are decoded\n", i);
+        }
+    }
+    return;
+}
+
+// Decodes the PNG textures of the scene into Texture.image, one texture per task. The materials hold copies
+// of the textures, so the images are copied into them afterwards, the pixels are owned by scene.textures.
+void decode_textures(Scene* scene, unsigned int threads_count) {
+    parallel_for(scene -> textures_count, threads_count, decode_textures_range, scene -> textures);
+    share_textures_with_materials(scene);
+    return;
+}
+
+#endif //_PNG_H_
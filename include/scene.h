@@ -0,0 +1,121 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include "./types.h"
+#include "./allocator.h"
+#include "./simd.h"
+
+/* -------------------------------------------------------------------------- */
+
+Node* get_scene_node(Scene* scene, unsigned int node_index);
+void multiply_matrices(const float* a, const float* b, float* result);
+void compute_local_matrix(Node* node, float* matrix);
+float* compute_world_matrices(Scene* scene);
+int get_scene_texture_index(Scene* scene, Texture* texture);
+void share_textures_with_materials(Scene* scene);
+
+/* -------------------------------------------------------------------------- */
+
+// The root node lives inside the Scene, so its address changes whenever the Scene is copied
+// and the nodes table only holds the heap-allocated descendants.
+Node* get_scene_node(Scene* scene, unsigned int node_index) {
+    if (node_index == scene -> root_node.index) return &(scene -> root_node);
+    if (node_index >= scene -> nodes_count) return NULL;
+    return (scene -> nodes)[node_index];
+}
+
+// Matrices are column-major as in glTF, result can't alias the operands
+void multiply_matrices(const float* a, const float* b, float* result) {
+    Vec4 columns[4] = { vec4_load(a), vec4_load(a + 4), vec4_load(a + 8), vec4_load(a + 12) };
+    for (unsigned char i = 0; i < 4; ++i) {
+        Vec4 column = vec4_mul(columns[0], vec4_set1(b[i * 4]));
+        column = vec4_madd(columns[1], vec4_set1(b[i * 4 + 1]), column);
+        column = vec4_madd(columns[2], vec4_set1(b[i * 4 + 2]), column);
+        column = vec4_madd(columns[3], vec4_set1(b[i * 4 + 3]), column);
+        vec4_store(result + i * 4, column);
+    }
+    return;
+}
+
+// Combines the node matrix with its TRS properties, glTF only allows one of the two so the other is the identity
+void compute_local_matrix(Node* node, float* matrix) {
+    float x = node -> rotation_quat[0];
+    float y = node -> rotation_quat[1];
+    float z = node -> rotation_quat[2];
+    float w = node -> rotation_quat[3];
+    float sx = node -> scale_vec[0];
+    float sy = node -> scale_vec[1];
+    float sz = node -> scale_vec[2];
+
+    float trs[16] = {
+        (1.0f - 2.0f * (y * y + z * z)) * sx, 2.0f * (x * y + z * w) * sx, 2.0f * (x * z - y * w) * sx, 0.0f,
+        2.0f * (x * y - z * w) * sy, (1.0f - 2.0f * (x * x + z * z)) * sy, 2.0f * (y * z + x * w) * sy, 0.0f,
+        2.0f * (x * z + y * w) * sz, 2.0f * (y * z - x * w) * sz, (1.0f - 2.0f * (x * x + y * y)) * sz, 0.0f,
+        node -> translation_vec[0], node -> translation_vec[1], node -> translation_vec[2], 1.0f
+    };
+
+    multiply_matrices(node -> transformation_matrix, trs, matrix);
+
+    return;
+}
+
+static void compute_node_world_matrices(Node* node, const float* parent_matrix, float* world_matrices, unsigned int nodes_count) {
+    float local_matrix[16];
+    float world_matrix[16];
+    compute_local_matrix(node, local_matrix);
+    multiply_matrices(parent_matrix, local_matrix, world_matrix);
+    if (node -> index < nodes_count) {
+        for (unsigned char i = 0; i < 16; ++i) world_matrices[node -> index * 16 + i] = world_matrix[i];
+    }
+
+    for (unsigned int i = 0; i < node -> children_count; ++i) {
+        compute_node_world_matrices(node -> childrens + i, world_matrix, world_matrices, nodes_count);
+    }
+
+    return;
+}
+
+// Returns nodes_count column-major matrices indexed by glTF node index, nodes outside the scene get the identity.
+// Returns NULL when out of memory.
+float* compute_world_matrices(Scene* scene) {
+    const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    unsigned int nodes_count = (scene -> nodes_count > 0) ? scene -> nodes_count : 1;
+    float* world_matrices = (float*) gltf_calloc(nodes_count * 16, sizeof(float));
+    if (world_matrices == NULL) return NULL;
+    for (unsigned int i = 0; i < nodes_count; ++i) {
+        for (unsigned char j = 0; j < 16; ++j) world_matrices[i * 16 + j] = identity[j];
+    }
+
+    compute_node_world_matrices(&(scene -> root_node), identity, world_matrices, nodes_count);
+
+    return world_matrices;
+}
+
+// Materials hold copies of the scene textures, recognized by the path or the embedded image they share
+int get_scene_texture_index(Scene* scene, Texture* texture) {
+    for (unsigned int i = 0; i < scene -> textures_count; ++i) {
+        Texture* scene_texture = scene -> textures + i;
+        if (texture -> texture_path != NULL && scene_texture -> texture_path == texture -> texture_path) return (int) i;
+        if (texture -> encoded != NULL && scene_texture -> encoded == texture -> encoded) return (int) i;
+    }
+    return -1;
+}
+
+// Refreshes the materials copies after the scene textures were decoded, keeping their own tex_coord
+void share_textures_with_materials(Scene* scene) {
+    for (unsigned int i = 0; i < scene -> materials_count; ++i) {
+        Material* material = scene -> materials + i;
+        Texture* copies[] = { &(material -> pbr_metallic_roughness.base_color_texture), &(material -> pbr_metallic_roughness.metallic_roughness_texture), &(material -> normal_texture.texture), &(material -> occlusion_texture.texture), &(material -> emissive_texture) };
+        for (unsigned char j = 0; j < sizeof(copies) / sizeof(copies[0]); ++j) {
+            int texture_index = get_scene_texture_index(scene, copies[j]);
+            if (texture_index < 0) continue;
+            unsigned int tex_coord = copies[j] -> tex_coord;
+            *(copies[j]) = (scene -> textures)[texture_index];
+            copies[j] -> tex_coord = tex_coord;
+        }
+    }
+
+    return;
+}
+
+#endif //_SCENE_H_
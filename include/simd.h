@@ -0,0 +1,185 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <string.h>
+#include "./types.h"
+
+// 4-wide float vectors, mapped on SSE when available and on plain arrays otherwise.
+// Define _NO_SIMD_ to force the scalar fallback.
+
+#if defined(__SSE__) && !defined(_NO_SIMD_)
+
+#include <xmmintrin.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif //__SSE2__
+#if defined(__FMA__) || defined(__F16C__)
+#include <immintrin.h>
+#endif //__FMA__ || __F16C__
+
+#define SIMD_ENABLED TRUE
+
+typedef __m128 Vec4;
+
+static inline Vec4 vec4_load(const float* ptr) { return _mm_loadu_ps(ptr); }
+static inline void vec4_store(float* ptr, Vec4 a) { _mm_storeu_ps(ptr, a); }
+static inline Vec4 vec4_set1(float value) { return _mm_set1_ps(value); }
+static inline Vec4 vec4_set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+static inline Vec4 vec4_add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+static inline Vec4 vec4_sub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+static inline Vec4 vec4_mul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+static inline Vec4 vec4_div(Vec4 a, Vec4 b) { return _mm_div_ps(a, b); }
+static inline Vec4 vec4_min(Vec4 a, Vec4 b) { return _mm_min_ps(a, b); }
+static inline Vec4 vec4_max(Vec4 a, Vec4 b) { return _mm_max_ps(a, b); }
+static inline Vec4 vec4_sqrt(Vec4 a) { return _mm_sqrt_ps(a); }
+static inline Vec4 vec4_abs(Vec4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+// Returns 1.0f in the lanes where a < b, 0.0f elsewhere
+static inline Vec4 vec4_less(Vec4 a, Vec4 b) { return _mm_and_ps(_mm_cmplt_ps(a, b), _mm_set1_ps(1.0f)); }
+
+// Bit i is set when lane i of a is less than lane i of b, false for NaN lanes
+static inline unsigned int vec4_less_mask(Vec4 a, Vec4 b) { return (unsigned int) _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+
+static inline void vec4_transpose(Vec4* a, Vec4* b, Vec4* c, Vec4* d) {
+    _MM_TRANSPOSE4_PS(*a, *b, *c, *d);
+    return;
+}
+
+#else
+
+#define SIMD_ENABLED FALSE
+
+typedef struct Vec4 {
+    float v[4];
+} Vec4;
+
+#define VEC4_OP(a, b, op) (Vec4) {{ (a).v[0] op (b).v[0], (a).v[1] op (b).v[1], (a).v[2] op (b).v[2], (a).v[3] op (b).v[3] }}
+
+static inline Vec4 vec4_load(const float* ptr) { return (Vec4) {{ ptr[0], ptr[1], ptr[2], ptr[3] }}; }
+static inline void vec4_store(float* ptr, Vec4 a) { for (unsigned char i = 0; i < 4; ++i) ptr[i] = a.v[i]; }
+static inline Vec4 vec4_set1(float value) { return (Vec4) {{ value, value, value, value }}; }
+static inline Vec4 vec4_set(float x, float y, float z, float w) { return (Vec4) {{ x, y, z, w }}; }
+static inline Vec4 vec4_add(Vec4 a, Vec4 b) { return VEC4_OP(a, b, +); }
+static inline Vec4 vec4_sub(Vec4 a, Vec4 b) { return VEC4_OP(a, b, -); }
+static inline Vec4 vec4_mul(Vec4 a, Vec4 b) { return VEC4_OP(a, b, *); }
+static inline Vec4 vec4_div(Vec4 a, Vec4 b) { return VEC4_OP(a, b, /); }
+
+static inline Vec4 vec4_min(Vec4 a, Vec4 b) {
+    for (unsigned char i = 0; i < 4; ++i) a.v[i] = (b.v[i] < a.v[i]) ? b.v[i] : a.v[i];
+    return a;
+}
+
+static inline Vec4 vec4_max(Vec4 a, Vec4 b) {
+    for (unsigned char i = 0; i < 4; ++i) a.v[i] = (b.v[i] > a.v[i]) ? b.v[i] : a.v[i];
+    return a;
+}
+
+static inline Vec4 vec4_sqrt(Vec4 a) {
+    for (unsigned char i = 0; i < 4; ++i) a.v[i] = __builtin_sqrtf(a.v[i]);
+    return a;
+}
+
+static inline Vec4 vec4_abs(Vec4 a) {
+    for (unsigned char i = 0; i < 4; ++i) a.v[i] = __builtin_fabsf(a.v[i]);
+    return a;
+}
+
+static inline Vec4 vec4_less(Vec4 a, Vec4 b) {
+    for (unsigned char i = 0; i < 4; ++i) a.v[i] = (a.v[i] < b.v[i]) ? 1.0f : 0.0f;
+    return a;
+}
+
+static inline unsigned int vec4_less_mask(Vec4 a, Vec4 b) {
+    unsigned int mask = 0;
+    for (unsigned char i = 0; i < 4; ++i) mask |= (unsigned int) (a.v[i] < b.v[i]) << i;
+    return mask;
+}
+
+static inline void vec4_transpose(Vec4* a, Vec4* b, Vec4* c, Vec4* d) {
+    Vec4* rows[4] = { a, b, c, d };
+    for (unsigned char i = 0; i < 4; ++i) {
+        for (unsigned char j = i + 1; j < 4; ++j) {
+            float tmp = rows[i] -> v[j];
+            rows[i] -> v[j] = rows[j] -> v[i];
+            rows[j] -> v[i] = tmp;
+        }
+    }
+    return;
+}
+
+#endif //__SSE__
+
+// a * b + c, fused when the target supports FMA
+#if defined(__FMA__) && SIMD_ENABLED
+static inline Vec4 vec4_madd(Vec4 a, Vec4 b, Vec4 c) { return _mm_fmadd_ps(a, b, c); }
+#else
+static inline Vec4 vec4_madd(Vec4 a, Vec4 b, Vec4 c) { return vec4_add(vec4_mul(a, b), c); }
+#endif //__FMA__
+
+// a + (b - a) * t
+static inline Vec4 vec4_lerp(Vec4 a, Vec4 b, Vec4 t) { return vec4_madd(vec4_sub(b, a), t, a); }
+
+// IEEE 754 binary16 conversions, rounding to nearest even like the hardware converters
+static inline unsigned short int float_to_half(float value) {
+    unsigned int bits = 0;
+    memcpy(&bits, &value, sizeof(float));
+    unsigned short int sign = (bits >> 16) & 0x8000;
+    unsigned int abs_bits = bits & 0x7FFFFFFF;
+
+    if (abs_bits > 0x7F800000) return sign | 0x7E00;
+    if (abs_bits >= 0x477FF000) return sign | 0x7C00;
+    if (abs_bits <= 0x33000000) return sign;
+
+    if (abs_bits < 0x38800000) {
+        unsigned int mantissa = (abs_bits & 0x7FFFFF) | 0x800000;
+        unsigned int shift = 126 - (abs_bits >> 23);
+        unsigned int half_mantissa = mantissa >> shift;
+        unsigned int remainder = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) half_mantissa++;
+        return sign | half_mantissa;
+    }
+
+    unsigned int rounded = abs_bits + 0xFFF + ((abs_bits >> 13) & 1);
+    return sign | ((rounded - 0x38000000) >> 13);
+}
+
+static inline float half_to_float(unsigned short int half) {
+    unsigned int sign = (unsigned int) (half & 0x8000) << 16;
+    unsigned int exponent = (half >> 10) & 0x1F;
+    unsigned int mantissa = half & 0x3FF;
+    if (exponent == 0) {
+        float value = (float) mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+
+    unsigned int bits = sign | ((exponent == 0x1F) ? 0x7F800000 : ((exponent + 112) << 23)) | (mantissa << 13);
+    float value = 0.0f;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+#if defined(__F16C__) && SIMD_ENABLED
+static inline void vec4_store_half(unsigned short int* ptr, Vec4 a) { _mm_storel_epi64((__m128i*) ptr, _mm_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT)); }
+#else
+static inline void vec4_store_half(unsigned short int* ptr, Vec4 a) {
+    float values[4];
+    vec4_store(values, a);
+    for (unsigned char i = 0; i < 4; ++i) ptr[i] = float_to_half(values[i]);
+    return;
+}
+#endif //__F16C__
+
+// Rounds each lane to the nearest integer
+#if defined(__SSE2__) && SIMD_ENABLED
+static inline void vec4_store_int(int* ptr, Vec4 a) { _mm_storeu_si128((__m128i*) ptr, _mm_cvtps_epi32(a)); }
+#else
+static inline void vec4_store_int(int* ptr, Vec4 a) {
+    float values[4];
+    vec4_store(values, a);
+    for (unsigned char i = 0; i < 4; ++i) ptr[i] = (int) (values[i] + ((values[i] < 0.0f) ? -0.5f : 0.5f));
+    return;
+}
+#endif //__SSE2__
+
+#endif //_SIMD_H_
@@ -0,0 +1,538 @@
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./mesh_optimizer.h"
+
+#define BOUNDARY_QUADRIC_WEIGHT 10.0
+#define NORMAL_ERROR_WEIGHT 0.01f
+#define UV_ERROR_WEIGHT 0.01f
+#define MAX_BOUNDARY_NEIGHBOURS 2
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int simplify_mesh(Mesh* mesh, const unsigned int* indices, unsigned int indices_count, unsigned int target_indices_count, float target_error, unsigned int* simplified_indices, float* result_error);
+void generate_lods(Mesh* mesh, unsigned int lods_count, float lod_ratio);
+
+/* -------------------------------------------------------------------------- */
+
+typedef enum VertexKind { MANIFOLD_VERTEX, BOUNDARY_VERTEX, LOCKED_VERTEX } VertexKind;
+
+// Error function of the squared distance from a set of planes: p^T A p + 2 b^T p + c, weighted by the triangles area
+typedef struct Quadric {
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double weight;
+} Quadric;
+
+typedef struct Collapse {
+    unsigned int source; // position ids, the source position moves onto the target one
+    unsigned int target;
+    float error;
+} Collapse;
+
+typedef struct EdgeTable {
+    unsigned long long int* keys; // key plus one, zero marks an empty slot
+    unsigned int size;
+} EdgeTable;
+
+typedef struct SimplifyContext {
+    const float* positions;
+    const float* normals; // NULL when the mesh has no float normals
+    const float* texture_coords; // NULL when the mesh has no float UVs
+    unsigned int vertices_count;
+    unsigned int* position_ids; // first vertex sharing the same position, so that seams collapse together
+    unsigned int* next_wedge; // circular list of the vertices sharing a position
+    Quadric* quadrics; // indexed by position id
+    VertexKind* kinds;
+    unsigned int* boundary_neighbours; // MAX_BOUNDARY_NEIGHBOURS position ids per boundary vertex
+    float inv_scale; // errors are relative to the mesh extent
+} SimplifyContext;
+
+static void add_plane_quadric(Quadric* quadric, double a, double b, double c, double d, double weight) {
+    quadric -> a00 += a * a * weight;
+    quadric -> a11 += b * b * weight;
+    quadric -> a22 += c * c * weight;
+    quadric -> a01 += a * b * weight;
+    quadric -> a02 += a * c * weight;
+    quadric -> a12 += b * c * weight;
+    quadric -> b0 += a * d * weight;
+    quadric -> b1 += b * d * weight;
+    quadric -> b2 += c * d * weight;
+    quadric -> c += d * d * weight;
+    quadric -> weight += weight;
+    return;
+}
+
+static void merge_quadrics(Quadric* quadric, const Quadric* other) {
+    double* values = (double*) quadric;
+    const double* other_values = (const double*) other;
+    for (unsigned int i = 0; i < sizeof(Quadric) / sizeof(double); ++i) values[i] += other_values[i];
+    return;
+}
+
+// Average squared distance of the point from the planes
+static double get_quadric_error(const Quadric* q, const float* p) {
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    double error = q -> a00 * x * x + q -> a11 * y * y + q -> a22 * z * z;
+    error += 2.0 * (q -> a01 * x * y + q -> a02 * x * z + q -> a12 * y * z);
+    error += 2.0 * (q -> b0 * x + q -> b1 * y + q -> b2 * z) + q -> c;
+    return (q -> weight > 0.0) ? fabs(error) / q -> weight : 0.0;
+}
+
+static void compute_triangle_normal(const float* a, const float* b, const float* c, float* normal) {
+    float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+    return;
+}
+
+static unsigned int hash_edge(unsigned long long int key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int) key;
+}
+
+static EdgeTable allocate_edge_table(unsigned int edges_count) {
+    EdgeTable table = { .size = 1 };
+    while (table.size < edges_count * 2) table.size <<= 1;
+    table.keys = (unsigned long long int*) gltf_calloc(table.size, sizeof(unsigned long long int));
+    return table;
+}
+
+static bool find_edge(EdgeTable* table, unsigned int a, unsigned int b, bool insert) {
+    unsigned long long int key = (((unsigned long long int) a << 32) | b) + 1;
+    unsigned int slot = hash_edge(key) & (table -> size - 1);
+    while ((table -> keys)[slot] != 0) {
+        if ((table -> keys)[slot] == key) return TRUE;
+        slot = (slot + 1) & (table -> size - 1);
+    }
+    if (insert) (table -> keys)[slot] = key;
+    return FALSE;
+}
+
+static void add_boundary_neighbour(SimplifyContext* context, unsigned int position, unsigned int neighbour) {
+    if (context -> kinds[position] == LOCKED_VERTEX) return;
+    unsigned int* neighbours = context -> boundary_neighbours + position * MAX_BOUNDARY_NEIGHBOURS;
+    if (context -> kinds[position] == MANIFOLD_VERTEX) {
+        context -> kinds[position] = BOUNDARY_VERTEX;
+        neighbours[0] = neighbour;
+        neighbours[1] = UNMAPPED_VERTEX;
+    } else if (neighbours[0] != neighbour && neighbours[1] != neighbour) {
+        if (neighbours[1] == UNMAPPED_VERTEX) neighbours[1] = neighbour;
+        else context -> kinds[position] = LOCKED_VERTEX;
+    }
+    return;
+}
+
+// Open edges and attribute seams (edges shared in position but not in vertices) are boundaries: their vertices
+// can only slide along them, and vertices where boundaries branch or end are locked
+static bool classify_vertices(SimplifyContext* context, const unsigned int* indices, unsigned int indices_count) {
+    EdgeTable position_edges = allocate_edge_table(indices_count);
+    EdgeTable vertex_edges = allocate_edge_table(indices_count);
+    if (position_edges.keys == NULL || vertex_edges.keys == NULL) {
+        gltf_free(position_edges.keys);
+        gltf_free(vertex_edges.keys);
+        return TRUE;
+    }
+
+    for (unsigned int i = 0; i < indices_count; ++i) {
+        unsigned int a = indices[i];
+        unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+        find_edge(&position_edges, context -> position_ids[a], context -> position_ids[b], TRUE);
+        find_edge(&vertex_edges, a, b, TRUE);
+    }
+
+    for (unsigned int i = 0; i < indices_count; ++i) {
+        unsigned int a = indices[i];
+        unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+        unsigned int position_a = context -> position_ids[a];
+        unsigned int position_b = context -> position_ids[b];
+        bool open = !find_edge(&position_edges, position_b, position_a, FALSE);
+        bool seam = !open && !find_edge(&vertex_edges, b, a, FALSE);
+        if (!open && !seam) continue;
+
+        add_boundary_neighbour(context, position_a, position_b);
+        add_boundary_neighbour(context, position_b, position_a);
+
+        // Keeps the boundary in place by penalizing the movement away from the plane orthogonal to the triangle
+        const float* pa = context -> positions + position_a * 3;
+        const float* pb = context -> positions + position_b * 3;
+        const float* pc = context -> positions + context -> position_ids[indices[i - i % 3 + (i + 2) % 3]] * 3;
+        float normal[3];
+        compute_triangle_normal(pa, pb, pc, normal);
+        float edge[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+        double plane[3] = { edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2], edge[0] * normal[1] - edge[1] * normal[0] };
+        double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length <= 0.0) continue;
+        for (unsigned char c = 0; c < 3; ++c) plane[c] /= length;
+        double distance = -(plane[0] * pa[0] + plane[1] * pa[1] + plane[2] * pa[2]);
+        double weight = (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]) * BOUNDARY_QUADRIC_WEIGHT;
+        add_plane_quadric(context -> quadrics + position_a, plane[0], plane[1], plane[2], distance, weight);
+        add_plane_quadric(context -> quadrics + position_b, plane[0], plane[1], plane[2], distance, weight);
+    }
+
+    // A boundary vertex with a single boundary edge is a corner
+    for (unsigned int i = 0; i < context -> vertices_count; ++i) {
+        if (context -> kinds[i] == BOUNDARY_VERTEX && context -> boundary_neighbours[i * MAX_BOUNDARY_NEIGHBOURS + 1] == UNMAPPED_VERTEX) context -> kinds[i] = LOCKED_VERTEX;
+    }
+
+    gltf_free(position_edges.keys);
+    gltf_free(vertex_edges.keys);
+
+    return FALSE;
+}
+
+static bool build_positions(SimplifyContext* context) {
+    unsigned int table_size = 1;
+    while (table_size < context -> vertices_count * 2) table_size <<= 1;
+    unsigned int* table = (unsigned int*) gltf_calloc(table_size, sizeof(unsigned int));
+    if (table == NULL) return TRUE;
+
+    for (unsigned int i = 0; i < context -> vertices_count; ++i) {
+        const float* position = context -> positions + i * 3;
+        unsigned int slot = hash_bytes((const unsigned char*) position, sizeof(float) * 3, 2166136261u) & (table_size - 1);
+        while (table[slot] != 0 && memcmp(context -> positions + (table[slot] - 1) * 3, position, sizeof(float) * 3)) slot = (slot + 1) & (table_size - 1);
+        if (table[slot] == 0) table[slot] = i + 1;
+
+        unsigned int first = table[slot] - 1;
+        context -> position_ids[i] = first;
+        context -> next_wedge[i] = i;
+        if (first != i) {
+            context -> next_wedge[i] = context -> next_wedge[first];
+            context -> next_wedge[first] = i;
+        }
+    }
+
+    gltf_free(table);
+
+    return FALSE;
+}
+
+static float get_attribute_error(SimplifyContext* context, unsigned int vertex, unsigned int target) {
+    float error = 0.0f;
+    if (context -> normals != NULL) {
+        const float* a = context -> normals + vertex * 3;
+        const float* b = context -> normals + target * 3;
+        for (unsigned char c = 0; c < 3; ++c) error += (a[c] - b[c]) * (a[c] - b[c]) * NORMAL_ERROR_WEIGHT;
+    }
+    if (context -> texture_coords != NULL) {
+        const float* a = context -> texture_coords + vertex * 2;
+        const float* b = context -> texture_coords + target * 2;
+        for (unsigned char c = 0; c < 2; ++c) error += (a[c] - b[c]) * (a[c] - b[c]) * UV_ERROR_WEIGHT;
+    }
+    return error;
+}
+
+// Each vertex of the source position moves onto the vertex of the target position it shares a triangle with,
+// so that both sides of a seam follow the collapse. Returns FALSE when one of them has no such vertex.
+static bool map_wedges(SimplifyContext* context, const unsigned int* indices, const unsigned int* adjacency_offsets, const unsigned int* adjacency, unsigned int source, unsigned int target, unsigned int* remap, float* attribute_error) {
+    unsigned int wedge = source;
+    *attribute_error = 0.0f;
+    do {
+        unsigned int mapped = UNMAPPED_VERTEX;
+        for (unsigned int i = adjacency_offsets[wedge]; i < adjacency_offsets[wedge + 1] && mapped == UNMAPPED_VERTEX; ++i) {
+            const unsigned int* triangle = indices + adjacency[i] * 3;
+            for (unsigned char c = 0; c < 3; ++c) {
+                if (context -> position_ids[triangle[c]] == target) mapped = triangle[c];
+            }
+        }
+
+        if (mapped == UNMAPPED_VERTEX) {
+            // Vertices not referenced anymore don't need to move
+            if (adjacency_offsets[wedge] != adjacency_offsets[wedge + 1]) return FALSE;
+            mapped = target;
+        }
+
+        if (remap != NULL) remap[wedge] = mapped;
+        *attribute_error += get_attribute_error(context, wedge, mapped);
+        wedge = context -> next_wedge[wedge];
+    } while (wedge != source);
+
+    return TRUE;
+}
+
+// Rejects the collapses that would flip the triangles around the source position
+static bool has_flipped_triangles(SimplifyContext* context, const unsigned int* indices, const unsigned int* adjacency_offsets, const unsigned int* adjacency, unsigned int source, unsigned int target) {
+    unsigned int wedge = source;
+    const float* target_position = context -> positions + target * 3;
+    do {
+        for (unsigned int i = adjacency_offsets[wedge]; i < adjacency_offsets[wedge + 1]; ++i) {
+            const unsigned int* triangle = indices + adjacency[i] * 3;
+            const float* corners[3];
+            const float* moved_corners[3];
+            bool collapsed = FALSE;
+            for (unsigned char c = 0; c < 3; ++c) {
+                unsigned int position = context -> position_ids[triangle[c]];
+                if (position == target) collapsed = TRUE;
+                corners[c] = context -> positions + position * 3;
+                moved_corners[c] = (position == source) ? target_position : corners[c];
+            }
+            if (collapsed) continue;
+
+            float normal[3];
+            float moved_normal[3];
+            compute_triangle_normal(corners[0], corners[1], corners[2], normal);
+            compute_triangle_normal(moved_corners[0], moved_corners[1], moved_corners[2], moved_normal);
+            if (normal[0] * moved_normal[0] + normal[1] * moved_normal[1] + normal[2] * moved_normal[2] <= 0.0f) return TRUE;
+        }
+        wedge = context -> next_wedge[wedge];
+    } while (wedge != source);
+
+    return FALSE;
+}
+
+static bool is_collapse_allowed(SimplifyContext* context, unsigned int source, unsigned int target) {
+    if (source == target || context -> kinds[source] == LOCKED_VERTEX) return FALSE;
+    if (context -> kinds[source] == MANIFOLD_VERTEX) return TRUE;
+    const unsigned int* neighbours = context -> boundary_neighbours + source * MAX_BOUNDARY_NEIGHBOURS;
+    return neighbours[0] == target || neighbours[1] == target;
+}
+
+// After sliding source onto target along the boundary, the boundary skips source
+static void update_boundary(SimplifyContext* context, unsigned int source, unsigned int target) {
+    if (context -> kinds[source] != BOUNDARY_VERTEX) return;
+    unsigned int* source_neighbours = context -> boundary_neighbours + source * MAX_BOUNDARY_NEIGHBOURS;
+    unsigned int other = (source_neighbours[0] == target) ? source_neighbours[1] : source_neighbours[0];
+    unsigned int* target_neighbours = context -> boundary_neighbours + target * MAX_BOUNDARY_NEIGHBOURS;
+    unsigned int* other_neighbours = context -> boundary_neighbours + other * MAX_BOUNDARY_NEIGHBOURS;
+    for (unsigned char i = 0; i < MAX_BOUNDARY_NEIGHBOURS; ++i) {
+        if (target_neighbours[i] == source) target_neighbours[i] = other;
+        if (other_neighbours[i] == source) other_neighbours[i] = target;
+    }
+    if (target_neighbours[0] == target_neighbours[1]) context -> kinds[target] = LOCKED_VERTEX;
+    return;
+}
+
+static int compare_collapses(const void* a, const void* b) {
+    float error_a = ((const Collapse*) a) -> error;
+    float error_b = ((const Collapse*) b) -> error;
+    return (error_a > error_b) - (error_a < error_b);
+}
+
+static void build_vertex_adjacency(const unsigned int* indices, unsigned int indices_count, unsigned int vertices_count, unsigned int* offsets, unsigned int* adjacency) {
+    memset(offsets, 0, sizeof(unsigned int) * (vertices_count + 1));
+    for (unsigned int i = 0; i < indices_count; ++i) offsets[indices[i] + 1]++;
+    for (unsigned int i = 0; i < vertices_count; ++i) offsets[i + 1] += offsets[i];
+    for (unsigned int i = 0; i < indices_count; ++i) adjacency[offsets[indices[i]]++] = i / 3;
+    for (unsigned int i = vertices_count; i > 0; --i) offsets[i] = offsets[i - 1];
+    offsets[0] = 0;
+    return;
+}
+
+static unsigned int remove_degenerate_triangles(SimplifyContext* context, unsigned int* indices, unsigned int indices_count) {
+    unsigned int kept_count = 0;
+    for (unsigned int i = 0; i < indices_count; i += 3) {
+        unsigned int a = context -> position_ids[indices[i]];
+        unsigned int b = context -> position_ids[indices[i + 1]];
+        unsigned int c = context -> position_ids[indices[i + 2]];
+        if (a == b || b == c || a == c) continue;
+        for (unsigned char j = 0; j < 3; ++j) indices[kept_count++] = indices[i + j];
+    }
+    return kept_count;
+}
+
+// Returns TRUE when out of memory, the context must be deallocated anyway
+static bool initialize_simplify_context(SimplifyContext* context, Mesh* mesh, const unsigned int* indices, unsigned int indices_count) {
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    context -> positions = (const float*) (mesh -> vertices.storage);
+    context -> normals = (mesh -> normals.storage != NULL && mesh -> normals.component_type == FLOAT && mesh -> normals.arr.count == vertices_count) ? (const float*) (mesh -> normals.storage) : NULL;
+    context -> texture_coords = (mesh -> texture_coords.storage != NULL && mesh -> texture_coords.component_type == FLOAT && mesh -> texture_coords.data_type == VEC2 && mesh -> texture_coords.arr.count == vertices_count) ? (const float*) (mesh -> texture_coords.storage) : NULL;
+    context -> vertices_count = vertices_count;
+    context -> position_ids = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    context -> next_wedge = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    context -> quadrics = (Quadric*) gltf_calloc(vertices_count, sizeof(Quadric));
+    context -> kinds = (VertexKind*) gltf_calloc(vertices_count, sizeof(VertexKind));
+    context -> boundary_neighbours = (unsigned int*) gltf_calloc(vertices_count * MAX_BOUNDARY_NEIGHBOURS, sizeof(unsigned int));
+    if (context -> position_ids == NULL || context -> next_wedge == NULL || context -> quadrics == NULL || context -> kinds == NULL || context -> boundary_neighbours == NULL) return TRUE;
+
+    float extent = 0.0f;
+    for (unsigned char c = 0; c < 3; ++c) extent = fmaxf(extent, mesh -> bounds_max[c] - mesh -> bounds_min[c]);
+    context -> inv_scale = (extent > 0.0f) ? 1.0f / extent : 1.0f;
+
+    if (build_positions(context)) return TRUE;
+
+    for (unsigned int i = 0; i < indices_count; i += 3) {
+        const float* a = context -> positions + context -> position_ids[indices[i]] * 3;
+        const float* b = context -> positions + context -> position_ids[indices[i + 1]] * 3;
+        const float* c = context -> positions + context -> position_ids[indices[i + 2]] * 3;
+        float normal[3];
+        compute_triangle_normal(a, b, c, normal);
+        double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length <= 0.0) continue;
+        double n[3] = { normal[0] / length, normal[1] / length, normal[2] / length };
+        double distance = -(n[0] * a[0] + n[1] * a[1] + n[2] * a[2]);
+        for (unsigned char j = 0; j < 3; ++j) add_plane_quadric(context -> quadrics + context -> position_ids[indices[i + j]], n[0], n[1], n[2], distance, length * 0.5);
+    }
+
+    return classify_vertices(context, indices, indices_count);
+}
+
+static void deallocate_simplify_context(SimplifyContext* context) {
+    gltf_free(context -> position_ids);
+    gltf_free(context -> next_wedge);
+    gltf_free(context -> quadrics);
+    gltf_free(context -> kinds);
+    gltf_free(context -> boundary_neighbours);
+    return;
+}
+
+// Edge-collapse simplification driven by quadric error metrics (Garland-Heckbert). Each pass sorts the valid
+// collapses of the current triangles by error and applies the cheapest ones, at most one per neighbourhood,
+// until target_indices_count or the relative target_error is reached. Vertices sharing a position collapse
+// together, seams and open borders only collapse along themselves, and normal/UV differences add to the error.
+// simplified_indices must hold indices_count elements, returns the simplified indices count.
+unsigned int simplify_mesh(Mesh* mesh, const unsigned int* indices, unsigned int indices_count, unsigned int target_indices_count, float target_error, unsigned int* simplified_indices, float* result_error) {
+    memcpy(simplified_indices, indices, sizeof(unsigned int) * indices_count);
+    if (result_error != NULL) *result_error = 0.0f;
+    if (mesh -> vertices.storage == NULL || mesh -> vertices.component_type != FLOAT || mesh -> vertices.data_type != VEC3) {
+        warning_print("only float positions can be simplified\n");
+        return indices_count;
+    }
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    for (unsigned int i = 0; i < indices_count; ++i) {
+        if (indices[i] >= vertices_count) {
+            warning_print("index %u out of range, skipping the simplification\n", indices[i]);
+            return indices_count;
+        }
+    }
+
+    SimplifyContext context = {0};
+    bool failed = initialize_simplify_context(&context, mesh, indices, indices_count);
+
+    unsigned int* adjacency_offsets = (unsigned int*) gltf_calloc(vertices_count + 1, sizeof(unsigned int));
+    unsigned int* adjacency = (unsigned int*) gltf_calloc(indices_count, sizeof(unsigned int));
+    Collapse* collapses = (Collapse*) gltf_calloc(indices_count * 2, sizeof(Collapse));
+    unsigned int* remap = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    bool* touched = (bool*) gltf_calloc(vertices_count, sizeof(bool));
+    float max_error_squared = target_error * target_error;
+    float applied_error = 0.0f;
+
+    // Without memory the indices are left as they are
+    failed = failed || adjacency_offsets == NULL || adjacency == NULL || collapses == NULL || remap == NULL || touched == NULL;
+    while (!failed && indices_count > target_indices_count) {
+        build_vertex_adjacency(simplified_indices, indices_count, vertices_count, adjacency_offsets, adjacency);
+
+        unsigned int collapses_count = 0;
+        for (unsigned int i = 0; i < indices_count; ++i) {
+            unsigned int a = context.position_ids[simplified_indices[i]];
+            unsigned int b = context.position_ids[simplified_indices[i - i % 3 + (i + 1) % 3]];
+            for (unsigned char direction = 0; direction < 2; ++direction) {
+                unsigned int source = direction ? b : a;
+                unsigned int target = direction ? a : b;
+                if (!is_collapse_allowed(&context, source, target)) continue;
+                float error = (float) get_quadric_error(context.quadrics + source, context.positions + target * 3) * context.inv_scale * context.inv_scale;
+                collapses[collapses_count++] = (Collapse) { .source = source, .target = target, .error = error };
+            }
+        }
+        qsort(collapses, collapses_count, sizeof(Collapse), compare_collapses);
+
+        // Every collapse removes two triangles on average
+        unsigned int collapses_goal = (indices_count - target_indices_count) / 6 + 1;
+        unsigned int applied_count = 0;
+        for (unsigned int i = 0; i < vertices_count; ++i) {
+            remap[i] = i;
+            touched[i] = FALSE;
+        }
+
+        for (unsigned int i = 0; i < collapses_count && applied_count < collapses_goal; ++i) {
+            Collapse* collapse = collapses + i;
+            if (touched[collapse -> source] || touched[collapse -> target]) continue;
+
+            float attribute_error = 0.0f;
+            if (!map_wedges(&context, simplified_indices, adjacency_offsets, adjacency, collapse -> source, collapse -> target, NULL, &attribute_error)) continue;
+            float error = collapse -> error + attribute_error;
+            if (error > max_error_squared) continue;
+            if (has_flipped_triangles(&context, simplified_indices, adjacency_offsets, adjacency, collapse -> source, collapse -> target)) continue;
+
+            map_wedges(&context, simplified_indices, adjacency_offsets, adjacency, collapse -> source, collapse -> target, remap, &attribute_error);
+            merge_quadrics(context.quadrics + collapse -> target, context.quadrics + collapse -> source);
+            update_boundary(&context, collapse -> source, collapse -> target);
+
+            // The neighbourhood of the source changed, its collapses are evaluated again in the next pass
+            unsigned int wedge = collapse -> source;
+            do {
+                for (unsigned int j = adjacency_offsets[wedge]; j < adjacency_offsets[wedge + 1]; ++j) {
+                    for (unsigned char c = 0; c < 3; ++c) touched[context.position_ids[simplified_indices[adjacency[j] * 3 + c]]] = TRUE;
+                }
+                wedge = context.next_wedge[wedge];
+            } while (wedge != collapse -> source);
+
+            applied_error = fmaxf(applied_error, error);
+            applied_count++;
+        }
+
+        if (applied_count == 0) break;
+
+        for (unsigned int i = 0; i < indices_count; ++i) simplified_indices[i] = remap[simplified_indices[i]];
+        indices_count = remove_degenerate_triangles(&context, simplified_indices, indices_count);
+    }
+
+    if (result_error != NULL) *result_error = sqrtf(applied_error);
+
+    gltf_free(touched);
+    gltf_free(remap);
+    gltf_free(collapses);
+    gltf_free(adjacency);
+    gltf_free(adjacency_offsets);
+    deallocate_simplify_context(&context);
+
+    return indices_count;
+}
+
+// Builds lods_count index buffers, each one simplified from the previous level down to lod_ratio of its
+// triangles, stopping early when the mesh can't be simplified any further
+void generate_lods(Mesh* mesh, unsigned int lods_count, float lod_ratio) {
+    if (!is_triangle_mesh(mesh) || lods_count == 0) return;
+
+    unsigned int indices_count = mesh -> faces_count * 3;
+    unsigned int* indices = (unsigned int*) gltf_calloc(indices_count, sizeof(unsigned int));
+    if (indices == NULL) return;
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) indices[i * 3 + c] = (mesh -> faces)[i].indices[c];
+    }
+
+    mesh -> lods = (MeshLod*) gltf_calloc(lods_count, sizeof(MeshLod));
+    mesh -> lods_count = 0;
+    if (mesh -> lods == NULL) lods_count = 0;
+    const unsigned int* source_indices = indices;
+    unsigned int source_count = indices_count;
+    for (unsigned int i = 0; i < lods_count; ++i) {
+        unsigned int target_count = (unsigned int) (source_count / 3 * lod_ratio) * 3;
+        MeshLod* lod = mesh -> lods + i;
+        lod -> indices = (unsigned int*) gltf_calloc(source_count, sizeof(unsigned int));
+        if (lod -> indices == NULL) break;
+        lod -> indices_count = simplify_mesh(mesh, source_indices, source_count, target_count, FLT_MAX, lod -> indices, &(lod -> error));
+        if (lod -> indices_count == source_count) {
+            gltf_free(lod -> indices);
+            *lod = (MeshLod) {0};
+            break;
+        }
+
+        unsigned int* shrunk_indices = (unsigned int*) gltf_realloc(lod -> indices, sizeof(unsigned int) * (lod -> indices_count + 1));
+        if (shrunk_indices != NULL) lod -> indices = shrunk_indices;
+        mesh -> lods_count++;
+        source_indices = lod -> indices;
+        source_count = lod -> indices_count;
+        debug_print(CYAN, "lod %u: %u triangles, error %f\n", i + 1, lod -> indices_count / 3, lod -> error);
+    }
+
+    gltf_free(indices);
+
+    return;
+}
+
+#endif //_SIMPLIFY_H_
@@ -0,0 +1,118 @@
+#ifndef _SKINNING_H_
+#define _SKINNING_H_
+
+#include <math.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./simd.h"
+#include "./scene.h"
+#include "./parallel.h"
+
+#define SKINNING_BATCH_SIZE 256
+
+/* -------------------------------------------------------------------------- */
+
+float* compute_joint_matrices(Scene* scene, Skin* skin, float* world_matrices);
+void skin_mesh(Mesh* mesh, const float* joint_matrices, unsigned int joints_count, float* skinned_positions, float* skinned_normals, unsigned int threads_count);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct SkinningJob {
+    Mesh* mesh;
+    const float* joint_matrices;
+    unsigned int joints_count;
+    float* skinned_positions;
+    float* skinned_normals;
+} SkinningJob;
+
+// Returns the matrix palette of the skin: world matrix of each joint times its inverse bind matrix, NULL when out of memory
+float* compute_joint_matrices(Scene* scene, Skin* skin, float* world_matrices) {
+    float* joint_matrices = (float*) gltf_calloc(skin -> joints_count * 16, sizeof(float));
+    for (unsigned int i = 0; joint_matrices != NULL && i < skin -> joints_count; ++i) {
+        unsigned int joint = (skin -> joints)[i];
+        if (joint >= scene -> nodes_count) joint = 0;
+        multiply_matrices(world_matrices + joint * 16, skin -> inverse_bind_matrices + i * 16, joint_matrices + i * 16);
+    }
+    return joint_matrices;
+}
+
+static unsigned int get_joint_index(Joints* joints, unsigned int vertex, unsigned char influence) {
+    if (joints -> component_type == UNSIGNED_BYTE) return ((unsigned char*) (joints -> storage))[vertex * 4 + influence];
+    return ((unsigned short int*) (joints -> storage))[vertex * 4 + influence];
+}
+
+static void skin_vertices(unsigned int start, unsigned int end, void* context) {
+    SkinningJob* job = (SkinningJob*) context;
+    const float* positions = (const float*) (job -> mesh -> vertices.storage);
+    const float* normals = (job -> skinned_normals != NULL) ? (const float*) (job -> mesh -> normals.storage) : NULL;
+    const float* weights = (const float*) (job -> mesh -> weights.storage);
+
+    for (unsigned int vertex = start; vertex < end; ++vertex) {
+        // Blend the columns of the influencing joint matrices, each column fills a whole register
+        Vec4 columns[4] = { vec4_set1(0.0f), vec4_set1(0.0f), vec4_set1(0.0f), vec4_set1(0.0f) };
+        for (unsigned char influence = 0; influence < 4; ++influence) {
+            float weight = weights[vertex * 4 + influence];
+            unsigned int joint = get_joint_index(&(job -> mesh -> joints), vertex, influence);
+            if (weight == 0.0f || joint >= job -> joints_count) continue;
+            const float* matrix = job -> joint_matrices + joint * 16;
+            Vec4 weight_vec = vec4_set1(weight);
+            for (unsigned char c = 0; c < 4; ++c) columns[c] = vec4_madd(vec4_load(matrix + c * 4), weight_vec, columns[c]);
+        }
+
+        float result[4];
+        const float* position = positions + vertex * 3;
+        Vec4 skinned = vec4_madd(columns[0], vec4_set1(position[0]), columns[3]);
+        skinned = vec4_madd(columns[1], vec4_set1(position[1]), skinned);
+        skinned = vec4_madd(columns[2], vec4_set1(position[2]), skinned);
+        vec4_store(result, skinned);
+        for (unsigned char c = 0; c < 3; ++c) job -> skinned_positions[vertex * 3 + c] = result[c];
+
+        if (normals == NULL) continue;
+
+        const float* normal = normals + vertex * 3;
+        Vec4 skinned_normal = vec4_mul(columns[0], vec4_set1(normal[0]));
+        skinned_normal = vec4_madd(columns[1], vec4_set1(normal[1]), skinned_normal);
+        skinned_normal = vec4_madd(columns[2], vec4_set1(normal[2]), skinned_normal);
+        vec4_store(result, skinned_normal);
+        float length = sqrtf(result[0] * result[0] + result[1] * result[1] + result[2] * result[2]);
+        float inv_length = (length > 0.0f) ? 1.0f / length : 0.0f;
+        for (unsigned char c = 0; c < 3; ++c) job -> skinned_normals[vertex * 3 + c] = result[c] * inv_length;
+    }
+
+    return;
+}
+
+static void skin_batches(unsigned int start, unsigned int end, void* context) {
+    SkinningJob* job = (SkinningJob*) context;
+    unsigned int vertices_count = job -> mesh -> vertices.arr.count;
+    for (unsigned int batch = start; batch < end; ++batch) {
+        unsigned int first_vertex = batch * SKINNING_BATCH_SIZE;
+        unsigned int last_vertex = (first_vertex + SKINNING_BATCH_SIZE < vertices_count) ? first_vertex + SKINNING_BATCH_SIZE : vertices_count;
+        skin_vertices(first_vertex, last_vertex, context);
+    }
+    return;
+}
+
+// Linear blend skinning of the mesh positions (and normals, when skinned_normals is not NULL) into
+// caller-provided arrays of three floats per vertex. Batches of vertices are spread across threads_count
+// workers, 0 meaning one per core.
+void skin_mesh(Mesh* mesh, const float* joint_matrices, unsigned int joints_count, float* skinned_positions, float* skinned_normals, unsigned int threads_count) {
+    if (mesh -> joints.storage == NULL || mesh -> weights.storage == NULL) {
+        warning_print("the mesh has no joints or weights, skipping the skinning\n");
+        return;
+    } else if (mesh -> vertices.component_type != FLOAT || (skinned_normals != NULL && mesh -> normals.component_type != FLOAT)) {
+        warning_print("only float positions and normals can be skinned\n");
+        return;
+    }
+
+    if (mesh -> normals.storage == NULL) skinned_normals = NULL;
+
+    SkinningJob job = { .mesh = mesh, .joint_matrices = joint_matrices, .joints_count = joints_count, .skinned_positions = skinned_positions, .skinned_normals = skinned_normals };
+    unsigned int batches_count = (mesh -> vertices.arr.count + SKINNING_BATCH_SIZE - 1) / SKINNING_BATCH_SIZE;
+    parallel_for(batches_count, threads_count, skin_batches, &job);
+
+    return;
+}
+
+#endif //_SKINNING_H_
@@ -0,0 +1,395 @@
+#ifndef _TANGENTS_H_
+#define _TANGENTS_H_
+
+#include <math.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./simd.h"
+#include "./parallel.h"
+#include "./mesh_optimizer.h"
+#include "./index_buffer.h"
+
+// Attributes to generate for a mesh when it lacks them, see generate_missing_attributes
+#define GENERATE_NORMALS 0x01
+#define GENERATE_TANGENTS 0x02
+
+/* -------------------------------------------------------------------------- */
+
+void generate_normals(Mesh* mesh);
+void generate_flat_normals(Mesh* mesh);
+void generate_tangents(Mesh* mesh);
+void generate_missing_attributes(Mesh* meshes, unsigned int meshes_count, const unsigned char* attributes, bool smooth_normals, unsigned int threads_count);
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct AttributesJob {
+    Mesh* meshes;
+    const unsigned char* attributes;
+    bool smooth_normals;
+} AttributesJob;
+
+// Four triangles in structure-of-arrays form: corners[corner][axis] holds the axis of that corner for each lane
+typedef struct TriangleBatch {
+    Vec4 corners[3][3];
+    unsigned int indices[4][3];
+    unsigned char count;
+} TriangleBatch;
+
+static TriangleBatch load_triangle_batch(Mesh* mesh, unsigned int first_face) {
+    TriangleBatch batch = {0};
+    const float* positions = (const float*) (mesh -> vertices.storage);
+    float lanes[3][3][4] = {0};
+    batch.count = (mesh -> faces_count - first_face < 4) ? mesh -> faces_count - first_face : 4;
+    for (unsigned char lane = 0; lane < batch.count; ++lane) {
+        for (unsigned char corner = 0; corner < 3; ++corner) {
+            unsigned int vertex = (mesh -> faces)[first_face + lane].indices[corner];
+            batch.indices[lane][corner] = vertex;
+            for (unsigned char axis = 0; axis < 3; ++axis) lanes[corner][axis][lane] = positions[vertex * 3 + axis];
+        }
+    }
+    for (unsigned char corner = 0; corner < 3; ++corner) {
+        for (unsigned char axis = 0; axis < 3; ++axis) batch.corners[corner][axis] = vec4_load(lanes[corner][axis]);
+    }
+    return batch;
+}
+
+static Vec4 dot_product(const Vec4* a, const Vec4* b) {
+    return vec4_madd(a[2], b[2], vec4_madd(a[1], b[1], vec4_mul(a[0], b[0])));
+}
+
+static void cross_product(const Vec4* a, const Vec4* b, Vec4* result) {
+    result[0] = vec4_sub(vec4_mul(a[1], b[2]), vec4_mul(a[2], b[1]));
+    result[1] = vec4_sub(vec4_mul(a[2], b[0]), vec4_mul(a[0], b[2]));
+    result[2] = vec4_sub(vec4_mul(a[0], b[1]), vec4_mul(a[1], b[0]));
+    return;
+}
+
+// Angle of each corner of the four triangles, the cosines are vectorized while acos runs per lane
+static void compute_corner_angles(TriangleBatch* batch, float angles[3][4]) {
+    for (unsigned char corner = 0; corner < 3; ++corner) {
+        Vec4 edge_0[3];
+        Vec4 edge_1[3];
+        for (unsigned char axis = 0; axis < 3; ++axis) {
+            edge_0[axis] = vec4_sub(batch -> corners[(corner + 1) % 3][axis], batch -> corners[corner][axis]);
+            edge_1[axis] = vec4_sub(batch -> corners[(corner + 2) % 3][axis], batch -> corners[corner][axis]);
+        }
+        Vec4 lengths_squared = vec4_mul(dot_product(edge_0, edge_0), dot_product(edge_1, edge_1));
+        Vec4 lengths = vec4_max(vec4_sqrt(lengths_squared), vec4_set1(1e-20f));
+
+        float cosines[4];
+        vec4_store(cosines, vec4_div(dot_product(edge_0, edge_1), lengths));
+        for (unsigned char lane = 0; lane < 4; ++lane) angles[corner][lane] = acosf(CLAMP(cosines[lane], -1.0f, 1.0f));
+    }
+    return;
+}
+
+// Takes ownership of values, which are released when the attribute can't be allocated
+static void write_attribute(ArrayExtended* attribute, float* values, unsigned int vertices_count, DataType data_type) {
+    unsigned int components_count = elements_count[data_type];
+    void** data = (void**) gltf_calloc(vertices_count, sizeof(void*));
+    if (data == NULL) {
+        gltf_free(values);
+        return;
+    }
+    attribute -> storage = values;
+    attribute -> data_type = data_type;
+    attribute -> component_type = FLOAT;
+    attribute -> arr = (Array) { .count = vertices_count, .data = data };
+    for (unsigned int i = 0; i < vertices_count; ++i) (attribute -> arr.data)[i] = values + i * components_count;
+    return;
+}
+
+static void normalize_vector(float* vector, const float* fallback) {
+    float length = sqrtf(vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+    if (length <= 1e-20f) {
+        for (unsigned char c = 0; c < 3; ++c) vector[c] = fallback[c];
+        return;
+    }
+    for (unsigned char c = 0; c < 3; ++c) vector[c] /= length;
+    return;
+}
+
+// Smooth normals as the sum of the adjacent face normals, weighted by the angle of the triangle at the vertex
+// so that the tessellation of a face doesn't bias the result. Faces are processed four at a time.
+void generate_normals(Mesh* mesh) {
+    if (!is_triangle_mesh(mesh) || mesh -> vertices.component_type != FLOAT) return;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    float* normals = (float*) gltf_calloc(vertices_count * 3, sizeof(float));
+    if (normals == NULL) return;
+    for (unsigned int face = 0; face < mesh -> faces_count; face += 4) {
+        TriangleBatch batch = load_triangle_batch(mesh, face);
+
+        Vec4 edge_0[3];
+        Vec4 edge_1[3];
+        Vec4 normal[3];
+        for (unsigned char axis = 0; axis < 3; ++axis) {
+            edge_0[axis] = vec4_sub(batch.corners[1][axis], batch.corners[0][axis]);
+            edge_1[axis] = vec4_sub(batch.corners[2][axis], batch.corners[0][axis]);
+        }
+        cross_product(edge_0, edge_1, normal);
+        Vec4 inv_length = vec4_div(vec4_set1(1.0f), vec4_max(vec4_sqrt(dot_product(normal, normal)), vec4_set1(1e-20f)));
+
+        float face_normals[3][4];
+        for (unsigned char axis = 0; axis < 3; ++axis) vec4_store(face_normals[axis], vec4_mul(normal[axis], inv_length));
+        float angles[3][4];
+        compute_corner_angles(&batch, angles);
+
+        for (unsigned char lane = 0; lane < batch.count; ++lane) {
+            for (unsigned char corner = 0; corner < 3; ++corner) {
+                float* vertex_normal = normals + batch.indices[lane][corner] * 3;
+                for (unsigned char axis = 0; axis < 3; ++axis) vertex_normal[axis] += face_normals[axis][lane] * angles[corner][lane];
+            }
+        }
+    }
+
+    const float up[3] = { 0.0f, 0.0f, 1.0f };
+    for (unsigned int i = 0; i < vertices_count; ++i) normalize_vector(normals + i * 3, up);
+
+    write_attribute(&(mesh -> normals), normals, vertices_count, VEC3);
+
+    return;
+}
+
+// Without memory a morph target loses its deltas, rather than keeping ones that no longer match the vertices
+static void clear_morph_target(MorphTarget* target) {
+    gltf_free(target -> position_deltas);
+    gltf_free(target -> normal_deltas);
+    gltf_free(target -> tangent_deltas);
+    gltf_free(target -> sparse_indices);
+    *target = (MorphTarget) {0};
+    return;
+}
+
+// Gives every triangle corner its own vertex, moving every attribute stream and morph target along. Sparse targets
+// keep the corners of their vertices in corner order, so their indices stay increasing.
+// Without memory for the attributes the mesh is left as it is.
+static void split_face_vertices(Mesh* mesh) {
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    unsigned int corners_count = mesh -> faces_count * 3;
+    unsigned int* corners = (unsigned int*) gltf_calloc(corners_count, sizeof(unsigned int));
+    if (corners == NULL) return;
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) corners[i * 3 + c] = (mesh -> faces)[i].indices[c];
+    }
+
+    ArrayExtended* attributes[] = { &(mesh -> vertices), &(mesh -> normals), &(mesh -> tangents), &(mesh -> texture_coords), &(mesh -> colors), &(mesh -> joints), &(mesh -> weights) };
+    ArrayExtended splits[sizeof(attributes) / sizeof(attributes[0])] = {0};
+    bool failed = FALSE;
+    for (unsigned char i = 0; i < sizeof(attributes) / sizeof(attributes[0]); ++i) {
+        gather_attribute(attributes[i], splits + i, corners, corners_count, vertices_count);
+        failed = failed || (attributes[i] -> storage != NULL && attributes[i] -> arr.count == vertices_count && splits[i].storage == NULL);
+    }
+    for (unsigned char i = 0; i < sizeof(attributes) / sizeof(attributes[0]); ++i) {
+        if (splits[i].storage == NULL) continue;
+        if (failed) {
+            gltf_free(splits[i].storage);
+            gltf_free(splits[i].arr.data);
+            continue;
+        }
+        gltf_free(attributes[i] -> storage);
+        gltf_free(attributes[i] -> arr.data);
+        *(attributes[i]) = splits[i];
+    }
+    if (failed) {
+        gltf_free(corners);
+        return;
+    }
+
+    for (unsigned int i = 0; i < mesh -> faces_count; ++i) {
+        for (unsigned char c = 0; c < 3; ++c) (mesh -> faces)[i].indices[c] = i * 3 + c;
+    }
+
+    unsigned int* entries = (unsigned int*) gltf_calloc(vertices_count, sizeof(unsigned int));
+    for (unsigned int i = 0; i < mesh -> targets_count; ++i) {
+        MorphTarget* target = mesh -> targets + i;
+        float** deltas[] = { &(target -> position_deltas), &(target -> normal_deltas), &(target -> tangent_deltas) };
+        if (target -> sparse_indices == NULL) {
+            for (unsigned char j = 0; j < 3; ++j) {
+                float* split_deltas = gather_deltas(*(deltas[j]), corners, corners_count);
+                gltf_free(*(deltas[j]));
+                *(deltas[j]) = split_deltas;
+            }
+            continue;
+        }
+        if (entries == NULL) {
+            clear_morph_target(target);
+            continue;
+        }
+
+        for (unsigned int v = 0; v < vertices_count; ++v) entries[v] = UNMAPPED_VERTEX;
+        for (unsigned int j = 0; j < target -> sparse_count; ++j) entries[(target -> sparse_indices)[j]] = j;
+        unsigned int split_count = 0;
+        for (unsigned int c = 0; c < corners_count; ++c) split_count += (entries[corners[c]] != UNMAPPED_VERTEX);
+
+        unsigned int* split_indices = (unsigned int*) gltf_calloc(split_count + 1, sizeof(unsigned int));
+        float* split_deltas[3] = {0};
+        bool split_failed = (split_indices == NULL);
+        for (unsigned char j = 0; j < 3; ++j) {
+            split_deltas[j] = (*(deltas[j]) != NULL) ? (float*) gltf_calloc(split_count * 3 + 1, sizeof(float)) : NULL;
+            split_failed = split_failed || (*(deltas[j]) != NULL && split_deltas[j] == NULL);
+        }
+        if (split_failed) {
+            for (unsigned char j = 0; j < 3; ++j) gltf_free(split_deltas[j]);
+            gltf_free(split_indices);
+            clear_morph_target(target);
+            continue;
+        }
+
+        for (unsigned int c = 0, k = 0; c < corners_count; ++c) {
+            unsigned int entry = entries[corners[c]];
+            if (entry == UNMAPPED_VERTEX) continue;
+            for (unsigned char j = 0; j < 3; ++j) {
+                if (split_deltas[j] != NULL) memcpy(split_deltas[j] + k * 3, *(deltas[j]) + entry * 3, sizeof(float) * 3);
+            }
+            split_indices[k++] = c;
+        }
+
+        for (unsigned char j = 0; j < 3; ++j) {
+            gltf_free(*(deltas[j]));
+            *(deltas[j]) = split_deltas[j];
+        }
+        gltf_free(target -> sparse_indices);
+        target -> sparse_indices = split_indices;
+        target -> sparse_count = split_count;
+    }
+
+    gltf_free(entries);
+    gltf_free(corners);
+
+    return;
+}
+
+// Flat normals, as glTF asks for primitives without normals: the vertices are split per face first, so that the
+// angle-weighted average of generate_normals reduces to the normal of the only face using each vertex
+void generate_flat_normals(Mesh* mesh) {
+    if (!is_triangle_mesh(mesh) || mesh -> vertices.component_type != FLOAT) return;
+    split_face_vertices(mesh);
+    generate_normals(mesh);
+    return;
+}
+
+// Per-vertex tangent frames following the MikkTSpace conventions: the per-face tangent and bitangent come
+// from the UV derivatives, are accumulated with the corner angle as weight, orthogonalized against the normal
+// (Gram-Schmidt) and the bitangent only survives as the handedness in w. Unlike the reference implementation
+// vertices are never split, so faces with mirrored UVs sharing a vertex get an averaged frame.
+void generate_tangents(Mesh* mesh) {
+    if (!is_triangle_mesh(mesh) || mesh -> vertices.component_type != FLOAT) return;
+
+    unsigned int vertices_count = mesh -> vertices.arr.count;
+    ArrayExtended* uvs = &(mesh -> texture_coords);
+    ArrayExtended* normals_attribute = &(mesh -> normals);
+    if (uvs -> storage == NULL || uvs -> component_type != FLOAT || uvs -> data_type != VEC2 || uvs -> arr.count != vertices_count) return;
+    if (normals_attribute -> storage == NULL || normals_attribute -> component_type != FLOAT || normals_attribute -> arr.count != vertices_count) return;
+
+    const float* texture_coords = (const float*) (uvs -> storage);
+    const float* normals = (const float*) (normals_attribute -> storage);
+    float* accumulated = (float*) gltf_calloc(vertices_count * 6, sizeof(float)); // tangent and bitangent
+    if (accumulated == NULL) return;
+    for (unsigned int face = 0; face < mesh -> faces_count; face += 4) {
+        TriangleBatch batch = load_triangle_batch(mesh, face);
+
+        float uv_lanes[4][4] = {0}; // du1, dv1, du2, dv2 for each lane
+        for (unsigned char lane = 0; lane < batch.count; ++lane) {
+            const float* uv_0 = texture_coords + batch.indices[lane][0] * 2;
+            const float* uv_1 = texture_coords + batch.indices[lane][1] * 2;
+            const float* uv_2 = texture_coords + batch.indices[lane][2] * 2;
+            uv_lanes[0][lane] = uv_1[0] - uv_0[0];
+            uv_lanes[1][lane] = uv_1[1] - uv_0[1];
+            uv_lanes[2][lane] = uv_2[0] - uv_0[0];
+            uv_lanes[3][lane] = uv_2[1] - uv_0[1];
+        }
+        Vec4 du_1 = vec4_load(uv_lanes[0]);
+        Vec4 dv_1 = vec4_load(uv_lanes[1]);
+        Vec4 du_2 = vec4_load(uv_lanes[2]);
+        Vec4 dv_2 = vec4_load(uv_lanes[3]);
+
+        // Degenerate UV mappings get a zero contribution
+        float determinants[4];
+        vec4_store(determinants, vec4_sub(vec4_mul(du_1, dv_2), vec4_mul(du_2, dv_1)));
+        for (unsigned char lane = 0; lane < 4; ++lane) determinants[lane] = (fabsf(determinants[lane]) > 1e-20f) ? 1.0f / determinants[lane] : 0.0f;
+        Vec4 inv_determinant = vec4_load(determinants);
+
+        float tangents[3][4];
+        float bitangents[3][4];
+        for (unsigned char axis = 0; axis < 3; ++axis) {
+            Vec4 edge_1 = vec4_sub(batch.corners[1][axis], batch.corners[0][axis]);
+            Vec4 edge_2 = vec4_sub(batch.corners[2][axis], batch.corners[0][axis]);
+            vec4_store(tangents[axis], vec4_mul(vec4_sub(vec4_mul(edge_1, dv_2), vec4_mul(edge_2, dv_1)), inv_determinant));
+            vec4_store(bitangents[axis], vec4_mul(vec4_sub(vec4_mul(edge_2, du_1), vec4_mul(edge_1, du_2)), inv_determinant));
+        }
+        float angles[3][4];
+        compute_corner_angles(&batch, angles);
+
+        for (unsigned char lane = 0; lane < batch.count; ++lane) {
+            for (unsigned char corner = 0; corner < 3; ++corner) {
+                float* vertex_frame = accumulated + batch.indices[lane][corner] * 6;
+                for (unsigned char axis = 0; axis < 3; ++axis) {
+                    vertex_frame[axis] += tangents[axis][lane] * angles[corner][lane];
+                    vertex_frame[axis + 3] += bitangents[axis][lane] * angles[corner][lane];
+                }
+            }
+        }
+    }
+
+    float* tangents = (float*) gltf_calloc(vertices_count * 4, sizeof(float));
+    if (tangents == NULL) {
+        gltf_free(accumulated);
+        return;
+    }
+    for (unsigned int i = 0; i < vertices_count; ++i) {
+        const float* normal = normals + i * 3;
+        const float* frame = accumulated + i * 6;
+        float* tangent = tangents + i * 4;
+        float projection = normal[0] * frame[0] + normal[1] * frame[1] + normal[2] * frame[2];
+        for (unsigned char c = 0; c < 3; ++c) tangent[c] = frame[c] - normal[c] * projection;
+
+        // Any direction orthogonal to the normal works when the UVs give none
+        float fallback[3] = { 0.0f, -normal[2], normal[1] };
+        if (fabsf(normal[0]) > fabsf(normal[2])) {
+            fallback[0] = -normal[1];
+            fallback[1] = normal[0];
+            fallback[2] = 0.0f;
+        }
+        const float x_axis[3] = { 1.0f, 0.0f, 0.0f };
+        normalize_vector(fallback, x_axis);
+        normalize_vector(tangent, fallback);
+
+        float cross[3] = { normal[1] * tangent[2] - normal[2] * tangent[1], normal[2] * tangent[0] - normal[0] * tangent[2], normal[0] * tangent[1] - normal[1] * tangent[0] };
+        tangent[3] = (cross[0] * frame[3] + cross[1] * frame[4] + cross[2] * frame[5] < 0.0f) ? -1.0f : 1.0f;
+    }
+
+    gltf_free(accumulated);
+    write_attribute(&(mesh -> tangents), tangents, vertices_count, VEC4);
+
+    return;
+}
+
+static void generate_meshes_attributes(unsigned int start, unsigned int end, void* context) {
+    AttributesJob* job = (AttributesJob*) context;
+    for (unsigned int i = start; i < end; ++i) {
+        Mesh* mesh = job -> meshes + i;
+        if ((job -> attributes[i] & GENERATE_NORMALS) && mesh -> normals.storage == NULL) {
+            if (job -> smooth_normals) generate_normals(mesh);
+            else generate_flat_normals(mesh);
+        }
+        if ((job -> attributes[i] & GENERATE_TANGENTS) && mesh -> tangents.storage == NULL) generate_tangents(mesh);
+    }
+    return;
+}
+
+// Fills the normals and tangents that the primitives don't provide, for the GENERATE_* flags in the attributes of
+// each mesh, spreading the meshes with some flag across threads_count workers (0 meaning one per core). Normals are
+// flat unless smooth_normals is set, tangents need texture coordinates and normals, meshes without them keep none.
+void generate_missing_attributes(Mesh* meshes, unsigned int meshes_count, const unsigned char* attributes, bool smooth_normals, unsigned int threads_count) {
+    bool any_attribute = FALSE;
+    for (unsigned int i = 0; !any_attribute && i < meshes_count; ++i) any_attribute = (attributes[i] != 0);
+    if (!any_attribute) return;
+
+    AttributesJob job = { .meshes = meshes, .attributes = attributes, .smooth_normals = smooth_normals };
+    parallel_for(meshes_count, threads_count, generate_meshes_attributes, &job);
+    return;
+}
+
+#endif //_TANGENTS_H_
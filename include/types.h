@@ -1,29 +1,105 @@
 #ifndef _TYPES_H_
 #define _TYPES_H_
 
+#include <stddef.h>
+
 typedef unsigned char bool;
 
-typedef enum BitStreamError {NO_ERROR, EXCEEDED_LENGTH} BitStreamError; 
+typedef enum BitStreamError {NO_ERROR, EXCEEDED_LENGTH, INVALID_LITERAL, OUT_OF_MEMORY} BitStreamError; 
 typedef enum Filter { NEAREST = 9728, LINEAR, NEAREST_MIPMAP_NEAREST = 9984, LINEAR_MIPMAP_NEAREST, NEAREST_MIPMAP_LINEAR, LINEAR_MIPMAP_LINEAR } Filter;
 typedef enum Topology { POINTS, LINES, LINE_LOOP, LINE_STRIP, TRIANGLES, TRIANGLE_STRIP, TRIANGLE_FAN } Topology;
-typedef enum ComponentType { BYTE, UNSIGNED_BYTE, SHORT, UNSIGNED_SHORT, UNSIGNED_INT = 5, FLOAT } ComponentType;
+typedef enum ComponentType { BYTE, UNSIGNED_BYTE, SHORT, UNSIGNED_SHORT, UNSIGNED_INT = 5, FLOAT, HALF_FLOAT } ComponentType; // HALF_FLOAT only comes from compact vertex formats
 typedef enum Wrap { CLAMP_TO_EDGE = 33071, MIRRORED_REPEAT = 33648, REPEAT = 10497 } Wrap;
-typedef enum ObjectType { ARRAY, STRING, NUMBER, DICTIONARY, INVALID_OBJECT } ObjectType;
+typedef enum ObjectType { ARRAY, STRING, NUMBER, DICTIONARY, BOOLEAN, NULL_OBJECT, INVALID_OBJECT, RAW_OBJECT } ObjectType;
 typedef enum DataType { SCALAR, VEC2, VEC3, VEC4, MAT2, MAT3, MAT4 } DataType;
 typedef enum Colors {RED = 31, GREEN, YELLOW, BLUE, PURPLE, CYAN, WHITE} Colors;
 typedef enum BufferTarget {ARRAY_BUFFER, ELEMENT_ARRAY_BUFFER} BufferTarget;
+typedef enum Interpolation { INTERPOLATION_STEP, INTERPOLATION_LINEAR, INTERPOLATION_CUBICSPLINE } Interpolation;
+typedef enum AnimationPath { TRANSLATION_PATH, ROTATION_PATH, SCALE_PATH, WEIGHTS_PATH } AnimationPath;
+typedef enum AttributeEncoding { ENCODING_NONE, ENCODING_OCTAHEDRAL } AttributeEncoding;
+typedef enum VertexFormat { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_HALF, VERTEX_FORMAT_OCTAHEDRAL_SNORM16, VERTEX_FORMAT_UNORM8 } VertexFormat;
 
-unsigned char byte_lengths[] = { sizeof(char), sizeof(unsigned char), sizeof(short int), sizeof(unsigned short int), 0, sizeof(unsigned int), sizeof(float) };
-const char* objs_types[] = {"ARRAY", "STRING", "NUMBER", "DICTIONARY", "INVALID_OBJECT"};
+unsigned char byte_lengths[] = { sizeof(char), sizeof(unsigned char), sizeof(short int), sizeof(unsigned short int), 0, sizeof(unsigned int), sizeof(float), sizeof(unsigned short int) };
+const char* objs_types[] = {"ARRAY", "STRING", "NUMBER", "DICTIONARY", "BOOLEAN", "NULL_OBJECT", "INVALID_OBJECT", "RAW_OBJECT"};
 unsigned char elements_count[] = { 1, 2, 3, 4, 4, 9, 16 };
 unsigned char topology_size[] = { 1, 2, 2, 2, 3, 3, 3 };
 
+typedef struct GltfAllocator {
+    void* (*alloc)(size_t size, void* user_data);
+    void* (*realloc)(void* ptr, size_t size, void* user_data);
+    void (*free)(void* ptr, void* user_data);
+    void* user_data;
+} GltfAllocator;
+
+// Resolves the external uris of a glTF decoded from memory into bytes owned by the caller, which must outlive the
+// decoding, and the scene for the images. Returns TRUE on error.
+typedef struct GltfUriResolver {
+    bool (*resolve)(const char* uri, const unsigned char** data, unsigned int* size, void* user_data);
+    void* user_data;
+} GltfUriResolver;
+
+typedef struct VertexFormats {
+    VertexFormat positions; // FLOAT or HALF, quantized with the mesh bounds
+    VertexFormat normals; // FLOAT or OCTAHEDRAL_SNORM16
+    VertexFormat tangents; // FLOAT or OCTAHEDRAL_SNORM16, the handedness is kept as a third component
+    VertexFormat texture_coords; // FLOAT or HALF, quantized with the UV bounds
+    VertexFormat colors; // FLOAT or UNORM8
+} VertexFormats;
+
+typedef struct GltfLoadOptions {
+    GltfAllocator* allocator; // NULL to use the default calloc/realloc/free allocator
+    bool weld_vertices; // merge duplicated vertices, see weld_vertices
+    float weld_epsilon; // when positive, also weld positions closer than this distance
+    bool optimize_meshes; // reorder triangles and vertices of triangle meshes for the vertex cache and fetch locality
+    unsigned int lods_count; // simplified index buffers to generate for each triangle mesh
+    float lod_ratio; // triangles kept by each LOD relative to the previous one
+    bool split_meshes; // split the meshes too large for 16-bit indices into Mesh.parts
+    unsigned int meshlet_max_vertices; // when set, partition each triangle mesh into Mesh.meshlets, at most 255 vertices each
+    unsigned int meshlet_max_triangles; // 124 when 0, at most 512
+    VertexFormats vertex_formats; // resident format of each attribute, floats by default
+    bool decode_textures; // decode the PNG textures into Texture.image, one texture per worker thread
+    bool load_ktx2_textures; // parse the KTX2 images, see Texture.ktx2
+    bool inflate_ktx2_levels; // also undo their supercompression, one mip level per worker thread
+    bool instance_matrices; // convert the instanced nodes transforms into Instances.matrices
+    unsigned int scene_index; // glTF scene to load, every root node of it is loaded
+    char* root_node_name; // when set, only the subtree under the node with this name is loaded
+    bool load_reachable_only; // skip the meshes, materials, textures, skins, animations and buffer bytes outside the loaded nodes
+    bool cache_buffers; // share the buffer files with the other loads through the process-wide buffer cache
+    bool build_bvhs; // build a BVH over the triangles of each mesh, see build_scene_bvh
+    bool keep_raw_json; // keep the JSON text in Scene.json, backing the extras and extensions spans
+    bool generate_normals; // generate the normals the primitives don't provide, flat as glTF asks unless smooth_normals is set
+    bool smooth_normals; // generate angle-weighted smooth normals instead
+    bool generate_tangents; // generate the missing tangents of the meshes whose material has a normal texture
+} GltfLoadOptions;
+
+typedef struct VertexCacheStatistics {
+    float acmr; // transformed vertices per triangle
+    float atvr; // transformed vertices per referenced vertex
+} VertexCacheStatistics;
+
 typedef struct File {
     unsigned char* data;
     char* file_path;
     unsigned int size;
 } File;
 
+typedef struct BufferedWriter {
+    void* file; // FILE*
+    unsigned char* buffer;
+    unsigned int buffer_size;
+    unsigned long long int written; // bytes written so far, including the buffered ones
+    bool error;
+} BufferedWriter;
+
+// LSB-first bit reader for entropy coded data, refilled eight bytes at a time
+typedef struct BitReader {
+    const unsigned char* data;
+    size_t size;
+    size_t position; // next byte to load into bits, can go past size as the reader pads with zeros
+    unsigned long long int bits;
+    unsigned int bits_count;
+} BitReader;
+
 typedef struct BitStream {
     unsigned char* stream;
     unsigned int byte;
@@ -35,61 +111,222 @@ typedef struct BitStream {
 
 typedef struct Object {
     char* identifier;
-    void* value;
+    void* value; // only used by STRING objects, scalars are stored already decoded
+    long long int integer;
+    double real;
+    bool boolean;
+    bool is_integer;
     ObjectType obj_type;
     struct Object* children;
     struct Object* parent;
     unsigned int children_count;
+    const char* raw; // JSON text of the value, set for dictionary members, RAW_OBJECT values are only skipped
+    unsigned int raw_size;
 } Object;
 
+// JSON text of a value left for the caller to parse, points inside Scene.json
+typedef struct RawJson {
+    const char* data; // NULL when the value is missing or keep_raw_json is not set
+    unsigned int size;
+} RawJson;
+
 typedef struct Array {
     void** data;
     unsigned int count;
 } Array;
 
 typedef struct ArrayExtended {
-    Array arr;
+    Array arr; // each element points inside storage
+    void* storage; // contiguous elements, tightly packed
     DataType data_type;
     ComponentType component_type;
+    bool normalized; // integer components map to [0, 1] or [-1, 1]
+    AttributeEncoding encoding;
+    float offset[4]; // HALF_FLOAT attributes decode to stored value * scale + offset
+    float scale[4];
 } ArrayExtended;
 
 typedef ArrayExtended Vertices;
 typedef ArrayExtended Normals;
 typedef ArrayExtended Tangents;
 typedef ArrayExtended TextureCoords;
+typedef ArrayExtended Joints;
+typedef ArrayExtended Weights;
+typedef ArrayExtended VertexColors;
 
 typedef struct Face {
     unsigned int* indices;
     Topology topology;
 } Face;
 
+typedef struct MorphTarget {
+    float* position_deltas; // three floats per vertex, NULL when the target doesn't displace the attribute
+    float* normal_deltas;
+    float* tangent_deltas;
+    unsigned int* sparse_indices; // when not NULL the deltas only cover these vertices, in increasing order
+    unsigned int sparse_count;
+} MorphTarget;
+
+typedef struct IndexBuffer {
+    void* data; // unsigned short int or unsigned int indices, following component_type
+    unsigned int count;
+    ComponentType component_type; // UNSIGNED_SHORT whenever the vertices fit 16-bit indices
+} IndexBuffer;
+
+typedef struct MeshLod {
+    unsigned int* indices; // triangle list indexing the vertices of the base mesh
+    unsigned int indices_count;
+    float error; // deviation from the base mesh, relative to the mesh extent
+} MeshLod;
+
+// Cluster of up to max_vertices vertices and max_triangles triangles, with the bounds used to cull it as a whole
+typedef struct Meshlet {
+    unsigned int vertices_offset; // first entry of Meshlets.vertices
+    unsigned int triangles_offset; // first byte of Meshlets.triangles, three local indices per triangle
+    unsigned int vertices_count;
+    unsigned int triangles_count;
+    float center[3]; // bounding sphere
+    float radius;
+    float cone_apex[3]; // the meshlet is backfacing from any camera position c with dot(normalize(cone_apex - c), cone_axis) >= cone_cutoff
+    float cone_axis[3];
+    float cone_cutoff; // 1 when the triangles face too many directions to ever be culled
+} Meshlet;
+
+typedef struct Meshlets {
+    Meshlet* meshlets;
+    unsigned int count;
+    unsigned int* vertices; // mesh vertex indices, referenced by the local indices of each meshlet
+    unsigned int vertices_count;
+    unsigned char* triangles; // local indices into the meshlet vertices
+    unsigned int triangles_count;
+} Meshlets;
+
+// 32 bytes, the two children of an inner node are stored next to each other
+typedef struct BvhNode {
+    float bounds_min[3];
+    unsigned int first; // left child for inner nodes, the right one follows it, first entry of Bvh.primitives for leaves
+    float bounds_max[3];
+    unsigned int count; // primitives in the leaf, 0 for inner nodes
+} BvhNode;
+
+typedef struct Bvh {
+    BvhNode* nodes; // the root is the first node
+    unsigned int nodes_count;
+    unsigned int* primitives; // faces of a mesh or instances of a scene, in leaf order
+    unsigned int primitives_count;
+} Bvh;
+
 typedef struct Mesh {
     Vertices vertices; // equivalent to the POSITION attribute of glTF meshes
     Normals normals;
     Tangents tangents;
     TextureCoords texture_coords;
+    VertexColors colors; // COLOR_0
+    Joints joints; // JOINTS_0, empty when the mesh is not skinned
+    Weights weights; // WEIGHTS_0
+    MorphTarget* targets;
+    unsigned int targets_count;
+    float* default_weights; // targets_count weights, from the glTF mesh
+    float bounds_min[3]; // local space AABB, from the POSITION accessor min/max when present
+    float bounds_max[3];
     Face* faces;
     unsigned int faces_count;
+    unsigned int* faces_indices; // the indices of every face in one block, Face.indices point into it
+    MeshLod* lods; // simplified versions of the faces, from the most to the least detailed
+    unsigned int lods_count;
+    IndexBuffer index_buffer; // faces flattened into the narrowest index type
+    struct Mesh* parts; // pieces of the mesh addressable with 16-bit indices, when split_meshes is set
+    unsigned int parts_count;
+    Meshlets meshlets; // clusters of the faces, when meshlet_max_vertices is set
+    Bvh bvh; // over the triangles of index_buffer, when build_bvhs is set, see build_mesh_bvh
     unsigned int material_index;
+    bool has_material; // FALSE when the primitive has no material, material_index is 0 then
+    unsigned long long int description_hash; // hash of the glTF mesh and of its accessors, views and buffers entries, see reload_gltf
+    unsigned long long int data_hash; // hash of the buffer views bytes read by the mesh, 0 unless loaded through reload_gltf
+    RawJson extras;
+    RawJson extensions;
 } Mesh;
 
+// EXT_mesh_gpu_instancing attributes, one contiguous array per component so that batches of four instances
+// load straight into SIMD registers. Missing attributes and the padding up to a multiple of four hold the identity.
+typedef struct Instances {
+    unsigned int count;
+    float* translations[3];
+    float* rotations[4]; // x, y, z, w
+    float* scales[3];
+    float* matrices; // count row-major 3x4 world matrices, NULL unless instance_matrices is set, see compute_instance_matrices
+    float* storage; // backs the component arrays
+} Instances;
+
 typedef struct Node {
+    unsigned int index; // index of the node inside the glTF nodes array
+    int skin_index; // -1 when the node has no skin
+    float* weights; // morph target weights of the node mesh, animated by WEIGHTS_PATH channels
+    unsigned int weights_count;
     Array meshes_indices;
     struct Node* childrens;
     unsigned int children_count;
     float transformation_matrix[16];
     float translation_vec[3];
-    float rotation_quat[4];\
+    float rotation_quat[4];
     float scale_vec[3];
+    float bounds_min[3]; // world space AABB of the node meshes and of its whole subtree, empty when min > max
+    float bounds_max[3];
+    Instances instances; // drawn once per instance instead of once, nothing is expanded into child nodes
+    RawJson extras;
+    RawJson extensions;
 } Node;
 
+typedef struct Image {
+    unsigned char* pixels; // RGBA8, rows from top to bottom
+    unsigned int width;
+    unsigned int height;
+} Image;
+
+typedef enum Supercompression { SUPERCOMPRESSION_NONE, SUPERCOMPRESSION_BASISLZ, SUPERCOMPRESSION_ZSTD, SUPERCOMPRESSION_ZLIB } Supercompression;
+
+typedef struct Ktx2Level {
+    const unsigned char* data; // borrowed from Texture.encoded, or inflated when the supercompression was undone
+    unsigned long long int size;
+    unsigned long long int uncompressed_size; // 0 for BasisLZ, whose levels are only inflated by the transcoder
+    bool inflated; // data is owned and holds uncompressed_size bytes
+} Ktx2Level;
+
+// KTX2 container, every range borrows Texture.encoded: no pixel is copied until the levels are inflated
+typedef struct Ktx2Texture {
+    unsigned int vk_format; // 0 (VK_FORMAT_UNDEFINED) for Basis Universal payloads
+    unsigned int type_size;
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;
+    unsigned int layers_count;
+    unsigned int faces_count;
+    unsigned int levels_count;
+    Supercompression supercompression;
+    const unsigned char* data_format_descriptor;
+    unsigned int data_format_descriptor_size;
+    const unsigned char* key_values;
+    unsigned int key_values_size;
+    const unsigned char* supercompression_data; // BasisLZ global codebooks
+    unsigned long long int supercompression_data_size;
+    Ktx2Level* levels; // level 0 is the largest
+} Ktx2Texture;
+
 typedef struct Texture {
-    char* texture_path;
+    char* texture_path; // NULL for images stored in a buffer view
+    char* mime_type; // images[].mimeType, NULL when missing
+    unsigned char* encoded; // image file bytes: a copy of the buffer view, or the KTX2 file once loaded
+    unsigned int encoded_size;
+    bool borrowed_encoded; // encoded points into memory returned by the uri resolver, the scene does not free it
+    Image image; // decoded pixels when decode_textures is set, shared with the materials copies
+    Ktx2Texture ktx2; // KTX2 images, either the KHR_texture_basisu source or a plain image/ktx2 one
     Filter mag_filter;
     Filter min_filter;
     Wrap wrap_s;
     Wrap wrap_t;
     unsigned int tex_coord;
+    RawJson extras; // only set on Scene.textures
+    RawJson extensions;
 } Texture;
 
 typedef struct PbrMetallicRoughness {
@@ -102,12 +339,12 @@ typedef struct PbrMetallicRoughness {
 
 typedef struct NormalTextureInfo { 
     Texture texture;
-    unsigned int scale;
+    float scale;
 } NormalTextureInfo;
 
 typedef struct OcclusionTextureInfo { 
     Texture texture;
-    unsigned int strength;
+    float strength;
 } OcclusionTextureInfo;
 
 typedef struct Material {
@@ -119,21 +356,184 @@ typedef struct Material {
     char* alpha_mode;
     float alpha_cutoff;
     bool double_sided;
+    RawJson extras;
+    RawJson extensions;
 } Material;
 
+typedef struct Skin {
+    unsigned int* joints; // glTF node indices of the joints
+    unsigned int joints_count;
+    float* inverse_bind_matrices; // joints_count column-major matrices
+    int skeleton; // -1 when not specified
+} Skin;
+
+typedef struct AnimationSampler {
+    float* inputs; // keyframe times
+    float* outputs; // keyframe values, each one padded to values_stride floats (three values per keyframe for CUBICSPLINE)
+    unsigned int keyframes_count;
+    unsigned int values_stride;
+    Interpolation interpolation;
+} AnimationSampler;
+
+typedef struct AnimationChannel {
+    unsigned int sampler_index;
+    unsigned int target_node;
+    AnimationPath path;
+} AnimationChannel;
+
+typedef struct Animation {
+    char* name;
+    AnimationChannel* channels;
+    unsigned int channels_count;
+    AnimationSampler* samplers;
+    unsigned int samplers_count;
+    float duration;
+} Animation;
+
 typedef struct Scene {
     Node root_node;
+    Node** nodes; // glTF node index to its decoded Node, NULL for the root node and nodes outside the scene, see get_scene_node
+    unsigned int nodes_count;
     Mesh* meshes;
     unsigned int meshes_count;
     Material* materials;
     unsigned int materials_count;
+    Texture* textures;
+    unsigned int textures_count;
+    Animation* animations;
+    unsigned int animations_count;
+    Skin* skins;
+    unsigned int skins_count;
+    char* json; // JSON text backing every RawJson span, NULL unless keep_raw_json is set
+    unsigned int json_size;
+    RawJson extras; // of the glTF root
+    RawJson extensions;
+    GltfAllocator allocator; // allocator that owns every buffer of the scene
 } Scene;
 
+// Files of a scene watched through inotify, every path is relative to the glTF directory
+typedef struct FileWatcher {
+    int descriptor; // inotify instance, -1 when closed
+    char* directory; // with a trailing slash
+    char** files;
+    bool* changed_files; // set by poll_file_watcher, cleared by clear_file_changes
+    unsigned int files_count;
+    char** watched_directories; // subdirectories holding the files, "" for the glTF directory itself
+    int* watches; // one inotify watch per watched directory
+    unsigned int watches_count;
+    GltfAllocator allocator; // allocator current when the watcher was opened, owns its buffers
+} FileWatcher;
+
+// Meshes and textures that reload_gltf moved from the previous scene instead of decoding them again
+typedef struct SceneDiff {
+    bool* reused_meshes;
+    unsigned int meshes_count;
+    bool* reused_textures;
+    unsigned int textures_count;
+    unsigned int changed_files_count; // watched files changed since the previous load
+    GltfAllocator allocator; // allocator of the scene, which owns the arrays
+} SceneDiff;
+
+// A mesh drawn by a node, once per GPU instance of the node when it uses EXT_mesh_gpu_instancing
+typedef struct BvhInstance {
+    float world_matrix[16]; // column-major
+    float inverse_matrix[16];
+    unsigned int node_index;
+    unsigned int mesh_index;
+    int instance_index; // -1 when the node is not instanced
+} BvhInstance;
+
+// Top level structure over the instances, each leaf points into the BVH of its instance mesh
+typedef struct SceneBvh {
+    Bvh bvh;
+    BvhInstance* instances;
+    unsigned int instances_count;
+    GltfAllocator allocator; // allocator that owns the arrays
+} SceneBvh;
+
+// Four rays in structure of arrays form, lane i of each component belongs to the ray i
+typedef struct RayPacket {
+    float origins[3][4];
+    float directions[3][4];
+} RayPacket;
+
+// t is read as the farthest distance to look at and holds the closest hit distance, in units of the ray direction
+typedef struct RayHit {
+    float t;
+    float u; // barycentrics of the hit point, relative to the second and third vertex of the face
+    float v;
+    unsigned int face_index;
+    int mesh_index; // -1 until a scene query hits
+    int node_index;
+    int instance_index;
+} RayHit;
+
+// Files whose device, inode, size and modification time match are assumed to hold the same bytes
+typedef struct FileIdentity {
+    unsigned long long int device;
+    unsigned long long int inode;
+    unsigned long long int size;
+    long long int modification_time;
+    long long int modification_nanoseconds; // 0 where the file system only keeps seconds
+} FileIdentity;
+
+// A buffer file shared by every load, keyed by its content and by the files known to hold it
+typedef struct CachedBuffer {
+    unsigned char* data;
+    unsigned int size;
+    unsigned long long int hash;
+    unsigned int references; // loads currently reading the buffer, only unreferenced buffers are evicted
+    unsigned long long int last_use; // cache clock at the last acquire, the least recently used go first
+    FileIdentity* identities;
+    unsigned int identities_count;
+} CachedBuffer;
+
+typedef struct BufferCacheStatistics {
+    unsigned long long int identity_hits; // served from the file identity, without reading the file
+    unsigned long long int content_hits; // read, but matching the bytes of another file
+    unsigned long long int misses;
+    unsigned long long int evictions;
+    unsigned long long int cached_bytes;
+    unsigned int buffers_count;
+} BufferCacheStatistics;
+
+typedef enum BufferOwnership { BUFFER_OWNED, BUFFER_BORROWED, BUFFER_CACHED } BufferOwnership;
+
+typedef enum SelectionKind { SELECT_NODES, SELECT_MESHES, SELECT_SKINS, SELECT_MATERIALS, SELECT_TEXTURES, SELECT_IMAGES, SELECT_ANIMATIONS, SELECT_ACCESSORS, SELECT_BUFFER_VIEWS, SELECT_BUFFERS, SELECTION_KINDS } SelectionKind;
+
+// glTF objects reachable from the loaded nodes, one flag per glTF index of each kind, see load_reachable_only
+typedef struct LoadSelection {
+    bool* selected[SELECTION_KINDS];
+    unsigned int counts[SELECTION_KINDS];
+} LoadSelection;
+
+// Where the buffers and images of the glTF being decoded come from: files relative to path, or the GLB binary
+// chunk and the resolver when decoding from memory
+typedef struct GltfSource {
+    char* path; // NULL when decoding from memory
+    GltfUriResolver* resolver;
+    const unsigned char* binary_chunk;
+    unsigned int binary_chunk_size;
+    bool track_changes; // hash the meshes sources so that a later reload can reuse them
+    Scene* previous_scene; // meshes and textures unchanged since this scene was decoded are moved out of it
+    FileWatcher* watcher; // files changed since previous_scene, NULL to compare the buffers bytes
+    bool* reused_meshes; // set by decode_scene, meshes moved from previous_scene skip the load-time passes
+    bool* reused_textures;
+    char** buffers_uris; // uris of the buffer files, collected when tracking changes
+    unsigned int buffers_count;
+    bool cache_buffers; // read the buffer files through the buffer cache
+    BufferOwnership* buffers_ownership; // how each decoded buffer has to be released
+} GltfSource;
+
 typedef struct Accessor {
     void* data;
     ComponentType component_type;
+    bool normalized;
     unsigned int elements_count;
     DataType data_type;
+    bool has_bounds;
+    float min[4]; // per-component min/max of the accessor, normalization already applied
+    float max[4];
 } Accessor;
 
 #define CLAMP(x, low, high)  (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
@@ -141,6 +541,7 @@ typedef struct Accessor {
 #define STR_LEN(str, len) while ((str)[len] != '\0') { len++; }
 #define SET_COLOR(color) printf("\033[%d;1m", color)
 #define RESET_COLOR() printf("\033[0m")
+#define NOT_USED(var) (void) var
 #define FALSE 0
 #define TRUE 1
 
@@ -3,9 +3,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "./types.h"
+#include "./allocator.h"
 
 #define GET_US_ELEMENT_LE(arr, ind) (unsigned short int) (((arr)[(ind) + 1] << 8) + (arr)[(ind)]) 
+#define HASH_SEED 14695981039346656037ULL
 #define GET_UI_ELEMENT_LE(arr, ind) (unsigned int) (((arr)[(ind) + 3] << 24) + ((arr)[(ind) + 2] << 16) + ((arr)[(ind) + 1] << 8) + (arr)[(ind)])
 
 /* -------------------------------------------------------------------------- */
@@ -13,9 +16,11 @@
 int s_atoi(char* value);
 bool str_to_bool(char* str, char* true_str);
 void strip(char** str);
+const char* parse_number(const char* str, const char* end, long long int* integer, double* real, bool* is_integer);
 Array init_arr();
-void append_element(Array* arr, void* element);
+bool append_element(Array* arr, void* element);
 void deallocate_arr(Array arr);
+unsigned long long int hash_data(const unsigned char* data, size_t size, unsigned long long int hash);
 
 /* -------------------------------------------------------------------------- */
 
@@ -43,40 +48,145 @@ void strip(char** str) {
 
     len++;
 
-    *str = (char*) realloc(*str, sizeof(char) * (len + 1));
-    
     unsigned int ind = 0;
     for (ind = 0; ind < len && ((*str)[ind] == ' ' || (*str)[ind] == '\n' || (*str)[len] == '\r'); ++ind) { }
     
-    char* new_str = (char*) calloc(len - ind, sizeof(char));
+    // Without memory the string is kept with only its trailing whitespace stripped
+    char* new_str = (char*) gltf_calloc(len - ind, sizeof(char));
+    if (new_str == NULL) return;
 
     for (unsigned int i = 0; ind < len; ++i, ++ind) {
         new_str[i] = (*str)[ind];
     }
 
-    free(*str);
+    gltf_free(*str);
     *str = new_str;
 
     return;
 }
 
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses a JSON number in [str, end) and returns the position past its last character, or NULL when the
+// number has no digits (a bare '-', '.' or exponent) or out of memory.
+// Numbers whose mantissa fits in 53 bits and whose exponent is within 10^22 are exactly
+// representable, so a single multiplication or division is correctly rounded (Clinger's fast path),
+// every other number falls back to strtod.
+const char* parse_number(const char* str, const char* end, long long int* integer, double* real, bool* is_integer) {
+    const char* start = str;
+    bool negative = FALSE;
+    if (str < end && *str == '-') {
+        negative = TRUE;
+        str++;
+    }
+
+    unsigned long long int mantissa = 0;
+    unsigned int digits = 0;
+    int exponent = 0;
+    bool truncated = FALSE;
+    bool has_digits = FALSE;
+    for (; str < end && *str >= '0' && *str <= '9'; ++str) {
+        has_digits = TRUE;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*str - '0');
+            if (mantissa) digits++;
+        } else {
+            truncated = TRUE;
+            exponent++;
+        }
+    }
+
+    *is_integer = TRUE;
+    if (str < end && *str == '.') {
+        *is_integer = FALSE;
+        for (++str; str < end && *str >= '0' && *str <= '9'; ++str) {
+            has_digits = TRUE;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*str - '0');
+                if (mantissa) digits++;
+                exponent--;
+            } else truncated = TRUE;
+        }
+    }
+
+    if (str < end && (*str == 'e' || *str == 'E')) {
+        *is_integer = FALSE;
+        str++;
+        bool negative_exponent = FALSE;
+        if (str < end && (*str == '+' || *str == '-')) {
+            negative_exponent = (*str == '-');
+            str++;
+        }
+        int explicit_exponent = 0;
+        if (str >= end || *str < '0' || *str > '9') return NULL;
+        for (; str < end && *str >= '0' && *str <= '9'; ++str) {
+            if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*str - '0');
+        }
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+    if (!has_digits) return NULL;
+
+    if (*is_integer && !truncated && mantissa <= 9223372036854775807ULL) {
+        *integer = negative ? -((long long int) mantissa) : (long long int) mantissa;
+        *real = (double) *integer;
+        return str;
+    }
+
+    *is_integer = FALSE;
+    if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double) mantissa;
+        if (exponent < 0) value /= exact_powers_of_ten[-exponent];
+        else value *= exact_powers_of_ten[exponent];
+        *real = negative ? -value : value;
+    } else {
+        char short_number_str[64] = {0};
+        unsigned int len = (unsigned int) (str - start);
+        char* number_str = (len < 64) ? short_number_str : (char*) gltf_calloc(len + 1, sizeof(char));
+        if (number_str == NULL) return NULL;
+        memcpy(number_str, start, len);
+        *real = strtod(number_str, NULL);
+        if (number_str != short_number_str) gltf_free(number_str);
+    }
+    *integer = (*real > -9.2e18 && *real < 9.2e18) ? (long long int) *real : 0;
+
+    return str;
+}
+
 Array init_arr() {
     Array arr = (Array) { .count = 0 };
-    arr.data = (void**) calloc(1, sizeof(void*));
+    arr.data = (void**) gltf_calloc(1, sizeof(void*));
     return arr;
 }
 
-void append_element(Array* arr, void* element) {
-    arr -> data = (void**) realloc(arr -> data, sizeof(void*) * (arr -> count + 1));
+// Returns TRUE when the array could not grow, the element is then left to the caller
+bool append_element(Array* arr, void* element) {
+    void** data = (void**) gltf_realloc(arr -> data, sizeof(void*) * (arr -> count + 1));
+    if (data == NULL) return TRUE;
+    arr -> data = data;
     (arr -> data)[arr -> count] = element;
     (arr -> count)++;
-    return;
+    return FALSE;
 }
 
 void deallocate_arr(Array arr) {
     debug_print(YELLOW, "deallocating array...\n");
-    free(arr.data);
+    gltf_free(arr.data);
     return;
 }
 
+// FNV-1a over 8-byte words, then the tail bytes: only meant to detect changes, start from HASH_SEED
+unsigned long long int hash_data(const unsigned char* data, size_t size, unsigned long long int hash) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long int word = 0;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < size; ++i) hash = (hash ^ data[i]) * 1099511628211ULL;
+    return hash;
+}
+
 #endif //_UTILS_H_
\ No newline at end of file
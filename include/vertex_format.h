@@ -0,0 +1,276 @@
+#ifndef _VERTEX_FORMAT_H_
+#define _VERTEX_FORMAT_H_
+
+#include <math.h>
+#include "./types.h"
+#include "./allocator.h"
+#include "./debug_print.h"
+#include "./simd.h"
+#include "./bounds.h"
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int compress_vertex_attributes(Mesh* mesh, VertexFormats* formats);
+unsigned char decode_vertex_attribute(ArrayExtended* attribute, unsigned int index, float* values);
+
+/* -------------------------------------------------------------------------- */
+
+static float read_component(const ArrayExtended* attribute, const unsigned char* element, unsigned char component) {
+    bool normalized = attribute -> normalized;
+    switch (attribute -> component_type) {
+        case BYTE: {
+            float value = (float) ((const signed char*) element)[component];
+            return normalized ? fmaxf(value / 127.0f, -1.0f) : value;
+        }
+
+        case UNSIGNED_BYTE: {
+            float value = (float) element[component];
+            return normalized ? value / 255.0f : value;
+        }
+
+        case SHORT: {
+            short int value = 0;
+            memcpy(&value, element + component * sizeof(short int), sizeof(short int));
+            return normalized ? fmaxf((float) value / 32767.0f, -1.0f) : (float) value;
+        }
+
+        case UNSIGNED_SHORT: {
+            unsigned short int value = 0;
+            memcpy(&value, element + component * sizeof(unsigned short int), sizeof(unsigned short int));
+            return normalized ? (float) value / 65535.0f : (float) value;
+        }
+
+        case UNSIGNED_INT: {
+            unsigned int value = 0;
+            memcpy(&value, element + component * sizeof(unsigned int), sizeof(unsigned int));
+            return (float) value;
+        }
+
+        case FLOAT: {
+            float value = 0.0f;
+            memcpy(&value, element + component * sizeof(float), sizeof(float));
+            return value;
+        }
+
+        case HALF_FLOAT: {
+            unsigned short int value = 0;
+            memcpy(&value, element + component * sizeof(unsigned short int), sizeof(unsigned short int));
+            return half_to_float(value) * (attribute -> scale)[component] + (attribute -> offset)[component];
+        }
+    }
+
+    return 0.0f;
+}
+
+// Reads a vertex back as floats whatever its resident format, octahedral vectors are unpacked to xyz
+// followed by the handedness for tangents. Returns the number of values written.
+unsigned char decode_vertex_attribute(ArrayExtended* attribute, unsigned int index, float* values) {
+    if (attribute -> storage == NULL || index >= attribute -> arr.count) return 0;
+
+    const unsigned char* element = (const unsigned char*) (attribute -> arr.data)[index];
+    unsigned char components_count = elements_count[attribute -> data_type];
+    if (attribute -> encoding != ENCODING_OCTAHEDRAL) {
+        for (unsigned char c = 0; c < components_count; ++c) values[c] = read_component(attribute, element, c);
+        return components_count;
+    }
+
+    float x = read_component(attribute, element, 0);
+    float y = read_component(attribute, element, 1);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    if (z < 0.0f) {
+        float folded_x = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+        x = folded_x;
+    }
+
+    float length = sqrtf(x * x + y * y + z * z);
+    values[0] = x / length;
+    values[1] = y / length;
+    values[2] = z / length;
+    if (components_count < 3) return 3;
+
+    values[3] = (read_component(attribute, element, 2) < 0.0f) ? -1.0f : 1.0f;
+    return 4;
+}
+
+// Loads up to four vertices transposed, lanes[c] holds the component c of each vertex
+static void load_vertices(const ArrayExtended* attribute, unsigned int first, unsigned char components_count, Vec4* lanes) {
+    float values[4][4] = {0};
+    for (unsigned char l = 0; l < 4 && first + l < attribute -> arr.count; ++l) {
+        const unsigned char* element = (const unsigned char*) (attribute -> arr.data)[first + l];
+        for (unsigned char c = 0; c < components_count; ++c) values[c][l] = read_component(attribute, element, c);
+    }
+    for (unsigned char c = 0; c < 4; ++c) lanes[c] = vec4_load(values[c]);
+    return;
+}
+
+static unsigned int replace_storage(ArrayExtended* attribute, void* storage, DataType data_type, ComponentType component_type, bool normalized, AttributeEncoding encoding) {
+    unsigned int previous_size = elements_count[attribute -> data_type] * byte_lengths[attribute -> component_type];
+    unsigned int element_size = elements_count[data_type] * byte_lengths[component_type];
+
+    gltf_free(attribute -> storage);
+    attribute -> storage = storage;
+    attribute -> data_type = data_type;
+    attribute -> component_type = component_type;
+    attribute -> normalized = normalized;
+    attribute -> encoding = encoding;
+    for (unsigned int i = 0; i < attribute -> arr.count; ++i) (attribute -> arr.data)[i] = (unsigned char*) storage + i * element_size;
+
+    return (previous_size - element_size) * attribute -> arr.count;
+}
+
+// Half floats are densest around zero, so each component is first mapped to [-1, 1] through the given range
+static unsigned int convert_to_half(ArrayExtended* attribute, const float* range_min, const float* range_max) {
+    unsigned char components_count = elements_count[attribute -> data_type];
+    unsigned short int* storage = (unsigned short int*) gltf_calloc(attribute -> arr.count * components_count, sizeof(unsigned short int));
+    if (storage == NULL) return 0;
+
+    Vec4 offsets[4];
+    Vec4 inverse_scales[4];
+    for (unsigned char c = 0; c < components_count; ++c) {
+        float extent = (range_max[c] - range_min[c]) * 0.5f;
+        (attribute -> offset)[c] = (range_min[c] + range_max[c]) * 0.5f;
+        (attribute -> scale)[c] = (extent > 0.0f) ? extent : 1.0f;
+        offsets[c] = vec4_set1((attribute -> offset)[c]);
+        inverse_scales[c] = vec4_set1(1.0f / (attribute -> scale)[c]);
+    }
+
+    for (unsigned int i = 0; i < attribute -> arr.count; i += 4) {
+        Vec4 lanes[4];
+        load_vertices(attribute, i, components_count, lanes);
+        for (unsigned char c = 0; c < components_count; ++c) {
+            unsigned short int halves[4];
+            vec4_store_half(halves, vec4_mul(vec4_sub(lanes[c], offsets[c]), inverse_scales[c]));
+            for (unsigned char l = 0; l < 4 && i + l < attribute -> arr.count; ++l) storage[(i + l) * components_count + c] = halves[l];
+        }
+    }
+
+    return replace_storage(attribute, storage, attribute -> data_type, HALF_FLOAT, FALSE, ENCODING_NONE);
+}
+
+// Octahedral mapping: the unit vector is projected on the octahedron |x| + |y| + |z| = 1 and the lower half
+// is folded over the upper one, leaving two snorm16 components. Tangents keep the handedness as a third one.
+static unsigned int convert_to_octahedral(ArrayExtended* attribute) {
+    bool has_handedness = (attribute -> data_type == VEC4);
+    unsigned char output_count = has_handedness ? 3 : 2;
+    short int* storage = (short int*) gltf_calloc(attribute -> arr.count * output_count, sizeof(short int));
+    if (storage == NULL) return 0;
+
+    Vec4 zero = vec4_set1(0.0f);
+    Vec4 one = vec4_set1(1.0f);
+    Vec4 two = vec4_set1(2.0f);
+    Vec4 snorm_max = vec4_set1(32767.0f);
+    for (unsigned int i = 0; i < attribute -> arr.count; i += 4) {
+        Vec4 lanes[4];
+        load_vertices(attribute, i, has_handedness ? 4 : 3, lanes);
+
+        // Zero vectors would divide by zero, they end up as +z
+        Vec4 norm = vec4_add(vec4_add(vec4_abs(lanes[0]), vec4_abs(lanes[1])), vec4_abs(lanes[2]));
+        Vec4 is_zero = vec4_less(norm, vec4_set1(1e-20f));
+        Vec4 inverse_norm = vec4_div(one, vec4_max(norm, vec4_set1(1e-20f)));
+        Vec4 x = vec4_mul(lanes[0], inverse_norm);
+        Vec4 y = vec4_mul(lanes[1], inverse_norm);
+        Vec4 lower = vec4_less(lanes[2], zero);
+
+        Vec4 sign_x = vec4_sub(one, vec4_mul(two, vec4_less(x, zero)));
+        Vec4 sign_y = vec4_sub(one, vec4_mul(two, vec4_less(y, zero)));
+        Vec4 folded_x = vec4_mul(vec4_sub(one, vec4_abs(y)), sign_x);
+        Vec4 folded_y = vec4_mul(vec4_sub(one, vec4_abs(x)), sign_y);
+        x = vec4_lerp(vec4_lerp(x, folded_x, lower), zero, is_zero);
+        y = vec4_lerp(vec4_lerp(y, folded_y, lower), zero, is_zero);
+
+        int encoded[3][4] = {0};
+        vec4_store_int(encoded[0], vec4_mul(vec4_min(vec4_max(x, vec4_set1(-1.0f)), one), snorm_max));
+        vec4_store_int(encoded[1], vec4_mul(vec4_min(vec4_max(y, vec4_set1(-1.0f)), one), snorm_max));
+        if (has_handedness) vec4_store_int(encoded[2], vec4_mul(vec4_sub(one, vec4_mul(two, vec4_less(lanes[3], zero))), snorm_max));
+
+        for (unsigned char l = 0; l < 4 && i + l < attribute -> arr.count; ++l) {
+            for (unsigned char c = 0; c < output_count; ++c) storage[(i + l) * output_count + c] = (short int) encoded[c][l];
+        }
+    }
+
+    return replace_storage(attribute, storage, has_handedness ? VEC3 : VEC2, SHORT, TRUE, ENCODING_OCTAHEDRAL);
+}
+
+// RGB colors gain an opaque alpha so that every vertex stays four bytes wide
+static unsigned int convert_to_unorm8(ArrayExtended* attribute) {
+    unsigned char components_count = elements_count[attribute -> data_type];
+    unsigned char* storage = (unsigned char*) gltf_calloc(attribute -> arr.count * 4, sizeof(unsigned char));
+    if (storage == NULL) return 0;
+
+    Vec4 zero = vec4_set1(0.0f);
+    Vec4 one = vec4_set1(1.0f);
+    Vec4 unorm_max = vec4_set1(255.0f);
+    for (unsigned int i = 0; i < attribute -> arr.count; i += 4) {
+        Vec4 lanes[4];
+        load_vertices(attribute, i, components_count, lanes);
+        if (components_count < 4) lanes[3] = one;
+
+        int encoded[4][4];
+        for (unsigned char c = 0; c < 4; ++c) vec4_store_int(encoded[c], vec4_mul(vec4_min(vec4_max(lanes[c], zero), one), unorm_max));
+        for (unsigned char l = 0; l < 4 && i + l < attribute -> arr.count; ++l) {
+            for (unsigned char c = 0; c < 4; ++c) storage[(i + l) * 4 + c] = (unsigned char) encoded[c][l];
+        }
+    }
+
+    return replace_storage(attribute, storage, VEC4, UNSIGNED_BYTE, TRUE, ENCODING_NONE);
+}
+
+static void get_attribute_range(ArrayExtended* attribute, float* range_min, float* range_max) {
+    unsigned char components_count = elements_count[attribute -> data_type];
+    for (unsigned char c = 0; c < components_count; ++c) {
+        range_min[c] = FLT_MAX;
+        range_max[c] = -FLT_MAX;
+    }
+
+    for (unsigned int i = 0; i < attribute -> arr.count; ++i) {
+        const unsigned char* element = (const unsigned char*) (attribute -> arr.data)[i];
+        for (unsigned char c = 0; c < components_count; ++c) {
+            float value = read_component(attribute, element, c);
+            range_min[c] = fminf(range_min[c], value);
+            range_max[c] = fmaxf(range_max[c], value);
+        }
+    }
+
+    return;
+}
+
+static bool can_compress(ArrayExtended* attribute, VertexFormat format) {
+    return format != VERTEX_FORMAT_FLOAT && attribute -> storage != NULL && attribute -> arr.count > 0 && attribute -> component_type == FLOAT;
+}
+
+// Converts the float attributes of the mesh and of its parts to the requested compact formats, positions and UVs are
+// quantized against their own range, stored in the attribute offset and scale. Skinning, morphing and the other
+// mesh passes only work on floats, so this is meant to run last. Returns the bytes saved.
+unsigned int compress_vertex_attributes(Mesh* mesh, VertexFormats* formats) {
+    unsigned int saved_bytes = 0;
+
+    if (can_compress(&(mesh -> vertices), formats -> positions) && formats -> positions == VERTEX_FORMAT_HALF) {
+        float bounds_min[3];
+        float bounds_max[3];
+        memcpy(bounds_min, mesh -> bounds_min, sizeof(bounds_min));
+        memcpy(bounds_max, mesh -> bounds_max, sizeof(bounds_max));
+        if (is_bounds_empty(bounds_min, bounds_max)) get_attribute_range(&(mesh -> vertices), bounds_min, bounds_max);
+        saved_bytes += convert_to_half(&(mesh -> vertices), bounds_min, bounds_max);
+    }
+
+    if (can_compress(&(mesh -> texture_coords), formats -> texture_coords) && formats -> texture_coords == VERTEX_FORMAT_HALF) {
+        float range_min[4];
+        float range_max[4];
+        get_attribute_range(&(mesh -> texture_coords), range_min, range_max);
+        saved_bytes += convert_to_half(&(mesh -> texture_coords), range_min, range_max);
+    }
+
+    if (can_compress(&(mesh -> normals), formats -> normals) && formats -> normals == VERTEX_FORMAT_OCTAHEDRAL_SNORM16) saved_bytes += convert_to_octahedral(&(mesh -> normals));
+    if (can_compress(&(mesh -> tangents), formats -> tangents) && formats -> tangents == VERTEX_FORMAT_OCTAHEDRAL_SNORM16) saved_bytes += convert_to_octahedral(&(mesh -> tangents));
+
+    // Colors can also come as normalized unsigned shorts, the byte ones are already as compact as it gets
+    ArrayExtended* colors = &(mesh -> colors);
+    if (formats -> colors == VERTEX_FORMAT_UNORM8 && colors -> storage != NULL && colors -> arr.count > 0 && colors -> component_type != UNSIGNED_BYTE) saved_bytes += convert_to_unorm8(colors);
+
+    for (unsigned int i = 0; i < mesh -> parts_count; ++i) saved_bytes += compress_vertex_attributes(mesh -> parts + i, formats);
+
+    return saved_bytes;
+}
+
+#endif //_VERTEX_FORMAT_H_
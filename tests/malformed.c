@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../include/gltf_loader.h"
+
+// Loads malformed glTF files, whose indices point past the arrays they refer to or whose numbers have no digits,
+// which must be rejected rather than read.
+// Build with `make test`, under AddressSanitizer any out of range read fails the run.
+
+// Three positions, two keyframe times and two translations
+static const float buffer_data[] = { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+
+static const char* scene_format =
+    "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+    "\"meshes\":[{\"primitives\":[{\"attributes\":{%s}}]}],"
+    "\"buffers\":[{\"uri\":\"data.bin\",\"byteLength\":68}],"
+    "\"bufferViews\":[{\"buffer\":0,\"byteLength\":36},{\"buffer\":0,\"byteOffset\":36,\"byteLength\":8},{\"buffer\":0,\"byteOffset\":44,\"byteLength\":24}],"
+    "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\",\"min\":[0,0,0],\"max\":[1,1,0]},"
+    "{\"bufferView\":1,\"componentType\":5126,\"count\":2,\"type\":\"SCALAR\",\"min\":[0],\"max\":[1]},"
+    "{\"bufferView\":2,\"componentType\":5126,\"count\":2,\"type\":\"VEC3\"}]%s}";
+
+static unsigned int failures_count = 0;
+
+static bool resolve_buffer(const char* uri, const unsigned char** data, unsigned int* size, void* user_data) {
+    (void) user_data;
+    if (strcmp(uri, "data.bin")) return TRUE;
+    *data = (const unsigned char*) buffer_data;
+    *size = sizeof(buffer_data);
+    return FALSE;
+}
+
+static Scene load_scene(const char* attributes, const char* extra) {
+    char json[4096];
+    int size = snprintf(json, sizeof(json), scene_format, attributes, extra);
+    GltfUriResolver resolver = { .resolve = resolve_buffer };
+    return decode_gltf_from_memory((unsigned char*) json, (unsigned int) size, &resolver);
+}
+
+static void check(bool condition, const char* name) {
+    printf("%s: %s\n", condition ? "PASS" : "FAIL", name);
+    if (!condition) failures_count++;
+    return;
+}
+
+static void test_animation_sampler_accessors() {
+    Scene scene = load_scene("\"POSITION\":0", ",\"animations\":[{\"samplers\":[{\"input\":1,\"output\":2},{\"input\":7,\"output\":2},{\"input\":1,\"output\":9}],"
+                             "\"channels\":[{\"sampler\":0,\"target\":{\"node\":0,\"path\":\"translation\"}},{\"sampler\":1,\"target\":{\"node\":0,\"path\":\"translation\"}}]}]");
+    bool loaded = (scene.animations_count == 1 && scene.animations[0].samplers_count == 3);
+    check(loaded && scene.animations[0].samplers[0].keyframes_count == 2, "animation sampler with valid accessors");
+    check(loaded && scene.animations[0].samplers[1].keyframes_count == 0 && scene.animations[0].samplers[2].keyframes_count == 0, "animation samplers with accessors out of range");
+    deallocate_scene(&scene);
+    return;
+}
+
+static void test_mesh_attribute_accessors() {
+    Scene scene = load_scene("\"POSITION\":0,\"NORMAL\":9,\"TANGENT\":-1,\"TEXCOORD_0\":8,\"COLOR_0\":1000,\"JOINTS_0\":7,\"WEIGHTS_0\":6", "");
+    bool loaded = (scene.meshes_count == 1 && scene.meshes[0].vertices.arr.count == 3);
+    check(loaded && scene.meshes[0].normals.storage == NULL && scene.meshes[0].texture_coords.storage == NULL && scene.meshes[0].joints.storage == NULL, "mesh attributes with accessors out of range");
+    deallocate_scene(&scene);
+
+    scene = load_scene("\"POSITION\":12", "");
+    check(scene.meshes_count == 1 && scene.meshes[0].vertices.storage == NULL && scene.meshes[0].faces_count == 0, "mesh positions with an accessor out of range");
+    deallocate_scene(&scene);
+    return;
+}
+
+static void test_skin_accessors_and_joints() {
+    Scene scene = load_scene("\"POSITION\":0", ",\"skins\":[{\"joints\":[0],\"inverseBindMatrices\":42},{\"joints\":[0,5]}]");
+    bool loaded = (scene.skins_count == 2);
+    check(loaded && scene.skins[0].joints_count == 1 && scene.skins[0].inverse_bind_matrices[0] == 1.0f, "skin inverse bind matrices with an accessor out of range");
+    check(loaded && scene.skins[1].joints_count == 0, "skin joints out of range");
+    deallocate_scene(&scene);
+    return;
+}
+
+static void test_material_textures() {
+    Scene scene = load_scene("\"POSITION\":0", ",\"images\":[{\"uri\":\"tex.png\"}],\"textures\":[{\"source\":0}],"
+                             "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":3},\"metallicRoughnessTexture\":{\"index\":-1}},"
+                             "\"normalTexture\":{\"index\":0,\"scale\":0.5},\"occlusionTexture\":{\"index\":1,\"strength\":0.25},\"emissiveTexture\":{\"index\":70000}}]");
+    bool loaded = (scene.materials_count == 1 && scene.textures_count == 1);
+    Material* material = scene.materials;
+    check(loaded && material -> normal_texture.texture.texture_path != NULL && material -> normal_texture.scale == 0.5f, "material texture in range with a fractional scale");
+    check(loaded && material -> pbr_metallic_roughness.base_color_texture.texture_path == NULL && material -> pbr_metallic_roughness.metallic_roughness_texture.texture_path == NULL
+          && material -> occlusion_texture.texture.texture_path == NULL && material -> emissive_texture.texture_path == NULL, "material textures out of range");
+    deallocate_scene(&scene);
+    return;
+}
+
+static void test_numbers_without_digits() {
+    // Spelled with 72 characters, past the buffer of the short numbers
+    Scene scene = load_scene("\"POSITION\":0", ",\"samplers\":[{\"magFilter\":0.0000000000000000000000000000000000000000000000000000000000000000000001}]");
+    check(scene.meshes_count == 1, "number longer than 64 characters");
+    deallocate_scene(&scene);
+
+    const char* numbers[] = { "-", "-.", "-e5", "1e", "-,1" };
+    for (unsigned int i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i) {
+        char extra[64];
+        snprintf(extra, sizeof(extra), ",\"samplers\":[{\"magFilter\":%s}]", numbers[i]);
+        scene = load_scene("\"POSITION\":0", extra);
+        char name[64];
+        snprintf(name, sizeof(name), "number without digits '%s'", numbers[i]);
+        check(scene.meshes_count == 0, name);
+        deallocate_scene(&scene);
+    }
+    return;
+}
+
+static void test_accessor_without_type() {
+    char json[2048];
+    int size = snprintf(json, sizeof(json), scene_format, "\"POSITION\":0,\"NORMAL\":3,\"TEXCOORD_0\":4",
+                        ",\"skins\":[{\"joints\":[0],\"inverseBindMatrices\":3}],\"animations\":[{\"samplers\":[{\"input\":3,\"output\":4}],"
+                        "\"channels\":[{\"sampler\":0,\"target\":{\"node\":0,\"path\":\"translation\"}}]}]");
+    // Two more accessors, one without a type and one whose type is not a string
+    char* accessors_end = strstr(json, "\"VEC3\"}]") + strlen("\"VEC3\"}");
+    const char* extra_accessors = ",{\"bufferView\":0,\"componentType\":5126,\"count\":3},{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":3}";
+    memmove(accessors_end + strlen(extra_accessors), accessors_end, strlen(accessors_end) + 1);
+    memcpy(accessors_end, extra_accessors, strlen(extra_accessors));
+    size += (int) strlen(extra_accessors);
+
+    GltfUriResolver resolver = { .resolve = resolve_buffer };
+    Scene scene = decode_gltf_from_memory((unsigned char*) json, (unsigned int) size, &resolver);
+    bool loaded = (scene.meshes_count == 1 && scene.meshes[0].vertices.arr.count == 3);
+    check(loaded && scene.meshes[0].normals.storage == NULL && scene.meshes[0].texture_coords.storage == NULL, "accessors without a valid type");
+    check(scene.animations_count == 1 && scene.animations[0].samplers[0].keyframes_count == 0, "animation sampler with accessors without a valid type");
+    deallocate_scene(&scene);
+    return;
+}
+
+int main() {
+    test_animation_sampler_accessors();
+    test_mesh_attribute_accessors();
+    test_skin_accessors_and_joints();
+    test_material_textures();
+    test_numbers_without_digits();
+    test_accessor_without_type();
+    printf("%u failures\n", failures_count);
+    return (failures_count > 0);
+}